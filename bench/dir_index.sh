@@ -0,0 +1,17 @@
+#!/bin/sh
+# 分别以开启和关闭目录名称索引(FF_USE_DIR_INDEX)构建，运行随机检查和新建文件的基准
+# 用法: bench/dir_index.sh [文件数(默认50000)]；关闭索引时50000个文件需要约6分钟
+set -e
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+n=${1:-50000}
+out=${TMPDIR:-/tmp}/fatfs-tool-dir-index
+
+for idx in 1 0; do
+    build="$out/build-$idx"
+    cmake -S "$src" -B "$build" -DCMAKE_BUILD_TYPE=Release -DFATFS_TOOL_BENCH=ON \
+        -DCMAKE_C_FLAGS="-DFF_USE_DIR_INDEX=$idx" > /dev/null
+    cmake --build "$build" -j > /dev/null
+    ctest --test-dir "$build" --output-on-failure
+    "$build/bench/dir_index_bench" "$n" "$out/bench-$idx.img"
+done
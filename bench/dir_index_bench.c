@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "image.h"
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#endif
+
+// 目录名称索引(FF_USE_DIR_INDEX)的基准：在2GB的FAT32镜像中以FA_CREATE_NEW新建大量同前缀的长文件名文件，
+// 每5000个输出一次耗时。FAT目录最多65536项，每个文件名占3项，所以每个目录放20000个文件。
+// 用法: dir_index_bench [文件数(默认50000)] [镜像路径(默认dir_index_bench.img)]
+
+#define BENCH_IMAGE_SIZE (2048LL << 20)
+#define BENCH_FILES_PER_DIR 20000
+#define BENCH_REPORT_EVERY 5000
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 创建稀疏的空镜像文件
+static int _make_image(const char* path, long long size)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        return -1;
+    }
+    int ok = fseeko(fp, (off_t)(size - 1), SEEK_SET) == 0 && fputc(0, fp) != EOF;
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    int         n_files = argc > 1 ? atoi(argv[1]) : 50000;
+    const char* path    = argc > 2 ? argv[2] : "dir_index_bench.img";
+    if (n_files <= 0 || _make_image(path, BENCH_IMAGE_SIZE) != 0) {
+        fprintf(stderr, "用法: dir_index_bench [文件数] [镜像路径]\n");
+        return 1;
+    }
+
+    image_t*  img  = image_open(path, NULL);
+    MKFS_PARM parm = {FM_FAT32, 0, 0, 0, 0};
+    if (!img || image_mkfs(img, &parm) != FR_OK || image_mount(img) != FR_OK) {
+        fprintf(stderr, "格式化或挂载失败: %s\n", path);
+        return 1;
+    }
+    printf("FF_USE_DIR_INDEX %d, %d 个文件\n", FF_USE_DIR_INDEX, n_files);
+
+    double t0 = _now(), last = t0;
+    for (int i = 1; i <= n_files; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/logs%d", (i - 1) / BENCH_FILES_PER_DIR);
+        if ((i - 1) % BENCH_FILES_PER_DIR == 0 && image_mkdir(img, name) != FR_OK) {
+            fprintf(stderr, "创建目录失败: %s\n", name);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "/logs%d/sensor_log_%05d.bin", (i - 1) / BENCH_FILES_PER_DIR, i);
+        FIL     fp;
+        FRESULT fr = image_fopen(img, &fp, name, FA_WRITE | FA_CREATE_NEW);
+        if (fr != FR_OK) {
+            fprintf(stderr, "创建文件失败: %s (%d)\n", name, fr);
+            return 1;
+        }
+        f_close(&fp);
+        if (i % BENCH_REPORT_EVERY == 0) {
+            double t = _now();
+            printf("%6d 个文件: 最近 %d 个 %.2f 秒\n", i, BENCH_REPORT_EVERY, t - last);
+            last = t;
+        }
+    }
+    printf("共 %d 个文件, 用时 %.2f 秒\n", n_files, _now() - t0);
+
+    image_close(img);
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#define fseeko _fseeki64
+#else
+#include <strings.h>
+#endif
+
+// 目录名称索引(FF_USE_DIR_INDEX)的随机检查：在几个目录中随机新建、删除、重命名文件(文件名有大小写不同的
+// 共同前缀，产生大量~N短文件名)，每一步的结果都与内存中的模型比较；索引误判不存在时会出现重复的文件名，
+// 误判存在时FA_CREATE_NEW会失败。最后重新挂载，逐个目录核对目录项与模型一致。
+// 用法: dir_index_check <随机种子> fat32|fat16 [镜像路径(默认dir_index_check.img)]
+
+#define CHECK_IMAGE_SIZE (256LL << 20)
+#define CHECK_STEPS 40000
+#define CHECK_DIRS 4
+#define CHECK_MAX_FILES 3000
+#define CHECK_NAME_MAX 40
+
+static const char* s_dirs[CHECK_DIRS] = {"", "/d1", "/d2", "/d1/s"};
+static char        s_names[CHECK_DIRS][CHECK_MAX_FILES][CHECK_NAME_MAX];  // 模型：每个目录中的文件名
+static int         s_count[CHECK_DIRS];
+
+static int _model_find(int d, const char* name)
+{
+    for (int i = 0; i < s_count[d]; i++) {
+        if (strcasecmp(s_names[d][i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void _model_remove(int d, int i)
+{
+    memmove(s_names[d][i], s_names[d][--s_count[d]], CHECK_NAME_MAX);
+}
+
+static void _random_name(char* buf)
+{
+    static const char* prefixes[] = {"log", "LOG", "sensor_log_", "Sensor_Log_", "a", "verylongprefixname_abcdefghijk_"};
+    const char*        pre        = prefixes[rand() % 6];
+    switch (rand() % 3) {
+        case 0:
+            snprintf(buf, CHECK_NAME_MAX, "%s%d.bin", pre, rand() % 400);
+            break;
+        case 1:
+            snprintf(buf, CHECK_NAME_MAX, "%s%d", pre, rand() % 400);
+            break;
+        default:
+            snprintf(buf, CHECK_NAME_MAX, "%s%d.txt.%d", pre, rand() % 50, rand() % 5);
+            break;
+    }
+}
+
+static int _make_image(const char* path, long long size)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        return -1;
+    }
+    int ok = fseeko(fp, (off_t)(size - 1), SEEK_SET) == 0 && fputc(0, fp) != EOF;
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+// 执行一步随机操作，结果与模型不符时返回-1
+static int _step(image_t* img, int it, int fat16)
+{
+    int  d  = rand() % CHECK_DIRS;
+    int  op = rand() % 10;
+    char name[CHECK_NAME_MAX], path[80];
+    if (fat16 && d == 0) {
+        d = 1;  // FAT16的根目录项数固定，不参与
+    }
+
+    if (op < 5) {  // 新建
+        _random_name(name);
+        snprintf(path, sizeof(path), "%s/%s", s_dirs[d], name);
+        FIL     fp;
+        FRESULT fr     = image_fopen(img, &fp, path, FA_WRITE | FA_CREATE_NEW);
+        int     exists = _model_find(d, name) >= 0;
+        if (exists ? fr != FR_EXIST : fr != FR_OK) {
+            printf("第 %d 步 新建 %s: 返回 %d, 模型中%s\n", it, path, fr, exists ? "已存在" : "不存在");
+            return -1;
+        }
+        if (fr == FR_OK) {
+            f_close(&fp);
+            if (s_count[d] < CHECK_MAX_FILES) {
+                strcpy(s_names[d][s_count[d]++], name);
+            } else {
+                image_unlink(img, path);
+            }
+        }
+    } else if (op < 8) {  // 删除
+        if (!s_count[d]) {
+            return 0;
+        }
+        int i = rand() % s_count[d];
+        snprintf(path, sizeof(path), "%s/%s", s_dirs[d], s_names[d][i]);
+        FRESULT fr = image_unlink(img, path);
+        if (fr != FR_OK) {
+            printf("第 %d 步 删除 %s: 返回 %d\n", it, path, fr);
+            return -1;
+        }
+        _model_remove(d, i);
+    } else {  // 重命名，可能移到另一个目录
+        if (!s_count[d]) {
+            return 0;
+        }
+        int  i  = rand() % s_count[d];
+        int  d2 = rand() % CHECK_DIRS;
+        char path2[80];
+        if (fat16 && d2 == 0) {
+            d2 = 2;
+        }
+        _random_name(name);
+        snprintf(path, sizeof(path), "%s/%s", s_dirs[d], s_names[d][i]);
+        snprintf(path2, sizeof(path2), "%s/%s", s_dirs[d2], name);
+        FRESULT fr     = image_rename(img, path, path2);
+        int     exists = _model_find(d2, name) >= 0 && !(d == d2 && strcasecmp(s_names[d][i], name) == 0);
+        if (exists ? fr != FR_EXIST : fr != FR_OK) {
+            printf("第 %d 步 重命名 %s -> %s: 返回 %d, 模型中%s\n", it, path, path2, fr, exists ? "已存在" : "不存在");
+            return -1;
+        }
+        if (fr == FR_OK) {
+            _model_remove(d, i);
+            strcpy(s_names[d2][s_count[d2]++], name);
+        }
+    }
+
+    // 不时新建并删除一个子目录，检查目录簇被重用时索引失效
+    if (it % 5000 == 0) {
+        FIL fp;
+        image_mkdir(img, "/tmpd");
+        image_mkdir(img, "/tmpd/x");
+        if (image_fopen(img, &fp, "/tmpd/x/long_name_file_1", FA_WRITE | FA_CREATE_NEW) == FR_OK) {
+            f_close(&fp);
+        }
+        image_unlink(img, "/tmpd/x/long_name_file_1");
+        image_unlink(img, "/tmpd/x");
+        image_unlink(img, "/tmpd");
+    }
+    return 0;
+}
+
+// 重新挂载后逐个目录核对目录项与模型一致
+static int _check_dirs(image_t* img)
+{
+    for (int d = 0; d < CHECK_DIRS; d++) {
+        const char* dir_path = d ? s_dirs[d] : "/";
+        DIR         dir;
+        FILINFO     fno;
+        int         n = 0;
+        if (image_opendir(img, &dir, dir_path) != FR_OK) {
+            printf("无法打开目录: %s\n", dir_path);
+            return -1;
+        }
+        while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+            if (fno.fattrib & AM_DIR) {
+                continue;
+            }
+            n++;
+            if (_model_find(d, fno.fname) < 0) {
+                printf("多余的文件: %s/%s\n", s_dirs[d], fno.fname);
+                f_closedir(&dir);
+                return -1;
+            }
+        }
+        f_closedir(&dir);
+        if (n != s_count[d]) {
+            printf("目录 %s 中有 %d 个文件, 模型中 %d 个\n", dir_path, n, s_count[d]);
+            return -1;
+        }
+        printf("%s: %d 个文件\n", dir_path, n);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3 || (strcmp(argv[2], "fat32") != 0 && strcmp(argv[2], "fat16") != 0)) {
+        fprintf(stderr, "用法: dir_index_check <随机种子> fat32|fat16 [镜像路径]\n");
+        return 1;
+    }
+    int         fat16 = strcmp(argv[2], "fat16") == 0;
+    const char* path  = argc > 3 ? argv[3] : "dir_index_check.img";
+    srand((unsigned)atoi(argv[1]));
+
+    image_t*  img  = _make_image(path, CHECK_IMAGE_SIZE) == 0 ? image_open(path, NULL) : NULL;
+    MKFS_PARM parm = {fat16 ? FM_FAT : FM_FAT32, 0, 0, 0, 0};
+    if (!img || image_mkfs(img, &parm) != FR_OK || image_mount(img) != FR_OK) {
+        fprintf(stderr, "格式化或挂载失败: %s\n", path);
+        return 1;
+    }
+    image_mkdir(img, "/d1");
+    image_mkdir(img, "/d2");
+    image_mkdir(img, "/d1/s");
+
+    int ret = 0;
+    for (int it = 0; it < CHECK_STEPS && ret == 0; it++) {
+        ret = _step(img, it, fat16);
+    }
+    if (ret == 0 && (image_unmount(img) != FR_OK || image_mount(img) != FR_OK)) {
+        printf("重新挂载失败\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = _check_dirs(img);
+    }
+
+    image_close(img);
+    remove(path);
+    printf("%s\n", ret == 0 ? "通过" : "失败");
+    return ret == 0 ? 0 : 1;
+}
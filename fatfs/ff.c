@@ -33,11 +33,50 @@
 #error Wrong include file (ff.h).
 #endif
 
+#if FF_USE_TRACE	/* API functions are implemented under these names and wrapped by the tracing hooks at the end of this file */
+#if FF_FS_READONLY || FF_FS_MINIMIZE
+#error FF_USE_TRACE needs FF_FS_READONLY = 0 and FF_FS_MINIMIZE = 0
+#endif
+#define f_mount		trace_f_mount
+#define f_open		trace_f_open
+#define f_close		trace_f_close
+#define f_read		trace_f_read
+#define f_write		trace_f_write
+#define f_sync		trace_f_sync
+#define f_lseek		trace_f_lseek
+#define f_truncate	trace_f_truncate
+#define f_opendir	trace_f_opendir
+#define f_closedir	trace_f_closedir
+#define f_readdir	trace_f_readdir
+#define f_stat		trace_f_stat
+#define f_getfree	trace_f_getfree
+#define f_unlink	trace_f_unlink
+#define f_mkdir		trace_f_mkdir
+#define f_rename	trace_f_rename
+#if FF_USE_CHMOD
+#define f_chmod		trace_f_chmod
+#define f_utime		trace_f_utime
+#endif
+#if FF_FS_RPATH >= 1
+#define f_chdir		trace_f_chdir
+#endif
+#if FF_USE_EXPAND
+#define f_expand	trace_f_expand
+#endif
+#if FF_USE_RMTREE
+#define f_rmtree	trace_f_rmtree
+#endif
+#if FF_USE_MKFS
+#define f_mkfs		trace_f_mkfs
+#endif
+#endif
+
 
 /* Limits and boundaries */
 #define MAX_DIR		0x200000		/* Max size of FAT directory (byte) */
 #define MAX_DIR_EX	0x10000000		/* Max size of exFAT directory (byte) */
 #define MAX_FAT12	0xFF5			/* Max FAT12 clusters (differs from specs, but right for real DOS/Windows behavior) */
+#define MAX_RMTREE	256				/* Max depth of the directory tree removed by f_rmtree() */
 #define MAX_FAT16	0xFFF5			/* Max FAT16 clusters (differs from specs, but right for real DOS/Windows behavior) */
 #define MAX_FAT32	0x0FFFFFF5		/* Max FAT32 clusters (not defined in specs, practical limit) */
 #define MAX_EXFAT	0x7FFFFFFD		/* Max exFAT clusters (differs from specs, implementation limit) */
@@ -468,6 +507,10 @@ static WORD Fsid;					/* Filesystem mount ID */
 static BYTE CurrVol;				/* Current drive number set by f_chdrive() */
 #endif
 
+#if FF_USE_STATS
+FFSTATS FfStats;					/* Performance counters */
+#endif
+
 #if FF_FS_LOCK
 static FILESEM Files[FF_FS_LOCK];	/* Open object lock semaphores */
 #if FF_FS_REENTRANT
@@ -499,6 +542,9 @@ static const BYTE GUID_MS_Basic[16] = {0xA2,0xA0,0xD0,0xEB,0xE5,0xB9,0x33,0x44,0
 #if FF_FS_EXFAT
 #error LFN must be enabled when enable exFAT
 #endif
+#if FF_USE_DIR_INDEX
+#error LFN must be enabled when enable directory index
+#endif
 #define DEF_NAMEBUFF
 #define INIT_NAMEBUFF(fs)
 #define FREE_NAMEBUFF()
@@ -1064,8 +1110,12 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 	if (fs->wflag) {	/* Is the disk access window dirty? */
 		if (disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write it back into the volume */
 			fs->wflag = 0;	/* Clear window dirty flag */
+			FF_STAT_INC(win_syncs);
 			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
-				if (fs->n_fats == 2) disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+				if (fs->n_fats == 2) {	/* Reflect it to 2nd FAT if needed */
+					disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);
+					FF_STAT_INC(win_mirror);
+				}
 			}
 		} else {
 			res = FR_DISK_ERR;
@@ -1085,6 +1135,7 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	if (sect != fs->winsect) {	/* Window offset changed? */
+		FF_STAT_INC(win_misses);
 #if !FF_FS_READONLY
 		res = sync_window(fs);		/* Flush the window */
 #endif
@@ -1095,6 +1146,8 @@ static FRESULT move_window (	/* Returns FR_OK or FR_DISK_ERR */
 			}
 			fs->winsect = sect;
 		}
+	} else {
+		FF_STAT_INC(win_hits);
 	}
 	return res;
 }
@@ -1183,6 +1236,7 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 	FATFS *fs = obj->fs;
 
 
+	FF_STAT_INC(getfat_calls);
 	if (clst < 2 || clst >= fs->n_fatent) {	/* Check if in valid range */
 		val = 1;	/* Internal error */
 
@@ -1262,6 +1316,7 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 	FRESULT res = FR_INT_ERR;
 
 
+	FF_STAT_INC(putfat_calls);
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
 		switch (fs->fs_type) {
 		case FS_FAT12:
@@ -1546,6 +1601,7 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 	FATFS *fs = obj->fs;
 
 
+	FF_STAT_INC(chain_calls);
 	if (clst == 0) {	/* Create a new chain */
 		scl = fs->last_clst;				/* Suggested cluster to start to find */
 		if (scl == 0 || scl >= fs->n_fatent) scl = 1;
@@ -1599,6 +1655,9 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 			}
 		}
 		if (ncl == 0) {	/* The new cluster cannot be contiguous and find another fragment */
+#if FF_USE_STATS
+			DWORD nscan = 0;
+#endif
 			ncl = scl;	/* Start cluster */
 			for (;;) {
 				ncl++;							/* Next cluster */
@@ -1606,11 +1665,16 @@ static DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:D
 					ncl = 2;
 					if (ncl > scl) return 0;	/* No free cluster found? */
 				}
+#if FF_USE_STATS
+				nscan++;
+#endif
 				cs = get_fat(obj, ncl);			/* Get the cluster status */
 				if (cs == 0) break;				/* Found a free cluster? */
 				if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
 				if (ncl == scl) return 0;		/* No free cluster found? */
 			}
+			FF_STAT_ADD(chain_scans, nscan);
+			FF_STAT_MAX(chain_scan_max, nscan);
 		}
 		res = put_fat(fs, ncl, 0xFFFFFFFF);		/* Mark the new cluster 'EOC' */
 		if (res == FR_OK && clst != 0) {
@@ -1768,6 +1832,7 @@ static FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DEN
 	FATFS *fs = dp->obj.fs;
 
 
+	FF_STAT_INC(dirnext_steps);
 	ofs = dp->dptr + SZDIRE;	/* Next entry */
 	if (ofs >= (DWORD)((FF_FS_EXFAT && fs->fs_type == FS_EXFAT) ? MAX_DIR_EX : MAX_DIR)) dp->sect = 0;	/* Disable it if the offset reached the max value */
 	if (dp->sect == 0) return FR_NO_FILE;	/* Report EOT if it has been disabled */
@@ -1815,6 +1880,296 @@ static FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DEN
 
 
 
+#if FF_USE_DIR_INDEX && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* FAT-LFN: Directory handling - Name index of the directory             */
+/*-----------------------------------------------------------------------*/
+/* The index holds the hash values of SFNs and LFNs in a directory and the
+/  offset of the first free entry. A name whose hash value is not in the
+/  index does not exist in the directory. */
+
+#define DINDEX_INIT	1024		/* Initial number of hash slots (power of 2) */
+
+typedef struct {
+	WORD	id;			/* Volume mount ID of the index */
+	BYTE	valid;		/* Index is valid */
+	DWORD	sclust;		/* Start cluster of the indexed directory */
+	DWORD	fofs;		/* Offset of the first free entry (no free entry is before it) */
+	UINT	n;			/* Number of hash values */
+	UINT	size;		/* Number of hash slots */
+	DWORD*	tbl;		/* Hash slots (0:empty) */
+} DINDEX;
+
+
+static DWORD dindex_fnv (	/* Returns the updated hash value */
+	DWORD h,	/* Hash value */
+	BYTE c		/* Byte to be added */
+)
+{
+	return (h ^ c) * 0x01000193;
+}
+
+
+static DWORD dindex_sfn (	/* Returns the hash value of the SFN (1..) */
+	const BYTE* sfn			/* Pointer to the SFN */
+)
+{
+	DWORD h = 0x811C9DC5;
+	UINT i;
+
+
+	for (i = 0; i < 11; i++) h = dindex_fnv(h, sfn[i]);
+	return h ? h : 1;
+}
+
+
+static DWORD dindex_part (	/* Returns the hash value of a part of the LFN stored in an LFN entry */
+	UINT ord,			/* Order of the LFN entry (1..) */
+	const WCHAR* str,	/* Pointer to the part of the LFN */
+	UINT len			/* Number of characters (0..13) */
+)
+{
+	DWORD h = 0x050C5D1F ^ ord;
+	DWORD wc;
+
+
+	while (len--) {
+		wc = ff_wtoupper(*str++);	/* Names are compared in case-insensitive */
+		h = dindex_fnv(dindex_fnv(h, (BYTE)wc), (BYTE)(wc >> 8));
+	}
+	return h;
+}
+
+
+static DWORD dindex_lfn (	/* Returns the hash value of the LFN (1..) */
+	const WCHAR* lfn		/* Pointer to the LFN */
+)
+{
+	DWORD h = 0;
+	UINT i, len, ord;
+
+
+	for (len = 0; lfn[len]; len++) ;
+	for (ord = 1, i = 0; i < len; ord++, i += 13) {	/* Sum of the parts in each LFN entry */
+		h += dindex_part(ord, lfn + i, (len - i < 13) ? len - i : 13);
+	}
+	return h ? h : 1;
+}
+
+
+static UINT dindex_slot (	/* Returns the slot of the hash value or the empty slot to put it */
+	const DWORD* tbl,	/* Hash slots */
+	UINT size,			/* Number of hash slots */
+	DWORD h				/* Hash value */
+)
+{
+	UINT i;
+
+
+	for (i = h & (size - 1); tbl[i] && tbl[i] != h; i = (i + 1) & (size - 1)) ;
+	return i;
+}
+
+
+static int dindex_put (	/* 1:Succeeded, 0:Not enough memory */
+	DINDEX* idx,		/* Pointer to the index */
+	DWORD h				/* Hash value to be added */
+)
+{
+	DWORD *tbl;
+	UINT i, sz;
+
+
+	if ((idx->n + 1) * 2 > idx->size) {	/* Expand the slots to keep the load factor under 1/2 */
+		sz = idx->size ? idx->size * 2 : DINDEX_INIT;
+		tbl = ff_memalloc(sz * sizeof (DWORD));
+		if (!tbl) return 0;
+		memset(tbl, 0, sz * sizeof (DWORD));
+		for (i = 0; i < idx->size; i++) {	/* Rehash */
+			if (idx->tbl[i]) tbl[dindex_slot(tbl, sz, idx->tbl[i])] = idx->tbl[i];
+		}
+		if (idx->tbl) ff_memfree(idx->tbl);
+		idx->tbl = tbl; idx->size = sz;
+	}
+	i = dindex_slot(idx->tbl, idx->size, h);
+	if (!idx->tbl[i]) {
+		idx->tbl[i] = h; idx->n++;
+	}
+	return 1;
+}
+
+
+static int dindex_has (	/* 1:The hash value is in the index, 0:Not in the index */
+	const DINDEX* idx,	/* Pointer to the index */
+	DWORD h				/* Hash value */
+)
+{
+	return idx->tbl[dindex_slot(idx->tbl, idx->size, h)] != 0;
+}
+
+
+static DWORD dindex_key (	/* Returns the start cluster identifying the directory */
+	const DIR* dp			/* Pointer to the directory object */
+)
+{
+	FATFS *fs = dp->obj.fs;
+
+
+	return (dp->obj.sclust == 0 && fs->fs_type == FS_FAT32) ? (DWORD)fs->dirbase : dp->obj.sclust;
+}
+
+
+static DINDEX* dindex_get (	/* Returns the index of the directory, null if not indexed */
+	const DIR* dp			/* Pointer to the directory object */
+)
+{
+	DINDEX *idx = dp->obj.fs->dirindex;
+
+
+	return (idx && idx->valid && idx->id == dp->obj.fs->id && idx->sclust == dindex_key(dp)) ? idx : 0;
+}
+
+
+static FRESULT dindex_load (	/* FR_OK:Indexed, FR_NOT_ENOUGH_CORE:Not indexed, FR_DISK_ERR/FR_INT_ERR:Error */
+	DIR* dp						/* Pointer to the directory object */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DINDEX *idx = fs->dirindex;
+	DWORD sum = 0, last = 0;
+	BYTE c, a, ord = 0xFF;
+	WCHAR part[13];
+	UINT len;
+
+
+	if (dindex_get(dp)) return FR_OK;	/* Already indexed */
+	if (!idx) {
+		idx = ff_memalloc(sizeof (DINDEX));
+		if (!idx) return FR_NOT_ENOUGH_CORE;
+		memset(idx, 0, sizeof (DINDEX));
+		fs->dirindex = idx;
+	}
+	if (idx->tbl) ff_memfree(idx->tbl);	/* Discard the index of the previous directory */
+	idx->tbl = 0; idx->size = idx->n = 0; idx->valid = 0;
+	idx->fofs = 0xFFFFFFFF;
+
+	res = dir_sdi(dp, 0);
+	while (res == FR_OK) {	/* Scan the directory */
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		c = dp->dir[DIR_Name];
+		if (c == 0) {		/* Reached end of directory table */
+			if (idx->fofs == 0xFFFFFFFF) idx->fofs = dp->dptr;
+			res = FR_NO_FILE; break;
+		}
+		last = dp->dptr;
+		a = dp->dir[DIR_Attr] & AM_MASK;
+		if (c == DDEM) {	/* Free entry */
+			if (idx->fofs == 0xFFFFFFFF) idx->fofs = dp->dptr;
+			ord = 0xFF;
+		} else if (a == AM_LFN) {	/* LFN entry */
+			if (c & LLEF) {		/* Start of an LFN sequence */
+				ord = c & (BYTE)~LLEF; sum = 0;
+			}
+			if (ord != 0xFF && ord != 0 && (c & (BYTE)~LLEF) == ord) {
+				for (len = 0; len < 13 && (part[len] = ld_16(dp->dir + LfnOfs[len])) != 0; len++) ;
+				sum += dindex_part(ord, part, len);
+				ord--;
+			} else {
+				ord = 0xFF;
+			}
+		} else {			/* SFN entry */
+			if (!(a & AM_VOL)) {
+				if (!dindex_put(idx, dindex_sfn(dp->dir))) { res = FR_NOT_ENOUGH_CORE; break; }
+				if (ord == 0 && !dindex_put(idx, sum ? sum : 1)) { res = FR_NOT_ENOUGH_CORE; break; }
+			}
+			ord = 0xFF;
+		}
+		res = dir_next(dp, 0);	/* Next entry */
+	}
+	if (res != FR_NO_FILE) return res;
+
+	if (idx->fofs == 0xFFFFFFFF) idx->fofs = last;	/* No free entry (the allocation starts at the last entry) */
+	idx->id = fs->id;
+	idx->sclust = dindex_key(dp);
+	idx->valid = 1;
+	return FR_OK;
+}
+
+
+static void dindex_add (
+	DIR* dp				/* Pointer to the directory object with the name registered */
+)
+{
+	DINDEX *idx = dindex_get(dp);
+
+
+	if (idx) {
+		if (!dindex_put(idx, dindex_sfn(dp->fn)) || ((dp->fn[NSFLAG] & NS_LFN) && !dindex_put(idx, dindex_lfn(dp->obj.fs->lfnbuf)))) {
+			idx->valid = 0;		/* Discard the index if it cannot be kept up to date */
+		}
+	}
+}
+
+
+static int dindex_absent (	/* 1:The name does not exist in the directory, 0:Unknown */
+	DIR* dp					/* Pointer to the directory object with the name to find */
+)
+{
+	DINDEX *idx = dindex_get(dp);
+
+
+	if (!idx) return 0;
+	if (!(dp->fn[NSFLAG] & NS_NOLFN) && dindex_has(idx, dindex_lfn(dp->obj.fs->lfnbuf))) return 0;
+	if (!(dp->fn[NSFLAG] & NS_LOSS) && dindex_has(idx, dindex_sfn(dp->fn))) return 0;
+	return 1;
+}
+
+
+static void dindex_release (
+	DIR* dp,			/* Pointer to the directory object */
+	DWORD ofs			/* Offset of the entries removed */
+)
+{
+	DINDEX *idx = dindex_get(dp);
+
+
+	if (idx && ofs < idx->fofs) idx->fofs = ofs;
+}
+
+
+static void dindex_forget (
+	FATFS* fs,			/* Pointer to the filesystem object */
+	DWORD clst			/* Start cluster of the new directory */
+)
+{
+	DINDEX *idx = fs->dirindex;
+
+
+	if (idx && idx->sclust == clst) idx->valid = 0;	/* The cluster was of a removed directory */
+}
+
+
+static void dindex_free (
+	FATFS* fs			/* Pointer to the filesystem object */
+)
+{
+	DINDEX *idx = fs->dirindex;
+
+
+	if (idx) {
+		if (idx->tbl) ff_memfree(idx->tbl);
+		ff_memfree(idx);
+		fs->dirindex = 0;
+	}
+}
+
+#endif	/* FF_USE_DIR_INDEX && !FF_FS_READONLY */
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Reserve a block of directory entries             */
@@ -1828,9 +2183,15 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 	FRESULT res;
 	UINT n;
 	FATFS *fs = dp->obj.fs;
+#if FF_USE_DIR_INDEX
+	DINDEX *idx = dindex_get(dp);
+	DWORD ffree = 0xFFFFFFFF;
 
+	res = dir_sdi(dp, idx ? idx->fofs : 0);	/* Skip the used entries if the directory is indexed */
+#else
 
 	res = dir_sdi(dp, 0);
+#endif
 	if (res == FR_OK) {
 		n = 0;
 		do {
@@ -1840,6 +2201,9 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 			if ((fs->fs_type == FS_EXFAT) ? (int)((dp->dir[XDIR_Type] & 0x80) == 0) : (int)(dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0)) {	/* Is the entry free? */
 #else
 			if (dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0) {	/* Is the entry free? */
+#endif
+#if FF_USE_DIR_INDEX
+				if (ffree == 0xFFFFFFFF) ffree = dp->dptr;	/* First free entry found */
 #endif
 				if (++n == n_ent) break;	/* Is a block of contiguous free entries found? */
 			} else {
@@ -1848,6 +2212,11 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 			res = dir_next(dp, 1);	/* Next entry with table stretch enabled */
 		} while (res == FR_OK);
 	}
+#if FF_USE_DIR_INDEX
+	if (res == FR_OK && idx) {	/* Update the first free entry of the index */
+		idx->fofs = (ffree == dp->dptr - (n_ent - 1) * SZDIRE) ? dp->dptr : ffree;
+	}
+#endif
 
 	if (res == FR_NO_FILE) res = FR_DENIED;	/* No directory entry to allocate */
 	return res;
@@ -2443,6 +2812,9 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_USE_DIR_INDEX && !FF_FS_READONLY
+	if (dindex_absent(dp)) return FR_NO_FILE;	/* Not in the index of the directory */
+#endif
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2543,9 +2915,22 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_USE_DIR_INDEX
+	res = dindex_load(dp);				/* Index the directory (scanned only on the first registration) */
+	if (res != FR_OK && res != FR_NOT_ENOUGH_CORE) return res;
+#endif
 	memcpy(sn, dp->fn, 12);
 	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
 		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
+#if FF_USE_DIR_INDEX
+		if (res == FR_OK) {				/* Check the names with the index */
+			for (n = 1; n < 100; n++) {
+				gen_numname(dp->fn, sn, fs->lfnbuf, (WORD)n);	/* Generate a numbered name */
+				if (!dindex_has(fs->dirindex, dindex_sfn(dp->fn))) break;	/* Check if the name collides with existing SFN */
+			}
+			res = FR_NO_FILE;
+		} else							/* Scan the directory for each name if the index is not available */
+#endif
 		for (n = 1; n < 100; n++) {
 			gen_numname(dp->fn, sn, fs->lfnbuf, (WORD)n);	/* Generate a numbered name */
 			res = dir_find(dp);				/* Check if the name collides with existing SFN */
@@ -2589,6 +2974,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put low-case flags */
 #endif
 			fs->wflag = 1;
+#if FF_USE_DIR_INDEX
+			dindex_add(dp);		/* Keep the index of the directory up to date */
+#endif
 		}
 	}
 
@@ -2613,6 +3001,9 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_USE_DIR_INDEX
+	dindex_release(dp, (dp->blk_ofs == 0xFFFFFFFF) ? dp->dptr : dp->blk_ofs);	/* The entries become free */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2703,6 +3094,11 @@ static void get_fileinfo (
 #if FF_FS_CRTIME
 		fno->crtime = ld_16(fs->dirbuf + XDIR_CrtTime + 0);	/* Created time */
 		fno->crdate = ld_16(fs->dirbuf + XDIR_CrtTime + 2);	/* Created date */
+#endif
+#if FF_FS_FCLUST
+		fno->fclust = ld_32(fs->dirbuf + XDIR_FstClus);		/* Start cluster */
+		fno->fcont = (fs->dirbuf[XDIR_GenFlags] & 2) ?		/* Number of contiguous clusters if no FAT chain */
+			(DWORD)((ld_64(fs->dirbuf + XDIR_FileSize) + (DWORD)fs->csize * SS(fs) - 1) / ((DWORD)fs->csize * SS(fs))) : 0;
 #endif
 		return;
 	} else
@@ -2790,6 +3186,12 @@ static void get_fileinfo (
 	fno->crtime = ld_16(dp->dir + DIR_CrtTime + 0);	/* Created time */
 	fno->crdate = ld_16(dp->dir + DIR_CrtTime + 2);	/* Created date */
 #endif
+#if FF_FS_FCLUST
+	fno->fclust = ld_clust(fs, dp->dir);			/* Start cluster */
+#if FF_FS_EXFAT
+	fno->fcont = 0;									/* Follow the FAT chain */
+#endif
+#endif
 }
 
 #endif /* FF_FS_MINIMIZE <= 1 || FF_FS_RPATH >= 2 */
@@ -3292,41 +3694,22 @@ static int get_ldnumber (	/* Returns logical drive number (-1:invalid drive numb
 
 #if FF_LBA64
 
-/* Calculate CRC32 in byte-by-byte */
-
-static DWORD crc32 (	/* Returns next CRC value */
-	DWORD crc,			/* Current CRC value */
-	BYTE d				/* A byte to be processed */
-)
-{
-	BYTE b;
-
-
-	for (b = 1; b; b <<= 1) {
-		crc ^= (d & b) ? 1 : 0;
-		crc = (crc & 1) ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
-	}
-	return crc;
-}
-
-
 /* Check validity of GPT header */
 
 static int test_gpt_header (	/* 0:Invalid, 1:Valid */
 	const BYTE* gpth			/* Pointer to the GPT header */
 )
 {
-	UINT i;
 	DWORD bcc, hlen;
 
 
 	if (memcmp(gpth + GPTH_Sign, "EFI PART" "\0\0\1", 12)) return 0;	/* Check signature and version (1.0) */
 	hlen = ld_32(gpth + GPTH_Size);							/* Check header size */
 	if (hlen < 92 || hlen > FF_MIN_SS) return 0;
-	for (i = 0, bcc = 0xFFFFFFFF; i < hlen; i++) {			/* Check header BCC */
-		bcc = crc32(bcc, i - GPTH_Bcc < 4 ? 0 : gpth[i]);
-	}
-	if (~bcc != ld_32(gpth + GPTH_Bcc)) return 0;
+	bcc = ff_crc32(0, gpth, GPTH_Bcc);						/* Check header BCC (calculated with the BCC field zeroed) */
+	bcc = ff_crc32(bcc, "\0\0\0\0", 4);
+	bcc = ff_crc32(bcc, gpth + GPTH_Bcc + 4, hlen - GPTH_Bcc - 4);
+	if (bcc != ld_32(gpth + GPTH_Bcc)) return 0;
 	if (ld_32(gpth + GPTH_PteSize) != SZ_GPTE) return 0;	/* Table entry size (must be SZ_GPTE bytes) */
 	if (ld_32(gpth + GPTH_PtNum) > 128) return 0;			/* Table size (must be 128 entries or less) */
 
@@ -3762,6 +4145,9 @@ FRESULT f_mount (
 		ff_mutex_delete(vol);
 #endif
 		cfs->fs_type = 0;		/* Invalidate the filesystem object to be unregistered */
+#if FF_USE_DIR_INDEX && !FF_FS_READONLY
+		dindex_free(cfs);		/* Release the directory index */
+#endif
 	}
 
 	if (fs) {					/* Register new filesystem object */
@@ -3780,6 +4166,9 @@ FRESULT f_mount (
 #endif
 #endif
 		fs->fs_type = 0;		/* Invalidate the new filesystem object */
+#if FF_USE_DIR_INDEX
+		fs->dirindex = 0;		/* The directory index is built on demand */
+#endif
 		FatFs[vol] = fs;		/* Register it */
 	}
 
@@ -3989,6 +4378,33 @@ FRESULT f_open (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Extend a direct transfer over the following contiguous clusters       */
+/*-----------------------------------------------------------------------*/
+
+static UINT contig_sect (	/* Number of sectors to be transferred from csect in the current cluster */
+	FIL* fp,		/* Pointer to the file object (fp->clust is moved to the cluster of the last sector) */
+	UINT csect,		/* Sector offset in the current cluster */
+	UINT cc			/* Number of sectors requested */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	UINT n = fs->csize - csect;	/* Sectors left in the current cluster */
+	DWORD nxt;
+
+
+	while (n < cc) {	/* Go through the clusters already linked next to each other (no allocation) */
+		nxt = get_fat(&fp->obj, fp->clust);
+		if (nxt != fp->clust + 1) break;	/* Fragmented, end of chain or error (checked by the caller later) */
+		fp->clust = nxt;
+		n += fs->csize;
+	}
+	return n < cc ? n : cc;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* API: Read File                                                        */
 /*-----------------------------------------------------------------------*/
@@ -4042,8 +4458,8 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
+				if (csect + cc > fs->csize) {	/* Clip at the end of contiguous clusters */
+					cc = contig_sect(fp, csect, cc);
 				}
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -4157,8 +4573,8 @@ FRESULT f_write (
 			sect += csect;
 			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
 			if (cc > 0) {					/* Write maximum contiguous sectors directly */
-				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
-					cc = fs->csize - csect;
+				if (csect + cc > fs->csize) {	/* Clip at cluster boundary, or at the end of contiguous clusters if the file continues */
+					cc = (fp->fptr + (FSIZE_t)(fs->csize - csect) * SS(fs) < fp->obj.objsize) ? contig_sect(fp, csect, cc) : fs->csize - csect;
 				}
 				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if FF_FS_MINIMIZE <= 2
@@ -4659,6 +5075,17 @@ FRESULT f_lseek (
 				fp->clust = clst;
 			}
 			if (clst != 0) {
+#if FF_FS_EXFAT
+				if (fs->fs_type == FS_EXFAT && fp->obj.stat == 2 && fp->obj.objsize > 0 && ofs > bcs) {	/* Contiguous object? */
+					DWORD nskip = (DWORD)((ofs - 1) / bcs);	/* Skip the allocated clusters without following the chain */
+					DWORD nlast = (DWORD)((fp->obj.objsize - 1) / bcs) - (clst - fp->obj.sclust);
+
+					if (nskip > nlast) nskip = nlast;
+					clst += nskip;
+					ofs -= (FSIZE_t)nskip * bcs; fp->fptr += (FSIZE_t)nskip * bcs;
+					fp->clust = clst;
+				}
+#endif
 				while (ofs > bcs) {						/* Cluster following loop */
 					ofs -= bcs; fp->fptr += bcs;
 #if !FF_FS_READONLY
@@ -5169,6 +5596,186 @@ FRESULT f_unlink (
 
 
 
+#if FF_USE_RMTREE
+/*-----------------------------------------------------------------------*/
+/* API: Delete a File or a Directory Tree                                */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT rmtree_scan (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,			/* Sub-directory to be scanned (sclust has been set) */
+	DWORD* tbl,			/* Table to store the top clusters of the objects */
+	UINT* n,			/* Number of items in the table */
+	UINT sz_tbl,		/* Size of the table in unit of item */
+	UINT depth			/* Depth of the sub-directory */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DIR sdj;
+	DWORD clst;
+
+
+	if (depth >= MAX_RMTREE) return FR_DENIED;	/* Too deep or circular tree */
+	res = dir_sdi(dp, 0);
+	while (res == FR_OK) {
+		res = DIR_READ_FILE(dp);				/* Get an object (the window is reloaded after a sub-directory is scanned) */
+		if (res != FR_OK) break;
+		if (dp->dir[DIR_Name] != '.') {			/* Skip dot entries */
+			if (dp->obj.attr & AM_RDO) return FR_DENIED;	/* Read-only objects cannot be removed */
+			clst = ld_clust(fs, dp->dir);
+			if (dp->obj.attr & AM_DIR) {		/* Scan the sub-directory first */
+				if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;
+#if FF_FS_RPATH
+				if (clst == fs->cdir) return FR_DENIED;	/* Current directory cannot be removed */
+#endif
+				sdj.obj.fs = fs;
+				sdj.obj.sclust = clst;
+				res = rmtree_scan(&sdj, tbl, n, sz_tbl, depth + 1);
+				if (res != FR_OK) break;
+			}
+			if (clst != 0) {
+				if (*n >= sz_tbl) return FR_NOT_ENOUGH_CORE;	/* Table overflow? */
+				tbl[(*n)++] = clst;
+			}
+		}
+		res = dir_next(dp, 0);
+	}
+	return (res == FR_NO_FILE) ? FR_OK : res;
+}
+
+
+static void rmtree_sift (DWORD* tbl, UINT p, UINT n)	/* Sift down an item of the heap */
+{
+	DWORD v = tbl[p];
+	UINT c;
+
+
+	while ((c = p * 2 + 1) < n) {
+		if (c + 1 < n && tbl[c + 1] > tbl[c]) c++;
+		if (v >= tbl[c]) break;
+		tbl[p] = tbl[c]; p = c;
+	}
+	tbl[p] = v;
+}
+
+
+FRESULT f_rmtree (
+	const TCHAR* path,	/* Pointer to the file or directory path */
+	void* work,			/* Pointer to the working buffer to store the top clusters of the objects */
+	UINT len			/* Size of the working buffer [byte] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DIR dj, sdj;
+	DWORD *tbl = (DWORD*)work, clst, nxt, v;
+	UINT n = 0, sz_tbl = len / sizeof (DWORD), i;
+#if FF_USE_TRIM
+	DWORD scl = 0, ecl = 0;
+	LBA_t rt[2];
+#endif
+	DEF_NAMEBUFF
+
+
+	if (!tbl || sz_tbl == 0) return FR_INVALID_PARAMETER;
+
+	/* Get logical drive and mount the volume if needed */
+	res = mount_volume(&path, &fs, FA_WRITE);
+	if (res == FR_OK) {
+		dj.obj.fs = fs;
+		INIT_NAMEBUFF(fs);
+		res = follow_path(&dj, path);	/* Follow the path to the object */
+		if (res == FR_OK) {
+			if (dj.fn[NSFLAG] & (NS_DOT | NS_NONAME)) {
+				res = FR_INVALID_NAME;	/* It must be a real object */
+			} else if (dj.obj.attr & AM_RDO) {
+				res = FR_DENIED;		/* The object must not be read-only */
+#if FF_FS_EXFAT
+			} else if (fs->fs_type == FS_EXFAT) {
+				res = FR_INVALID_PARAMETER;	/* exFAT chains need the allocation bitmap (use f_unlink) */
+#endif
+			}
+		}
+		if (res == FR_OK) {		/* Scan the tree without any change to the volume */
+			clst = ld_clust(fs, dj.dir);
+			if (dj.obj.attr & AM_DIR) {
+				if (clst < 2 || clst >= fs->n_fatent) {
+					res = FR_INT_ERR;
+#if FF_FS_RPATH
+				} else if (clst == fs->cdir) {
+					res = FR_DENIED;	/* Current directory cannot be removed */
+#endif
+				} else {
+					sdj.obj.fs = fs;
+					sdj.obj.sclust = clst;
+					res = rmtree_scan(&sdj, tbl, &n, sz_tbl, 0);
+				}
+			}
+			if (res == FR_OK && clst != 0) {
+				if (n < sz_tbl) {
+					tbl[n++] = clst;
+				} else {
+					res = FR_NOT_ENOUGH_CORE;
+				}
+			}
+		}
+		if (res == FR_OK) {		/* Remove the top entry, the entries in the tree go away with its clusters */
+			res = dir_remove(&dj);
+		}
+		if (res == FR_OK) {		/* Sort the top clusters (heap sort) so that the FAT is updated in sector order */
+			for (i = n / 2; i > 0; ) rmtree_sift(tbl, --i, n);
+			for (i = n; i > 1; ) {
+				v = tbl[--i]; tbl[i] = tbl[0]; tbl[0] = v;
+				rmtree_sift(tbl, 0, i);
+			}
+			for (i = 0; i < n && res == FR_OK; i++) {	/* Free the chains */
+				clst = tbl[i];
+				do {
+					nxt = get_fat(&dj.obj, clst);
+					if (nxt == 0) break;				/* Already freed (cross-linked)? */
+					if (nxt == 1) { res = FR_INT_ERR; break; }
+					if (nxt == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+					res = put_fat(fs, clst, 0);		/* Each FAT sector is written back once as the window moves forward */
+					if (res != FR_OK) break;
+					if (fs->free_clst < fs->n_fatent - 2) {	/* Update allocation information if it is valid */
+						fs->free_clst++;
+						fs->fsi_flag |= 1;
+					}
+#if FF_USE_TRIM
+					if (ecl != 0 && ecl + 1 == clst) {	/* Contiguous to the current block (also across the chains)? */
+						ecl = clst;
+					} else {
+						if (ecl != 0) {
+							rt[0] = clst2sect(fs, scl);
+							rt[1] = clst2sect(fs, ecl) + fs->csize - 1;
+							disk_ioctl(fs->pdrv, CTRL_TRIM, rt);	/* Inform storage device that the data in the block may be erased */
+						}
+						scl = ecl = clst;
+					}
+#endif
+					clst = nxt;
+				} while (clst >= 2 && clst < fs->n_fatent);	/* Repeat until the last link */
+			}
+#if FF_USE_TRIM
+			if (res == FR_OK && ecl != 0) {
+				rt[0] = clst2sect(fs, scl);
+				rt[1] = clst2sect(fs, ecl) + fs->csize - 1;
+				disk_ioctl(fs->pdrv, CTRL_TRIM, rt);
+			}
+#endif
+			if (res == FR_OK) res = sync_fs(fs);
+		}
+		FREE_NAMEBUFF();
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif /* FF_USE_RMTREE */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* API: Create a Directory                                               */
 /*-----------------------------------------------------------------------*/
@@ -5200,6 +5807,9 @@ FRESULT f_mkdir (
 			if (dcl == 0) res = FR_DENIED;		/* No space to allocate a new cluster? */
 			if (dcl == 1) res = FR_INT_ERR;		/* Any insanity? */
 			if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;	/* Disk error? */
+#if FF_USE_DIR_INDEX
+			if (res == FR_OK) dindex_forget(fs, dcl);	/* Discard the index of the removed directory on the cluster */
+#endif
 			tm = GET_FATTIME();
 			if (res == FR_OK) {
 				res = dir_clear(fs, dcl);		/* Clear the allocated cluster as new direcotry table */
@@ -5933,7 +6543,7 @@ static FRESULT create_partition (
 		top_bpt = sz_drv - sz_ptbl - 1;		/* Backup partition table start LBA */
 		nxt_alloc = 2 + sz_ptbl;			/* First allocatable LBA */
 		sz_pool = top_bpt - nxt_alloc;		/* Size of allocatable area [sector] */
-		bcc = 0xFFFFFFFF; sz_part = 1;
+		bcc = 0; sz_part = 1;
 		pi = si = 0;	/* partition table index, map index */
 		do {
 			if (pi * SZ_GPTE % ss == 0) memset(buf, 0, ss);	/* Clean the buffer if needed */
@@ -5957,7 +6567,7 @@ static FRESULT create_partition (
 				nxt_alloc += sz_part;								/* Next allocatable LBA */
 			}
 			if ((pi + 1) * SZ_GPTE % ss == 0) {		/* Write the sector buffer if it is filled up */
-				for (i = 0; i < ss; bcc = crc32(bcc, buf[i++])) ;	/* Calculate table check sum */
+				bcc = ff_crc32(bcc, buf, ss);		/* Calculate table check sum */
 				if (disk_write(drv, buf, 2 + pi * SZ_GPTE / ss, 1) != RES_OK) return FR_DISK_ERR;		/* Write to primary table */
 				if (disk_write(drv, buf, top_bpt + pi * SZ_GPTE / ss, 1) != RES_OK) return FR_DISK_ERR;	/* Write to secondary table */
 			}
@@ -5966,7 +6576,7 @@ static FRESULT create_partition (
 		/* Create primary GPT header */
 		memset(buf, 0, ss);
 		memcpy(buf + GPTH_Sign, "EFI PART" "\0\0\1\0" "\x5C\0\0", 16);	/* Signature, version (1.0) and size (92) */
-		st_32(buf + GPTH_PtBcc, ~bcc);			/* Table check sum */
+		st_32(buf + GPTH_PtBcc, bcc);			/* Table check sum */
 		st_64(buf + GPTH_CurLba, 1);			/* LBA of this header */
 		st_64(buf + GPTH_BakLba, sz_drv - 1);	/* LBA of secondary header */
 		st_64(buf + GPTH_FstLba, 2 + sz_ptbl);	/* LBA of first allocatable sector */
@@ -5975,8 +6585,7 @@ static FRESULT create_partition (
 		st_32(buf + GPTH_PtNum, GPT_ITEMS);		/* Number of table entries */
 		st_32(buf + GPTH_PtOfs, 2);				/* LBA of this table */
 		rnd = make_rand(rnd, buf + GPTH_DskGuid, 16);	/* Disk GUID */
-		for (i = 0, bcc= 0xFFFFFFFF; i < 92; bcc = crc32(bcc, buf[i++])) ;	/* Calculate header check sum */
-		st_32(buf + GPTH_Bcc, ~bcc);			/* Header check sum */
+		st_32(buf + GPTH_Bcc, ff_crc32(0, buf, 92));	/* Header check sum */
 		if (disk_write(drv, buf, 1, 1) != RES_OK) return FR_DISK_ERR;
 
 		/* Create secondary GPT header */
@@ -5984,8 +6593,7 @@ static FRESULT create_partition (
 		st_64(buf + GPTH_BakLba, 1);		 	/* LBA of primary header */
 		st_64(buf + GPTH_PtOfs, top_bpt);		/* LBA of this table */
 		st_32(buf + GPTH_Bcc, 0);
-		for (i = 0, bcc= 0xFFFFFFFF; i < 92; bcc = crc32(bcc, buf[i++])) ;	/* Calculate header check sum */
-		st_32(buf + GPTH_Bcc, ~bcc);			/* Header check sum */
+		st_32(buf + GPTH_Bcc, ff_crc32(0, buf, 92));	/* Header check sum */
 		if (disk_write(drv, buf, sz_drv - 1, 1) != RES_OK) return FR_DISK_ERR;
 
 		/* Create protective MBR */
@@ -6039,6 +6647,34 @@ static FRESULT create_partition (
 }
 
 
+/* Fill a block of sectors with zero. The lower layer is asked to do it
+/  with CTRL_ZERO first and zeros are written only if it is not supported. */
+
+static FRESULT fill_zero (
+	BYTE drv,			/* Physical drive number */
+	BYTE fsopt,			/* Format options (FM_ZEROED: nothing to do) */
+	BYTE* buf,			/* Working buffer filled with zero */
+	DWORD sz_buf,		/* Size of working buffer [sector] */
+	LBA_t sect,			/* Start sector */
+	DWORD nsect			/* Number of sectors to be filled */
+)
+{
+	LBA_t lba[2];
+	DWORD n;
+
+
+	if (nsect == 0 || (fsopt & FM_ZEROED)) return FR_OK;	/* Nothing to do or the media is already zero-filled? */
+	lba[0] = sect; lba[1] = sect + nsect - 1;
+	if (disk_ioctl(drv, CTRL_ZERO, lba) == RES_OK) return FR_OK;	/* Zero-filled by the lower layer? */
+	do {
+		n = (nsect > sz_buf) ? sz_buf : nsect;
+		if (disk_write(drv, buf, sect, (UINT)n) != RES_OK) return FR_DISK_ERR;
+		sect += n; nsect -= n;
+	} while (nsect);
+	return FR_OK;
+}
+
+
 
 FRESULT f_mkfs (
 	const TCHAR* path,		/* Logical drive number */
@@ -6089,7 +6725,7 @@ FRESULT f_mkfs (
 #endif
 
 	/* Options for FAT sub-type and FAT parameters */
-	fsopt = opt->fmt & (FM_ANY | FM_SFD);
+	fsopt = opt->fmt & (FM_ANY | FM_SFD | FM_ZEROED);
 	n_fat = (opt->n_fat >= 1 && opt->n_fat <= 2) ? opt->n_fat : 1;
 	n_root = (opt->n_root >= 1 && opt->n_root <= 32768 && (opt->n_root % (ss / SZDIRE)) == 0) ? opt->n_root : 512;
 	sz_au = (opt->au_size <= 0x1000000 && (opt->au_size & (opt->au_size - 1)) == 0) ? opt->au_size : 0;
@@ -6279,7 +6915,10 @@ FRESULT f_mkfs (
 			n = (nsect > sz_buf) ? sz_buf : nsect;	/* Write the buffered data */
 			if (disk_write(pdrv, buf, sect, n) != RES_OK) LEAVE_MKFS(FR_DISK_ERR);
 			sect += n; nsect -= n;
-		} while (nsect);
+		} while (nsect && (nbit != 0 || j < 3));	/* Until all chains are written */
+		memset(buf, 0, sz_buf * ss);
+		res = fill_zero(pdrv, fsopt, buf, sz_buf, sect, nsect);	/* Rest of FAT is initially zero */
+		if (res != FR_OK) LEAVE_MKFS(res);
 
 		/* Initialize the root directory */
 		memset(buf, 0, sz_buf * ss);
@@ -6483,22 +7122,17 @@ FRESULT f_mkfs (
 			} else {
 				st_32(buf + 0, (fsty == FS_FAT12) ? 0xFFFFF8 : 0xFFFFFFF8);	/* FAT[0] and FAT[1] */
 			}
-			nsect = sz_fat;		/* Number of FAT sectors */
-			do {	/* Fill FAT sectors */
-				n = (nsect > sz_buf) ? sz_buf : nsect;
-				if (disk_write(pdrv, buf, sect, (UINT)n) != RES_OK) LEAVE_MKFS(FR_DISK_ERR);
-				memset(buf, 0, ss);	/* Rest of FAT area is initially zero */
-				sect += n; nsect -= n;
-			} while (nsect);
+			if (disk_write(pdrv, buf, sect, 1) != RES_OK) LEAVE_MKFS(FR_DISK_ERR);	/* Write the first FAT sector */
+			memset(buf, 0, ss);	/* Rest of FAT area is initially zero */
+			res = fill_zero(pdrv, fsopt, buf, sz_buf, sect + 1, sz_fat - 1);
+			if (res != FR_OK) LEAVE_MKFS(res);
+			sect += sz_fat;
 		}
 
 		/* Initialize root directory (fill with zero) */
 		nsect = (fsty == FS_FAT32) ? pau : sz_dir;	/* Number of root directory sectors */
-		do {
-			n = (nsect > sz_buf) ? sz_buf : nsect;
-			if (disk_write(pdrv, buf, sect, (UINT)n) != RES_OK) LEAVE_MKFS(FR_DISK_ERR);
-			sect += n; nsect -= n;
-		} while (nsect);
+		res = fill_zero(pdrv, fsopt, buf, sz_buf, sect, nsect);
+		if (res != FR_OK) LEAVE_MKFS(res);
 	}
 
 	/* A FAT volume has been created here */
@@ -7247,3 +7881,78 @@ FRESULT f_setcp (
 }
 #endif	/* FF_CODE_PAGE == 0 */
 
+
+
+
+#if FF_USE_TRACE
+/*-----------------------------------------------------------------------*/
+/* Tracing hooks of the API functions                                    */
+/*-----------------------------------------------------------------------*/
+
+#define TRACE_API(func, params, args, a0, a1) \
+FRESULT func params { \
+	FRESULT res; \
+	FF_TRACE(#func, 'B', a0, a1); \
+	res = trace_##func args; \
+	FF_TRACE(#func, 'E', res, 0); \
+	return res; \
+}
+
+#undef f_mount
+#undef f_open
+#undef f_close
+#undef f_read
+#undef f_write
+#undef f_sync
+#undef f_lseek
+#undef f_truncate
+#undef f_opendir
+#undef f_closedir
+#undef f_readdir
+#undef f_stat
+#undef f_getfree
+#undef f_unlink
+#undef f_mkdir
+#undef f_rename
+
+TRACE_API(f_mount, (FATFS* fs, const TCHAR* path, BYTE opt), (fs, path, opt), opt, fs != 0)
+TRACE_API(f_open, (FIL* fp, const TCHAR* path, BYTE mode), (fp, path, mode), mode, 0)
+TRACE_API(f_close, (FIL* fp), (fp), 0, 0)
+TRACE_API(f_read, (FIL* fp, void* buff, UINT btr, UINT* br), (fp, buff, btr, br), btr, fp ? fp->fptr : 0)
+TRACE_API(f_write, (FIL* fp, const void* buff, UINT btw, UINT* bw), (fp, buff, btw, bw), btw, fp ? fp->fptr : 0)
+TRACE_API(f_sync, (FIL* fp), (fp), 0, 0)
+TRACE_API(f_lseek, (FIL* fp, FSIZE_t ofs), (fp, ofs), ofs, 0)
+TRACE_API(f_truncate, (FIL* fp), (fp), fp ? fp->fptr : 0, 0)
+TRACE_API(f_opendir, (DIR* dp, const TCHAR* path), (dp, path), 0, 0)
+TRACE_API(f_closedir, (DIR* dp), (dp), 0, 0)
+TRACE_API(f_readdir, (DIR* dp, FILINFO* fno), (dp, fno), 0, 0)
+TRACE_API(f_stat, (const TCHAR* path, FILINFO* fno), (path, fno), 0, 0)
+TRACE_API(f_getfree, (const TCHAR* path, DWORD* nclst, FATFS** fatfs), (path, nclst, fatfs), 0, 0)
+TRACE_API(f_unlink, (const TCHAR* path), (path), 0, 0)
+TRACE_API(f_mkdir, (const TCHAR* path), (path), 0, 0)
+TRACE_API(f_rename, (const TCHAR* path_old, const TCHAR* path_new), (path_old, path_new), 0, 0)
+#if FF_USE_CHMOD
+#undef f_chmod
+#undef f_utime
+TRACE_API(f_chmod, (const TCHAR* path, BYTE attr, BYTE mask), (path, attr, mask), attr, mask)
+TRACE_API(f_utime, (const TCHAR* path, const FILINFO* fno), (path, fno), 0, 0)
+#endif
+#if FF_FS_RPATH >= 1
+#undef f_chdir
+TRACE_API(f_chdir, (const TCHAR* path), (path), 0, 0)
+#endif
+#if FF_USE_EXPAND
+#undef f_expand
+TRACE_API(f_expand, (FIL* fp, FSIZE_t fsz, BYTE opt), (fp, fsz, opt), fsz, opt)
+#endif
+#if FF_USE_RMTREE
+#undef f_rmtree
+TRACE_API(f_rmtree, (const TCHAR* path, void* work, UINT len), (path, work, len), len, 0)
+#endif
+#if FF_USE_MKFS
+#undef f_mkfs
+TRACE_API(f_mkfs, (const TCHAR* path, const MKFS_PARM* opt, void* work, UINT len), (path, opt, work, len), opt ? opt->fmt : 0, len)
+#endif
+
+#endif /* FF_USE_TRACE */
+
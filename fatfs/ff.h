@@ -163,6 +163,9 @@ typedef struct {
 #if FF_USE_LFN
 	WCHAR*	lfnbuf;		/* Pointer to LFN working buffer */
 #endif
+#if FF_USE_DIR_INDEX
+	void*	dirindex;	/* Name index of the directory last registered to (allocated on demand) */
+#endif
 #if !FF_FS_READONLY
 	DWORD	last_clst;	/* Last allocated cluster (invalid if >=n_fatent) */
 	DWORD	free_clst;	/* Number of free clusters (invalid if >=fs->n_fatent-2) */
@@ -264,6 +267,12 @@ typedef struct {
 #if FF_FS_CRTIME
 	WORD	crdate;			/* Date of object createion */
 	WORD	crtime;			/* Time of object createion */
+#endif
+#if FF_FS_FCLUST
+	DWORD	fclust;			/* Object start cluster (0:no cluster allocated) */
+#if FF_FS_EXFAT
+	DWORD	fcont;			/* Number of contiguous clusters of a no-FAT-chain object (0:follow the FAT chain) */
+#endif
 #endif
 	BYTE	fattrib;		/* Object attribute */
 #if FF_USE_LFN
@@ -279,7 +288,7 @@ typedef struct {
 /* Format parameter structure (MKFS_PARM) used for f_mkfs() */
 
 typedef struct {
-	BYTE fmt;			/* Format option (FM_FAT, FM_FAT32, FM_EXFAT and FM_SFD) */
+	BYTE fmt;			/* Format option (FM_FAT, FM_FAT32, FM_EXFAT, FM_SFD and FM_ZEROED) */
 	BYTE n_fat;			/* Number of FATs */
 	UINT align;			/* Data area alignment (sector) */
 	UINT n_root;		/* Number of root directory entries */
@@ -335,6 +344,7 @@ FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
+FRESULT f_rmtree (const TCHAR* path, void* work, UINT len);		/* Delete a file or a directory tree at a time */
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
 FRESULT f_utime (const TCHAR* path, const FILINFO* fno);			/* Change timestamp of a file/dir */
@@ -387,10 +397,62 @@ WCHAR ff_uni2oem (DWORD uni, WORD cp);	/* Unicode to OEM code conversion */
 DWORD ff_wtoupper (DWORD uni);			/* Unicode upper-case conversion */
 #endif
 
+/* CRC-32 function (defined in ffcrc.c) */
+
+DWORD ff_crc32 (DWORD crc, const void* buf, UINT len);	/* Update CRC-32 of IEEE 802.3 (0 for the first call) */
+
+
+/* Performance counters (defined in ff.c, also updated by the disk I/O layer) */
+
+#if FF_USE_STATS
+#define FF_STAT_NLAT	16	/* Number of latency histogram buckets */
+
+typedef struct {
+	QWORD	rd_calls, rd_sects, rd_bytes;	/* disk_read() */
+	QWORD	wr_calls, wr_sects, wr_bytes;	/* disk_write() */
+	QWORD	rd_lat[FF_STAT_NLAT];	/* disk_read() latency, bucket 0: <1us, bucket n: [2^(n-1), 2^n) us, last: longer */
+	QWORD	wr_lat[FF_STAT_NLAT];	/* disk_write() latency */
+	QWORD	win_hits, win_misses;	/* move_window() */
+	QWORD	win_syncs, win_mirror;	/* sync_window() write-backs, and of them reflected to the 2nd FAT */
+	QWORD	getfat_calls, putfat_calls;	/* get_fat(), put_fat() */
+	QWORD	dirnext_steps;			/* dir_next() */
+	QWORD	chain_calls, chain_scans, chain_scan_max;	/* create_chain(), FAT entries scanned for a free cluster */
+} FFSTATS;
+
+extern FFSTATS FfStats;
+#define FF_STAT_ADD(f, n)	(FfStats.f += (n))
+#define FF_STAT_MAX(f, v)	do { if ((QWORD)(v) > FfStats.f) FfStats.f = (v); } while (0)
+#else
+#define FF_STAT_ADD(f, n)	((void)0)
+#define FF_STAT_MAX(f, v)	((void)0)
+#endif
+#define FF_STAT_INC(f)		FF_STAT_ADD(f, 1)
+
+
+/* Event tracing (ring buffer and clock defined in ffsystem.c) */
+
+#if FF_USE_TRACE
+typedef struct {
+	const char* name;	/* Event name (static string) */
+	QWORD	ts;			/* Timestamp (ns) */
+	QWORD	arg0, arg1;	/* Begin: call parameters, End: arg0 is the result code */
+	char	ph;			/* Phase, 'B':begin or 'E':end */
+} FFTRACE;
+
+extern FFTRACE FfTrace[FF_TRACE_DEPTH];	/* Event n is stored at FfTrace[n % FF_TRACE_DEPTH] */
+extern volatile BYTE FfTraceOn;			/* Events are recorded only while this is not zero */
+void ff_trace (const char* name, char ph, QWORD arg0, QWORD arg1);	/* Record an event */
+QWORD ff_trace_count (void);			/* Number of events recorded since the last clear */
+void ff_trace_clear (void);				/* Discard all events */
+#define FF_TRACE(name, ph, a0, a1)	do { if (FfTraceOn) ff_trace(name, ph, (QWORD)(a0), (QWORD)(a1)); } while (0)
+#else
+#define FF_TRACE(name, ph, a0, a1)	((void)0)
+#endif
+
 
 /* O/S dependent functions (samples available in ffsystem.c) */
 
-#if FF_USE_LFN == 3		/* Dynamic memory allocation */
+#if FF_USE_LFN == 3 || FF_USE_DIR_INDEX	/* Dynamic memory allocation */
 void* ff_memalloc (UINT msize);		/* Allocate memory block */
 void ff_memfree (void* mblock);		/* Free memory block */
 #endif
@@ -426,6 +488,7 @@ void ff_mutex_give (int vol);		/* Unlock sync object */
 #define FM_EXFAT	0x04
 #define FM_ANY		0x07
 #define FM_SFD		0x08
+#define FM_ZEROED	0x10	/* The media is known to be zero-filled (skip clearing FAT and directory area) */
 
 /* Filesystem type (FATFS.fs_type) */
 #define FS_FAT12	1
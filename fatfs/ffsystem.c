@@ -5,7 +5,7 @@
 #include "ff.h"
 
 
-#if FF_USE_LFN == 3	/* Use dynamic memory allocation */
+#if FF_USE_LFN == 3 || FF_USE_DIR_INDEX	/* Use dynamic memory allocation */
 
 /*------------------------------------------------------------------------*/
 /* Allocate/Free a Memory Block                                           */
@@ -206,3 +206,64 @@ void ff_mutex_give (
 
 #endif	/* FF_FS_REENTRANT */
 
+
+
+
+
+#if FF_USE_TRACE	/* Event tracing */
+/*------------------------------------------------------------------------*/
+/* Trace Ring Buffer                                                      */
+/*------------------------------------------------------------------------*/
+
+#include <time.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TRACE_FETCH_ADD(p)	((QWORD)_InterlockedExchangeAdd64((volatile __int64*)(p), 1))
+static volatile QWORD TraceHead;
+#else
+#include <stdatomic.h>
+#define TRACE_FETCH_ADD(p)	((QWORD)atomic_fetch_add_explicit((p), 1, memory_order_relaxed))
+static _Atomic QWORD TraceHead;
+#endif
+
+#if FF_TRACE_DEPTH & (FF_TRACE_DEPTH - 1)
+#error FF_TRACE_DEPTH must be a power of 2
+#endif
+
+FFTRACE FfTrace[FF_TRACE_DEPTH];
+volatile BYTE FfTraceOn;
+
+
+void ff_trace (
+	const char* name,	/* Event name (static string) */
+	char ph,			/* 'B':begin, 'E':end */
+	QWORD arg0,
+	QWORD arg1
+)
+{
+	struct timespec ts;
+	FFTRACE *ev;
+
+
+	timespec_get(&ts, TIME_UTC);
+	ev = &FfTrace[TRACE_FETCH_ADD(&TraceHead) & (FF_TRACE_DEPTH - 1)];	/* Claim a slot, overwriting the oldest event */
+	ev->name = name;
+	ev->ts = (QWORD)ts.tv_sec * 1000000000 + (QWORD)ts.tv_nsec;
+	ev->arg0 = arg0;
+	ev->arg1 = arg1;
+	ev->ph = ph;
+}
+
+
+QWORD ff_trace_count (void)
+{
+	return (QWORD)TraceHead;
+}
+
+
+void ff_trace_clear (void)
+{
+	TraceHead = 0;
+}
+
+#endif	/* FF_USE_TRACE */
@@ -42,6 +42,13 @@
 /* This option switches f_expand(). (0:Disable or 1:Enable) */
 
 
+#define FF_USE_RMTREE	1
+/* This option switches f_rmtree(). (0:Disable or 1:Enable) f_rmtree() removes a
+/  directory tree at a time: it scans the tree into the working buffer first, then
+/  removes the top entry, frees all cluster chains in sorted order and syncs once.
+/  The directory entries inside the removed tree are not modified. */
+
+
 #define FF_USE_CHMOD	1
 /* This option switches attribute control API functions, f_chmod() and f_utime().
 /  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
@@ -56,6 +63,23 @@
 /* This option switches f_forward(). (0:Disable or 1:Enable) */
 
 
+#define FF_USE_STATS	1
+/* This option switches performance counters in FfStats. (0:Disable or 1:Enable)
+/  When enabled, the disk I/O layer counts accesses, sectors and latency, and the
+/  filesystem module counts sector window hits/misses, window write-backs, FAT
+/  accesses, directory steps and free cluster scans. When disabled, the counting
+/  macros expand to nothing and FfStats is not defined. */
+
+
+#define FF_USE_TRACE	1
+#define FF_TRACE_DEPTH	65536
+/* FF_USE_TRACE switches event tracing of the API functions and disk I/O. (0:Disable
+/  or 1:Enable) Begin/end events are recorded into a lock-free ring buffer of
+/  FF_TRACE_DEPTH entries (defined in ffsystem.c) only while FfTraceOn is set, so an
+/  inactive trace costs a flag test per call. FF_TRACE_DEPTH must be a power of 2.
+/  This option needs FF_FS_READONLY = 0 and FF_FS_MINIMIZE = 0. */
+
+
 #define FF_USE_STRFUNC	2
 #define FF_PRINT_LLI	0
 #define FF_PRINT_FLOAT	1
@@ -113,7 +137,7 @@
 */
 
 
-#define FF_USE_LFN		1
+#define FF_USE_LFN		2
 #define FF_MAX_LFN		255
 /* The FF_USE_LFN switches the support for LFN (long file name).
 /
@@ -133,7 +157,21 @@
 /  ff_memfree() exemplified in ffsystem.c, need to be added to the project. */
 
 
-#define FF_LFN_UNICODE	3
+#ifndef FF_USE_DIR_INDEX
+#define FF_USE_DIR_INDEX	1
+#endif
+/* This option switches the name index of directories. (0:Disable or 1:Enable)
+/  When enabled, the hash values of SFNs and LFNs in the directory are collected into
+/  a hash set on the first registration to the directory and kept up to date with the
+/  first free entry. It is used to generate numbered SFNs, to reject a new name without
+/  scanning the directory and to allocate entries without scanning the used part of
+/  the directory. One index per volume is kept for the directory last registered to.
+/  This option needs FF_USE_LFN >= 1 and ff_memalloc()/ff_memfree() in ffsystem.c.
+/  If the memory cannot be allocated, it falls back to scanning the directory.
+/  It has no effect on the exFAT volume, which has the name hash in each entry. */
+
+
+#define FF_LFN_UNICODE	2
 /* This option switches the character encoding on the API when LFN is enabled.
 /
 /   0: ANSI/OEM in current CP (TCHAR = char)
@@ -178,7 +216,7 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_VOLUMES		1
+#define FF_VOLUMES		10
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -196,7 +234,7 @@
 */
 
 
-#define FF_MULTI_PARTITION	0
+#define FF_MULTI_PARTITION	1
 /* This option switches support for multiple volumes on the physical drive.
 /  By default (0), each logical drive number is bound to the same physical drive
 /  number and only an FAT volume found on the physical drive will be mounted.
@@ -215,7 +253,7 @@
 /  GET_SECTOR_SIZE command. */
 
 
-#define FF_LBA64		0
+#define FF_LBA64		1
 /* This option switches support for 64-bit LBA. (0:Disable or 1:Enable)
 /  To enable the 64-bit LBA, also exFAT needs to be enabled. (FF_FS_EXFAT == 1) */
 
@@ -225,7 +263,7 @@
 /  f_fdisk(). 2^32 sectors maximum. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable this feature, also CTRL_TRIM command should be implemented to
 /  the disk_ioctl(). */
@@ -243,7 +281,7 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
-#define FF_FS_EXFAT		0
+#define FF_FS_EXFAT		1
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
 /  Note that enabling exFAT discards ANSI C (C89) compatibility. */
@@ -268,6 +306,13 @@
 /  set 1, the file created time is available in FILINFO structure. */
 
 
+#define FF_FS_FCLUST	1
+/* This option enables(1)/disables(0) the start cluster of the object in FILINFO
+/  structure. It is needed by the applications which index the cluster chains of
+/  the directory tree without opening each file. On the exFAT volume, also the
+/  number of contiguous clusters of the object without FAT chain is given. */
+
+
 #define FF_FS_NOFSINFO	0
 /* If you need to know the correct free space on the FAT32 volume, set bit 0 of
 /  this option, and f_getfree() on the first time after volume mount will force
@@ -8,4 +8,14 @@
 #define MB (KB * KB)
 #define GB (MB * KB)
 
+// 延迟写回缓存的最大扇区数(64MB)，写满时全部冲刷
+#define WRITEBACK_SECTORS (64 * MB / SECTOR_SIZE)
+// 不少于该扇区数的写入(通常是文件数据)不进入延迟写回缓存
+#define WRITEBACK_DIRECT 16
+// 延迟写回模式下等待写回后再打洞的区间数上限，排满时先写回缓存再打洞
+#define TRIM_QUEUE_MAX 1024
+
+// 压缩镜像的解压缓存大小(每个打开的压缩镜像)
+#define PACKED_CACHE_SIZE (32 * MB)
+
 #endif  // FATFS_PORTS_FILE_CONFIG_H_
@@ -1,90 +1,527 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* for fallocate */
+#include <fcntl.h>
+#endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ff.h"
 #include "diskio.h"
 #include "config.h"
+#include "overlay.h"
+#include "packed.h"
+#include "writeback.h"
+#include "vdisk.h"
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
-// 全局文件指针，指向虚拟磁盘文件
-extern char *disk_path;
-static FILE* vdisk_fp = NULL;
-static DWORD total_sectors = 0; // 总扇区数
+// 一个打开的镜像(物理驱动器)的全部状态
+typedef struct vdisk_t {
+    FILE*        fp;              // 压缩镜像时为NULL
+    packed_t*    packed;          // 非NULL时为块压缩的只读镜像，只能在写时复制模式下写入
+    overlay_t*   overlay;         // 非NULL时为写时复制模式：fp只读，所有写入进入增量文件
+    writeback_t* writeback;       // 非NULL时启用延迟写回缓存
+    long         writeback_interval;  // 延迟写回的定时冲刷间隔(秒)，0只在CTRL_FLUSH时冲刷
+    time_t       writeback_time;  // 上次冲刷的时间
+    LBA_t*       trims;           // 延迟写回模式下等待下一次冲刷后再打洞的扇区区间，每两项为[起始, 结束]
+    int          n_trims;
+    LBA_t        total_sectors;   // 总扇区数
+    int          flush_running;   // 定时冲刷线程已启动(writeback_interval > 0)
+    int          flush_stop;      // 通知定时冲刷线程退出
+    // 多个线程(每个线程一个分区)可同时访问同一个镜像。延迟写回缓存、增量文件和stdio的文件位置是共享状态，
+    // 访问时持有lock；POSIX下直接读写镜像使用pread/pwrite，不移动文件位置，不重叠的扇区区间并行读写
+#ifdef _WIN32
+    SRWLOCK            lock;
+    CONDITION_VARIABLE flush_cond;
+    HANDLE             flush_thread;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t  flush_cond;
+    pthread_t       flush_thread;
+#endif
+} vdisk_t;
 
-// 打开虚拟磁盘
-DSTATUS disk_initialize(BYTE pdrv) {
-    (void)pdrv;  // 忽略驱动器号（仅一个虚拟磁盘）
-    if (disk_path) {
-        vdisk_fp = fopen(disk_path, "rb+");  // 读写模式打开
-        if (vdisk_fp) {
-            // 获取文件大小
-            if (fseek(vdisk_fp, 0, SEEK_END) == 0) {
-                long file_size = ftell(vdisk_fp);
-                if (file_size >= 0) {
-                    // 计算总扇区数
-                    total_sectors = (DWORD)(file_size / SECTOR_SIZE);
-                }
-                // 将文件指针重置到文件开始
-                fseek(vdisk_fp, 0, SEEK_SET);
+#ifdef _WIN32
+#define LOCK_INIT(l) InitializeSRWLock(l)
+#define LOCK_FREE(l) ((void)0)
+#define LOCK(l) AcquireSRWLockExclusive(l)
+#define UNLOCK(l) ReleaseSRWLockExclusive(l)
+static SRWLOCK drives_lock = SRWLOCK_INIT;
+#else
+#define LOCK_INIT(l) pthread_mutex_init(l, NULL)
+#define LOCK_FREE(l) pthread_mutex_destroy(l)
+#define LOCK(l) pthread_mutex_lock(l)
+#define UNLOCK(l) pthread_mutex_unlock(l)
+static pthread_mutex_t drives_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static vdisk_t* drives[VDISK_MAX];  // 驱动器号 -> 镜像，分配和释放时持有drives_lock
+
+static DRESULT file_write(void* ctx, const BYTE* buff, LBA_t sector, UINT count);
+
+// 定位到扇区，偏移量按64位计算，long为32位的平台上也能访问2GB以后的扇区
+static int seek_sector(FILE* fp, LBA_t sector) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)sector * SECTOR_SIZE, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)sector * SECTOR_SIZE, SEEK_SET);
+#endif
+}
+
+// 获取文件大小(字节)，失败返回-1，文件指针回到开头
+static long long file_size64(FILE* fp) {
+#ifdef _WIN32
+    if (_fseeki64(fp, 0, SEEK_END) != 0) return -1;
+    long long size = _ftelli64(fp);
+#else
+    if (fseeko(fp, 0, SEEK_END) != 0) return -1;
+    long long size = (long long)ftello(fp);
+#endif
+    return seek_sector(fp, 0) == 0 ? size : -1;
+}
+
+static vdisk_t* get_drive(BYTE pdrv) {
+    return pdrv < VDISK_MAX ? drives[pdrv] : NULL;
+}
+
+static DRESULT writeback_sync(vdisk_t* d);
+static void trim_cancel(vdisk_t* d, LBA_t start, LBA_t end);
+static void trim_punch(vdisk_t* d);
+
+// 定时冲刷线程：进程空闲时也按间隔写回延迟写回缓存，不必等到下一次写入
+static void flush_loop(vdisk_t* d) {
+    LOCK(&d->lock);
+    while (!d->flush_stop) {
+        time_t now = time(NULL);
+        time_t due = d->writeback_time + d->writeback_interval;
+        if (now >= due) {
+            if (writeback_count(d->writeback) > 0) {
+                writeback_sync(d);  // 失败时扇区留在缓存中，下一次冲刷重试
             } else {
-                return STA_NOINIT;
+                d->writeback_time = now;
             }
+            continue;
+        }
+#ifdef _WIN32
+        SleepConditionVariableSRW(&d->flush_cond, &d->lock, (DWORD)(due - now) * 1000, 0);
+#else
+        struct timespec ts = {due, 0};
+        pthread_cond_timedwait(&d->flush_cond, &d->lock, &ts);
+#endif
+    }
+    UNLOCK(&d->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI flush_main(LPVOID arg) {
+    flush_loop((vdisk_t*)arg);
+    return 0;
+}
+#else
+static void* flush_main(void* arg) {
+    flush_loop((vdisk_t*)arg);
+    return NULL;
+}
+#endif
+
+static int start_flusher(vdisk_t* d) {
+#ifdef _WIN32
+    InitializeConditionVariable(&d->flush_cond);
+    d->flush_thread = CreateThread(NULL, 0, flush_main, d, 0, NULL);
+    if (!d->flush_thread) return -1;
+#else
+    if (pthread_cond_init(&d->flush_cond, NULL) != 0) return -1;
+    if (pthread_create(&d->flush_thread, NULL, flush_main, d) != 0) {
+        pthread_cond_destroy(&d->flush_cond);
+        return -1;
+    }
+#endif
+    d->flush_running = 1;
+    return 0;
+}
+
+static void stop_flusher(vdisk_t* d) {
+    if (!d->flush_running) return;
+    LOCK(&d->lock);
+    d->flush_stop = 1;
+#ifdef _WIN32
+    WakeConditionVariable(&d->flush_cond);
+    UNLOCK(&d->lock);
+    WaitForSingleObject(d->flush_thread, INFINITE);
+    CloseHandle(d->flush_thread);
+#else
+    pthread_cond_signal(&d->flush_cond);
+    UNLOCK(&d->lock);
+    pthread_join(d->flush_thread, NULL);
+    pthread_cond_destroy(&d->flush_cond);
+#endif
+    d->flush_running = 0;
+}
+
+static void close_drive(vdisk_t* d) {
+    stop_flusher(d);
+    writeback_close(d->writeback);
+    free(d->trims);
+    overlay_close(d->overlay);
+    packed_close(d->packed);
+    if (d->fp) fclose(d->fp);
+    LOCK_FREE(&d->lock);
+    free(d);
+}
+
+int vdisk_attach(const char* path, const vdisk_opts_t* opts) {
+    vdisk_t* d = (vdisk_t*)calloc(1, sizeof(vdisk_t));
+    if (!d) return -1;
+    LOCK_INIT(&d->lock);
+    const char* overlay_path = opts ? opts->overlay_path : NULL;
+
+    if (packed_probe(path)) {
+        d->packed = packed_open(path, PACKED_CACHE_SIZE);
+        if (!d->packed) {
+            close_drive(d);
+            return -1;
+        }
+        d->total_sectors = packed_sectors(d->packed);
+    } else {
+        d->fp = fopen(path, overlay_path ? "rb" : "rb+");  // 覆盖层模式下基础镜像只读
+        // 获取文件大小(使用64位偏移，支持超过2GB/4GB的镜像)
+        long long file_size = d->fp ? file_size64(d->fp) : -1;
+        if (file_size < 0) {
+            close_drive(d);
+            return -1;
         }
+        d->total_sectors = (LBA_t)(file_size / SECTOR_SIZE);
     }
-    return (vdisk_fp != NULL) ? RES_OK : STA_NOINIT;
+    if (overlay_path) {
+        d->overlay = overlay_open(overlay_path, d->total_sectors);
+        if (!d->overlay) {
+            close_drive(d);
+            return -1;
+        }
+    }
+    if (opts && opts->writeback >= 0) {
+        d->writeback = writeback_open(WRITEBACK_SECTORS, file_write, d);
+        if (!d->writeback) {
+            close_drive(d);
+            return -1;
+        }
+        d->writeback_interval = opts->writeback;
+        d->writeback_time = time(NULL);
+        if (d->writeback_interval > 0 && start_flusher(d) != 0) {
+            close_drive(d);
+            return -1;
+        }
+    }
+
+    int pdrv = -1;
+    LOCK(&drives_lock);
+    for (int i = 0; i < VDISK_MAX; i++) {
+        if (!drives[i]) {
+            drives[i] = d;
+            pdrv = i;
+            break;
+        }
+    }
+    UNLOCK(&drives_lock);
+    if (pdrv < 0) close_drive(d);
+    return pdrv;
+}
+
+// 没有增量文件的压缩镜像是写保护的
+static DSTATUS drive_status(const vdisk_t* d) {
+    return d->packed && !d->overlay ? STA_PROTECT : 0;
+}
+
+// 打开虚拟磁盘：镜像在vdisk_attach时已经打开，这里只刷新大小(镜像可能被重新创建)
+DSTATUS disk_initialize(BYTE pdrv) {
+    vdisk_t* d = get_drive(pdrv);
+    if (!d) return STA_NOINIT;
+    if (d->packed) return drive_status(d);
+    LOCK(&d->lock);
+    long long file_size = file_size64(d->fp);
+    if (file_size >= 0) d->total_sectors = (LBA_t)(file_size / SECTOR_SIZE);
+    UNLOCK(&d->lock);
+    return file_size >= 0 ? RES_OK : STA_NOINIT;
 }
 
 // 获取磁盘状态
 DSTATUS disk_status(BYTE pdrv) {
-    (void)pdrv;
-    return (vdisk_fp != NULL) ? RES_OK : STA_NOINIT;
+    vdisk_t* d = get_drive(pdrv);
+    return d ? drive_status(d) : STA_NOINIT;
 }
 
-// 读取扇区
-DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
-    (void)pdrv;
-    if (!vdisk_fp) return RES_NOTRDY;
+#if FF_USE_STATS
+// 当前时间(纳秒)
+static QWORD stat_clock(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (QWORD)ts.tv_sec * 1000000000u + (QWORD)ts.tv_nsec;
+}
+
+// 按耗时的微秒数量级计入延迟直方图
+static void stat_latency(QWORD* hist, QWORD t0) {
+    QWORD us = (stat_clock() - t0) / 1000;
+    int bucket = 0;
+    while (us && bucket < FF_STAT_NLAT - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    hist[bucket]++;
+}
+#endif
+
+#ifndef _WIN32
+// 按扇区偏移整段读写(pread/pwrite)，不使用也不移动fp的文件位置，无需加锁
+static DRESULT pio_full(vdisk_t* d, int write, BYTE* buff, LBA_t sector, UINT count) {
+    int fd = fileno(d->fp);
+    off_t off = (off_t)sector * SECTOR_SIZE;
+    size_t left = (size_t)count * SECTOR_SIZE;
+    while (left) {
+        ssize_t n = write ? pwrite(fd, buff, left, off) : pread(fd, buff, left, off);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return RES_ERROR;  // 读到文件末尾或I/O错误
+        }
+        buff += n;
+        off += n;
+        left -= (size_t)n;
+    }
+    return RES_OK;
+}
+#endif
+
+// 有共享状态需要保护时返回非0：延迟写回缓存、增量文件、解压缓存，以及Windows下依赖文件位置的fseek+fread/fwrite
+static int port_shared(const vdisk_t* d) {
+#ifdef _WIN32
+    (void)d;
+    return 1;
+#else
+    return d->overlay != NULL || d->writeback != NULL || d->packed != NULL;
+#endif
+}
+
+// 从基础镜像(镜像文件或压缩镜像)读取扇区
+static DRESULT base_read(void* ctx, BYTE* buff, LBA_t sector, UINT count) {
+    vdisk_t* d = (vdisk_t*)ctx;
+    if (d->packed) return packed_read(d->packed, buff, sector, count) == 0 ? RES_OK : RES_ERROR;
+#ifndef _WIN32
+    return pio_full(d, 0, buff, sector, count);
+#endif
 
     // 定位到扇区位置
-    if (fseek(vdisk_fp, sector * SECTOR_SIZE, SEEK_SET) != 0) {
+    if (seek_sector(d->fp, sector) != 0) {
         return RES_ERROR;
     }
 
     // 读取count个扇区
-    if (fread(buff, SECTOR_SIZE, count, vdisk_fp) != count) {
+    if (fread(buff, SECTOR_SIZE, count, d->fp) != count) {
         return RES_ERROR;
     }
 
     return RES_OK;
 }
 
+// 读取扇区
+static DRESULT file_read(vdisk_t* d, BYTE* buff, LBA_t sector, UINT count) {
+    if (d->overlay) return overlay_read(d->overlay, base_read, d, buff, sector, count) == 0 ? RES_OK : RES_ERROR;
+    return base_read(d, buff, sector, count);
+}
+
 // 写入扇区
-DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
-    (void)pdrv;
-    if (!vdisk_fp) return RES_NOTRDY;
+static DRESULT file_write(void* ctx, const BYTE* buff, LBA_t sector, UINT count) {
+    vdisk_t* d = (vdisk_t*)ctx;
+    if (d->overlay) return overlay_write(d->overlay, buff, sector, count) == 0 ? RES_OK : RES_ERROR;
+    if (d->packed) return RES_WRPRT;
+#ifndef _WIN32
+    return pio_full(d, 1, (BYTE*)buff, sector, count);
+#endif
 
     // 定位到扇区位置
-    if (fseek(vdisk_fp, sector * SECTOR_SIZE, SEEK_SET) != 0) {
+    if (seek_sector(d->fp, sector) != 0) {
         return RES_ERROR;
     }
 
     // 写入count个扇区
-    if (fwrite(buff, SECTOR_SIZE, count, vdisk_fp) != count) {
+    if (fwrite(buff, SECTOR_SIZE, count, d->fp) != count) {
         return RES_ERROR;
     }
 
     return RES_OK;
 }
 
+// 读取扇区，延迟写回缓存中尚未落盘的扇区覆盖读出的数据
+static DRESULT cached_read(vdisk_t* d, BYTE* buff, LBA_t sector, UINT count) {
+    DRESULT res = file_read(d, buff, sector, count);
+    if (res == RES_OK && d->writeback) writeback_read(d->writeback, buff, sector, count);
+    return res;
+}
+
+// 写回缓存中的扇区，之后再为等待中的区间打洞
+static DRESULT writeback_sync(vdisk_t* d) {
+    d->writeback_time = time(NULL);
+    if (writeback_flush(d->writeback) < 0) return RES_ERROR;
+    trim_punch(d);
+    return RES_OK;
+}
+
+// 写入扇区，启用延迟写回时小块写入进入缓存，大块写入(文件数据)直接落盘
+static DRESULT cached_write(vdisk_t* d, const BYTE* buff, LBA_t sector, UINT count) {
+    if (!d->writeback) return file_write(d, buff, sector, count);
+    trim_cancel(d, sector, sector + count - 1);
+    if (count >= WRITEBACK_DIRECT) {
+        writeback_discard(d->writeback, sector, sector + count - 1);
+        return file_write(d, buff, sector, count);
+    }
+    if (writeback_write(d->writeback, buff, sector, count) != 0) return RES_ERROR;
+    if (d->writeback_interval > 0 && time(NULL) - d->writeback_time >= d->writeback_interval) return writeback_sync(d);
+    return RES_OK;
+}
+
+static DRESULT locked_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+    vdisk_t* d = get_drive(pdrv);
+    if (!d) return RES_NOTRDY;
+    if (!port_shared(d)) return cached_read(d, buff, sector, count);
+    LOCK(&d->lock);
+    DRESULT res = cached_read(d, buff, sector, count);
+    UNLOCK(&d->lock);
+    return res;
+}
+
+static DRESULT locked_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
+    vdisk_t* d = get_drive(pdrv);
+    if (!d) return RES_NOTRDY;
+    if (!port_shared(d)) return cached_write(d, buff, sector, count);
+    LOCK(&d->lock);
+    DRESULT res = cached_write(d, buff, sector, count);
+    UNLOCK(&d->lock);
+    return res;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+    FF_TRACE("disk_read", 'B', sector, count);
+#if FF_USE_STATS
+    QWORD t0 = stat_clock();
+    DRESULT res = locked_read(pdrv, buff, sector, count);
+    stat_latency(FfStats.rd_lat, t0);
+    FF_STAT_INC(rd_calls);
+    FF_STAT_ADD(rd_sects, count);
+    FF_STAT_ADD(rd_bytes, (QWORD)count * SECTOR_SIZE);
+#else
+    DRESULT res = locked_read(pdrv, buff, sector, count);
+#endif
+    FF_TRACE("disk_read", 'E', res, 0);
+    return res;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
+    FF_TRACE("disk_write", 'B', sector, count);
+#if FF_USE_STATS
+    QWORD t0 = stat_clock();
+    DRESULT res = locked_write(pdrv, buff, sector, count);
+    stat_latency(FfStats.wr_lat, t0);
+    FF_STAT_INC(wr_calls);
+    FF_STAT_ADD(wr_sects, count);
+    FF_STAT_ADD(wr_bytes, (QWORD)count * SECTOR_SIZE);
+#else
+    DRESULT res = locked_write(pdrv, buff, sector, count);
+#endif
+    FF_TRACE("disk_write", 'E', res, 0);
+    return res;
+}
+
+// 在镜像文件的扇区区间 [range[0], range[1]] 上打洞，成功后该区间读回全零
+static DRESULT punch_hole(vdisk_t* d, const LBA_t* range) {
+    if (range[1] < range[0]) return RES_PARERR;
+#ifdef __linux__
+    // 先冲刷stdio缓冲，避免尚未落盘的旧数据在打洞后又被写回
+    if (fflush(d->fp) != 0) return RES_ERROR;
+    off_t offset = (off_t)range[0] * SECTOR_SIZE;
+    off_t length = (off_t)(range[1] - range[0] + 1) * SECTOR_SIZE;
+    if (fallocate(fileno(d->fp), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) {
+        return RES_OK;
+    }
+    if (fallocate(fileno(d->fp), FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, offset, length) == 0) {
+        return RES_OK;
+    }
+#endif
+    return RES_ERROR;
+}
+
+// 延迟写回模式下释放这些簇的FAT和目录项修改可能还在缓存中，立即打洞后进程崩溃会留下指向全零数据的
+// 目录项，所以先记下区间，等到下一次冲刷之后再打洞。记录失败时放弃这次打洞，数据仍然有效
+static void trim_queue(vdisk_t* d, const LBA_t* range) {
+    if (range[1] < range[0]) return;
+    if (d->n_trims == TRIM_QUEUE_MAX && writeback_sync(d) != RES_OK) return;
+    if (!d->trims) {
+        d->trims = (LBA_t*)malloc(TRIM_QUEUE_MAX * 2 * sizeof(LBA_t));
+        if (!d->trims) return;
+    }
+    d->trims[d->n_trims * 2]     = range[0];
+    d->trims[d->n_trims * 2 + 1] = range[1];
+    d->n_trims++;
+}
+
+// 等待打洞的扇区又被写入时(簇被重新分配)，从区间中去掉这些扇区，避免冲刷后打洞清掉新数据
+static void trim_cancel(vdisk_t* d, LBA_t start, LBA_t end) {
+    for (int i = 0; i < d->n_trims; i++) {
+        LBA_t* r = d->trims + i * 2;
+        if (end < r[0] || start > r[1]) continue;
+        if (start > r[0] && end < r[1]) {  // 写入位于区间中间，拆成两段
+            LBA_t range[2] = {end + 1, r[1]};
+            r[1] = start - 1;
+            trim_queue(d, range);  // 队列已满时先冲刷并打洞，其余区间随之清空
+            continue;
+        }
+        if (start <= r[0] && end >= r[1]) {  // 整个区间被覆盖
+            r[0] = d->trims[(d->n_trims - 1) * 2];
+            r[1] = d->trims[(d->n_trims - 1) * 2 + 1];
+            d->n_trims--;
+            i--;
+            continue;
+        }
+        if (start <= r[0]) {
+            r[0] = end + 1;
+        } else {
+            r[1] = start - 1;
+        }
+    }
+}
+
+static void trim_punch(vdisk_t* d) {
+    for (int i = 0; i < d->n_trims; i++) {
+        punch_hole(d, d->trims + i * 2);
+    }
+    d->n_trims = 0;
+}
+
 // 控制操作
-DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
-    (void)pdrv;  // 忽略驱动器号（本项目只有一个虚拟磁盘）
+static DRESULT file_ioctl(vdisk_t* d, BYTE cmd, void* buff) {
     switch (cmd) {
         case CTRL_SYNC:
             // 功能：完成待处理的写操作
-            fflush(vdisk_fp);
+            // 延迟写回模式下只在到达冲刷间隔时写回，其余写入留到CTRL_FLUSH
+            if (d->writeback &&
+                (d->writeback_interval == 0 || time(NULL) - d->writeback_time < d->writeback_interval)) {
+                return RES_OK;
+            }
+            /* fall through */
+
+        case CTRL_FLUSH:
+            // 功能：写回延迟写回缓存中的所有扇区并完成待处理的写操作(sync命令和卸载时使用)
+            if (d->writeback && writeback_sync(d) != RES_OK) return RES_ERROR;
+            if (d->overlay) return overlay_sync(d->overlay) == 0 ? RES_OK : RES_ERROR;
+            if (d->fp) fflush(d->fp);
             return RES_OK;
 
         case GET_SECTOR_COUNT:
-            // 功能：获取总扇区数（格式化必需）
-            *(DWORD*)buff = total_sectors;
+            // 功能：获取总扇区数（格式化必需），FF_LBA64 == 1时为64位
+            *(LBA_t*)buff = d->total_sectors;
             return RES_OK;
 
         case GET_SECTOR_SIZE:
@@ -98,8 +535,24 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
             return RES_OK;
 
         case CTRL_TRIM:
-            // 功能：通知设备指定扇区数据不再使用（虚拟文件无需实际擦除，返回成功）
+            // 功能：通知设备指定扇区数据不再使用（buff为起止扇区号 [start, end]）
+            // 在镜像文件上打洞释放宿主机磁盘空间；文件系统不支持打洞时忽略，数据仍然有效
             // 注：仅当FF_USE_TRIM == 1时FatFs才会调用
+            if (d->writeback) writeback_discard(d->writeback, ((LBA_t*)buff)[0], ((LBA_t*)buff)[1]);
+            if (!d->fp || d->overlay) return RES_OK;  // 覆盖层模式下基础镜像只读，忽略
+            if (d->writeback) {
+                trim_queue(d, (LBA_t*)buff);
+            } else {
+                punch_hole(d, (LBA_t*)buff);
+            }
+            return RES_OK;
+
+        case CTRL_ZERO:
+            // 功能：将指定扇区 [start, end] 清零而不传输数据（f_mkfs清零FAT和根目录时使用）
+            // 打洞后读回即为全零，且镜像保持稀疏；失败时由FatFs回退为写零
+            if (d->overlay || d->packed) return RES_ERROR;  // 覆盖层中没有空洞可打，由FatFs写零
+            if (punch_hole(d, (LBA_t*)buff) != RES_OK) return RES_ERROR;
+            if (d->writeback) writeback_discard(d->writeback, ((LBA_t*)buff)[0], ((LBA_t*)buff)[1]);
             return RES_OK;
 
         case CTRL_POWER:
@@ -120,4 +573,30 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
         default:
             return RES_PARERR;  // 未支持的命令
     }
-}
\ No newline at end of file
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
+    FF_TRACE("disk_ioctl", 'B', cmd, 0);
+    vdisk_t* d = get_drive(pdrv);
+    DRESULT res = RES_NOTRDY;
+    if (d) {
+        LOCK(&d->lock);
+        res = file_ioctl(d, cmd, buff);
+        UNLOCK(&d->lock);
+    }
+    FF_TRACE("disk_ioctl", 'E', res, 0);
+    return res;
+}
+
+DRESULT vdisk_detach(BYTE pdrv) {
+    LOCK(&drives_lock);
+    vdisk_t* d = get_drive(pdrv);
+    if (d) drives[pdrv] = NULL;
+    UNLOCK(&drives_lock);
+    if (!d) return RES_PARERR;
+
+    stop_flusher(d);
+    DRESULT res = file_ioctl(d, CTRL_FLUSH, NULL);
+    close_drive(d);
+    return res;
+}
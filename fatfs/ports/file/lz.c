@@ -0,0 +1,137 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_HASH_BITS 14  // 哈希表16K项，每项为最近一次出现该4字节序列的位置
+
+static DWORD read32(const BYTE* p) {
+    DWORD v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static DWORD hash32(DWORD v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 从ip开始与ref比较，返回相同的字节数(不超过limit)，先按8字节比较
+static size_t match_length(const BYTE* src, size_t ref, size_t ip, size_t limit) {
+    size_t len = 0;
+    while (len + 8 <= limit) {
+        QWORD a, b;
+        memcpy(&a, src + ref + len, 8);
+        memcpy(&b, src + ip + len, 8);
+        if (a != b) break;
+        len += 8;
+    }
+    while (len < limit && src[ref + len] == src[ip + len]) len++;
+    return len;
+}
+
+static BYTE* put_len(BYTE* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (BYTE)len;
+    return op;
+}
+
+// 输出一个序列(mlen为0时只有字面量)，空间不够时返回NULL
+static BYTE* put_seq(BYTE* op, const BYTE* end, const BYTE* lit, size_t n_lit, size_t off, size_t mlen) {
+    // 最坏情况：标记、两个长度的扩展字节、字面量、偏移
+    size_t need = 1 + n_lit / 255 + 1 + n_lit + (mlen ? 2 + mlen / 255 + 1 : 0);
+    if ((size_t)(end - op) < need) return NULL;
+    BYTE* token = op++;
+    *token = (BYTE)((n_lit < 15 ? n_lit : 15) << 4);
+    if (n_lit >= 15) op = put_len(op, n_lit - 15);
+    memcpy(op, lit, n_lit);
+    op += n_lit;
+    if (mlen) {
+        size_t m = mlen - LZ_MIN_MATCH;
+        op[0] = (BYTE)off;
+        op[1] = (BYTE)(off >> 8);
+        op += 2;
+        *token |= (BYTE)(m < 15 ? m : 15);
+        if (m >= 15) op = put_len(op, m - 15);
+    }
+    return op;
+}
+
+size_t lz_compress(const BYTE* src, size_t n, BYTE* dst, size_t cap) {
+    DWORD table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    BYTE* op = dst;
+    const BYTE* end = dst + cap;
+    size_t ip = 0, anchor = 0;
+
+    while (ip + LZ_MIN_MATCH <= n) {
+        DWORD v = read32(src + ip);
+        DWORD h = hash32(v);
+        size_t ref = table[h];
+        table[h] = (DWORD)ip;
+        if (ref < ip && ip - ref <= LZ_MAX_OFFSET && read32(src + ref) == v) {
+            size_t len = LZ_MIN_MATCH + match_length(src, ref + LZ_MIN_MATCH, ip + LZ_MIN_MATCH, n - ip - LZ_MIN_MATCH);
+            op = put_seq(op, end, src + anchor, ip - anchor, ip - ref, len);
+            if (!op) return 0;
+            ip += len;
+            anchor = ip;
+            if (ip + 2 <= n) table[hash32(read32(src + ip - 2))] = (DWORD)(ip - 2);
+        } else {
+            ip += 1 + ((ip - anchor) >> 6);  // 长时间找不到匹配时加大步长，很快略过不可压缩的数据
+        }
+    }
+    // 最后一个序列只有字面量(可以为0个)，解压时以此判断结束
+    op = put_seq(op, end, src + anchor, n - anchor, 0, 0);
+    if (!op || (size_t)(op - dst) >= cap) return 0;
+    return (size_t)(op - dst);
+}
+
+static int get_len(const BYTE** ip, const BYTE* iend, size_t* len) {
+    BYTE b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+// 复制匹配：[op - off, op) 已经输出，偏移小于长度时每次复制的长度随已输出的部分倍增
+static void copy_match(BYTE* op, size_t off, size_t len) {
+    const BYTE* m = op - off;
+    while (len) {
+        size_t n = (size_t)(op - m) < len ? (size_t)(op - m) : len;
+        memcpy(op, m, n);
+        op += n;
+        len -= n;
+    }
+}
+
+long lz_decompress(const BYTE* src, size_t n, BYTE* dst, size_t cap) {
+    const BYTE* ip = src;
+    const BYTE* iend = src + n;
+    BYTE* op = dst;
+    const BYTE* oend = dst + cap;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && get_len(&ip, iend, &lit) != 0) return -1;
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return -1;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == iend) break;  // 最后一个序列
+
+        if (iend - ip < 2) return -1;
+        size_t off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && get_len(&ip, iend, &len) != 0) return -1;
+        len += LZ_MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - dst) || (size_t)(oend - op) < len) return -1;
+        copy_match(op, off, len);
+        op += len;
+    }
+    return (long)(op - dst);
+}
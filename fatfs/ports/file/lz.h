@@ -0,0 +1,21 @@
+#ifndef FATFS_PORTS_FILE_LZ_H_
+#define FATFS_PORTS_FILE_LZ_H_
+
+#include <stddef.h>
+#include "ff.h"
+
+// 块压缩使用的LZ77压缩格式，没有外部依赖。压缩数据是一串序列，每个序列为：
+//   标记字节: 高4位为字面量长度，低4位为匹配长度-4，为15时后跟扩展长度字节(255表示继续)
+//   字面量
+//   匹配偏移(2字节小端，1-65535)，最后一个序列只有字面量，没有匹配
+// 匹配可以与输出重叠(偏移小于长度)，用于重复的短模式
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+// 压缩n字节，压缩结果不小于cap字节时返回0(调用者按未压缩存放)，否则返回压缩后的长度
+size_t lz_compress(const BYTE* src, size_t n, BYTE* dst, size_t cap);
+// 解压缩，数据损坏或输出超过cap时返回-1，否则返回解压后的长度
+long lz_decompress(const BYTE* src, size_t n, BYTE* dst, size_t cap);
+
+#endif  // FATFS_PORTS_FILE_LZ_H_
@@ -0,0 +1,271 @@
+#include "overlay.h"
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+#define OVERLAY_MAGIC "FFCOWv1"
+#define OVERLAY_HEADER_SIZE SECTOR_SIZE
+#define OVERLAY_RECORD_SIZE (8 + SECTOR_SIZE)
+#define OVERLAY_BATCH 64        // 一次追加写入的最大记录数
+#define INDEX_EMPTY ((LBA_t)-1)  // 索引空槽标记
+
+struct overlay_t {
+    FILE*  fp;
+    LBA_t  base_sectors;
+    DWORD  n_records;
+    LBA_t* keys;  // 开放寻址哈希表: 扇区号 -> 记录号
+    DWORD* vals;
+    DWORD  mask;
+    BYTE   batch[OVERLAY_BATCH * OVERLAY_RECORD_SIZE];
+};
+
+static void st_qword(BYTE* p, QWORD v) {
+    for (int i = 0; i < 8; i++) p[i] = (BYTE)(v >> (i * 8));
+}
+
+static QWORD ld_qword(const BYTE* p) {
+    QWORD v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static int seek_to(FILE* fp, QWORD offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static QWORD record_offset(DWORD rec) {
+    return OVERLAY_HEADER_SIZE + (QWORD)rec * OVERLAY_RECORD_SIZE;
+}
+
+static DWORD index_slot(const overlay_t* ovl, LBA_t sector) {
+    QWORD h = (QWORD)sector * 0x9E3779B97F4A7C15ULL;
+    return (DWORD)(h >> 32) & ovl->mask;
+}
+
+// 查找扇区对应的记录号，不存在时返回-1
+static long index_find(const overlay_t* ovl, LBA_t sector) {
+    for (DWORD i = index_slot(ovl, sector); ovl->keys[i] != INDEX_EMPTY; i = (i + 1) & ovl->mask) {
+        if (ovl->keys[i] == sector) return (long)ovl->vals[i];
+    }
+    return -1;
+}
+
+static int index_insert(overlay_t* ovl, LBA_t sector, DWORD rec);
+
+// 负载超过一半时容量翻倍并重新插入
+static int index_grow(overlay_t* ovl) {
+    LBA_t* old_keys = ovl->keys;
+    DWORD* old_vals = ovl->vals;
+    DWORD  old_cap  = ovl->keys ? ovl->mask + 1 : 0;
+    DWORD  cap      = old_cap ? old_cap * 2 : 1024;
+
+    ovl->keys = (LBA_t*)malloc(cap * sizeof(LBA_t));
+    ovl->vals = (DWORD*)malloc(cap * sizeof(DWORD));
+    if (!ovl->keys || !ovl->vals) {
+        free(ovl->keys);
+        free(ovl->vals);
+        ovl->keys = old_keys;
+        ovl->vals = old_vals;
+        return -1;
+    }
+    memset(ovl->keys, 0xFF, cap * sizeof(LBA_t));
+    ovl->mask = cap - 1;
+    for (DWORD i = 0; i < old_cap; i++) {
+        if (old_keys[i] != INDEX_EMPTY) index_insert(ovl, old_keys[i], old_vals[i]);
+    }
+    free(old_keys);
+    free(old_vals);
+    return 0;
+}
+
+static int index_insert(overlay_t* ovl, LBA_t sector, DWORD rec) {
+    DWORD i = index_slot(ovl, sector);
+    while (ovl->keys[i] != INDEX_EMPTY && ovl->keys[i] != sector) i = (i + 1) & ovl->mask;
+    ovl->keys[i] = sector;
+    ovl->vals[i] = rec;
+    return 0;
+}
+
+overlay_t* overlay_open(const char* path, LBA_t base_sectors) {
+    overlay_t* ovl = (overlay_t*)calloc(1, sizeof(overlay_t));
+    if (!ovl || index_grow(ovl) != 0) {
+        free(ovl);
+        return NULL;
+    }
+    ovl->base_sectors = base_sectors;
+
+    BYTE hdr[OVERLAY_HEADER_SIZE];
+    ovl->fp = fopen(path, "rb+");
+    if (!ovl->fp) {  // 新建增量文件
+        ovl->fp = fopen(path, "wb+");
+        if (!ovl->fp) goto fail;
+        memset(hdr, 0, sizeof(hdr));
+        memcpy(hdr, OVERLAY_MAGIC, sizeof(OVERLAY_MAGIC));
+        st_qword(hdr + 8, base_sectors);
+        if (fwrite(hdr, sizeof(hdr), 1, ovl->fp) != 1) goto fail;
+        return ovl;
+    }
+
+    if (fread(hdr, sizeof(hdr), 1, ovl->fp) != 1 || memcmp(hdr, OVERLAY_MAGIC, sizeof(OVERLAY_MAGIC)) != 0) {
+        fprintf(stderr, "无效的增量文件: %s\n", path);
+        goto fail;
+    }
+    if (ld_qword(hdr + 8) != base_sectors) {
+        fprintf(stderr, "增量文件与基础镜像大小不匹配: %s\n", path);
+        goto fail;
+    }
+
+    // 扫描记录重建索引，末尾不完整的记录(写入中断)被忽略并在下次追加时覆盖
+    BYTE rec[OVERLAY_RECORD_SIZE];
+    while (fread(rec, sizeof(rec), 1, ovl->fp) == 1) {
+        LBA_t sector = (LBA_t)ld_qword(rec);
+        if (sector >= base_sectors) {
+            fprintf(stderr, "增量文件已损坏: %s\n", path);
+            goto fail;
+        }
+        if (ovl->n_records >= (ovl->mask + 1) / 2 && index_grow(ovl) != 0) goto fail;
+        index_insert(ovl, sector, ovl->n_records++);
+    }
+    return ovl;
+
+fail:
+    overlay_close(ovl);
+    return NULL;
+}
+
+void overlay_close(overlay_t* ovl) {
+    if (!ovl) return;
+    if (ovl->fp) fclose(ovl->fp);
+    free(ovl->keys);
+    free(ovl->vals);
+    free(ovl);
+}
+
+DWORD overlay_count(const overlay_t* ovl) {
+    return ovl->n_records;
+}
+
+int overlay_read(overlay_t* ovl, overlay_base_fn base, void* ctx, BYTE* buff, LBA_t sector, UINT count) {
+    UINT i = 0;
+    while (i < count) {
+        long rec = index_find(ovl, sector + i);
+        if (rec >= 0) {
+            if (seek_to(ovl->fp, record_offset((DWORD)rec) + 8) != 0 ||
+                fread(buff + (size_t)i * SECTOR_SIZE, SECTOR_SIZE, 1, ovl->fp) != 1) {
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        // 连续不在覆盖层中的扇区一次从基础镜像读取
+        UINT n = 1;
+        while (i + n < count && index_find(ovl, sector + i + n) < 0) n++;
+        if (base(ctx, buff + (size_t)i * SECTOR_SIZE, sector + i, n) != RES_OK) return -1;
+        i += n;
+    }
+    return 0;
+}
+
+int overlay_write(overlay_t* ovl, const BYTE* buff, LBA_t sector, UINT count) {
+    UINT i = 0;
+    while (i < count) {
+        long rec = index_find(ovl, sector + i);
+        if (rec >= 0) {  // 已有记录，原地覆盖
+            if (seek_to(ovl->fp, record_offset((DWORD)rec) + 8) != 0 ||
+                fwrite(buff + (size_t)i * SECTOR_SIZE, SECTOR_SIZE, 1, ovl->fp) != 1) {
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        // 连续的新扇区打包后一次追加
+        UINT n = 0;
+        while (i + n < count && n < OVERLAY_BATCH && index_find(ovl, sector + i + n) < 0) {
+            BYTE* p = ovl->batch + (size_t)n * OVERLAY_RECORD_SIZE;
+            st_qword(p, sector + i + n);
+            memcpy(p + 8, buff + (size_t)(i + n) * SECTOR_SIZE, SECTOR_SIZE);
+            n++;
+        }
+        if (seek_to(ovl->fp, record_offset(ovl->n_records)) != 0 ||
+            fwrite(ovl->batch, OVERLAY_RECORD_SIZE, n, ovl->fp) != n) {
+            return -1;
+        }
+        for (UINT k = 0; k < n; k++) {
+            if (ovl->n_records >= (ovl->mask + 1) / 2 && index_grow(ovl) != 0) return -1;
+            index_insert(ovl, sector + i + k, ovl->n_records++);
+        }
+        i += n;
+    }
+    return 0;
+}
+
+int overlay_sync(overlay_t* ovl) {
+    return fflush(ovl->fp) == 0 ? 0 : -1;
+}
+
+typedef struct commit_entry_t {
+    LBA_t sector;
+    DWORD rec;
+} commit_entry_t;
+
+static int commit_entry_cmp(const void* a, const void* b) {
+    LBA_t sa = ((const commit_entry_t*)a)->sector;
+    LBA_t sb = ((const commit_entry_t*)b)->sector;
+    return sa < sb ? -1 : sa > sb;
+}
+
+long overlay_commit(const char* base_path, const char* overlay_path) {
+    FILE* base = fopen(base_path, "rb+");
+    if (!base) return -1;
+    if (seek_to(base, 0) != 0 || fseek(base, 0, SEEK_END) != 0) {
+        fclose(base);
+        return -1;
+    }
+#ifdef _WIN32
+    LBA_t base_sectors = (LBA_t)(_ftelli64(base) / SECTOR_SIZE);
+#else
+    LBA_t base_sectors = (LBA_t)(ftello(base) / SECTOR_SIZE);
+#endif
+
+    overlay_t* ovl = overlay_open(overlay_path, base_sectors);
+    if (!ovl) {
+        fclose(base);
+        return -1;
+    }
+
+    // 按扇区号排序后顺序写回，基础镜像上的写入尽量连续
+    long            ret     = -1;
+    commit_entry_t* entries = (commit_entry_t*)malloc((ovl->n_records ? ovl->n_records : 1) * sizeof(commit_entry_t));
+    if (entries) {
+        DWORD n = 0;
+        for (DWORD i = 0; i <= ovl->mask; i++) {
+            if (ovl->keys[i] != INDEX_EMPTY) {
+                entries[n].sector = ovl->keys[i];
+                entries[n].rec    = ovl->vals[i];
+                n++;
+            }
+        }
+        qsort(entries, n, sizeof(commit_entry_t), commit_entry_cmp);
+
+        BYTE data[SECTOR_SIZE];
+        ret = (long)n;
+        for (DWORD i = 0; i < n; i++) {
+            if (seek_to(ovl->fp, record_offset(entries[i].rec) + 8) != 0 ||
+                fread(data, SECTOR_SIZE, 1, ovl->fp) != 1 ||
+                seek_to(base, (QWORD)entries[i].sector * SECTOR_SIZE) != 0 ||
+                fwrite(data, SECTOR_SIZE, 1, base) != 1) {
+                ret = -1;
+                break;
+            }
+        }
+        free(entries);
+    }
+
+    overlay_close(ovl);
+    if (fclose(base) != 0) ret = -1;
+    return ret;
+}
@@ -0,0 +1,35 @@
+#ifndef FATFS_PORTS_FILE_OVERLAY_H_
+#define FATFS_PORTS_FILE_OVERLAY_H_
+
+#include <stdio.h>
+#include "ff.h"
+#include "diskio.h"
+
+// 写时复制(COW)覆盖层：基础镜像只读，写入的扇区记录在增量文件中
+//
+// 增量文件格式：
+//   [0, 512)          文件头: 魔数 "FFCOWv1\0"，基础镜像扇区数(8字节小端)
+//   512 + i * 520     第i条记录: 扇区号(8字节小端) + 512字节扇区数据
+// 每个扇区最多一条记录，再次写入时原地覆盖；打开时扫描记录重建 扇区号->记录 索引
+
+typedef struct overlay_t overlay_t;
+
+// 读取基础镜像使用的函数，ctx为overlay_read传入的参数
+typedef DRESULT (*overlay_base_fn)(void* ctx, BYTE* buff, LBA_t sector, UINT count);
+
+// 打开增量文件(不存在时创建)，base_sectors用于校验增量文件是否属于该基础镜像
+overlay_t* overlay_open(const char* path, LBA_t base_sectors);
+void       overlay_close(overlay_t* ovl);
+
+// 读写扇区：读取时优先使用覆盖层中的扇区，其余从只读的基础镜像读取
+int overlay_read(overlay_t* ovl, overlay_base_fn base, void* ctx, BYTE* buff, LBA_t sector, UINT count);
+int overlay_write(overlay_t* ovl, const BYTE* buff, LBA_t sector, UINT count);
+int overlay_sync(overlay_t* ovl);
+
+// 增量文件中已记录的扇区数
+DWORD overlay_count(const overlay_t* ovl);
+
+// 把增量文件中的扇区按扇区号顺序写回基础镜像，成功返回合并的扇区数，失败返回-1
+long overlay_commit(const char* base_path, const char* overlay_path);
+
+#endif  // FATFS_PORTS_FILE_OVERLAY_H_
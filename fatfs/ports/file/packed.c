@@ -0,0 +1,405 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* for SEEK_DATA/SEEK_HOLE */
+#endif
+#include "packed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "lz.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#define PACKED_MAGIC "FFPACKv1"
+#define PACKED_HEADER_SIZE 64
+#define SLOT_NONE ((DWORD)-1)
+#define BLOCK_NONE ((QWORD)-1)
+
+struct packed_t {
+    FILE*  fp;
+    DWORD  block_size;
+    QWORD  image_bytes;
+    QWORD  n_blocks;
+    QWORD* index;  // n_blocks+1个偏移
+    BYTE*  zbuf;   // 从文件读入的压缩数据
+    // 解压缓存：n_slots个块大小的槽，按使用顺序组成双向链表，head为最近使用，tail最先被替换
+    DWORD  n_slots;
+    DWORD  n_used;
+    BYTE*  slots;
+    QWORD* slot_block;  // 槽 -> 块号
+    DWORD* prev;
+    DWORD* next;
+    DWORD  head;
+    DWORD  tail;
+    DWORD* block_slot;  // 块号 -> 槽，不在缓存中为SLOT_NONE
+};
+
+static void st_dword(BYTE* p, DWORD v) {
+    for (int i = 0; i < 4; i++) p[i] = (BYTE)(v >> (i * 8));
+}
+
+static DWORD ld_dword(const BYTE* p) {
+    return (DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+static void st_qword(BYTE* p, QWORD v) {
+    for (int i = 0; i < 8; i++) p[i] = (BYTE)(v >> (i * 8));
+}
+
+static QWORD ld_qword(const BYTE* p) {
+    QWORD v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static int seek_to(FILE* fp, QWORD offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, (long long)offset, SEEK_SET);
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static long long file_size64(FILE* fp) {
+    if (fseek(fp, 0, SEEK_END) != 0) return -1;
+#ifdef _WIN32
+    return _ftelli64(fp);
+#else
+    return (long long)ftello(fp);
+#endif
+}
+
+// 从偏移处读取n字节；POSIX下使用pread，不依赖文件位置
+static int read_at(FILE* fp, QWORD offset, BYTE* buff, size_t n) {
+#ifdef _WIN32
+    return seek_to(fp, offset) == 0 && fread(buff, 1, n, fp) == n ? 0 : -1;
+#else
+    while (n) {
+        ssize_t r = pread(fileno(fp), buff, n, (off_t)offset);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        buff += r;
+        offset += (QWORD)r;
+        n -= (size_t)r;
+    }
+    return 0;
+#endif
+}
+
+static int valid_block_size(DWORD bs) {
+    return bs >= PACKED_BLOCK_MIN && bs <= PACKED_BLOCK_MAX && (bs & (bs - 1)) == 0;
+}
+
+// 块的字节数，最后一块可能不满
+static size_t block_bytes(const packed_t* pk, QWORD b) {
+    QWORD left = pk->image_bytes - b * pk->block_size;
+    return left < pk->block_size ? (size_t)left : pk->block_size;
+}
+
+static int is_zero(const BYTE* p, size_t n) {
+    QWORD acc = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        QWORD v;
+        memcpy(&v, p + i, 8);
+        acc |= v;
+        if (acc) return 0;
+    }
+    for (; i < n; i++) acc |= p[i];
+    return acc == 0;
+}
+
+int packed_probe(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    char magic[8];
+    int ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, PACKED_MAGIC, 8) == 0;
+    fclose(fp);
+    return ok;
+}
+
+void packed_close(packed_t* pk) {
+    if (!pk) return;
+    if (pk->fp) fclose(pk->fp);
+    free(pk->index);
+    free(pk->zbuf);
+    free(pk->slots);
+    free(pk->slot_block);
+    free(pk->prev);
+    free(pk->next);
+    free(pk->block_slot);
+    free(pk);
+}
+
+// 读取并检查文件头和索引
+static int load_index(packed_t* pk) {
+    BYTE hdr[PACKED_HEADER_SIZE];
+    if (read_at(pk->fp, 0, hdr, sizeof(hdr)) != 0 || memcmp(hdr, PACKED_MAGIC, 8) != 0) return -1;
+    pk->block_size = ld_dword(hdr + 8);
+    pk->image_bytes = ld_qword(hdr + 16);
+    pk->n_blocks = ld_qword(hdr + 24);
+    QWORD index_off = ld_qword(hdr + 32);
+    if (!valid_block_size(pk->block_size) || pk->image_bytes % SECTOR_SIZE != 0 ||
+        pk->n_blocks != (pk->image_bytes + pk->block_size - 1) / pk->block_size ||
+        pk->n_blocks >= SLOT_NONE) {
+        return -1;
+    }
+
+    size_t n = (size_t)pk->n_blocks + 1;
+    pk->index = (QWORD*)malloc(n * sizeof(QWORD));
+    if (!pk->index || read_at(pk->fp, index_off, (BYTE*)pk->index, n * sizeof(QWORD)) != 0) return -1;
+    for (size_t i = 0; i < n; i++) pk->index[i] = ld_qword((const BYTE*)&pk->index[i]);  // 原地转换字节序
+    if (pk->index[0] != PACKED_HEADER_SIZE || pk->index[n - 1] != index_off) return -1;
+    for (QWORD b = 0; b < pk->n_blocks; b++) {
+        if (pk->index[b + 1] < pk->index[b] || pk->index[b + 1] - pk->index[b] > block_bytes(pk, b)) return -1;
+    }
+    return 0;
+}
+
+packed_t* packed_open(const char* path, size_t cache_bytes) {
+    packed_t* pk = (packed_t*)calloc(1, sizeof(packed_t));
+    if (!pk) return NULL;
+    pk->fp = fopen(path, "rb");
+    if (!pk->fp || load_index(pk) != 0) {
+        packed_close(pk);
+        return NULL;
+    }
+
+    size_t slots = cache_bytes / pk->block_size;
+    if (slots < 1) slots = 1;
+    if (slots > pk->n_blocks) slots = pk->n_blocks ? (size_t)pk->n_blocks : 1;
+    pk->n_slots = (DWORD)slots;
+    pk->head = pk->tail = SLOT_NONE;
+    pk->zbuf = (BYTE*)malloc(pk->block_size);
+    pk->slots = (BYTE*)malloc(slots * pk->block_size);
+    pk->slot_block = (QWORD*)malloc(slots * sizeof(QWORD));
+    pk->prev = (DWORD*)malloc(slots * sizeof(DWORD));
+    pk->next = (DWORD*)malloc(slots * sizeof(DWORD));
+    pk->block_slot = (DWORD*)malloc(((size_t)pk->n_blocks + 1) * sizeof(DWORD));
+    if (!pk->zbuf || !pk->slots || !pk->slot_block || !pk->prev || !pk->next || !pk->block_slot) {
+        packed_close(pk);
+        return NULL;
+    }
+    memset(pk->block_slot, 0xFF, ((size_t)pk->n_blocks + 1) * sizeof(DWORD));
+    return pk;
+}
+
+LBA_t packed_sectors(const packed_t* pk) {
+    return (LBA_t)(pk->image_bytes / SECTOR_SIZE);
+}
+
+// 读出块b的数据(全零、未压缩或解压缩)到dst
+static int load_block(packed_t* pk, QWORD b, BYTE* dst) {
+    size_t n = block_bytes(pk, b);
+    size_t len = (size_t)(pk->index[b + 1] - pk->index[b]);
+    if (len == 0) {
+        memset(dst, 0, n);
+        return 0;
+    }
+    if (len == n) return read_at(pk->fp, pk->index[b], dst, n);
+    if (read_at(pk->fp, pk->index[b], pk->zbuf, len) != 0) return -1;
+    return lz_decompress(pk->zbuf, len, dst, n) == (long)n ? 0 : -1;
+}
+
+static void lru_unlink(packed_t* pk, DWORD s) {
+    if (pk->prev[s] != SLOT_NONE) pk->next[pk->prev[s]] = pk->next[s];
+    else pk->head = pk->next[s];
+    if (pk->next[s] != SLOT_NONE) pk->prev[pk->next[s]] = pk->prev[s];
+    else pk->tail = pk->prev[s];
+}
+
+static void lru_push(packed_t* pk, DWORD s) {
+    pk->prev[s] = SLOT_NONE;
+    pk->next[s] = pk->head;
+    if (pk->head != SLOT_NONE) pk->prev[pk->head] = s;
+    else pk->tail = s;
+    pk->head = s;
+}
+
+// 返回缓存中块b的数据，不在缓存中时解压到空闲槽或最久未使用的槽，失败返回NULL
+static const BYTE* cached_block(packed_t* pk, QWORD b) {
+    DWORD s = pk->block_slot[b];
+    if (s != SLOT_NONE) {
+        if (s != pk->head) {
+            lru_unlink(pk, s);
+            lru_push(pk, s);
+        }
+        return pk->slots + (size_t)s * pk->block_size;
+    }
+
+    if (pk->n_used < pk->n_slots) {
+        s = pk->n_used++;
+    } else {
+        s = pk->tail;
+        lru_unlink(pk, s);
+        if (pk->slot_block[s] != BLOCK_NONE) pk->block_slot[pk->slot_block[s]] = SLOT_NONE;
+    }
+    BYTE* data = pk->slots + (size_t)s * pk->block_size;
+    int ok = load_block(pk, b, data) == 0;
+    pk->slot_block[s] = ok ? b : BLOCK_NONE;
+    if (ok) pk->block_slot[b] = s;
+    lru_push(pk, s);
+    return ok ? data : NULL;
+}
+
+int packed_read(packed_t* pk, BYTE* buff, LBA_t sector, UINT count) {
+    QWORD off = (QWORD)sector * SECTOR_SIZE;
+    QWORD end = off + (QWORD)count * SECTOR_SIZE;
+    if (end > pk->image_bytes || end < off) return -1;
+
+    while (off < end) {
+        QWORD b = off / pk->block_size;
+        size_t boff = (size_t)(off % pk->block_size);
+        size_t bn = block_bytes(pk, b);
+        size_t n = (size_t)(end - off < bn - boff ? end - off : bn - boff);
+        if (pk->index[b + 1] == pk->index[b]) {
+            memset(buff, 0, n);  // 全零块不经过缓存
+        } else if (boff == 0 && n == bn && pk->block_slot[b] == SLOT_NONE) {
+            // 整块读取(通常是连续的文件数据)直接解压到buff，不挤占元数据所在块的缓存
+            if (load_block(pk, b, buff) != 0) return -1;
+        } else {
+            const BYTE* data = cached_block(pk, b);
+            if (!data) return -1;
+            memcpy(buff, data + boff, n);
+        }
+        buff += n;
+        off += n;
+    }
+    return 0;
+}
+
+#ifdef SEEK_DATA
+// 块 [off, end) 是否完全在稀疏文件的空洞中；[*data_start, *data_end) 为最近一次查到的数据区间
+static int in_hole(int fd, QWORD off, QWORD end, QWORD size, QWORD* data_start, QWORD* data_end) {
+    if (off >= *data_end) {
+        off_t d = lseek(fd, (off_t)off, SEEK_DATA);
+        if (d < 0) {
+            // ENXIO: off之后没有数据；其他错误(文件系统不支持)时按全部是数据处理
+            *data_start = errno == ENXIO ? size : off;
+            *data_end = size;
+        } else {
+            off_t h = lseek(fd, d, SEEK_HOLE);
+            *data_start = (QWORD)d;
+            *data_end = h < 0 ? size : (QWORD)h;
+        }
+    }
+    return *data_start >= end;
+}
+#endif
+
+int packed_pack(const char* src_path, const char* dst_path, DWORD block_size, packed_stats_t* st) {
+    memset(st, 0, sizeof(*st));
+    if (!valid_block_size(block_size)) return -1;
+    FILE* in = fopen(src_path, "rb");
+    if (!in) return -1;
+    long long size = file_size64(in);
+    FILE* out = size >= 0 ? fopen(dst_path, "wb") : NULL;
+    if (!out) {
+        fclose(in);
+        return -1;
+    }
+
+    QWORD image_bytes = (QWORD)size / SECTOR_SIZE * SECTOR_SIZE;
+    QWORD n_blocks = (image_bytes + block_size - 1) / block_size;
+    QWORD* index = (QWORD*)malloc(((size_t)n_blocks + 1) * sizeof(QWORD));
+    BYTE* raw = (BYTE*)malloc(block_size);
+    BYTE* z = (BYTE*)malloc(block_size);
+    BYTE hdr[PACKED_HEADER_SIZE] = {0};
+    int ret = index && raw && z && fwrite(hdr, 1, sizeof(hdr), out) == sizeof(hdr) ? 0 : -1;
+#ifdef SEEK_DATA
+    QWORD data_start = 0, data_end = 0;
+#endif
+
+    QWORD pos = PACKED_HEADER_SIZE;
+    for (QWORD b = 0; ret == 0 && b < n_blocks; b++) {
+        QWORD off = b * block_size;
+        size_t n = (size_t)(image_bytes - off < block_size ? image_bytes - off : block_size);
+        index[b] = pos;
+        int zero;
+#ifdef SEEK_DATA
+        if (in_hole(fileno(in), off, off + n, image_bytes, &data_start, &data_end)) {
+            zero = 1;  // 稀疏镜像中的空洞不读取
+        } else
+#endif
+        {
+            if (read_at(in, off, raw, n) != 0) {
+                ret = -1;
+                break;
+            }
+            zero = is_zero(raw, n);
+        }
+        if (zero) {
+            st->zero_blocks++;
+            continue;
+        }
+        size_t zn = lz_compress(raw, n, z, n);
+        if (!zn) st->raw_blocks++;
+        if (fwrite(zn ? z : raw, 1, zn ? zn : n, out) != (zn ? zn : n)) ret = -1;
+        pos += zn ? zn : n;
+    }
+
+    if (ret == 0) {
+        index[n_blocks] = pos;
+        for (size_t i = 0; i <= n_blocks; i++) st_qword((BYTE*)&index[i], index[i]);  // 原地转换为小端
+        memcpy(hdr, PACKED_MAGIC, 8);
+        st_dword(hdr + 8, block_size);
+        st_qword(hdr + 16, image_bytes);
+        st_qword(hdr + 24, n_blocks);
+        st_qword(hdr + 32, pos);
+        if (fwrite(index, sizeof(QWORD), (size_t)n_blocks + 1, out) != n_blocks + 1 || seek_to(out, 0) != 0 ||
+            fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr)) {
+            ret = -1;
+        }
+    }
+    if (fclose(out) != 0) ret = -1;
+    fclose(in);
+    free(index);
+    free(raw);
+    free(z);
+
+    st->image_bytes = image_bytes;
+    st->packed_bytes = pos + (n_blocks + 1) * sizeof(QWORD);
+    st->blocks = n_blocks;
+    return ret;
+}
+
+int packed_unpack(const char* src_path, const char* dst_path, packed_stats_t* st) {
+    memset(st, 0, sizeof(*st));
+    packed_t* pk = packed_open(src_path, 0);
+    if (!pk) return -1;
+    FILE* out = fopen(dst_path, "wb");
+    BYTE* buf = (BYTE*)malloc(pk->block_size);
+    int ret = out && buf ? 0 : -1;
+
+    QWORD pos = 0;  // out的文件位置
+    for (QWORD b = 0; ret == 0 && b < pk->n_blocks; b++) {
+        if (pk->index[b + 1] == pk->index[b]) {
+            st->zero_blocks++;  // 留作空洞
+            continue;
+        }
+        QWORD off = b * pk->block_size;
+        size_t n = block_bytes(pk, b);
+        if (pk->index[b + 1] - pk->index[b] == n) st->raw_blocks++;
+        if (load_block(pk, b, buf) != 0 || (pos != off && seek_to(out, off) != 0) || fwrite(buf, 1, n, out) != n) {
+            ret = -1;
+        }
+        pos = off + n;
+    }
+    // 末尾是空洞时在最后写入一个字节，使文件达到镜像的大小
+    if (ret == 0 && pos < pk->image_bytes &&
+        (seek_to(out, pk->image_bytes - 1) != 0 || fputc(0, out) == EOF)) {
+        ret = -1;
+    }
+    if (out && fclose(out) != 0) ret = -1;
+
+    st->image_bytes = pk->image_bytes;
+    st->packed_bytes = pk->index[pk->n_blocks] + (pk->n_blocks + 1) * sizeof(QWORD);
+    st->blocks = pk->n_blocks;
+    free(buf);
+    packed_close(pk);
+    return ret;
+}
@@ -0,0 +1,46 @@
+#ifndef FATFS_PORTS_FILE_PACKED_H_
+#define FATFS_PORTS_FILE_PACKED_H_
+
+#include <stddef.h>
+#include "ff.h"
+
+// 块压缩的只读镜像：镜像按固定大小的块分别压缩(lz.h)，可以随机访问任意扇区
+//
+// 文件格式：
+//   [0, 64)   文件头: 魔数 "FFPACKv1"，块大小(4字节小端)，保留(4字节)，镜像字节数(8字节小端)，
+//             块数(8字节小端)，索引偏移(8字节小端)
+//   64 ...    各块的数据依次存放
+//   索引      块数+1个偏移(8字节小端)，第i块的数据为 [off[i], off[i+1])：
+//             长度为0是全零块，等于块的大小是未压缩的块，其余为压缩数据
+// 读取时按需解压缩，解压后的块保存在LRU缓存中，同一块内的多次小读取只解压一次
+
+#define PACKED_BLOCK_MIN (4 * 1024)
+#define PACKED_BLOCK_MAX (1024 * 1024)
+#define PACKED_BLOCK_DEFAULT (64 * 1024)
+
+typedef struct packed_t packed_t;
+
+typedef struct packed_stats_t {
+    QWORD image_bytes;   // 镜像字节数
+    QWORD packed_bytes;  // 压缩镜像文件的字节数
+    QWORD blocks;
+    QWORD zero_blocks;   // 全零的块(不占空间)
+    QWORD raw_blocks;    // 压缩后没有变小、未压缩存放的块
+} packed_stats_t;
+
+// 文件是压缩镜像时返回1
+int packed_probe(const char* path);
+// 打开压缩镜像，cache_bytes为解压缓存的大小，失败返回NULL
+packed_t* packed_open(const char* path, size_t cache_bytes);
+void      packed_close(packed_t* pk);
+// 镜像的扇区数
+LBA_t packed_sectors(const packed_t* pk);
+// 读取扇区，失败(超出镜像或数据损坏)返回-1
+int packed_read(packed_t* pk, BYTE* buff, LBA_t sector, UINT count);
+
+// 把镜像文件压缩为压缩镜像(block_size为2的幂，PACKED_BLOCK_MIN-PACKED_BLOCK_MAX)，成功返回0
+int packed_pack(const char* src_path, const char* dst_path, DWORD block_size, packed_stats_t* st);
+// 把压缩镜像还原为镜像文件(全零的块留作稀疏空洞)，成功返回0
+int packed_unpack(const char* src_path, const char* dst_path, packed_stats_t* st);
+
+#endif  // FATFS_PORTS_FILE_PACKED_H_
@@ -0,0 +1,22 @@
+#ifndef FATFS_PORTS_FILE_VDISK_H_
+#define FATFS_PORTS_FILE_VDISK_H_
+
+#include "ff.h"
+#include "diskio.h"
+
+// 镜像文件作为FatFs的物理驱动器：每个打开的镜像占用一个驱动器号(pdrv)，拥有各自的文件、
+// 写时复制增量文件、延迟写回缓存和锁，不同驱动器之间没有共享状态，可以在不同线程中同时访问
+
+#define VDISK_MAX FF_VOLUMES  // 同时打开的镜像数上限，每个镜像至少要映射一个逻辑卷
+
+typedef struct vdisk_opts_t {
+    const char* overlay_path;  // 非NULL时为写时复制模式：镜像只读打开，所有写入进入该增量文件
+    long        writeback;     // 不小于0时启用延迟写回缓存，大于0时为定时冲刷的间隔秒数
+} vdisk_opts_t;
+
+// 打开镜像文件并分配驱动器号，opts为NULL时直接读写镜像，失败返回-1
+int vdisk_attach(const char* path, const vdisk_opts_t* opts);
+// 写回缓存并关闭驱动器，返回写回的结果
+DRESULT vdisk_detach(BYTE pdrv);
+
+#endif  // FATFS_PORTS_FILE_VDISK_H_
@@ -0,0 +1,189 @@
+#include "writeback.h"
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+#define WRITEBACK_RUN 256             // 冲刷时一次写入的最大扇区数
+#define SLOT_EMPTY ((DWORD)0xFFFFFFFF)  // 哈希表空槽标记
+#define SECTOR_NONE ((LBA_t)-1)        // 已丢弃的缓存扇区
+
+struct writeback_t {
+    writeback_write_fn write;
+    void*              ctx;    // write的第一个参数
+    DWORD              max;    // 最大缓存扇区数
+    DWORD              count;  // 已用的缓存扇区数(含已丢弃的)
+    DWORD              cap;    // sectors/data 已分配的容量
+    LBA_t*             sectors;  // 每个缓存扇区的扇区号
+    BYTE*              data;
+    DWORD*             slots;  // 开放寻址哈希表: 扇区号 -> 缓存扇区下标
+    DWORD              mask;
+};
+
+static DWORD hash_slot(const writeback_t* wb, LBA_t sector) {
+    QWORD h = (QWORD)sector * 0x9E3779B97F4A7C15ULL;
+    return (DWORD)(h >> 32) & wb->mask;
+}
+
+// 查找扇区对应的缓存下标，不存在时返回SLOT_EMPTY
+static DWORD cache_find(const writeback_t* wb, LBA_t sector) {
+    for (DWORD i = hash_slot(wb, sector); wb->slots[i] != SLOT_EMPTY; i = (i + 1) & wb->mask) {
+        if (wb->sectors[wb->slots[i]] == sector) return wb->slots[i];
+    }
+    return SLOT_EMPTY;
+}
+
+static void hash_insert(writeback_t* wb, LBA_t sector, DWORD idx) {
+    DWORD i = hash_slot(wb, sector);
+    while (wb->slots[i] != SLOT_EMPTY) i = (i + 1) & wb->mask;
+    wb->slots[i] = idx;
+}
+
+// 缓存数组容量翻倍，哈希表保持至少两倍于容量
+static int cache_grow(writeback_t* wb) {
+    DWORD cap = wb->cap ? wb->cap * 2 : 1024;
+    if (cap > wb->max) cap = wb->max;
+
+    LBA_t* sectors = (LBA_t*)realloc(wb->sectors, cap * sizeof(LBA_t));
+    if (!sectors) return -1;
+    wb->sectors = sectors;
+    BYTE* data = (BYTE*)realloc(wb->data, (size_t)cap * SECTOR_SIZE);
+    if (!data) return -1;
+    wb->data = data;
+
+    DWORD n_slots = 1;
+    while (n_slots < cap * 2) n_slots <<= 1;
+    if (!wb->slots || n_slots > wb->mask + 1) {
+        DWORD* slots = (DWORD*)malloc(n_slots * sizeof(DWORD));
+        if (!slots) return -1;
+        free(wb->slots);
+        wb->slots = slots;
+        wb->mask  = n_slots - 1;
+        memset(wb->slots, 0xFF, n_slots * sizeof(DWORD));
+        for (DWORD i = 0; i < wb->count; i++) hash_insert(wb, wb->sectors[i], i);
+    }
+    wb->cap = cap;
+    return 0;
+}
+
+writeback_t* writeback_open(DWORD max_sectors, writeback_write_fn write, void* ctx) {
+    writeback_t* wb = (writeback_t*)calloc(1, sizeof(writeback_t));
+    if (!wb) return NULL;
+    wb->write = write;
+    wb->ctx   = ctx;
+    wb->max   = max_sectors ? max_sectors : 1;
+    if (cache_grow(wb) != 0) {
+        writeback_close(wb);
+        return NULL;
+    }
+    return wb;
+}
+
+void writeback_close(writeback_t* wb) {
+    if (!wb) return;
+    free(wb->sectors);
+    free(wb->data);
+    free(wb->slots);
+    free(wb);
+}
+
+int writeback_write(writeback_t* wb, const BYTE* buff, LBA_t sector, UINT count) {
+    for (UINT n = 0; n < count; n++, sector++, buff += SECTOR_SIZE) {
+        DWORD idx = cache_find(wb, sector);
+        if (idx == SLOT_EMPTY) {
+            if (wb->count == wb->cap && (wb->cap == wb->max || cache_grow(wb) != 0)) {
+                if (writeback_flush(wb) < 0) return -1;  // 缓存已满，先落盘
+            }
+            idx               = wb->count++;
+            wb->sectors[idx] = sector;
+            hash_insert(wb, sector, idx);
+        }
+        memcpy(wb->data + (size_t)idx * SECTOR_SIZE, buff, SECTOR_SIZE);
+    }
+    return 0;
+}
+
+void writeback_read(const writeback_t* wb, BYTE* buff, LBA_t sector, UINT count) {
+    if (wb->count == 0) return;
+    for (UINT n = 0; n < count; n++) {
+        DWORD idx = cache_find(wb, sector + n);
+        if (idx != SLOT_EMPTY) memcpy(buff + (size_t)n * SECTOR_SIZE, wb->data + (size_t)idx * SECTOR_SIZE, SECTOR_SIZE);
+    }
+}
+
+void writeback_discard(writeback_t* wb, LBA_t start, LBA_t end) {
+    if (wb->count == 0 || end < start) return;
+    if (end - start >= wb->count) {  // 区间较大时遍历缓存
+        for (DWORD i = 0; i < wb->count; i++) {
+            if (wb->sectors[i] != SECTOR_NONE && wb->sectors[i] >= start && wb->sectors[i] <= end) {
+                wb->sectors[i] = SECTOR_NONE;
+            }
+        }
+        return;
+    }
+    for (LBA_t s = start; s <= end; s++) {
+        DWORD idx = cache_find(wb, s);
+        if (idx != SLOT_EMPTY) wb->sectors[idx] = SECTOR_NONE;  // 槽位保留，仍可作为探测链的一环
+    }
+}
+
+// 冲刷时排序用的 扇区号->缓存下标 对，比较函数不依赖全局状态，多个缓存可同时冲刷
+typedef struct flush_entry_t {
+    LBA_t sector;
+    DWORD idx;
+} flush_entry_t;
+
+static int cmp_entry(const void* a, const void* b) {
+    LBA_t x = ((const flush_entry_t*)a)->sector;
+    LBA_t y = ((const flush_entry_t*)b)->sector;
+    return (x > y) - (x < y);
+}
+
+long writeback_flush(writeback_t* wb) {
+    if (wb->count == 0) return 0;
+
+    flush_entry_t* order = (flush_entry_t*)malloc(wb->count * sizeof(flush_entry_t));
+    BYTE*  run   = (BYTE*)malloc((size_t)WRITEBACK_RUN * SECTOR_SIZE);
+    if (!order || !run) {
+        free(order);
+        free(run);
+        return -1;
+    }
+    DWORD n = 0;
+    for (DWORD i = 0; i < wb->count; i++) {
+        if (wb->sectors[i] != SECTOR_NONE) order[n++] = (flush_entry_t){wb->sectors[i], i};
+    }
+    qsort(order, n, sizeof(flush_entry_t), cmp_entry);
+
+    // 扇区号连续的缓存扇区合并为一次写入
+    long  written = 0;
+    DWORD i       = 0;
+    while (i < n) {
+        LBA_t start = order[i].sector;
+        UINT  k     = 0;
+        while (i < n && k < WRITEBACK_RUN && order[i].sector == start + k) {
+            memcpy(run + (size_t)k * SECTOR_SIZE, wb->data + (size_t)order[i].idx * SECTOR_SIZE, SECTOR_SIZE);
+            k++;
+            i++;
+        }
+        if (wb->write(wb->ctx, run, start, k) != RES_OK) {
+            written = -1;
+            break;
+        }
+        written += k;
+    }
+    free(order);
+    free(run);
+    if (written < 0) return -1;
+
+    wb->count = 0;
+    memset(wb->slots, 0xFF, (wb->mask + 1) * sizeof(DWORD));
+    return written;
+}
+
+DWORD writeback_count(const writeback_t* wb) {
+    DWORD n = 0;
+    for (DWORD i = 0; i < wb->count; i++) {
+        if (wb->sectors[i] != SECTOR_NONE) n++;
+    }
+    return n;
+}
@@ -0,0 +1,33 @@
+#ifndef FATFS_PORTS_FILE_WRITEBACK_H_
+#define FATFS_PORTS_FILE_WRITEBACK_H_
+
+#include "ff.h"
+#include "diskio.h"
+
+// 延迟写回缓存：小块写入的扇区先保存在内存中，同一扇区的多次写入(目录项、FAT、FSInfo)合并为一次，
+// 在显式冲刷、定时冲刷或缓存写满时按扇区号顺序合并为多扇区写入落盘。
+// 冲刷之前进程崩溃或断电会丢失缓存中的所有修改，镜像可能处于不一致状态。
+
+typedef struct writeback_t writeback_t;
+
+// 落盘使用的写函数，ctx为writeback_open传入的参数
+typedef DRESULT (*writeback_write_fn)(void* ctx, const BYTE* buff, LBA_t sector, UINT count);
+
+// max_sectors为缓存的最大扇区数，写满时自动冲刷
+writeback_t* writeback_open(DWORD max_sectors, writeback_write_fn write, void* ctx);
+// 丢弃缓存(调用前应先冲刷)
+void writeback_close(writeback_t* wb);
+
+// 写入扇区到缓存，缓存写满时先冲刷
+int writeback_write(writeback_t* wb, const BYTE* buff, LBA_t sector, UINT count);
+// 用缓存中的扇区覆盖已从下层读出的数据
+void writeback_read(const writeback_t* wb, BYTE* buff, LBA_t sector, UINT count);
+// 丢弃扇区区间 [start, end] 内的缓存，用于随后直接写入或打洞的区间
+void writeback_discard(writeback_t* wb, LBA_t start, LBA_t end);
+
+// 把缓存中的扇区按扇区号顺序写入下层并清空缓存，返回写入的扇区数，失败返回-1
+long writeback_flush(writeback_t* wb);
+// 缓存中的扇区数
+DWORD writeback_count(const writeback_t* wb);
+
+#endif  // FATFS_PORTS_FILE_WRITEBACK_H_
@@ -9,7 +9,14 @@ DWORD get_fattime(void) {
     struct tm *timeinfo;
 
     time(&rawtime);
-    timeinfo = localtime(&rawtime);
+#ifdef _WIN32
+    struct tm tmbuf;
+    localtime_s(&tmbuf, &rawtime);
+    timeinfo = &tmbuf;
+#else
+    struct tm tmbuf;
+    timeinfo = localtime_r(&rawtime, &tmbuf);  // 多个分区的工作线程会同时调用
+#endif
 
     return ((DWORD)(timeinfo->tm_year - 80) << 25) |
            ((DWORD)(timeinfo->tm_mon + 1) << 21) |
@@ -17,4 +24,13 @@ DWORD get_fattime(void) {
            ((DWORD)timeinfo->tm_hour << 11) |
            ((DWORD)timeinfo->tm_min << 5) |
            ((DWORD)timeinfo->tm_sec >> 1);
-}
\ No newline at end of file
+}
+
+#if FF_MULTI_PARTITION
+/**
+ * 逻辑卷到分区的映射表，pt为0时自动查找第一个可用分区，
+ * 由镜像句柄(src/image.c)在打开时设置：pd为镜像的驱动器号，pt为分区号；
+ * 每个句柄独占一个逻辑卷，只修改自己的表项
+ */
+PARTITION VolToPart[FF_VOLUMES] = {{0, 0}};
+#endif
@@ -0,0 +1,449 @@
+#include "checksum.h"
+#include <string.h>
+#include "ff.h"
+
+// ---------------------------------------------------------------- CRC32
+
+// 计算由FatFs的ff_crc32完成(切片查表，支持时使用PCLMULQDQ或ARMv8 CRC32指令)，这里只处理超过UINT的长度
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 0) {
+        UINT n = len < 0x40000000 ? (UINT)len : 0x40000000;
+        crc    = ff_crc32(crc, p, n);
+        p += n;
+        len -= n;
+    }
+    return crc;
+}
+
+// GF(2)上模CRC多项式的乘法(位反转表示，x^0为最高位)
+static uint32_t _crc_multmod(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+    }
+    return p;
+}
+
+// x^(2^n) mod P(x)
+static const uint32_t s_crc_x2n[32] = {
+    0x40000000, 0x20000000, 0x08000000, 0x00800000, 0x00008000, 0xEDB88320,
+    0xB1E6B092, 0xA06A2517, 0xED627DAE, 0x88D14467, 0xD7BBFE6A, 0xEC447F11,
+    0x8E7EA170, 0x6427800E, 0x4D47BAE0, 0x09FE548F, 0x83852D0F, 0x30362F1A,
+    0x7B5A9CC3, 0x31FEC169, 0x9FEC022A, 0x6C8DEDC4, 0x15D6874D, 0x5FDE7A4E,
+    0xBAD90E37, 0x2E4E5EEF, 0x4EABA214, 0xA8A472C0, 0x429A969E, 0x148D302A,
+    0xC40BA6D0, 0xC4E22C3C};
+
+uint32_t checksum_crc32_shift(uint64_t len)
+{
+    uint32_t p = 1u << 31;  // x^0
+    for (unsigned k = 3; len; len >>= 1, k++) {  // x^(8*len)
+        if (len & 1) {
+            p = _crc_multmod(s_crc_x2n[k & 31], p);
+        }
+    }
+    return p;
+}
+
+uint32_t checksum_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint32_t op)
+{
+    return _crc_multmod(op, crc_a) ^ crc_b;
+}
+
+// ---------------------------------------------------------------- SHA-256
+
+static const uint32_t s_sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t _ld_be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+#define SHA_CH(x, y, z) (((x) & ((y) ^ (z))) ^ (z))
+#define SHA_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA_S0(x) (ROR32(x, 2) ^ ROR32(x, 13) ^ ROR32(x, 22))
+#define SHA_S1(x) (ROR32(x, 6) ^ ROR32(x, 11) ^ ROR32(x, 25))
+#define SHA_G0(x) (ROR32(x, 7) ^ ROR32(x, 18) ^ ((x) >> 3))
+#define SHA_G1(x) (ROR32(x, 17) ^ ROR32(x, 19) ^ ((x) >> 10))
+
+// 一轮压缩，8个工作变量的角色轮换由调用方交换参数完成，避免每轮移动变量
+#define SHA_ROUND(a, b, c, d, e, f, g, h, i)                                \
+    do {                                                                   \
+        uint32_t t1 = h + SHA_S1(e) + SHA_CH(e, f, g) + s_sha256_k[i] + w[(i) & 15]; \
+        d += t1;                                                           \
+        h = t1 + SHA_S0(a) + SHA_MAJ(a, b, c);                             \
+    } while (0)
+
+// 消息扩展只保留最近16个字，原地更新
+#define SHA_EXPAND(i) \
+    (w[(i) & 15] += SHA_G1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + SHA_G0(w[((i) - 15) & 15]))
+
+// 处理连续的64字节分组
+static void _sha256_blocks(uint32_t st[8], const uint8_t *p, size_t n)
+{
+    uint32_t w[16];
+    for (; n; n--, p += 64) {
+        uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+        uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+        for (int i = 0; i < 16; i++) {
+            w[i] = _ld_be32(p + i * 4);
+        }
+        for (int i = 0; i < 64; i += 8) {
+            if (i >= 16) {
+                for (int j = i; j < i + 8; j++) {
+                    SHA_EXPAND(j);
+                }
+            }
+            SHA_ROUND(a, b, c, d, e, f, g, h, i);
+            SHA_ROUND(h, a, b, c, d, e, f, g, i + 1);
+            SHA_ROUND(g, h, a, b, c, d, e, f, i + 2);
+            SHA_ROUND(f, g, h, a, b, c, d, e, i + 3);
+            SHA_ROUND(e, f, g, h, a, b, c, d, i + 4);
+            SHA_ROUND(d, e, f, g, h, a, b, c, i + 5);
+            SHA_ROUND(c, d, e, f, g, h, a, b, i + 6);
+            SHA_ROUND(b, c, d, e, f, g, h, a, i + 7);
+        }
+        st[0] += a;
+        st[1] += b;
+        st[2] += c;
+        st[3] += d;
+        st[4] += e;
+        st[5] += f;
+        st[6] += g;
+        st[7] += h;
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <immintrin.h>
+
+// 用SHA扩展指令(SHA-NI)处理连续的64字节分组，每条sha256rnds2完成两轮
+__attribute__((target("sha,sse4.1"))) static void _sha256_blocks_ni(uint32_t st[8], const uint8_t *p,
+                                                                     size_t n)
+{
+    const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i       tmp  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&st[0]), 0xB1);  // CDAB
+    __m128i       s1   = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&st[4]), 0x1B);  // EFGH
+    __m128i       s0   = _mm_alignr_epi8(tmp, s1, 8);                                        // ABEF
+    s1                 = _mm_blend_epi16(s1, tmp, 0xF0);                                     // CDGH
+
+    for (; n; n--, p += 64) {
+        __m128i abef = s0, cdgh = s1, m[4], msg;
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                m[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + g * 16)), mask);
+            } else {  // m[g&3]依次为W[t-16..t-13]，其后三个为W[t-12..t-1]
+                __m128i x = _mm_sha256msg1_epu32(m[g & 3], m[(g + 1) & 3]);
+                x         = _mm_add_epi32(x, _mm_alignr_epi8(m[(g + 3) & 3], m[(g + 2) & 3], 4));
+                m[g & 3]  = _mm_sha256msg2_epu32(x, m[(g + 3) & 3]);
+            }
+            msg = _mm_add_epi32(m[g & 3], _mm_loadu_si128((const __m128i *)&s_sha256_k[g * 4]));
+            s1  = _mm_sha256rnds2_epu32(s1, s0, msg);
+            s0  = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1B);                                          // FEBA
+    s1  = _mm_shuffle_epi32(s1, 0xB1);                                          // DCHG
+    _mm_storeu_si128((__m128i *)&st[0], _mm_blend_epi16(tmp, s1, 0xF0));  // DCBA
+    _mm_storeu_si128((__m128i *)&st[4], _mm_alignr_epi8(s1, tmp, 8));     // HGFE
+}
+
+static int _sha256_ni_supported(void)
+{
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSSE3) || !(c & bit_SSE4_1)) {
+        return 0;
+    }
+    return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29));  // CPUID.7.0:EBX.SHA
+}
+#endif
+
+// 当前处理器上最快的分组函数，第一次初始化时选择
+static void (*s_sha256_blocks)(uint32_t st[8], const uint8_t *p, size_t n);
+
+static void _sha256_init(sha256_ctx_t *ctx)
+{
+    if (!s_sha256_blocks) {
+#ifdef bit_SSE4_1
+        s_sha256_blocks = _sha256_ni_supported() ? _sha256_blocks_ni : _sha256_blocks;
+#else
+        s_sha256_blocks = _sha256_blocks;
+#endif
+    }
+    static const uint32_t iv[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                   0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    memcpy(ctx->h, iv, sizeof(iv));
+    ctx->len = 0;
+}
+
+static void _sha256_update(sha256_ctx_t *ctx, const uint8_t *p, size_t len)
+{
+    size_t used = (size_t)(ctx->len % 64);
+    ctx->len += len;
+    if (used) {  // 先补满上次剩下的分组
+        size_t n = 64 - used < len ? 64 - used : len;
+        memcpy(ctx->buf + used, p, n);
+        p += n;
+        len -= n;
+        if (used + n < 64) {
+            return;
+        }
+        s_sha256_blocks(ctx->h, ctx->buf, 1);
+    }
+    s_sha256_blocks(ctx->h, p, len / 64);  // 整块直接处理，不经过缓冲
+    memcpy(ctx->buf, p + len / 64 * 64, len % 64);
+}
+
+static int _sha256_final(sha256_ctx_t *ctx, uint8_t out[32])
+{
+    uint64_t bits = ctx->len * 8;
+    size_t   used = (size_t)(ctx->len % 64);
+    ctx->buf[used++] = 0x80;
+    if (used > 56) {
+        memset(ctx->buf + used, 0, 64 - used);
+        s_sha256_blocks(ctx->h, ctx->buf, 1);
+        used = 0;
+    }
+    memset(ctx->buf + used, 0, 56 - used);
+    for (int i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    s_sha256_blocks(ctx->h, ctx->buf, 1);
+    for (int i = 0; i < 8; i++) {
+        out[i * 4]     = (uint8_t)(ctx->h[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(ctx->h[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(ctx->h[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)ctx->h[i];
+    }
+    return 32;
+}
+
+// ---------------------------------------------------------------- XXH64
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+#define ROL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static uint64_t _ld_le64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static uint64_t _xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_P2;
+    acc = ROL64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t _xxh64_merge(uint64_t acc, uint64_t v)
+{
+    acc ^= _xxh64_round(0, v);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+static void _xxh64_init(xxh64_ctx_t *ctx)
+{
+    ctx->v[0] = XXH_P1 + XXH_P2;
+    ctx->v[1] = XXH_P2;
+    ctx->v[2] = 0;
+    ctx->v[3] = 0 - XXH_P1;
+    ctx->len  = 0;
+}
+
+// 处理连续的32字节条带
+static void _xxh64_stripes(uint64_t v[4], const uint8_t *p, size_t n)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    for (; n; n--, p += 32) {
+        v0 = _xxh64_round(v0, _ld_le64(p));
+        v1 = _xxh64_round(v1, _ld_le64(p + 8));
+        v2 = _xxh64_round(v2, _ld_le64(p + 16));
+        v3 = _xxh64_round(v3, _ld_le64(p + 24));
+    }
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+}
+
+static void _xxh64_update(xxh64_ctx_t *ctx, const uint8_t *p, size_t len)
+{
+    size_t used = (size_t)(ctx->len % 32);
+    ctx->len += len;
+    if (used) {
+        size_t n = 32 - used < len ? 32 - used : len;
+        memcpy(ctx->buf + used, p, n);
+        p += n;
+        len -= n;
+        if (used + n < 32) {
+            return;
+        }
+        _xxh64_stripes(ctx->v, ctx->buf, 1);
+    }
+    _xxh64_stripes(ctx->v, p, len / 32);
+    memcpy(ctx->buf, p + len / 32 * 32, len % 32);
+}
+
+static uint64_t _xxh64_final(xxh64_ctx_t *ctx)
+{
+    uint64_t h;
+    if (ctx->len >= 32) {
+        h = ROL64(ctx->v[0], 1) + ROL64(ctx->v[1], 7) + ROL64(ctx->v[2], 12) + ROL64(ctx->v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = _xxh64_merge(h, ctx->v[i]);
+        }
+    } else {
+        h = XXH_P5;
+    }
+    h += ctx->len;
+
+    const uint8_t *p   = ctx->buf;
+    size_t         len = (size_t)(ctx->len % 32);
+    for (; len >= 8; len -= 8, p += 8) {
+        h ^= _xxh64_round(0, _ld_le64(p));
+        h = ROL64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (len >= 4) {
+        uint64_t k = (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+        h ^= k * XXH_P1;
+        h = ROL64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+        len -= 4;
+    }
+    for (; len; len--, p++) {
+        h ^= *p * XXH_P5;
+        h = ROL64(h, 11) * XXH_P1;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---------------------------------------------------------------- 通用接口
+
+static const char *s_names[CHECKSUM_ALG_COUNT] = {"crc32", "sha256", "xxh64"};
+static const char *s_tags[CHECKSUM_ALG_COUNT]  = {"CRC32", "SHA256", "XXH64"};
+
+int checksum_parse(const char *name)
+{
+    for (int i = 0; i < CHECKSUM_ALG_COUNT; i++) {
+        const char *a = s_names[i], *b = name;
+        while (*a && (*b | 0x20) == *a) {
+            a++;
+            b++;
+        }
+        if (!*a && !*b) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *checksum_name(checksum_alg_t alg)
+{
+    return s_names[alg];
+}
+
+const char *checksum_tag(checksum_alg_t alg)
+{
+    return s_tags[alg];
+}
+
+void checksum_init(checksum_t *ck, checksum_alg_t alg)
+{
+    ck->alg = alg;
+    switch (alg) {
+        case CHECKSUM_CRC32:
+            ck->u.crc = 0;
+            break;
+        case CHECKSUM_SHA256:
+            _sha256_init(&ck->u.sha);
+            break;
+        default:
+            _xxh64_init(&ck->u.xxh);
+            break;
+    }
+}
+
+void checksum_update(checksum_t *ck, const void *data, size_t len)
+{
+    switch (ck->alg) {
+        case CHECKSUM_CRC32:
+            ck->u.crc = checksum_crc32(ck->u.crc, data, len);
+            break;
+        case CHECKSUM_SHA256:
+            _sha256_update(&ck->u.sha, (const uint8_t *)data, len);
+            break;
+        default:
+            _xxh64_update(&ck->u.xxh, (const uint8_t *)data, len);
+            break;
+    }
+}
+
+int checksum_final(checksum_t *ck, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    uint8_t           out[32];
+    int               n;
+    switch (ck->alg) {
+        case CHECKSUM_CRC32:
+            n = 4;
+            for (int i = 0; i < 4; i++) {
+                out[i] = (uint8_t)(ck->u.crc >> (24 - i * 8));
+            }
+            break;
+        case CHECKSUM_SHA256:
+            n = _sha256_final(&ck->u.sha, out);
+            break;
+        default: {
+            uint64_t h = _xxh64_final(&ck->u.xxh);
+            n          = 8;
+            for (int i = 0; i < 8; i++) {
+                out[i] = (uint8_t)(h >> (56 - i * 8));
+            }
+            break;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        hex[i * 2]     = digits[out[i] >> 4];
+        hex[i * 2 + 1] = digits[out[i] & 0x0F];
+    }
+    hex[n * 2] = '\0';
+    return n * 2;
+}
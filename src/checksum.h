@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 文件内容校验和：CRC32(与zlib/7z/rhash相同的IEEE多项式)、SHA-256、XXH64(与xxhsum相同)
+
+typedef enum checksum_alg_t {
+    CHECKSUM_CRC32  = 0,
+    CHECKSUM_SHA256 = 1,
+    CHECKSUM_XXH64  = 2,
+    CHECKSUM_ALG_COUNT,
+} checksum_alg_t;
+
+#define CHECKSUM_HEX_MAX 65  // 最长的十六进制结果(SHA-256)加结尾的'\0'
+
+typedef struct sha256_ctx_t {
+    uint32_t h[8];
+    uint64_t len;  // 已输入的字节数
+    uint8_t  buf[64];
+} sha256_ctx_t;
+
+typedef struct xxh64_ctx_t {
+    uint64_t v[4];
+    uint64_t len;  // 已输入的字节数
+    uint8_t  buf[32];
+} xxh64_ctx_t;
+
+typedef struct checksum_t {
+    checksum_alg_t alg;
+    union {
+        uint32_t     crc;
+        sha256_ctx_t sha;
+        xxh64_ctx_t  xxh;
+    } u;
+} checksum_t;
+
+// 按名称(crc32、sha256、xxh64，不区分大小写)查找算法，未知时返回-1
+int checksum_parse(const char *name);
+// 算法名称(小写)，用于命令行和GNU格式清单的说明
+const char *checksum_name(checksum_alg_t alg);
+// BSD格式清单("SHA256 (path) = ...")中的算法标记
+const char *checksum_tag(checksum_alg_t alg);
+
+void checksum_init(checksum_t *ck, checksum_alg_t alg);
+void checksum_update(checksum_t *ck, const void *data, size_t len);
+// 结束计算并把结果写成小写十六进制字符串(至少CHECKSUM_HEX_MAX字节)，返回字符串长度
+int checksum_final(checksum_t *ck, char *hex);
+
+// 单独使用的CRC32：crc为之前的结果(第一次为0)
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t len);
+// 由前后两段数据各自的CRC32求整体的CRC32，op为checksum_crc32_shift(后一段的字节数)，长度相同时可以复用
+uint32_t checksum_crc32_shift(uint64_t len);
+uint32_t checksum_crc32_combine(uint32_t crc_a, uint32_t crc_b, uint32_t op);
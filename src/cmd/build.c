@@ -0,0 +1,1205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "diskio.h"
+#include "fferrno.h"
+#include "hostfs.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+#define STREAM_BUFFER_SIZE (4 * MB)  // 顺序写入数据区时的缓冲区大小
+#define FAT_WRITE_SECTORS 8192       // 每次写入FAT的最大扇区数
+#define MAX_DIR_ENTRIES 65536        // 一个目录最多容纳的32字节目录项数
+#define MAX_BUILD_TRIES 8            // 自动估算镜像大小时的最大重试次数
+
+// 目录项字段偏移
+#define DIR_Name 0
+#define DIR_Attr 11
+#define DIR_NTres 12
+#define DIR_CrtTime 14
+#define DIR_CrtDate 16
+#define DIR_LstAccDate 18
+#define DIR_FstClusHI 20
+#define DIR_ModTime 22
+#define DIR_ModDate 24
+#define DIR_FstClusLO 26
+#define DIR_FileSize 28
+#define LDIR_Ord 0
+#define LDIR_Attr 11
+#define LDIR_Type 12
+#define LDIR_Chksum 13
+#define LDIR_FstClusLO 26
+#define SZDIRE 32
+#define LLEF 0x40      // LFN最后一项的标志
+#define AM_LFN 0x0F    // LFN项的属性
+#define NS_BODY 0x08   // SFN主名为小写
+#define NS_EXT 0x10    // SFN扩展名为小写
+#define NAME_SKIP 0x01 // 该项被跳过(名称无效或重复)
+
+static const BYTE lfn_ofs[] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+
+typedef struct build_node_t {
+    char                 *name;       // 宿主机上的名称(UTF-8)
+    char                 *host_path;  // 宿主机上的完整路径
+    int                   is_dir;
+    unsigned long long    size;
+    DWORD                 fattime;
+    struct build_node_t  *parent;
+    struct build_node_t **children;
+    int                   n_children;
+    BYTE                  flags;
+    BYTE                  sfn[11];   // 8.3短文件名
+    BYTE                  ntres;     // 短文件名大小写标志
+    WCHAR                *lfn;       // 长文件名(UTF-16)，不需要时为NULL
+    int                   lfn_len;
+    DWORD                 n_ent;     // 在父目录中占用的目录项数
+    DWORD                 dir_ents;  // 目录自身包含的目录项数
+    DWORD                 sclust;    // 起始簇号(0表示未分配)
+    DWORD                 nclust;    // 占用的簇数
+} build_node_t;
+
+typedef struct build_cmd_args_t {
+    char*     img_name;
+    char*     src_dir;
+    size_t    img_size;
+    MKFS_PARM mkfs_parm;
+} build_cmd_args_t;
+
+const char* build_help_str =
+    "用法: build [选项]\n"
+    "从宿主机目录一次性构建带内容的虚拟磁盘镜像(顺序大块写入，不经过FatFs写路径)。\n\n"
+    "选项:\n"
+    "  -n, --name=名称    指定虚拟磁盘镜像的名称。(默认: disk.img)\n"
+    "  -d, --dir=目录     指定宿主机上的源目录。(必填)\n"
+    "  -s, --size=大小    指定虚拟磁盘镜像的大小(MB)。(默认: 按内容自动估算)\n"
+    "  -f, --fmt=类型     指定FAT类型 (FAT12, FAT16, FAT32, SFD，可用逗号组合；不支持exFAT)。\n"
+    "  --n-fat=数量       指定FAT表的数量 (0=默认)。\n"
+    "  --align=数值       指定数据区域的扇区对齐大小 (0=默认)。\n"
+    "  --n-root=数量      指定根目录的数量 (0=默认)。\n"
+    "  --au-size=大小     指定簇大小(字节) (0=默认)。\n"
+    "  -h, --help         显示此帮助信息。\n";
+
+static const build_cmd_args_t default_args = {
+    .img_name = "disk.img",
+    .src_dir  = NULL,
+    .img_size = 0,
+    .mkfs_parm =
+        {
+            .fmt     = FM_FAT | FM_FAT32,  // 内容较多时允许自动切换到FAT32
+            .n_fat   = 0,
+            .align   = 0,
+            .n_root  = 0,
+            .au_size = 0,
+        },
+};
+
+cmd_args_t cmd_parse_build_args(int argc, char** argv)
+{
+    build_cmd_args_t* args = (build_cmd_args_t*)calloc(1, sizeof(build_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"name", required_argument, 0, 'n'},
+                                           {"dir", required_argument, 0, 'd'},
+                                           {"size", required_argument, 0, 's'},  // MB
+                                           {"fmt", required_argument, 0, 'f'},
+                                           {"n-fat", required_argument, 0, 4},
+                                           {"align", required_argument, 0, 5},
+                                           {"n-root", required_argument, 0, 6},
+                                           {"au-size", required_argument, 0, 7},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "n:d:s:f:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'n':  // name
+                cmd_args_field_should_free(args, img_name, default_args);
+                args->img_name = strdup(optarg);
+                break;
+            case 'd':  // dir
+                cmd_args_field_should_free(args, src_dir, default_args);
+                args->src_dir = strdup(optarg);
+                break;
+            case 's':  // size
+                args->img_size = atoi(optarg);
+                break;
+            case 'f':  // fmt
+                // 直接生成的是FAT表，不支持exFAT的分配位图
+                if (cmd_parse_fmt(optarg, &args->mkfs_parm.fmt) != 0 ||
+                    !((args->mkfs_parm.fmt &= ~FM_EXFAT) & (FM_FAT | FM_FAT32))) {
+                    fprintf(stderr, "无效的FAT类型: %s\n", optarg);
+                    cmd_free_build_args(args);
+                    return NULL;
+                }
+                break;
+            case 4:  // n-fat
+                args->mkfs_parm.n_fat = atoi(optarg);
+                break;
+            case 5:  // align
+                args->mkfs_parm.align = atoi(optarg);
+                break;
+            case 6:  // n-root
+                args->mkfs_parm.n_root = atoi(optarg);
+                break;
+            case 7:  // au-size
+                args->mkfs_parm.au_size = atoll(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", build_help_str);
+                cmd_free_build_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_build_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->src_dir) {
+        fprintf(stderr, "必需参数: --dir=目录\n");
+        cmd_free_build_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_build_args(cmd_args_t arg)
+{
+    build_cmd_args_t* args = cmd_args_cast(arg, build_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_name, default_args);
+        cmd_args_field_should_free(args, src_dir, default_args);
+        free(args);
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/* 扫描宿主机目录树                                                          */
+/*--------------------------------------------------------------------------*/
+
+static void _free_tree(build_node_t* node)
+{
+    if (!node) {
+        return;
+    }
+    for (int i = 0; i < node->n_children; i++) {
+        _free_tree(node->children[i]);
+    }
+    free(node->children);
+    free(node->name);
+    free(node->host_path);
+    free(node->lfn);
+    free(node);
+}
+
+// 仅按ASCII忽略大小写比较，FAT目录中的名称匹配同样不区分大小写
+static int _name_casecmp(const char* a, const char* b)
+{
+    for (;; a++, b++) {
+        int ca = (*a >= 'a' && *a <= 'z') ? *a - 0x20 : (unsigned char)*a;
+        int cb = (*b >= 'a' && *b <= 'z') ? *b - 0x20 : (unsigned char)*b;
+        if (ca != cb || ca == 0) {
+            return ca - cb;
+        }
+    }
+}
+
+static int _node_cmp(const void* a, const void* b)
+{
+    const build_node_t* na = *(const build_node_t* const*)a;
+    const build_node_t* nb = *(const build_node_t* const*)b;
+    int                 r  = _name_casecmp(na->name, nb->name);
+    return r ? r : strcmp(na->name, nb->name);
+}
+
+static build_node_t* _new_node(build_node_t* parent, const char* name, const char* host_path)
+{
+    build_node_t* node = (build_node_t*)calloc(1, sizeof(build_node_t));
+    if (!node) {
+        return NULL;
+    }
+    node->parent    = parent;
+    node->name      = strdup(name);
+    node->host_path = strdup(host_path);
+    if (!node->name || !node->host_path) {
+        _free_tree(node);
+        return NULL;
+    }
+    return node;
+}
+
+static int _scan_tree(build_node_t* dir)
+{
+    hostfs_dir_t* hd = hostfs_opendir(dir->host_path);
+    if (!hd) {
+        fprintf(stderr, "无法打开宿主机目录: %s\n", dir->host_path);
+        return -1;
+    }
+
+    int         cap = 0;
+    int         ret = 0;
+    const char* name;
+    while ((name = hostfs_readdir(hd)) != NULL) {
+        size_t len  = strlen(dir->host_path) + strlen(name) + 2;
+        char*  path = (char*)malloc(len);
+        if (!path) {
+            ret = -1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir->host_path, name);
+
+        hostfs_stat_t st;
+        if (hostfs_stat(path, &st) != 0) {
+            fprintf(stderr, "跳过无法访问的宿主机路径: %s\n", path);
+            free(path);
+            continue;
+        }
+        if (!st.is_dir && st.size > 0xFFFFFFFFULL) {
+            fprintf(stderr, "跳过超过4GB的文件: %s\n", path);
+            free(path);
+            continue;
+        }
+
+        if (dir->n_children == cap) {
+            cap                   = cap ? cap * 2 : 16;
+            build_node_t** grown = (build_node_t**)realloc(dir->children, cap * sizeof(*grown));
+            if (!grown) {
+                free(path);
+                ret = -1;
+                break;
+            }
+            dir->children = grown;
+        }
+        build_node_t* node = _new_node(dir, name, path);
+        free(path);
+        if (!node) {
+            ret = -1;
+            break;
+        }
+        node->is_dir                       = st.is_dir;
+        node->size                         = st.is_dir ? 0 : st.size;
+        node->fattime                      = hostfs_to_fattime(st.mtime);
+        dir->children[dir->n_children++] = node;
+
+        if (node->is_dir && _scan_tree(node) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    hostfs_closedir(hd);
+
+    if (ret == 0 && dir->n_children > 1) {
+        qsort(dir->children, dir->n_children, sizeof(build_node_t*), _node_cmp);
+    }
+    return ret;
+}
+
+/*--------------------------------------------------------------------------*/
+/* 生成长短文件名                                                            */
+/*--------------------------------------------------------------------------*/
+
+// 将UTF-8名称解码为UTF-16，返回编码单元数，名称无效时返回-1
+static int _utf8_to_utf16(const char* s, WCHAR* out, int max)
+{
+    const unsigned char* p = (const unsigned char*)s;
+    int                  n = 0;
+    while (*p) {
+        DWORD uc;
+        int   extra;
+        if (*p < 0x80) {
+            uc    = *p++;
+            extra = 0;
+        } else if ((*p & 0xE0) == 0xC0) {
+            uc    = *p++ & 0x1F;
+            extra = 1;
+        } else if ((*p & 0xF0) == 0xE0) {
+            uc    = *p++ & 0x0F;
+            extra = 2;
+        } else if ((*p & 0xF8) == 0xF0) {
+            uc    = *p++ & 0x07;
+            extra = 3;
+        } else {
+            return -1;
+        }
+        while (extra--) {
+            if ((*p & 0xC0) != 0x80) {
+                return -1;
+            }
+            uc = uc << 6 | (*p++ & 0x3F);
+        }
+        if (uc >= 0x10000) {
+            if (uc > 0x10FFFF || n + 2 > max) {
+                return -1;
+            }
+            uc -= 0x10000;
+            out[n++] = (WCHAR)(0xD800 | (uc >> 10));
+            out[n++] = (WCHAR)(0xDC00 | (uc & 0x3FF));
+        } else {
+            if (n + 1 > max) {
+                return -1;
+            }
+            out[n++] = (WCHAR)uc;
+        }
+    }
+    return n;
+}
+
+// 按8.3规则转换一段名称(主名或扩展名)，返回是否有信息丢失，case_bits记录出现过的大小写
+static int _make_sfn_part(const WCHAR* src, int len, BYTE* dst, int max, BYTE* case_bits)
+{
+    int loss = 0, n = 0;
+    for (int i = 0; i < len; i++) {
+        WCHAR c = src[i];
+        if (c == ' ' || c == '.') {
+            loss = 1;
+            continue;
+        }
+        if (n == max) {
+            loss = 1;
+            break;
+        }
+        if (c >= 0x80 || strchr("+,;=[]", (int)c)) {
+            c    = '_';
+            loss = 1;
+        } else if (c >= 'a' && c <= 'z') {
+            c -= 0x20;
+            *case_bits |= 2;
+        } else if (c >= 'A' && c <= 'Z') {
+            *case_bits |= 1;
+        }
+        dst[n++] = (BYTE)c;
+    }
+    return loss;
+}
+
+// 为节点生成短文件名，需要长文件名时保存UTF-16名称。返回1表示短文件名需要编号(~N)
+static int _make_names(build_node_t* node)
+{
+    WCHAR lfn[FF_MAX_LFN + 1];
+    int   len = _utf8_to_utf16(node->name, lfn, FF_MAX_LFN);
+    if (len <= 0 || lfn[len - 1] == ' ' || lfn[len - 1] == '.') {
+        return -1;
+    }
+    for (int i = 0; i < len; i++) {
+        if (lfn[i] < 0x20 || (lfn[i] < 0x80 && strchr("\\/:*?\"<>|", (int)lfn[i]))) {
+            return -1;
+        }
+    }
+
+    int start = 0, dot = -1;
+    while (start < len && lfn[start] == '.') {
+        start++;
+    }
+    for (int i = len - 1; i > start; i--) {
+        if (lfn[i] == '.') {
+            dot = i;
+            break;
+        }
+    }
+
+    BYTE body_case = 0, ext_case = 0;
+    int  loss      = start > 0;
+    memset(node->sfn, ' ', sizeof(node->sfn));
+    loss |= _make_sfn_part(lfn + start, (dot < 0 ? len : dot) - start, node->sfn, 8, &body_case);
+    if (dot >= 0) {
+        loss |= _make_sfn_part(lfn + dot + 1, len - dot - 1, node->sfn + 8, 3, &ext_case);
+    }
+    if (node->sfn[0] == ' ') {
+        node->sfn[0] = '_';
+        loss         = 1;
+    }
+
+    if (!loss && body_case != 3 && ext_case != 3) {  // 合法的8.3名称，仅用大小写标志即可还原
+        node->ntres = (body_case == 2 ? NS_BODY : 0) | (ext_case == 2 ? NS_EXT : 0);
+        node->n_ent = 1;
+        return 0;
+    }
+
+    node->lfn = (WCHAR*)malloc(len * sizeof(WCHAR));
+    if (!node->lfn) {
+        return -1;
+    }
+    memcpy(node->lfn, lfn, len * sizeof(WCHAR));
+    node->lfn_len = len;
+    node->n_ent   = 1 + (len + 12) / 13;
+    return 1;
+}
+
+// 以11字节短文件名为键的开放寻址哈希表，用于检测冲突和记录编号进度
+typedef struct sfn_map_t {
+    BYTE (*keys)[11];
+    DWORD *vals;
+    BYTE  *used;
+    DWORD  mask;
+} sfn_map_t;
+
+static int _sfn_map_init(sfn_map_t* map, int n)
+{
+    DWORD cap = 16;
+    while (cap < (DWORD)n * 4) {
+        cap <<= 1;
+    }
+    map->keys = (BYTE(*)[11])malloc(cap * 11);
+    map->vals = (DWORD*)calloc(cap, sizeof(DWORD));
+    map->used = (BYTE*)calloc(cap, 1);
+    map->mask = cap - 1;
+    return (map->keys && map->vals && map->used) ? 0 : -1;
+}
+
+static void _sfn_map_free(sfn_map_t* map)
+{
+    free(map->keys);
+    free(map->vals);
+    free(map->used);
+}
+
+// 查找键，不存在时插入(值为0)，返回值槽位
+static DWORD* _sfn_map_get(sfn_map_t* map, const BYTE* key, int* inserted)
+{
+    DWORD h = 2166136261u;
+    for (int i = 0; i < 11; i++) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    for (h &= map->mask; map->used[h]; h = (h + 1) & map->mask) {
+        if (memcmp(map->keys[h], key, 11) == 0) {
+            *inserted = 0;
+            return &map->vals[h];
+        }
+    }
+    map->used[h] = 1;
+    memcpy(map->keys[h], key, 11);
+    *inserted = 1;
+    return &map->vals[h];
+}
+
+// 为目录中的所有子项分配互不冲突的短文件名，并统计目录项数
+static int _register_names(build_node_t* dir)
+{
+    sfn_map_t names, bases;  // 已占用的短文件名, 每个基础名已用到的编号
+    if (_sfn_map_init(&names, dir->n_children) != 0 || _sfn_map_init(&bases, dir->n_children) != 0) {
+        _sfn_map_free(&names);
+        _sfn_map_free(&bases);
+        return -1;
+    }
+
+    int* numbered = (int*)calloc(dir->n_children ? dir->n_children : 1, sizeof(int));
+    if (!numbered) {
+        _sfn_map_free(&names);
+        _sfn_map_free(&bases);
+        return -1;
+    }
+
+    // 第一遍: 合法的8.3名称原样占用；子项已按名称忽略大小写排序，重名必然相邻
+    int ret = 0, inserted;
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (i > 0 && _name_casecmp(dir->children[i - 1]->name, node->name) == 0) {
+            fprintf(stderr, "跳过仅大小写不同的重名项: %s\n", node->host_path);
+            node->flags |= NAME_SKIP;
+            continue;
+        }
+        int r = _make_names(node);
+        if (r < 0) {
+            fprintf(stderr, "跳过无效的文件名: %s\n", node->host_path);
+            node->flags |= NAME_SKIP;
+            continue;
+        }
+        numbered[i] = r;
+        if (!r) {
+            _sfn_map_get(&names, node->sfn, &inserted);
+            if (!inserted) {
+                fprintf(stderr, "跳过重名项: %s\n", node->host_path);
+                node->flags |= NAME_SKIP;
+            }
+        }
+    }
+
+    // 第二遍: 需要长文件名的项生成 "主名~N.扩展名"，从该基础名上次用到的编号继续，避免反复探测
+    for (int i = 0; i < dir->n_children && ret == 0; i++) {
+        build_node_t* node = dir->children[i];
+        if (!numbered[i] || (node->flags & NAME_SKIP)) {
+            continue;
+        }
+        BYTE   base[11];
+        DWORD* seq = _sfn_map_get(&bases, node->sfn, &inserted);
+        memcpy(base, node->sfn, sizeof(base));
+        for (;;) {
+            DWORD n = ++(*seq);
+            char  num[10];
+            int   nl = snprintf(num, sizeof(num), "~%lu", (unsigned long)n);
+            if (nl > 7) {
+                fprintf(stderr, "短文件名冲突过多: %s\n", node->host_path);
+                ret = -1;
+                break;
+            }
+            int bl = 0;
+            while (bl < 8 - nl && base[bl] != ' ') {
+                bl++;
+            }
+            memcpy(node->sfn, base, 8);
+            memset(node->sfn + bl, ' ', 8 - bl);
+            memcpy(node->sfn + bl, num, nl);
+            _sfn_map_get(&names, node->sfn, &inserted);
+            if (inserted) {
+                break;
+            }
+        }
+    }
+
+    free(numbered);
+    _sfn_map_free(&names);
+    _sfn_map_free(&bases);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // 统计目录项数，子目录递归处理
+    dir->dir_ents = dir->parent ? 2 : 0;  // "." 和 ".."
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (node->flags & NAME_SKIP) {
+            continue;
+        }
+        dir->dir_ents += node->n_ent;
+        if (node->is_dir && _register_names(node) != 0) {
+            return -1;
+        }
+    }
+    if (dir->dir_ents > MAX_DIR_ENTRIES) {  // 根目录也写入同样大小的目录缓冲区
+        fprintf(stderr, "目录项过多: %s\n", dir->host_path);
+        return -1;
+    }
+    return 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/* 布局计算                                                                  */
+/*--------------------------------------------------------------------------*/
+
+typedef struct build_layout_t {
+    build_node_t** order;  // 按簇号升序排列的已分配节点
+    size_t         n_order;
+    size_t         cap_order;
+    DWORD          next_clst;  // 下一个可分配的簇
+    DWORD          cl_bytes;   // 每簇字节数
+    unsigned int   n_dirs, n_files;
+    unsigned long long n_bytes;
+} build_layout_t;
+
+static int _layout_push(build_layout_t* lay, build_node_t* node, DWORD nclust)
+{
+    node->sclust = nclust ? lay->next_clst : 0;
+    node->nclust = nclust;
+    lay->next_clst += nclust;
+    if (!nclust) {
+        return 0;
+    }
+    if (lay->n_order == lay->cap_order) {
+        size_t         cap   = lay->cap_order ? lay->cap_order * 2 : 256;
+        build_node_t** grown = (build_node_t**)realloc(lay->order, cap * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        lay->order     = grown;
+        lay->cap_order = cap;
+    }
+    lay->order[lay->n_order++] = node;
+    return 0;
+}
+
+// 目录按广度优先连续分配在数据区开头，随后是按目录树顺序连续分配的文件数据
+static int _layout_dirs(build_layout_t* lay, build_node_t* dir)
+{
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if ((node->flags & NAME_SKIP) || !node->is_dir) {
+            continue;
+        }
+        DWORD bytes = node->dir_ents * SZDIRE;
+        if (_layout_push(lay, node, (bytes + lay->cl_bytes - 1) / lay->cl_bytes) != 0) {
+            return -1;
+        }
+        lay->n_dirs++;
+    }
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (!(node->flags & NAME_SKIP) && node->is_dir && _layout_dirs(lay, node) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int _layout_files(build_layout_t* lay, build_node_t* dir)
+{
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (node->flags & NAME_SKIP) {
+            continue;
+        }
+        if (node->is_dir) {
+            if (_layout_files(lay, node) != 0) {
+                return -1;
+            }
+        } else {
+            DWORD nclust = (DWORD)((node->size + lay->cl_bytes - 1) / lay->cl_bytes);
+            if (_layout_push(lay, node, nclust) != 0) {
+                return -1;
+            }
+            lay->n_files++;
+            lay->n_bytes += node->size;
+        }
+    }
+    return 0;
+}
+
+static int _compute_layout(build_layout_t* lay, build_node_t* root, FATFS* fs)
+{
+    free(lay->order);
+    memset(lay, 0, sizeof(*lay));
+    lay->cl_bytes  = (DWORD)fs->csize * SECTOR_SIZE;
+    lay->next_clst = 2;
+    if (fs->fs_type == FS_FAT32) {  // FAT32的根目录是从2号簇开始的簇链
+        DWORD bytes = root->dir_ents * SZDIRE;
+        DWORD n     = (bytes + lay->cl_bytes - 1) / lay->cl_bytes;
+        if (_layout_push(lay, root, n ? n : 1) != 0) {
+            return -1;
+        }
+    } else if (root->dir_ents > fs->n_rootdir) {
+        fprintf(stderr, "根目录项过多 (%lu > %u)\n", (unsigned long)root->dir_ents,
+                (unsigned int)fs->n_rootdir);
+        return -1;
+    }
+    if (_layout_dirs(lay, root) != 0 || _layout_files(lay, root) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 粗略估算镜像大小(字节)：按4KB簇估算数据量并预留FAT等元数据空间
+static unsigned long long _estimate_bytes(build_node_t* dir)
+{
+    unsigned long long total = ((unsigned long long)dir->dir_ents * SZDIRE + 4095) / 4096 * 4096;
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (node->flags & NAME_SKIP) {
+            continue;
+        }
+        total += node->is_dir ? _estimate_bytes(node) : (node->size + 4095) / 4096 * 4096;
+    }
+    return total;
+}
+
+/*--------------------------------------------------------------------------*/
+/* 写入                                                                      */
+/*--------------------------------------------------------------------------*/
+
+static void _st_16(BYTE* p, WORD v)
+{
+    p[0] = (BYTE)v;
+    p[1] = (BYTE)(v >> 8);
+}
+
+static void _st_32(BYTE* p, DWORD v)
+{
+    _st_16(p, (WORD)v);
+    _st_16(p + 2, (WORD)(v >> 16));
+}
+
+static void _fat_set(BYTE* fat, BYTE fs_type, DWORD clst, DWORD val)
+{
+    switch (fs_type) {
+        case FS_FAT12: {
+            BYTE* p = fat + clst + clst / 2;
+            if (clst & 1) {
+                p[0] = (BYTE)((p[0] & 0x0F) | (val << 4));
+                p[1] = (BYTE)(val >> 4);
+            } else {
+                p[0] = (BYTE)val;
+                p[1] = (BYTE)((p[1] & 0xF0) | ((val >> 8) & 0x0F));
+            }
+            break;
+        }
+        case FS_FAT16:
+            _st_16(fat + clst * 2, (WORD)val);
+            break;
+        default:
+            _st_32(fat + clst * 4, val);
+            break;
+    }
+}
+
+static BYTE _sum_sfn(const BYTE* sfn)
+{
+    BYTE sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (BYTE)((sum >> 1) + (sum << 7) + sfn[i]);
+    }
+    return sum;
+}
+
+static void _put_sfn_entry(BYTE* ent, const BYTE* sfn, BYTE attr, BYTE ntres, DWORD clst,
+                           DWORD size, DWORD fattime)
+{
+    memcpy(ent + DIR_Name, sfn, 11);
+    ent[DIR_Attr]  = attr;
+    ent[DIR_NTres] = ntres;
+    _st_16(ent + DIR_CrtTime, (WORD)fattime);
+    _st_16(ent + DIR_CrtDate, (WORD)(fattime >> 16));
+    _st_16(ent + DIR_LstAccDate, (WORD)(fattime >> 16));
+    _st_16(ent + DIR_FstClusHI, (WORD)(clst >> 16));
+    _st_16(ent + DIR_ModTime, (WORD)fattime);
+    _st_16(ent + DIR_ModDate, (WORD)(fattime >> 16));
+    _st_16(ent + DIR_FstClusLO, (WORD)clst);
+    _st_32(ent + DIR_FileSize, size);
+}
+
+// 填充目录内容，返回写入的字节数
+static size_t _fill_dir(BYTE* buf, build_node_t* dir)
+{
+    BYTE* p = buf;
+    if (dir->parent) {
+        static const BYTE dot[11]    = {'.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        static const BYTE dotdot[11] = {'.', '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        DWORD             pclst      = dir->parent->parent ? dir->parent->sclust : 0;
+        _put_sfn_entry(p, dot, AM_DIR, 0, dir->sclust, 0, dir->fattime);
+        _put_sfn_entry(p + SZDIRE, dotdot, AM_DIR, 0, pclst, 0, dir->fattime);
+        p += 2 * SZDIRE;
+    }
+    for (int i = 0; i < dir->n_children; i++) {
+        build_node_t* node = dir->children[i];
+        if (node->flags & NAME_SKIP) {
+            continue;
+        }
+        if (node->lfn) {  // 长文件名项逆序存放在短文件名项之前
+            BYTE sum = _sum_sfn(node->sfn);
+            int  n   = (node->lfn_len + 12) / 13;
+            for (int ord = n; ord >= 1; ord--, p += SZDIRE) {
+                p[LDIR_Ord]    = (BYTE)(ord | (ord == n ? LLEF : 0));
+                p[LDIR_Attr]   = AM_LFN;
+                p[LDIR_Type]   = 0;
+                p[LDIR_Chksum] = sum;
+                _st_16(p + LDIR_FstClusLO, 0);
+                for (int k = 0; k < 13; k++) {
+                    int   idx = (ord - 1) * 13 + k;
+                    WCHAR wc  = idx < node->lfn_len ? node->lfn[idx] : (idx == node->lfn_len ? 0 : 0xFFFF);
+                    _st_16(p + lfn_ofs[k], wc);
+                }
+            }
+        }
+        _put_sfn_entry(p, node->sfn, node->is_dir ? AM_DIR : AM_ARC, node->ntres, node->sclust,
+                       (DWORD)node->size, node->fattime);
+        p += SZDIRE;
+    }
+    return (size_t)(p - buf);
+}
+
+// 顺序写入数据区的缓冲写入器，buf[0] 对应扇区 sect
+typedef struct stream_writer_t {
+    BYTE   pdrv;
+    BYTE*  buf;
+    size_t cap;
+    LBA_t  sect;
+    size_t fill;
+} stream_writer_t;
+
+static int _writer_flush(stream_writer_t* w)
+{
+    if (w->fill == 0) {
+        return 0;
+    }
+    UINT n = (UINT)((w->fill + SECTOR_SIZE - 1) / SECTOR_SIZE);
+    memset(w->buf + w->fill, 0, (size_t)n * SECTOR_SIZE - w->fill);
+    if (disk_write(w->pdrv, w->buf, w->sect, n) != RES_OK) {
+        fprintf(stderr, "写入镜像失败 (扇区 %llu)\n", (unsigned long long)w->sect);
+        return -1;
+    }
+    w->sect += n;
+    w->fill = 0;
+    return 0;
+}
+
+// 定位到指定扇区，与当前缓冲区衔接的空隙直接补零以保持大块写入
+static int _writer_seek(stream_writer_t* w, LBA_t sect)
+{
+    if (w->fill != 0 && sect >= w->sect && (size_t)(sect - w->sect) * SECTOR_SIZE >= w->fill &&
+        (size_t)(sect - w->sect) * SECTOR_SIZE < w->cap) {
+        size_t ofs = (size_t)(sect - w->sect) * SECTOR_SIZE;
+        memset(w->buf + w->fill, 0, ofs - w->fill);
+        w->fill = ofs;
+        return 0;
+    }
+    if (_writer_flush(w) != 0) {
+        return -1;
+    }
+    w->sect = sect;
+    return 0;
+}
+
+static int _writer_write(stream_writer_t* w, const BYTE* data, size_t len)
+{
+    while (len) {
+        size_t n = w->cap - w->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->buf + w->fill, data, n);
+        w->fill += n;
+        data += n;
+        len -= n;
+        if (w->fill == w->cap && _writer_flush(w) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 将宿主机文件内容直接读入写入缓冲区
+static int _writer_copy_file(stream_writer_t* w, build_node_t* node)
+{
+    FILE* fp = fopen(node->host_path, "rb");
+    if (!fp) {
+        fprintf(stderr, "无法打开宿主机文件: %s\n", node->host_path);
+        return -1;
+    }
+    unsigned long long left = node->size;
+    while (left) {
+        size_t n = w->cap - w->fill;
+        if (n > left) {
+            n = (size_t)left;
+        }
+        if (fread(w->buf + w->fill, 1, n, fp) != n) {
+            fprintf(stderr, "读取宿主机文件失败: %s\n", node->host_path);
+            fclose(fp);
+            return -1;
+        }
+        w->fill += n;
+        left -= n;
+        if (w->fill == w->cap && _writer_flush(w) != 0) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int _write_fat(FATFS* fs, build_layout_t* lay)
+{
+    size_t fat_bytes = (size_t)fs->fsize * SECTOR_SIZE;
+    BYTE*  fat       = (BYTE*)calloc(1, fat_bytes);
+    if (!fat) {
+        fprintf(stderr, "内存分配失败\n");
+        return -1;
+    }
+
+    DWORD eoc = fs->fs_type == FS_FAT12 ? 0xFFF : fs->fs_type == FS_FAT16 ? 0xFFFF : 0x0FFFFFFF;
+    _fat_set(fat, fs->fs_type, 0, fs->fs_type == FS_FAT32 ? 0x0FFFFFF8 : (eoc & ~7));
+    _fat_set(fat, fs->fs_type, 1, eoc);
+    for (size_t i = 0; i < lay->n_order; i++) {
+        build_node_t* node = lay->order[i];
+        for (DWORD c = 0; c < node->nclust; c++) {
+            _fat_set(fat, fs->fs_type, node->sclust + c,
+                     c + 1 < node->nclust ? node->sclust + c + 1 : eoc);
+        }
+    }
+
+    // 镜像是新建的，最后一个已分配簇之后的FAT扇区已全部为零，无需写入
+    DWORD last  = lay->next_clst;
+    DWORD bytes = fs->fs_type == FS_FAT12 ? last + last / 2 + 2
+                  : fs->fs_type == FS_FAT16 ? last * 2
+                                            : last * 4;
+    DWORD nsect = (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (nsect > fs->fsize) {
+        nsect = fs->fsize;
+    }
+
+    int ret = 0;
+    for (BYTE f = 0; f < fs->n_fats && ret == 0; f++) {
+        for (DWORD s = 0; s < nsect; s += FAT_WRITE_SECTORS) {
+            UINT n = (UINT)(nsect - s > FAT_WRITE_SECTORS ? FAT_WRITE_SECTORS : nsect - s);
+            if (disk_write(fs->pdrv, fat + (size_t)s * SECTOR_SIZE,
+                           fs->fatbase + (LBA_t)f * fs->fsize + s, n) != RES_OK) {
+                fprintf(stderr, "写入FAT失败\n");
+                ret = -1;
+                break;
+            }
+        }
+    }
+    free(fat);
+    return ret;
+}
+
+static int _write_fsinfo(FATFS* fs, build_layout_t* lay)
+{
+    if (fs->fs_type != FS_FAT32) {
+        return 0;
+    }
+    BYTE buf[SECTOR_SIZE];
+    if (disk_read(fs->pdrv, buf, fs->volbase + 1, 1) != RES_OK) {
+        return -1;
+    }
+    _st_32(buf + 488, fs->n_fatent - lay->next_clst);  // FSI_Free_Count
+    _st_32(buf + 492, lay->next_clst - 1);             // FSI_Nxt_Free
+    return disk_write(fs->pdrv, buf, fs->volbase + 1, 1) == RES_OK ? 0 : -1;
+}
+
+static int _write_volume(FATFS* fs, build_node_t* root, build_layout_t* lay)
+{
+    if (_write_fat(fs, lay) != 0) {
+        return -1;
+    }
+
+    // FAT12/16的根目录位于FAT之后的固定区域
+    if (fs->fs_type != FS_FAT32) {
+        size_t bytes = (size_t)fs->n_rootdir * SZDIRE;
+        BYTE*  buf   = (BYTE*)calloc(1, bytes);
+        if (!buf) {
+            return -1;
+        }
+        _fill_dir(buf, root);
+        DRESULT dr = disk_write(fs->pdrv, buf, fs->dirbase, (UINT)(bytes / SECTOR_SIZE));
+        free(buf);
+        if (dr != RES_OK) {
+            fprintf(stderr, "写入根目录失败\n");
+            return -1;
+        }
+    }
+
+    stream_writer_t w = {.pdrv = fs->pdrv, .cap = STREAM_BUFFER_SIZE};
+    w.buf             = (BYTE*)malloc(STREAM_BUFFER_SIZE);
+    BYTE* dirbuf      = (BYTE*)malloc((size_t)MAX_DIR_ENTRIES * SZDIRE);
+    int   ret         = (w.buf && dirbuf) ? 0 : -1;
+
+    for (size_t i = 0; i < lay->n_order && ret == 0; i++) {
+        build_node_t* node = lay->order[i];
+        ret = _writer_seek(&w, fs->database + (LBA_t)fs->csize * (node->sclust - 2));
+        if (ret != 0) {
+            break;
+        }
+        if (node->is_dir || node == root) {
+            ret = _writer_write(&w, dirbuf, _fill_dir(dirbuf, node));
+        } else {
+            ret = _writer_copy_file(&w, node);
+        }
+    }
+    if (ret == 0) {
+        ret = _writer_flush(&w);
+    }
+    free(w.buf);
+    free(dirbuf);
+
+    if (ret == 0 && _write_fsinfo(fs, lay) != 0) {
+        fprintf(stderr, "写入FSInfo失败\n");
+        ret = -1;
+    }
+    if (ret == 0 && disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/*--------------------------------------------------------------------------*/
+/* build命令                                                                 */
+/*--------------------------------------------------------------------------*/
+
+// 格式化卷，挂载后读出卷的几何参数
+static FRESULT _format_volume(image_t* img, MKFS_PARM* parm, FATFS* fs)
+{
+    FRESULT fr = image_mkfs(img, parm);
+    if (fr == FR_OK) {
+        fr = image_mount(img);
+    }
+    if (fr == FR_OK) {
+        *fs = *image_fs(img);  // 卸载会清除fs_type，先保留一份几何参数
+        image_unmount(img);
+    }
+    return fr;
+}
+
+// 创建指定大小的镜像并打开，失败返回NULL
+static image_t* _create_image(build_cmd_args_t* args, unsigned long long size)
+{
+    if (create_virtual_disk(args->img_name, size / SECTOR_SIZE) != 0) {
+        fprintf(stderr, "创建虚拟磁盘文件失败: %s\n", args->img_name);
+        return NULL;
+    }
+    image_t* img = image_open(args->img_name, NULL);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘文件失败: %s\n", args->img_name);
+    }
+    return img;
+}
+
+// 只允许FAT32时卷的最小字节数：至少65526个簇，加上保留扇区和FAT
+static unsigned long long _min_volume_bytes(const MKFS_PARM* parm)
+{
+    if ((parm->fmt & FM_FAT) || !(parm->fmt & FM_FAT32)) {
+        return 0;
+    }
+    unsigned long long n_clst  = 0xFFF6;
+    unsigned long long cl_size = parm->au_size ? parm->au_size : SECTOR_SIZE;
+    unsigned long long fat     = (n_clst * 4 + 8 + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+    return n_clst * cl_size + fat * (parm->n_fat ? parm->n_fat : 1) + 64 * SECTOR_SIZE;
+}
+
+// 扫描宿主机目录树并生成长短文件名，失败返回NULL
+static build_node_t* _load_tree(const char* src_dir)
+{
+    hostfs_stat_t st;
+    if (hostfs_stat(src_dir, &st) != 0 || !st.is_dir) {
+        fprintf(stderr, "源目录不存在: %s\n", src_dir);
+        return NULL;
+    }
+    build_node_t* root = _new_node(NULL, "", src_dir);
+    if (!root) {
+        fprintf(stderr, "内存分配失败\n");
+        return NULL;
+    }
+    root->is_dir  = 1;
+    root->fattime = hostfs_to_fattime(st.mtime);
+    if (_scan_tree(root) != 0 || _register_names(root) != 0) {
+        _free_tree(root);
+        return NULL;
+    }
+    return root;
+}
+
+// FAT12/16的根目录大小固定，根据内容调整；超过上限时只能使用FAT32
+static void _fit_root(build_node_t* root, MKFS_PARM* parm)
+{
+    UINT n_root = (root->dir_ents + 15) / 16 * 16;
+    if (n_root > 32768) {
+        parm->fmt &= ~FM_FAT;
+        parm->fmt |= FM_FAT32;
+    } else if (n_root > (parm->n_root ? parm->n_root : 512)) {
+        parm->n_root = n_root;
+    }
+}
+
+int build_volume(image_t* img, const char* src_dir, const MKFS_PARM* parm)
+{
+    build_node_t* root = _load_tree(src_dir);
+    if (!root) {
+        return -1;
+    }
+    MKFS_PARM p = *parm;
+    _fit_root(root, &p);
+
+    FATFS          fs;
+    build_layout_t lay = {0};
+    int            ret = -1;
+    FRESULT        fr  = _format_volume(img, &p, &fs);
+    if (fr != FR_OK) {
+        fprintf(stderr, "创建文件系统失败 (%s: %d)\n", f_strerror(fr), fr);
+    } else if (_compute_layout(&lay, root, &fs) == 0) {
+        if (lay.next_clst <= fs.n_fatent) {
+            ret = _write_volume(&fs, root, &lay);
+        } else {
+            fprintf(stderr, "卷 %s 空间不足: 还需要 %llu 字节\n", image_drive(img),
+                    (unsigned long long)(lay.next_clst - fs.n_fatent) * lay.cl_bytes);
+        }
+    }
+    free(lay.order);
+    _free_tree(root);
+    return ret;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int cmd_do_build(cmd_args_t arg)
+{
+    build_cmd_args_t* args = cmd_args_cast(arg, build_cmd_args_t);
+    if (!args || !args->img_name || !args->src_dir) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    double t0 = _now();
+
+    build_node_t* root = _load_tree(args->src_dir);
+    if (!root) {
+        return -1;
+    }
+    MKFS_PARM parm = args->mkfs_parm;
+    _fit_root(root, &parm);
+
+    unsigned long long size = (unsigned long long)args->img_size * MB;
+    if (size == 0) {
+        size = (_estimate_bytes(root) + (unsigned long long)root->dir_ents * SZDIRE) * 21 / 20 + 2 * MB;
+        if (size < _min_volume_bytes(&parm)) {
+            size = _min_volume_bytes(&parm);
+        }
+        size = (size + MB - 1) / MB * MB;
+    }
+
+    FATFS          fs;
+    build_layout_t lay = {0};
+    int            ret = -1;
+    image_t*       img = NULL;
+    for (int tries = 0; tries < MAX_BUILD_TRIES; tries++) {
+        image_close(img);  // 重试前关闭上一次创建的镜像
+        img = _create_image(args, size);
+        if (!img) {
+            break;
+        }
+        FRESULT fr = _format_volume(img, &parm, &fs);
+        if (fr == FR_MKFS_ABORTED && !args->img_size) {
+            size *= 2;  // 按内容估算的大小不满足所选FAT类型的簇数要求，扩大镜像后重试
+            continue;
+        }
+        if (fr != FR_OK) {
+            fprintf(stderr, "创建文件系统失败 (%s: %d)\n", f_strerror(fr), fr);
+            break;
+        }
+        if (_compute_layout(&lay, root, &fs) != 0) {
+            break;
+        }
+        if (lay.next_clst <= fs.n_fatent) {
+            ret = 0;
+            break;
+        }
+        unsigned long long need = (unsigned long long)(lay.next_clst - fs.n_fatent) * lay.cl_bytes;
+        if (args->img_size) {
+            fprintf(stderr, "镜像空间不足: 还需要 %llu 字节\n", need);
+            break;
+        }
+        size = (size + need * 11 / 10 + MB) / MB * MB;  // 按实际簇大小扩大镜像后重试
+    }
+    if (ret == 0) {
+        ret = _write_volume(&fs, root, &lay);
+    }
+    if (image_close(img) != 0) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        double secs = _now() - t0;
+        printf("镜像构建成功: %s (%llu MB, %u 目录, %u 文件, %llu 字节, 用时 %.3f 秒, %.1f MB/s)\n",
+               args->img_name, size / MB, lay.n_dirs, lay.n_files, lay.n_bytes, secs,
+               secs > 0 ? lay.n_bytes / secs / MB : 0.0);
+    } else {
+        remove(args->img_name);
+        fprintf(stderr, "构建镜像失败: %s\n", args->img_name);
+    }
+
+    free(lay.order);
+    _free_tree(root);
+    return ret;
+}
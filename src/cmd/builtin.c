@@ -14,6 +14,19 @@ int cmd_do_help(cmd_args_t arg)
     printf("  create                  创建虚拟磁盘镜像。\n");
     printf("  format                  格式化虚拟磁盘镜像。\n");
     printf("  mount                   挂载虚拟磁盘镜像。\n");
+    printf("  compact                 释放镜像中空闲簇占用的宿主机磁盘空间。\n");
+    printf("  build                   从宿主机目录一次性构建带内容的镜像。\n");
+    printf("  commit                  把写时复制增量文件合并回基础镜像。\n");
+    printf("  serve                   常驻挂载镜像，在Unix域套接字上执行shell命令。\n");
+    printf("  client                  向serve发送shell命令。\n");
+    printf("  sum                     计算镜像中文件的校验和，输出校验清单。\n");
+    printf("  diff                    比较两个镜像中的目录树和文件内容。\n");
+    printf("  sync                    把宿主机目录树增量同步到已有镜像中。\n");
+    printf("  import-tar              把tar流直接导入镜像，不在宿主机上解包。\n");
+    printf("  export-tar              把镜像中的子树写成tar流(标准输出或文件)。\n");
+    printf("  pack                    把镜像按块压缩为可直接挂载的只读压缩镜像。\n");
+    printf("  unpack                  把压缩镜像还原为普通镜像。\n");
+    printf("  verify                  按簇校验镜像的CRC32，发现静默损坏。\n");
     return 0;
 }
 
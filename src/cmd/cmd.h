@@ -1,13 +1,10 @@
 #ifndef TOOL_SRC_CMD_H_
 #define TOOL_SRC_CMD_H_
 
-#ifdef _WIN32
-#include <getopt.h>
-#else
-#include <unistd.h> /* for getopt */
-#endif
+#include <getopt.h> /* for getopt_long */
 #include "config.h"
 #include "ff.h"
+#include "image.h"
 
 typedef void *cmd_args_t;
 typedef int (*cmd_func_t)(cmd_args_t);
@@ -36,6 +33,19 @@ int cmd_do_version(cmd_args_t);
 int cmd_do_create(cmd_args_t arg);
 int cmd_do_format(cmd_args_t arg);
 int cmd_do_mount(cmd_args_t arg);
+int cmd_do_compact(cmd_args_t arg);
+int cmd_do_build(cmd_args_t arg);
+int cmd_do_commit(cmd_args_t arg);
+int cmd_do_serve(cmd_args_t arg);
+int cmd_do_client(cmd_args_t arg);
+int cmd_do_sum(cmd_args_t arg);
+int cmd_do_diff(cmd_args_t arg);
+int cmd_do_sync(cmd_args_t arg);
+int cmd_do_import_tar(cmd_args_t arg);
+int cmd_do_export_tar(cmd_args_t arg);
+int cmd_do_pack(cmd_args_t arg);
+int cmd_do_unpack(cmd_args_t arg);
+int cmd_do_verify(cmd_args_t arg);
 
 // 命令解析函数声明
 cmd_args_t cmd_parse_reate_args(int argc, char **argv);
@@ -44,6 +54,50 @@ cmd_args_t cmd_parse_format_args(int argc, char **argv);
 void       cmd_free_format_args(cmd_args_t arg);
 cmd_args_t cmd_parse_mount_args(int argc, char **argv);
 void       cmd_free_mount_args(cmd_args_t arg);
+cmd_args_t cmd_parse_compact_args(int argc, char **argv);
+void       cmd_free_compact_args(cmd_args_t arg);
+cmd_args_t cmd_parse_build_args(int argc, char **argv);
+void       cmd_free_build_args(cmd_args_t arg);
+cmd_args_t cmd_parse_commit_args(int argc, char **argv);
+void       cmd_free_commit_args(cmd_args_t arg);
+cmd_args_t cmd_parse_serve_args(int argc, char **argv);
+void       cmd_free_serve_args(cmd_args_t arg);
+cmd_args_t cmd_parse_client_args(int argc, char **argv);
+void       cmd_free_client_args(cmd_args_t arg);
+cmd_args_t cmd_parse_sum_args(int argc, char **argv);
+void       cmd_free_sum_args(cmd_args_t arg);
+cmd_args_t cmd_parse_diff_args(int argc, char **argv);
+void       cmd_free_diff_args(cmd_args_t arg);
+cmd_args_t cmd_parse_sync_args(int argc, char **argv);
+void       cmd_free_sync_args(cmd_args_t arg);
+cmd_args_t cmd_parse_import_tar_args(int argc, char **argv);
+void       cmd_free_import_tar_args(cmd_args_t arg);
+cmd_args_t cmd_parse_export_tar_args(int argc, char **argv);
+void       cmd_free_export_tar_args(cmd_args_t arg);
+cmd_args_t cmd_parse_pack_args(int argc, char **argv);
+void       cmd_free_pack_args(cmd_args_t arg);
+cmd_args_t cmd_parse_unpack_args(int argc, char **argv);
+void       cmd_free_unpack_args(cmd_args_t arg);
+cmd_args_t cmd_parse_verify_args(int argc, char **argv);
+void       cmd_free_verify_args(cmd_args_t arg);
+
+// 解析 --fmt 参数(FAT类型名称或FM_*数值)，成功返回0
+int cmd_parse_fmt(const char *str, BYTE *fmt);
+
+// 解析 --partition 参数(分区号1-128)，成功返回0
+int cmd_parse_partition(const char *str, BYTE *pt);
+
+// 解析 --writeback 参数(冲刷间隔秒数0-86400)，成功返回0
+int cmd_parse_writeback(const char *str, long *interval);
+
+// 创建指定扇区数的(稀疏)虚拟磁盘文件
+int create_virtual_disk(const char *path, unsigned long long total_sectors);
+
+// 格式化镜像句柄对应的卷并直接写入宿主机目录src_dir的内容(不支持exFAT)，成功返回0
+int build_volume(image_t *img, const char *src_dir, const MKFS_PARM *parm);
+
+// 删除文件或目录树(FAT卷上用f_rmtree一次性删除，exFAT上逐项删除)
+FRESULT remove_tree(const TCHAR *path);
 
 // Shell命令函数声明
 int shell_do_help(int argc, char **argv);
@@ -60,6 +114,9 @@ int shell_do_truncate(int argc, char **argv);
 
 int shell_do_touch(int argc, char **argv);
 int shell_do_mv(int argc, char **argv);
+int shell_do_cp(int argc, char **argv);
+int shell_do_find(int argc, char **argv);
+int shell_do_du(int argc, char **argv);
 
 int shell_do_stat(int argc, char **argv);
 int shell_do_chmod(int argc, char **argv);
@@ -70,7 +127,27 @@ int shell_do_setlabel(int argc, char **argv);
 
 // 导出文件系统中的文件或目录到宿主机文件系统
 int shell_do_export(int argc, char **argv);
+// 把文件系统中的文件或目录子树写成tar流(文件或标准输出)
+int shell_do_export_tar(int argc, char **argv);
 
-int shell_run(void);
+// 计算文件或目录树的校验和，输出sha256sum等工具兼容的清单
+int shell_do_sum(int argc, char **argv);
+
+// 显示或清零FatFs性能计数器
+int shell_do_stats(int argc, char **argv);
+
+// 把延迟写回缓存中的数据写入镜像
+int shell_do_sync(int argc, char **argv);
+
+#define SHELL_EXIT 1  // shell_exec执行exit命令时的返回值
+
+// 设置shell命令使用的镜像句柄(sync写回这些镜像)，n为0时解除
+void shell_attach(image_t **imgs, int n);
+// serve中执行命令时设置为1，从标准输入读取数据的命令(write -)会被拒绝
+void shell_set_remote(int remote);
+// 执行一行shell命令(line会被修改)，返回命令的结果
+int shell_exec(char *line);
+// 在已挂载的镜像句柄上运行交互式shell
+int shell_run(image_t *img);
 
 #endif  // TOOL_SRC_CMD_H_
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmd.h"
+#include "overlay.h"
+#include "packed.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+typedef struct commit_cmd_args_t {
+    char* img_path;
+    char* overlay_path;
+    int   keep;  // 合并后保留增量文件
+} commit_cmd_args_t;
+
+const char* commit_help_str =
+    "用法: commit [选项]\n"
+    "把写时复制增量文件(mount -o 产生)中的扇区合并回基础镜像。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径    指定基础镜像的路径。(必填)\n"
+    "  -o, --overlay=路径     指定增量文件的路径。(必填)\n"
+    "  -k, --keep             合并后保留增量文件。(默认: 删除)\n"
+    "  -h, --help             显示此帮助信息。\n";
+
+static const commit_cmd_args_t default_args = {
+    .img_path     = NULL,
+    .overlay_path = NULL,
+    .keep         = 0,
+};
+
+cmd_args_t cmd_parse_commit_args(int argc, char** argv)
+{
+    commit_cmd_args_t* args = (commit_cmd_args_t*)calloc(1, sizeof(commit_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"overlay", required_argument, 0, 'o'},
+                                           {"keep", no_argument, 0, 'k'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:o:kh", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'o':  // overlay
+                cmd_args_field_should_free(args, overlay_path, default_args);
+                args->overlay_path = strdup(optarg);
+                break;
+            case 'k':  // keep
+                args->keep = 1;
+                break;
+            case 'h':  // help
+                printf("%s", commit_help_str);
+                cmd_free_commit_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_commit_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path || !args->overlay_path) {
+        fprintf(stderr, "必需参数: --img-path=路径 --overlay=路径\n");
+        cmd_free_commit_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_commit_args(cmd_args_t arg)
+{
+    commit_cmd_args_t* args = cmd_args_cast(arg, commit_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        cmd_args_field_should_free(args, overlay_path, default_args);
+        free(args);
+    }
+}
+
+int cmd_do_commit(cmd_args_t arg)
+{
+    commit_cmd_args_t* args = cmd_args_cast(arg, commit_cmd_args_t);
+    if (!args || !args->img_path || !args->overlay_path) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    if (packed_probe(args->img_path)) {
+        fprintf(stderr, "压缩镜像是只读的，请先用unpack还原: %s\n", args->img_path);
+        return -1;
+    }
+
+    long n = overlay_commit(args->img_path, args->overlay_path);
+    if (n < 0) {
+        fprintf(stderr, "合并增量文件失败: %s -> %s\n", args->overlay_path, args->img_path);
+        return -1;
+    }
+
+    if (!args->keep && remove(args->overlay_path) != 0) {
+        fprintf(stderr, "删除增量文件失败: %s\n", args->overlay_path);
+        return -1;
+    }
+
+    printf("已合并 %ld 个扇区 (%ld 字节) 到 %s\n", n, n * SECTOR_SIZE, args->img_path);
+    return 0;
+}
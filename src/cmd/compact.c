@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "cmd.h"
+#include "diskio.h"
+#include "fferrno.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 每次读取的FAT扇区数，取3的倍数使FAT12表项不会跨越两次读取
+#define FAT_CHUNK_SECTORS 384
+
+typedef struct compact_cmd_args_t {
+    char* img_path;
+} compact_cmd_args_t;
+
+const char* compact_help_str =
+    "用法: compact [选项]\n"
+    "释放虚拟磁盘镜像中所有空闲簇占用的宿主机磁盘空间(打洞)。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径    指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -h, --help             显示此帮助信息。\n";
+
+static const compact_cmd_args_t default_args = {
+    .img_path = NULL,
+};
+
+cmd_args_t cmd_parse_compact_args(int argc, char** argv)
+{
+    compact_cmd_args_t* args = (compact_cmd_args_t*)calloc(1, sizeof(compact_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", compact_help_str);
+                cmd_free_compact_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_compact_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_compact_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_compact_args(cmd_args_t arg)
+{
+    compact_cmd_args_t* args = cmd_args_cast(arg, compact_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        free(args);
+    }
+}
+
+// 获取镜像文件实际占用的宿主机磁盘空间(字节)，无法获取时返回-1
+static long long _allocated_bytes(const char* path)
+{
+#ifdef _WIN32
+    (void)path;
+    return -1;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    return (long long)st.st_blocks * 512;
+#endif
+}
+
+// 对空闲簇区间 [scl, ecl] 打洞
+static DRESULT _trim_clusters(FATFS* fs, DWORD scl, DWORD ecl)
+{
+    LBA_t range[2];
+    range[0] = fs->database + (LBA_t)fs->csize * (scl - 2);
+    range[1] = fs->database + (LBA_t)fs->csize * (ecl - 2) + fs->csize - 1;
+    return disk_ioctl(fs->pdrv, CTRL_TRIM, range);
+}
+
+// 记录一个簇是否空闲，连续的空闲簇区间结束时打洞
+static int _account_cluster(FATFS* fs, DWORD clst, int is_free, DWORD* run_start, DWORD* n_free,
+                            DWORD* n_runs)
+{
+    if (is_free) {
+        (*n_free)++;
+        if (*run_start == 0) {
+            *run_start = clst;
+        }
+    } else if (*run_start != 0) {
+        if (_trim_clusters(fs, *run_start, clst - 1) != RES_OK) {
+            return -1;
+        }
+        (*n_runs)++;
+        *run_start = 0;
+    }
+    return 0;
+}
+
+#if FF_FS_EXFAT
+// exFAT按分配位图判断簇是否空闲(不使用FAT链的连续文件不会写FAT)
+static int _scan_bitmap(FATFS* fs, BYTE* buf, DWORD* run_start, DWORD* n_free, DWORD* n_runs)
+{
+    DWORD per_chunk = FAT_CHUNK_SECTORS * SECTOR_SIZE * 8;  // 每次读取包含的簇数
+    DWORD n_clst    = fs->n_fatent - 2;
+
+    for (DWORD base = 0; base < n_clst; base += per_chunk) {
+        LBA_t sect  = fs->bitbase + (LBA_t)(base / per_chunk) * FAT_CHUNK_SECTORS;
+        DWORD left  = n_clst - base < per_chunk ? n_clst - base : per_chunk;
+        UINT  nsect = (UINT)((left + SECTOR_SIZE * 8 - 1) / (SECTOR_SIZE * 8));
+        if (disk_read(fs->pdrv, buf, sect, nsect) != RES_OK) {
+            fprintf(stderr, "读取分配位图失败 (扇区 %llu)\n", (unsigned long long)sect);
+            return -1;
+        }
+        for (DWORD i = 0; i < left; i++) {
+            int is_free = !(buf[i / 8] & (1 << (i % 8)));
+            if (_account_cluster(fs, base + i + 2, is_free, run_start, n_free, n_runs) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+// 扫描FAT表，将连续的空闲簇合并后逐段打洞
+static int _scan_fat(FATFS* fs, BYTE* buf, DWORD* run_start, DWORD* n_free, DWORD* n_runs)
+{
+    DWORD per_chunk;  // 每次读取包含的FAT表项数
+    switch (fs->fs_type) {
+        case FS_FAT12:
+            per_chunk = FAT_CHUNK_SECTORS * SECTOR_SIZE * 2 / 3;
+            break;
+        case FS_FAT16:
+            per_chunk = FAT_CHUNK_SECTORS * SECTOR_SIZE / 2;
+            break;
+        case FS_FAT32:
+            per_chunk = FAT_CHUNK_SECTORS * SECTOR_SIZE / 4;
+            break;
+        default:
+            fprintf(stderr, "不支持的文件系统类型: %u\n", (unsigned int)fs->fs_type);
+            return -1;
+    }
+
+    for (DWORD base = 0; base < fs->n_fatent; base += per_chunk) {
+        LBA_t sect   = fs->fatbase + (LBA_t)(base / per_chunk) * FAT_CHUNK_SECTORS;
+        UINT  nsect  = FAT_CHUNK_SECTORS;
+        DWORD remain = fs->fsize - (DWORD)(sect - fs->fatbase);
+        if (nsect > remain) {
+            nsect = remain;
+        }
+        if (disk_read(fs->pdrv, buf, sect, nsect) != RES_OK) {
+            fprintf(stderr, "读取FAT失败 (扇区 %llu)\n", (unsigned long long)sect);
+            return -1;
+        }
+
+        for (DWORD i = 0; i < per_chunk && base + i < fs->n_fatent; i++) {
+            DWORD clst = base + i;
+            DWORD val;
+            switch (fs->fs_type) {
+                case FS_FAT12: {
+                    UINT bc = (UINT)(i + i / 2);
+                    val     = buf[bc] | (buf[bc + 1] << 8);
+                    val     = (clst & 1) ? (val >> 4) : (val & 0xFFF);
+                    break;
+                }
+                case FS_FAT16:
+                    val = buf[i * 2] | (buf[i * 2 + 1] << 8);
+                    break;
+                default:
+                    val = (buf[i * 4] | (buf[i * 4 + 1] << 8) | (buf[i * 4 + 2] << 16) |
+                           ((DWORD)buf[i * 4 + 3] << 24)) &
+                          0x0FFFFFFF;
+                    break;
+            }
+
+            if (clst >= 2 && _account_cluster(fs, clst, val == 0, run_start, n_free, n_runs) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 找出所有空闲簇，合并为连续区间后逐段打洞
+static int _compact_volume(FATFS* fs, DWORD* n_free, DWORD* n_runs)
+{
+    BYTE* buf = (BYTE*)malloc(FAT_CHUNK_SECTORS * SECTOR_SIZE);
+    if (!buf) {
+        fprintf(stderr, "内存分配失败\n");
+        return -1;
+    }
+
+    DWORD run_start = 0;  // 当前空闲簇区间的起始簇号(0表示不在区间内)
+    *n_free = *n_runs = 0;
+#if FF_FS_EXFAT
+    int ret = fs->fs_type == FS_EXFAT ? _scan_bitmap(fs, buf, &run_start, n_free, n_runs)
+                                      : _scan_fat(fs, buf, &run_start, n_free, n_runs);
+#else
+    int ret = _scan_fat(fs, buf, &run_start, n_free, n_runs);
+#endif
+
+    if (ret == 0 && run_start != 0) {
+        if (_trim_clusters(fs, run_start, fs->n_fatent - 1) != RES_OK) {
+            ret = -1;
+        } else {
+            (*n_runs)++;
+        }
+    }
+
+    free(buf);
+    return ret;
+}
+
+int cmd_do_compact(cmd_args_t arg)
+{
+    compact_cmd_args_t* args = cmd_args_cast(arg, compact_cmd_args_t);
+    if (!args || !args->img_path) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    long long before = _allocated_bytes(args->img_path);
+
+    image_t* img = image_open(args->img_path, NULL);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        return -1;
+    }
+
+    FATFS* fs     = image_fs(img);
+    DWORD  n_free = 0, n_runs = 0;
+    int    ret    = _compact_volume(fs, &n_free, &n_runs);
+    WORD   csize  = fs->csize;
+    disk_ioctl(fs->pdrv, CTRL_SYNC, 0);
+    if (image_close(img) != 0) {
+        ret = -1;
+    }
+    if (ret != 0) {
+        fprintf(stderr, "压缩虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+
+    printf("已释放 %lu 个空闲簇 (%lu 段, %llu 字节)\n", (unsigned long)n_free,
+           (unsigned long)n_runs, (unsigned long long)n_free * csize * SECTOR_SIZE);
+    long long after = _allocated_bytes(args->img_path);
+    if (before >= 0 && after >= 0) {
+        printf("镜像占用空间: %lld -> %lld 字节\n", before, after);
+    }
+    return 0;
+}
@@ -1,16 +1,29 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "cmd.h"
 #include "fferrno.h"
+#include "stats.h"
+#include "thread.h"
 
-#define WORK_BUFFER_SIZE 4096               // 工作缓冲区大小
-static char work_buffer[WORK_BUFFER_SIZE];  // 定义工作缓冲区
+#ifdef _WIN32
+#define strncasecmp _strnicmp
+#endif
+
+#define MAX_PARTITIONS 128            // GPT分区表的项数，MBR最多4个
+#define MAX_WORKERS (FF_VOLUMES - 1)  // 整个镜像的句柄占用一个逻辑卷，其余留给各分区
 
 typedef struct create_cmd_args_t {
     char*     img_name;
     size_t    img_size;
     MKFS_PARM mkfs_parm;
+    int       stats;  // 输出性能计数器的格式(stats_mode_t)
+    LBA_t     partitions[MAX_PARTITIONS + 1];  // f_fdisk分区表(扇区数或<=100的百分比)，以0结尾
+    UINT      n_partitions;                    // 0表示不分区，由f_mkfs创建单个分区
+    char*     dirs[MAX_PARTITIONS];            // 按顺序填充各分区的宿主机目录，NULL或空串只格式化
+    UINT      n_dirs;
+    int       jobs;  // 并行处理分区的线程数，0为自动
 } create_cmd_args_t;
 
 const char* create_help_str =
@@ -19,11 +32,17 @@ const char* create_help_str =
     "选项:\n"
     "  -n, --name=名称    指定虚拟磁盘镜像的名称。(默认: disk.img)\n"
     "  -s, --size=大小    指定虚拟磁盘镜像的大小(MB)。(必填)\n"
-    "  -f, --fmt=类型     指定FAT类型 (FAT12, FAT16, FAT32, EXFAT, SFD)。\n"
+    "  -f, --fmt=类型     指定FAT类型 (FAT12, FAT16, FAT32, EXFAT, ANY, SFD，可用逗号组合，或FM_*数值)。\n"
     "  --n-fat=数量       指定FAT表的数量 (0=默认)。\n"
     "  --align=数值       指定数据区域的扇区对齐大小 (0=默认)。\n"
     "  --n-root=数量      指定根目录的数量 (0=默认)。\n"
-    "  --au-size=大小     指定簇大小(字节) (0=默认)。\n";
+    "  --au-size=大小     指定簇大小(字节) (0=默认)。\n"
+    "  --partitions=列表  先创建分区表再逐个格式化，列表为逗号分隔的分区大小(MB，或带%的百分比)，\n"
+    "                     如 1024,50%,100%。镜像不小于128GB时使用GPT(最多128个分区)，否则使用MBR(最多4个)。\n"
+    "  -d, --dir=目录     格式化后写入宿主机目录的内容(同build，不支持exFAT)。可重复指定，第i个目录\n"
+    "                     对应第i个分区，空字符串表示该分区只格式化。\n"
+    "  -j, --jobs=数量    同时格式化/填充分区的线程数。(默认: 分区数，不超过处理器数和FatFs的逻辑卷数)\n"
+    "  --stats[=json]     完成后输出I/O和元数据计数器 (text或json)。多个线程同时处理分区时计数器不加锁，为近似值。\n";
 
 static const create_cmd_args_t default_args = {
     .img_name = "disk.img",
@@ -49,6 +68,41 @@ static const create_cmd_args_t default_args = {
         },
 };
 
+// 解析分区列表，每项为MB数或带'%'的百分比(1-100)
+static int parse_partitions(const char* str, create_cmd_args_t* args)
+{
+    UINT n = 0;
+    while (*str) {
+        if (n == MAX_PARTITIONS) {
+            return -1;
+        }
+        char*              end;
+        unsigned long long val = strtoull(str, &end, 10);
+        if (end == str || val == 0) {
+            return -1;
+        }
+        if (*end == '%') {
+            if (val > 100) {
+                return -1;
+            }
+            end++;
+        } else {
+            val = val * MB / SECTOR_SIZE;  // 至少2048扇区，不会与百分比混淆
+        }
+        if (*end && *end != ',') {
+            return -1;
+        }
+        args->partitions[n++] = (LBA_t)val;
+        str                   = *end ? end + 1 : end;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    args->partitions[n] = 0;
+    args->n_partitions  = n;
+    return 0;
+}
+
 // 解析create命令参数
 cmd_args_t cmd_parse_reate_args(int argc, char** argv)
 {
@@ -67,13 +121,17 @@ cmd_args_t cmd_parse_reate_args(int argc, char** argv)
                                            {"align", optional_argument, 0, 5},
                                            {"n-root", optional_argument, 0, 6},
                                            {"au-size", optional_argument, 0, 7},
+                                           {"stats", optional_argument, 0, 8},
+                                           {"partitions", required_argument, 0, 9},
+                                           {"dir", required_argument, 0, 'd'},
+                                           {"jobs", required_argument, 0, 'j'},
                                            {"help", no_argument, 0, 'h'},
                                            {0, 0, 0, 0}};
 
     int opt;
     int option_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "n:s:f:h", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "n:s:f:d:j:h", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'n':  // name
                 cmd_args_field_should_free(args, img_name, default_args);
@@ -83,7 +141,11 @@ cmd_args_t cmd_parse_reate_args(int argc, char** argv)
                 args->img_size = atoi(optarg);
                 break;
             case 'f':  // fmt
-                args->mkfs_parm.fmt = atoi(optarg);
+                if (cmd_parse_fmt(optarg, &args->mkfs_parm.fmt) != 0) {
+                    fprintf(stderr, "无效的FAT类型: %s\n", optarg);
+                    cmd_free_create_args(args);
+                    return NULL;
+                }
                 break;
             case 4:  // n-fat
                 args->mkfs_parm.n_fat = atoi(optarg);
@@ -97,6 +159,37 @@ cmd_args_t cmd_parse_reate_args(int argc, char** argv)
             case 7:  // au-size
                 args->mkfs_parm.au_size = atoll(optarg);
                 break;
+            case 8:  // stats
+                args->stats = stats_parse_mode(optarg);
+                if (args->stats < 0) {
+                    fprintf(stderr, "无效的统计输出格式: %s\n", optarg);
+                    cmd_free_create_args(args);
+                    return NULL;
+                }
+                break;
+            case 9:  // partitions
+                if (parse_partitions(optarg, args) != 0) {
+                    fprintf(stderr, "无效的分区列表: %s\n", optarg);
+                    cmd_free_create_args(args);
+                    return NULL;
+                }
+                break;
+            case 'd':  // dir
+                if (args->n_dirs == MAX_PARTITIONS) {
+                    fprintf(stderr, "目录数量超过 %d\n", MAX_PARTITIONS);
+                    cmd_free_create_args(args);
+                    return NULL;
+                }
+                args->dirs[args->n_dirs++] = strdup(optarg);
+                break;
+            case 'j':  // jobs
+                args->jobs = atoi(optarg);
+                if (args->jobs <= 0) {
+                    fprintf(stderr, "无效的线程数: %s\n", optarg);
+                    cmd_free_create_args(args);
+                    return NULL;
+                }
+                break;
             case 'h':  // help
                 printf("%s", create_help_str);
                 cmd_free_create_args(args);
@@ -114,6 +207,12 @@ cmd_args_t cmd_parse_reate_args(int argc, char** argv)
         cmd_free_create_args(args);
         return NULL;
     }
+    if (args->n_dirs > (args->n_partitions ? args->n_partitions : 1)) {
+        fprintf(stderr, "指定的目录(%u)多于分区(%u)\n", args->n_dirs,
+                args->n_partitions ? args->n_partitions : 1);
+        cmd_free_create_args(args);
+        return NULL;
+    }
 
     return (cmd_args_t)args;
 }
@@ -126,39 +225,197 @@ void cmd_free_create_args(cmd_args_t arg)
         if (args->img_name) {
             cmd_args_field_should_free(args, img_name, default_args);
         }
+        for (UINT i = 0; i < args->n_dirs; i++) {
+            free(args->dirs[i]);
+        }
         free(args);
     }
 }
 
+// 解析分区号(1-128)，用于mount/format的 --partition 选项
+int cmd_parse_partition(const char* str, BYTE* pt)
+{
+    char* end;
+    long  val = strtol(str, &end, 10);
+    if (end == str || *end || val < 1 || val > MAX_PARTITIONS) {
+        return -1;
+    }
+    *pt = (BYTE)val;
+    return 0;
+}
+
+// 解析延迟写回的冲刷间隔(秒，0-86400)，用于mount/serve的 --writeback 选项
+int cmd_parse_writeback(const char* str, long* interval)
+{
+    char* end;
+    long  val = strtol(str, &end, 10);
+    if (end == str || *end || val < 0 || val > 86400) {
+        return -1;
+    }
+    *interval = val;
+    return 0;
+}
+
+// 解析FAT类型，名称不区分大小写，可用','或'|'组合(如 FAT,FAT32)，也接受FM_*标志的数值
+int cmd_parse_fmt(const char* str, BYTE* fmt)
+{
+    static const struct {
+        const char* name;
+        BYTE        flag;
+    } names[] = {{"FAT", FM_FAT},     {"FAT12", FM_FAT}, {"FAT16", FM_FAT}, {"FAT32", FM_FAT32},
+                 {"EXFAT", FM_EXFAT}, {"ANY", FM_ANY},   {"SFD", FM_SFD}};
+
+    if (!str || !*str) {
+        return -1;
+    }
+    if (isdigit((unsigned char)*str)) {
+        char* end;
+        long  val = strtol(str, &end, 0);
+        if (*end || val <= 0 || (val & ~(FM_ANY | FM_SFD))) {
+            return -1;
+        }
+        *fmt = (BYTE)val;
+        return 0;
+    }
+
+    BYTE flags = 0;
+    while (*str) {
+        size_t len = strcspn(str, ",|");
+        size_t i;
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == len && strncasecmp(str, names[i].name, len) == 0) {
+                break;
+            }
+        }
+        if (i == sizeof(names) / sizeof(names[0])) {
+            return -1;
+        }
+        flags |= names[i].flag;
+        str += len;
+        if (*str) {
+            str++;
+        }
+    }
+    if (!(flags & FM_ANY)) {  // 只指定了SFD时由FatFs自动选择类型
+        flags |= FM_ANY;
+    }
+    *fmt = flags;
+    return 0;
+}
+
 // 创建指定大小的虚拟磁盘文件
-int create_virtual_disk(const char* path, int total_sectors)
+// 只在末尾写入一个字节，文件其余部分为稀疏的空洞，读回即为全零，无需逐扇区填充
+int create_virtual_disk(const char* path, unsigned long long total_sectors)
 {
+    if (total_sectors == 0) {
+        return -1;
+    }
+
     FILE* fp = fopen(path, "wb");
     if (!fp) {
         return -1;
     }
 
-    // 填充空数据（总大小=扇区数×SECTOR_SIZE）
-    char* buffer = (char*)calloc(1, SECTOR_SIZE);
-    if (!buffer) {
+#ifdef _WIN32
+    int ret = _fseeki64(fp, (long long)(total_sectors * SECTOR_SIZE - 1), SEEK_SET);
+#else
+    int ret = fseeko(fp, (off_t)(total_sectors * SECTOR_SIZE - 1), SEEK_SET);
+#endif
+    if (ret != 0 || fputc(0, fp) == EOF) {
         fclose(fp);
         return -1;
     }
 
-    // 按照扇区写入，一次性写入可能会崩，受限于硬盘带宽
-    for (int i = 0; i < total_sectors; i++) {
-        if (fwrite(buffer, 1, SECTOR_SIZE, fp) != SECTOR_SIZE) {
-            free(buffer);
-            fclose(fp);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// 格式化镜像句柄对应的卷，指定了目录时同时写入目录内容；part为分区号(0为整个镜像)
+static int setup_volume(const create_cmd_args_t* args, image_t* img, UINT part)
+{
+    const char* dir  = args->n_dirs > (part ? part - 1 : 0) ? args->dirs[part ? part - 1 : 0] : NULL;
+    MKFS_PARM   parm = args->mkfs_parm;
+    parm.fmt |= FM_ZEROED;
+
+    if (dir && *dir) {
+        parm.fmt &= ~FM_EXFAT;  // build直接生成FAT表
+        if (!(parm.fmt & (FM_FAT | FM_FAT32))) {
+            fprintf(stderr, "分区 %u: 填充目录不支持exFAT\n", part);
             return -1;
         }
+        return build_volume(img, dir, &parm);
+    }
+    FRESULT fr = image_mkfs(img, &parm);
+    if (fr != FR_OK) {
+        if (part) {
+            fprintf(stderr, "分区 %u: 格式化失败 (%s: %d)\n", part, f_strerror(fr), fr);
+        } else {
+            fprintf(stderr, "创建文件系统失败 (%s: %d)\n", f_strerror(fr), fr);
+        }
+        return -1;
     }
-
-    free(buffer);
-    fclose(fp);
     return 0;
 }
 
+typedef struct part_worker_t {
+    const create_cmd_args_t* args;
+    image_t*                 img;    // 整个镜像的句柄，工作线程在其上打开各分区的句柄
+    UINT                     first;  // 该线程依次处理第 first, first+step, ... 个分区
+    UINT                     step;   // 线程数
+} part_worker_t;
+
+// 工作线程：每个分区打开一个独立的句柄(逻辑卷和工作缓冲区)，不与其他线程共享
+static int part_worker(void* arg)
+{
+    part_worker_t* w   = (part_worker_t*)arg;
+    int            ret = 0;
+    for (UINT part = w->first; part <= w->args->n_partitions; part += w->step) {
+        image_t* img = image_open_partition(w->img, (BYTE)part);
+        if (!img) {
+            fprintf(stderr, "分区 %u: 打开失败\n", part);
+            ret = -1;
+            continue;
+        }
+        if (setup_volume(w->args, img, part) != 0) {
+            ret = -1;
+        }
+        image_close(img);
+    }
+    return ret;
+}
+
+// 并行格式化(并填充)所有分区，每个线程同一时刻只打开一个分区句柄
+static int setup_partitions(const create_cmd_args_t* args, image_t* img)
+{
+    UINT n_workers = args->jobs ? (UINT)args->jobs : (UINT)thread_cpu_count();
+    if (n_workers > args->n_partitions) n_workers = args->n_partitions;
+    if (n_workers > MAX_WORKERS) n_workers = MAX_WORKERS;
+
+    part_worker_t workers[MAX_WORKERS];
+    thread_t*     threads[MAX_WORKERS] = {0};
+    for (UINT i = 0; i < n_workers; i++) {
+        workers[i] = (part_worker_t){.args = args, .img = img, .first = i + 1, .step = n_workers};
+    }
+    if (n_workers == 1) {
+        return part_worker(&workers[0]);
+    }
+
+    int ret = 0;
+    for (UINT i = 0; i < n_workers; i++) {
+        threads[i] = thread_start(part_worker, &workers[i]);
+        if (!threads[i]) {
+            fprintf(stderr, "创建线程失败\n");
+            ret = -1;
+            break;
+        }
+    }
+    for (UINT i = 0; i < n_workers; i++) {
+        if (threads[i] && thread_join(threads[i]) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
 // create命令执行函数
 int cmd_do_create(cmd_args_t arg)
 {
@@ -168,22 +425,50 @@ int cmd_do_create(cmd_args_t arg)
         return -1;
     }
 
-    if (create_virtual_disk(args->img_name, args->img_size * MB / SECTOR_SIZE) != 0) {
+    if (create_virtual_disk(args->img_name, (unsigned long long)args->img_size * MB / SECTOR_SIZE) !=
+        0) {
         fprintf(stderr, "创建虚拟磁盘文件失败: %s\n", args->img_name);
         return -1;
     }
 
-    extern char* disk_path;
-    disk_path = args->img_name;
+    image_t* img = image_open(args->img_name, NULL);
+    if (!img) {
+        remove(args->img_name);
+        fprintf(stderr, "打开虚拟磁盘文件失败: %s\n", args->img_name);
+        return -1;
+    }
 
-    // 创建文件系统
-    FRESULT fr = f_mkfs("", &args->mkfs_parm, work_buffer, sizeof(work_buffer));
-    if (fr != FR_OK) {
+    // 创建文件系统（新建的镜像全部为零，无需再清零FAT和根目录）
+    stats_reset();
+    int ret;
+    if (args->n_partitions == 0) {
+        ret = setup_volume(args, img, 0);
+    } else {
+        // 写入分区表后由工作线程分别格式化(并填充)各分区
+        FRESULT fr = image_fdisk(img, args->partitions);
+        if (fr != FR_OK) {
+            fprintf(stderr, "创建分区表失败 (%s: %d)\n", f_strerror(fr), fr);
+            ret = -1;
+        } else {
+            ret = setup_partitions(args, img);
+        }
+    }
+    if (image_close(img) != 0) {
+        ret = -1;
+    }
+    if (ret != 0) {
         remove(args->img_name);
-        fprintf(stderr, "创建文件系统失败 (%s: %d)\n", f_strerror(fr), fr);
         return -1;
     }
 
-    printf("虚拟磁盘创建成功: %s (%zu MB)\n", args->img_name, args->img_size);
+    if (args->n_partitions) {
+        printf("虚拟磁盘创建成功: %s (%zu MB, %u 个分区)\n", args->img_name, args->img_size,
+               args->n_partitions);
+    } else {
+        printf("虚拟磁盘创建成功: %s (%zu MB)\n", args->img_name, args->img_size);
+    }
+    if (args->stats) {
+        stats_print(stdout, args->stats);
+    }
     return 0;
 }
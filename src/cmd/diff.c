@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "diskio.h"
+#include "fferrno.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 同时挂载两个镜像(各占一个逻辑卷和物理驱动器)，先按目录项元数据(名称、类型、大小、时间戳、属性)合并比较两棵目录树，
+// 两边都有的文件再通过快速定位的簇链映射表取得各自的连续簇段，按段以多扇区为单位直接读出两边的扇区逐块memcmp，
+// 相同的块整块跳过，只在不同的块中定位变化的字节范围。
+
+#define DIFF_BUFFER_SIZE (4 * MB)  // 每次从每个镜像读出的最大字节数
+#define DIFF_CHUNK_SIZE 4096       // 块不同时再按该粒度memcmp，只逐字节扫描不同的小块
+#define DIFF_MERGE_GAP 64          // 间隔小于该字节数的两处变化合并为一个范围
+#define DIFF_MAX_RANGES 16         // 每个文件最多列出的变化范围数
+#define DIFF_LINKMAP_SIZE 64       // 簇链映射表的初始大小
+#define DIFF_PATH_MAX 4096
+
+typedef struct diff_opts_t {
+    int brief;  // 只列出有变化的文件，发现第一处不同即停止比较该文件
+    int times;  // 时间戳或属性不同也算作变化
+} diff_opts_t;
+
+typedef struct diff_entry_t {
+    char*   name;
+    FSIZE_t fsize;
+    WORD    fdate;
+    WORD    ftime;
+    BYTE    fattrib;
+} diff_entry_t;
+
+// 文件簇链上的读取位置
+typedef struct diff_run_t {
+    FATFS* fs;
+    DWORD* frag;  // 下一段(簇数, 起始簇号)
+    LBA_t  sect;  // 当前段中下一个要读的扇区
+    LBA_t  left;  // 当前段中剩余的扇区数
+} diff_run_t;
+
+typedef struct diff_ctx_t {
+    image_t*           img[2];
+    const diff_opts_t* opts;
+    BYTE*              buf[2];
+    const char*        cur;  // 正在比较的文件
+    FSIZE_t            cur_size[2];
+    int                cur_shown;  // 已输出该文件的标题行
+    int                n_ranges;
+    FSIZE_t            range_start;
+    FSIZE_t            range_end;  // 为0表示没有未输出的范围
+    unsigned long long changed;    // 该文件变化范围的总字节数
+    unsigned long long bytes;      // 两边共读出的字节数
+    long               n_files;
+    long               n_added;
+    long               n_removed;
+    long               n_modified;
+    long               n_errors;
+} diff_ctx_t;
+
+// FAT的文件名不区分大小写，按ASCII大小写无关的顺序排列两边的目录项
+static int _diff_namecmp(const char* a, const char* b)
+{
+    for (;; a++, b++) {
+        int ca = (unsigned char)*a, cb = (unsigned char)*b;
+        if (ca >= 'A' && ca <= 'Z') {
+            ca += 'a' - 'A';
+        }
+        if (cb >= 'A' && cb <= 'Z') {
+            cb += 'a' - 'A';
+        }
+        if (ca != cb || !ca) {
+            return ca - cb;
+        }
+    }
+}
+
+static int _diff_entry_cmp(const void* a, const void* b)
+{
+    return _diff_namecmp(((const diff_entry_t*)a)->name, ((const diff_entry_t*)b)->name);
+}
+
+static void _diff_free_list(diff_entry_t* list, int n)
+{
+    for (int i = 0; i < n; i++) {
+        free(list[i].name);
+    }
+    free(list);
+}
+
+// 读出目录中的所有目录项并按名称排序
+static FRESULT _diff_list(image_t* img, const char* path, diff_entry_t** out, int* count)
+{
+    DIR           dir;
+    FILINFO       fno;
+    diff_entry_t* list = NULL;
+    int           n = 0, cap = 0;
+    FRESULT       fr = image_opendir(img, &dir, path);
+    if (fr != FR_OK) {
+        return fr;
+    }
+    while ((fr = f_readdir(&dir, &fno)) == FR_OK && fno.fname[0]) {
+        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0) {
+            continue;
+        }
+        if (n == cap) {
+            cap                = cap ? cap * 2 : 64;
+            diff_entry_t* grow = (diff_entry_t*)realloc(list, cap * sizeof(diff_entry_t));
+            if (!grow) {
+                fr = FR_NOT_ENOUGH_CORE;
+                break;
+            }
+            list = grow;
+        }
+        list[n] = (diff_entry_t){strdup(fno.fname), fno.fsize, fno.fdate, fno.ftime, fno.fattrib};
+        if (!list[n].name) {
+            fr = FR_NOT_ENOUGH_CORE;
+            break;
+        }
+        n++;
+    }
+    f_closedir(&dir);
+    if (fr != FR_OK) {
+        _diff_free_list(list, n);
+        return fr;
+    }
+    if (n > 1) {
+        qsort(list, n, sizeof(diff_entry_t), _diff_entry_cmp);
+    }
+    *out   = list;
+    *count = n;
+    return FR_OK;
+}
+
+static void _diff_show(diff_ctx_t* ctx)
+{
+    if (ctx->cur_shown) {
+        return;
+    }
+    ctx->cur_shown = 1;
+    ctx->n_modified++;
+    if (ctx->cur_size[0] != ctx->cur_size[1]) {
+        printf("M\t%s (%llu -> %llu 字节)\n", ctx->cur, (unsigned long long)ctx->cur_size[0],
+               (unsigned long long)ctx->cur_size[1]);
+    } else {
+        printf("M\t%s\n", ctx->cur);
+    }
+}
+
+// 输出尚未输出的变化范围
+static void _diff_flush_range(diff_ctx_t* ctx)
+{
+    if (!ctx->range_end) {
+        return;
+    }
+    _diff_show(ctx);
+    ctx->n_ranges++;
+    ctx->changed += ctx->range_end - ctx->range_start;
+    if (!ctx->opts->brief && ctx->n_ranges <= DIFF_MAX_RANGES) {
+        printf("\t@ 0x%llx-0x%llx (%llu 字节)\n", (unsigned long long)ctx->range_start,
+               (unsigned long long)ctx->range_end,
+               (unsigned long long)(ctx->range_end - ctx->range_start));
+    }
+    ctx->range_end = 0;
+}
+
+// 记录偏移pos处的一个不同字节，与前一个范围间隔较小时合并
+static void _diff_mark(diff_ctx_t* ctx, FSIZE_t pos)
+{
+    if (ctx->range_end && pos <= ctx->range_end + DIFF_MERGE_GAP) {
+        ctx->range_end = pos + 1;
+        return;
+    }
+    _diff_flush_range(ctx);
+    ctx->range_start = pos;
+    ctx->range_end   = pos + 1;
+}
+
+// 比较文件偏移base处的两块数据，返回是否有不同
+static int _diff_block(diff_ctx_t* ctx, const BYTE* a, const BYTE* b, size_t len, FSIZE_t base)
+{
+    if (memcmp(a, b, len) == 0) {
+        return 0;
+    }
+    for (size_t off = 0; off < len; off += DIFF_CHUNK_SIZE) {
+        size_t n = len - off < DIFF_CHUNK_SIZE ? len - off : DIFF_CHUNK_SIZE;
+        if (memcmp(a + off, b + off, n) == 0) {
+            continue;
+        }
+        for (size_t i = off; i < off + n; i++) {
+            if (a[i] != b[i]) {
+                _diff_mark(ctx, base + i);
+            }
+        }
+    }
+    return 1;
+}
+
+// 取得文件的簇链映射表，small放不下时分配所需大小的表
+static FRESULT _diff_linkmap(FIL* fp, DWORD* small, DWORD** tbl)
+{
+    small[0]  = DIFF_LINKMAP_SIZE;
+    fp->cltbl = small;
+    FRESULT fr = f_lseek(fp, CREATE_LINKMAP);
+    *tbl       = small;
+    if (fr == FR_NOT_ENOUGH_CORE) {  // 碎片较多，按所需大小重新分配
+        DWORD  need = small[0];
+        DWORD* big  = (DWORD*)malloc(need * sizeof(DWORD));
+        if (!big) {
+            fp->cltbl = NULL;
+            return FR_NOT_ENOUGH_CORE;
+        }
+        big[0]    = need;
+        fp->cltbl = big;
+        *tbl      = big;
+        fr        = f_lseek(fp, CREATE_LINKMAP);
+    }
+    fp->cltbl = NULL;  // 映射表只用于取得簇段，之后不再经由文件对象读取
+    return fr;
+}
+
+static FRESULT _diff_run_read(diff_run_t* r, BYTE* buf, UINT n)
+{
+    if (disk_read(r->fs->pdrv, buf, r->sect, n) != RES_OK) {
+        return FR_DISK_ERR;
+    }
+    r->sect += n;
+    r->left -= n;
+    return FR_OK;
+}
+
+// 进入下一个连续簇段
+static FRESULT _diff_run_next(diff_run_t* r)
+{
+    if (!r->frag[0]) {
+        return FR_INT_ERR;  // 簇链比文件大小短
+    }
+    r->sect = r->fs->database + (LBA_t)r->fs->csize * (r->frag[1] - 2);
+    r->left = (LBA_t)r->frag[0] * r->fs->csize;
+    r->frag += 2;
+    return FR_OK;
+}
+
+// 沿两边的簇链比较文件的前len字节
+static FRESULT _diff_content(diff_ctx_t* ctx, FIL* fa, FIL* fb, FSIZE_t len)
+{
+    DWORD   small[2][DIFF_LINKMAP_SIZE];
+    DWORD*  tbl[2] = {small[0], small[1]};
+    FRESULT fr     = _diff_linkmap(fa, small[0], &tbl[0]);
+    if (fr == FR_OK) {
+        fr = _diff_linkmap(fb, small[1], &tbl[1]);
+    }
+
+    diff_run_t run[2] = {{fa->obj.fs, tbl[0] + 1, 0, 0}, {fb->obj.fs, tbl[1] + 1, 0, 0}};
+    FSIZE_t    off    = 0;
+    UINT       max_n  = DIFF_BUFFER_SIZE / SECTOR_SIZE;
+    while (fr == FR_OK && off < len) {
+        for (int i = 0; i < 2 && fr == FR_OK; i++) {
+            if (!run[i].left) {
+                fr = _diff_run_next(&run[i]);
+            }
+        }
+        if (fr != FR_OK) {
+            break;
+        }
+        FSIZE_t rest = len - off;
+        LBA_t   n    = run[0].left < run[1].left ? run[0].left : run[1].left;
+        if (n > max_n) {
+            n = max_n;
+        }
+        if (n > (rest + SECTOR_SIZE - 1) / SECTOR_SIZE) {
+            n = (rest + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        }
+        fr = _diff_run_read(&run[0], ctx->buf[0], (UINT)n);
+        if (fr == FR_OK) {
+            fr = _diff_run_read(&run[1], ctx->buf[1], (UINT)n);
+        }
+        if (fr != FR_OK) {
+            break;
+        }
+        size_t cmp = (size_t)(rest < (FSIZE_t)n * SECTOR_SIZE ? rest : (FSIZE_t)n * SECTOR_SIZE);
+        ctx->bytes += 2 * cmp;
+        if (_diff_block(ctx, ctx->buf[0], ctx->buf[1], cmp, off) && ctx->opts->brief) {
+            break;
+        }
+        off += cmp;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (tbl[i] != small[i]) {
+            free(tbl[i]);
+        }
+    }
+    return fr;
+}
+
+static void _diff_file(diff_ctx_t* ctx, const char* path, const diff_entry_t* ea, const diff_entry_t* eb)
+{
+    ctx->cur         = path;
+    ctx->cur_size[0] = ea->fsize;
+    ctx->cur_size[1] = eb->fsize;
+    ctx->cur_shown   = 0;
+    ctx->n_ranges    = 0;
+    ctx->range_end   = 0;
+    ctx->changed     = 0;
+    ctx->n_files++;
+
+    FSIZE_t common = ea->fsize < eb->fsize ? ea->fsize : eb->fsize;
+    if (ea->fsize != eb->fsize && ctx->opts->brief) {
+        common = 0;  // 大小不同已经足够判断
+    }
+    if (common) {
+        FIL     fa, fb;
+        FRESULT fr = image_fopen(ctx->img[0], &fa, path, FA_READ);
+        if (fr == FR_OK) {
+            fr = image_fopen(ctx->img[1], &fb, path, FA_READ);
+            if (fr == FR_OK) {
+                fr = _diff_content(ctx, &fa, &fb, common);
+                f_close(&fb);
+            }
+            f_close(&fa);
+        }
+        if (fr != FR_OK) {
+            fprintf(stderr, "比较文件失败: %s (%s)\n", path, f_strerror(fr));
+            ctx->n_errors++;
+            return;
+        }
+    }
+    if (ea->fsize != eb->fsize) {
+        _diff_mark(ctx, common);
+        ctx->range_end = ea->fsize > eb->fsize ? ea->fsize : eb->fsize;
+    }
+    _diff_flush_range(ctx);
+
+    if (ctx->cur_shown) {
+        if (!ctx->opts->brief && ctx->n_ranges > DIFF_MAX_RANGES) {
+            printf("\t... 共 %d 处, %llu 字节\n", ctx->n_ranges, ctx->changed);
+        }
+    } else if (ctx->opts->times && (ea->fdate != eb->fdate || ea->ftime != eb->ftime ||
+                                    ea->fattrib != eb->fattrib)) {
+        printf("m\t%s\n", path);  // 内容相同，只有时间戳或属性不同
+        ctx->n_modified++;
+    }
+}
+
+static void _diff_only(diff_ctx_t* ctx, const char* path, const diff_entry_t* e, int side)
+{
+    printf("%c\t%s%s\n", side ? 'A' : 'D', path, e->fattrib & AM_DIR ? "/" : "");
+    if (side) {
+        ctx->n_added++;
+    } else {
+        ctx->n_removed++;
+    }
+}
+
+// 合并比较两边的同名目录，path[0..len)为目录路径
+static void _diff_dir(diff_ctx_t* ctx, char* path, size_t len)
+{
+    diff_entry_t* list[2] = {NULL, NULL};
+    int           n[2]    = {0, 0};
+    for (int s = 0; s < 2; s++) {
+        FRESULT fr = _diff_list(ctx->img[s], path, &list[s], &n[s]);
+        if (fr != FR_OK) {
+            fprintf(stderr, "无法读取目录: %s (%s)\n", path, f_strerror(fr));
+            ctx->n_errors++;
+            _diff_free_list(list[0], n[0]);
+            return;
+        }
+    }
+
+    int i = 0, j = 0;
+    while (i < n[0] || j < n[1]) {
+        int c = i == n[0] ? 1 : j == n[1] ? -1 : _diff_namecmp(list[0][i].name, list[1][j].name);
+        const char* name = c <= 0 ? list[0][i].name : list[1][j].name;
+        int         k    = snprintf(path + len, DIFF_PATH_MAX - len, "%s%s",
+                                    len && path[len - 1] == '/' ? "" : "/", name);
+        if (k < 0 || len + k >= DIFF_PATH_MAX) {
+            path[len] = '\0';
+            fprintf(stderr, "路径过长: %s/%s\n", path, name);
+            ctx->n_errors++;
+        } else if (c < 0) {
+            _diff_only(ctx, path, &list[0][i], 0);
+        } else if (c > 0) {
+            _diff_only(ctx, path, &list[1][j], 1);
+        } else {
+            const diff_entry_t* ea = &list[0][i];
+            const diff_entry_t* eb = &list[1][j];
+            if ((ea->fattrib & AM_DIR) != (eb->fattrib & AM_DIR)) {
+                _diff_only(ctx, path, ea, 0);
+                _diff_only(ctx, path, eb, 1);
+            } else if (ea->fattrib & AM_DIR) {
+                if (ctx->opts->times && (ea->fdate != eb->fdate || ea->ftime != eb->ftime ||
+                                         ea->fattrib != eb->fattrib)) {
+                    printf("m\t%s/\n", path);
+                    ctx->n_modified++;
+                }
+                _diff_dir(ctx, path, len + k);
+            } else {
+                _diff_file(ctx, path, ea, eb);
+            }
+        }
+        path[len] = '\0';
+        i += c <= 0;
+        j += c >= 0;
+    }
+    _diff_free_list(list[0], n[0]);
+    _diff_free_list(list[1], n[1]);
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 比较两个镜像中的src目录，相同返回0，有变化返回1，出错返回-1
+static int _diff_run(image_t* a, image_t* b, const char* src, const diff_opts_t* opts)
+{
+    diff_ctx_t ctx = {.img = {a, b}, .opts = opts};
+    char*      path = (char*)malloc(DIFF_PATH_MAX);
+    ctx.buf[0]      = (BYTE*)malloc(DIFF_BUFFER_SIZE);
+    ctx.buf[1]      = (BYTE*)malloc(DIFF_BUFFER_SIZE);
+    if (!path || !ctx.buf[0] || !ctx.buf[1]) {
+        fprintf(stderr, "内存不足\n");
+        free(path);
+        free(ctx.buf[0]);
+        free(ctx.buf[1]);
+        return -1;
+    }
+
+    double t0 = _now();
+    snprintf(path, DIFF_PATH_MAX, "%s", src);
+    _diff_dir(&ctx, path, strlen(path));
+    fflush(stdout);
+    double secs = _now() - t0;
+
+    fprintf(stderr, "比较 %ld 个文件, 读取 %llu 字节, 用时 %.3f 秒, %.1f MB/s; 新增 %ld, 删除 %ld, 修改 %ld\n",
+            ctx.n_files, ctx.bytes, secs, secs > 0 ? ctx.bytes / secs / MB : 0.0, ctx.n_added,
+            ctx.n_removed, ctx.n_modified);
+
+    free(path);
+    free(ctx.buf[0]);
+    free(ctx.buf[1]);
+    if (ctx.n_errors) {
+        return -1;
+    }
+    return ctx.n_added || ctx.n_removed || ctx.n_modified ? 1 : 0;
+}
+
+typedef struct diff_cmd_args_t {
+    char*       img_paths[2];
+    BYTE        partitions[2];
+    int         n_images;
+    char*       src;
+    diff_opts_t opts;
+} diff_cmd_args_t;
+
+const char* diff_help_str =
+    "用法: diff [选项]\n"
+    "比较两个镜像中的目录树，列出新增(A)、删除(D)、修改(M)的文件和变化的字节范围。\n"
+    "两边都有的文件沿各自的簇链直接读取扇区比较，相同的数据块整块跳过。\n"
+    "没有变化时返回0，有变化时返回1。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     依次指定旧镜像和新镜像的路径。(必填两次)\n"
+    "  -P, --partition=序号    前一个 -p 镜像使用的分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -s, --src=路径          只比较镜像内的该目录。(默认: /)\n"
+    "  -q, --brief             只列出有变化的文件，不定位变化的字节范围。\n"
+    "  -t, --times             内容相同但时间戳或属性不同时也列出(m)。\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const diff_cmd_args_t default_args = {
+    .n_images = 0,
+    .src      = "/",
+};
+
+cmd_args_t cmd_parse_diff_args(int argc, char** argv)
+{
+    diff_cmd_args_t* args = (diff_cmd_args_t*)calloc(1, sizeof(diff_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"src", required_argument, 0, 's'},
+                                           {"brief", no_argument, 0, 'q'},
+                                           {"times", no_argument, 0, 't'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:s:qth", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                if (args->n_images >= 2) {
+                    fprintf(stderr, "只能比较两个镜像\n");
+                    cmd_free_diff_args(args);
+                    return NULL;
+                }
+                args->img_paths[args->n_images++] = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (args->n_images == 0 ||
+                    cmd_parse_partition(optarg, &args->partitions[args->n_images - 1]) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_diff_args(args);
+                    return NULL;
+                }
+                break;
+            case 's':  // src
+                cmd_args_field_should_free(args, src, default_args);
+                args->src = strdup(optarg);
+                break;
+            case 'q':  // brief
+                args->opts.brief = 1;
+                break;
+            case 't':  // times
+                args->opts.times = 1;
+                break;
+            case 'h':  // help
+                printf("%s", diff_help_str);
+                cmd_free_diff_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_diff_args(args);
+                return NULL;
+        }
+    }
+
+    if (args->n_images != 2) {
+        fprintf(stderr, "必需参数: --img-path=旧镜像 --img-path=新镜像\n");
+        cmd_free_diff_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_diff_args(cmd_args_t arg)
+{
+    diff_cmd_args_t* args = cmd_args_cast(arg, diff_cmd_args_t);
+    if (args) {
+        for (int i = 0; i < args->n_images; i++) {
+            free(args->img_paths[i]);
+        }
+        cmd_args_field_should_free(args, src, default_args);
+        free(args);
+    }
+}
+
+int cmd_do_diff(cmd_args_t arg)
+{
+    diff_cmd_args_t* args = cmd_args_cast(arg, diff_cmd_args_t);
+    if (!args || args->n_images != 2) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    image_t* imgs[2] = {NULL, NULL};
+    int      ret     = 0;
+    for (int i = 0; i < 2 && ret == 0; i++) {
+        image_opts_t opts = {.partition = args->partitions[i]};
+        imgs[i]           = image_open(args->img_paths[i], &opts);
+        if (!imgs[i]) {
+            fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_paths[i]);
+            ret = -1;
+            break;
+        }
+        FRESULT fr = image_mount(imgs[i]);
+        if (fr != FR_OK) {
+            fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_paths[i], f_strerror(fr),
+                    fr);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = _diff_run(imgs[0], imgs[1], args->src, &args->opts);
+    }
+    image_close(imgs[1]);
+    image_close(imgs[0]);
+    return ret;
+}
@@ -4,17 +4,18 @@
 #include "cmd.h"
 #include "ff.h"
 #include "fferrno.h"
+#include "stats.h"
 
 #ifdef _WIN32
 #define strdup _strdup
 #endif
 
-#define WORK_BUFFER_SIZE 4096               // 工作缓冲区大小
-static char work_buffer[WORK_BUFFER_SIZE];  // 定义静态工作缓冲区
-
 typedef struct format_cmd_args_t {
     char*     img_path;
     MKFS_PARM mkfs_parm;
+    int       zeroed;  // 镜像已全部为零
+    int       stats;   // 输出性能计数器的格式(stats_mode_t)
+    BYTE      partition;  // 只格式化分区表中的该分区，0为整个镜像
 } format_cmd_args_t;
 
 const char* format_help_str =
@@ -22,11 +23,14 @@ const char* format_help_str =
     "格式化虚拟磁盘镜像。\n\n"
     "选项:\n"
     "  -p, --img-path=路径    指定虚拟磁盘镜像的路径。(必填)\n"
-    "  -f, --fmt=类型         指定FAT类型 (FAT12, FAT16, FAT32, EXFAT, SFD)。\n"
+    "  -f, --fmt=类型         指定FAT类型 (FAT12, FAT16, FAT32, EXFAT, ANY, SFD，可用逗号组合，或FM_*数值)。\n"
     "  --n-fat=数量           指定FAT表的数量 (0=默认)。\n"
     "  --align=数值           指定数据区域的扇区对齐大小 (0=默认)。\n"
     "  --n-root=数量          指定根目录的数量 (0=默认)。\n"
     "  --au-size=大小         指定簇大小(字节) (0=默认)。\n"
+    "  --zeroed               镜像已全部为零(如刚创建的稀疏文件)，跳过清零FAT和根目录。\n"
+    "  --stats[=json]         完成后输出I/O和元数据计数器 (text或json)。\n"
+    "  --partition=序号       只格式化已有分区表中的第几个分区(从1开始)，不改动分区表。\n"
     "  -h, --help             显示此帮助信息。\n";
 
 static const format_cmd_args_t default_args = {
@@ -67,7 +71,10 @@ cmd_args_t cmd_parse_format_args(int argc, char** argv)
         {"img-path", required_argument, 0, 'p'}, {"fmt", optional_argument, 0, 'f'},
         {"n-fat", optional_argument, 0, 4},      {"align", optional_argument, 0, 5},
         {"n-root", optional_argument, 0, 6},     {"au-size", optional_argument, 0, 7},
-        {"help", no_argument, 0, 'h'},           {0, 0, 0, 0}};
+        {"zeroed", no_argument, 0, 8},           {"stats", optional_argument, 0, 9},
+        {"partition", required_argument, 0, 10},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
 
     int opt;
     int option_index = 0;
@@ -79,7 +86,11 @@ cmd_args_t cmd_parse_format_args(int argc, char** argv)
                 args->img_path = strdup(optarg);
                 break;
             case 'f':  // fmt
-                args->mkfs_parm.fmt = atoi(optarg);
+                if (cmd_parse_fmt(optarg, &args->mkfs_parm.fmt) != 0) {
+                    fprintf(stderr, "无效的FAT类型: %s\n", optarg);
+                    cmd_free_format_args(args);
+                    return NULL;
+                }
                 break;
             case 4:  // n-fat
                 args->mkfs_parm.n_fat = atoi(optarg);
@@ -93,6 +104,24 @@ cmd_args_t cmd_parse_format_args(int argc, char** argv)
             case 7:  // au-size
                 args->mkfs_parm.au_size = atoll(optarg);
                 break;
+            case 8:  // zeroed
+                args->zeroed = 1;
+                break;
+            case 9:  // stats
+                args->stats = stats_parse_mode(optarg);
+                if (args->stats < 0) {
+                    fprintf(stderr, "无效的统计输出格式: %s\n", optarg);
+                    cmd_free_format_args(args);
+                    return NULL;
+                }
+                break;
+            case 10:  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_format_args(args);
+                    return NULL;
+                }
+                break;
             case 'h':  // help
                 printf("%s", format_help_str);
                 cmd_free_format_args(args);
@@ -133,17 +162,31 @@ int cmd_do_format(cmd_args_t arg)
         return -1;
     }
 
-    // 设置全局磁盘路径
-    extern char* disk_path;
-    disk_path = args->img_path;
+    image_opts_t opts = {.partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
 
     // 格式化文件系统
-    FRESULT fr = f_mkfs("", &args->mkfs_parm, work_buffer, sizeof(work_buffer));
+    MKFS_PARM parm = args->mkfs_parm;
+    if (args->zeroed) {
+        parm.fmt |= FM_ZEROED;
+    }
+    stats_reset();
+    FRESULT fr = image_mkfs(img, &parm);
+    if (image_close(img) != 0 && fr == FR_OK) {
+        fr = FR_DISK_ERR;
+    }
     if (fr != FR_OK) {
         fprintf(stderr, "格式化文件系统失败！(%s: %d)\n", f_strerror(fr), fr);
         return -1;
     }
 
     printf("虚拟磁盘格式成功: %s\n", args->img_path);
+    if (args->stats) {
+        stats_print(stdout, args->stats);
+    }
     return 0;
 }
@@ -3,10 +3,17 @@
 #include <string.h>
 #include "cmd.h"
 #include "fferrno.h"
+#include "fsindex.h"
+#include "trace.h"
 
 typedef struct mount_cmd_args_t {
     char* img_path;
     char* driver_number;
+    char* trace_path;    // 卸载时写入Chrome trace JSON的路径
+    char* overlay_path;  // 写时复制增量文件的路径
+    char* index_path;    // 目录树索引文件的路径
+    long  writeback;     // 延迟写回的冲刷间隔(秒)，<0不启用，0只在sync和卸载时冲刷
+    BYTE  partition;     // 挂载的分区号，0为自动查找第一个分区
 } mount_cmd_args_t;
 
 const char* mount_help_str =
@@ -14,12 +21,23 @@ const char* mount_help_str =
     "挂载虚拟磁盘镜像。\n\n"
     "选项:\n"
     "  -p, --img-path=/path/to/img  指定虚拟磁盘镜像的名称。(默认: disk.img)\n"
-    "  -d, --driver-number=数值     指定要使用的驱动器编号。(默认: 0)\n"
+    "  -d, --driver-number=数值     已废弃，逻辑卷由镜像句柄自动分配，该选项被忽略。\n"
+    "  -t, --trace=文件             记录API调用和磁盘I/O事件，卸载时写入Chrome trace JSON文件。\n"
+    "  -o, --overlay=文件           以写时复制方式挂载：镜像只读，写入保存到该增量文件(不存在时创建)。\n"
+    "  -i, --index[=文件]           使用目录树索引文件(默认: 镜像路径.idx)：卷未被修改时直接加载，卸载时更新。\n"
+    "  -w, --writeback[=秒]         延迟写回：元数据写入缓存在内存中，在sync命令、卸载或每隔指定秒数时写入镜像。\n"
+    "                               进程崩溃或被杀死时未写回的修改全部丢失，镜像可能不一致。\n"
+    "  -P, --partition=序号         挂载分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
     "  -h, --help                   显示此帮助信息。\n";
 
 static const mount_cmd_args_t default_args = {
     .img_path      = "disk.img",
     .driver_number = "",
+    .trace_path    = NULL,
+    .overlay_path  = NULL,
+    .index_path    = NULL,
+    .writeback     = -1,
+    .partition     = 0,
 };
 
 cmd_args_t cmd_parse_mount_args(int argc, char** argv)
@@ -33,12 +51,18 @@ cmd_args_t cmd_parse_mount_args(int argc, char** argv)
 
     static struct option long_options[] = {{"img-path", optional_argument, NULL, 'p'},
                                            {"driver-number", optional_argument, NULL, 'd'},
+                                           {"trace", required_argument, NULL, 't'},
+                                           {"overlay", required_argument, NULL, 'o'},
+                                           {"index", optional_argument, NULL, 'i'},
+                                           {"writeback", optional_argument, NULL, 'w'},
+                                           {"partition", required_argument, NULL, 'P'},
                                            {"help", no_argument, NULL, 'h'},
                                            {0, 0, 0, 0}};
 
     int opt;
-    int opt_index = 0;
-    while ((opt = getopt_long(argc, argv, "p:d:h", long_options, &opt_index)) != -1) {
+    int opt_index     = 0;
+    int index_default = 0;
+    while ((opt = getopt_long(argc, argv, "p:d:t:o:i::w::P:h", long_options, &opt_index)) != -1) {
         switch (opt) {
             case 'p':
                 args->img_path = strdup(optarg);
@@ -46,6 +70,37 @@ cmd_args_t cmd_parse_mount_args(int argc, char** argv)
             case 'd':
                 args->driver_number = strdup(optarg);
                 break;
+            case 't':
+                cmd_args_field_should_free(args, trace_path, default_args);
+                args->trace_path = strdup(optarg);
+                break;
+            case 'o':
+                cmd_args_field_should_free(args, overlay_path, default_args);
+                args->overlay_path = strdup(optarg);
+                break;
+            case 'i':
+                cmd_args_field_should_free(args, index_path, default_args);
+                if (optarg) {
+                    args->index_path = strdup(optarg);
+                } else {
+                    index_default = 1;
+                }
+                break;
+            case 'w':
+                args->writeback = 0;
+                if (optarg && cmd_parse_writeback(optarg, &args->writeback) != 0) {
+                    fprintf(stderr, "无效的写回间隔: %s\n", optarg);
+                    cmd_free_mount_args(args);
+                    return NULL;
+                }
+                break;
+            case 'P':
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_mount_args(args);
+                    return NULL;
+                }
+                break;
             case 'h':
                 printf("%s", mount_help_str);
                 cmd_free_mount_args(args);
@@ -63,6 +118,15 @@ cmd_args_t cmd_parse_mount_args(int argc, char** argv)
         return NULL;
     }
 
+    if (index_default && !args->index_path) {
+        size_t len       = strlen(args->img_path);
+        args->index_path = (char*)malloc(len + sizeof(".idx"));
+        if (args->index_path) {
+            memcpy(args->index_path, args->img_path, len);
+            memcpy(args->index_path + len, ".idx", sizeof(".idx"));
+        }
+    }
+
     return (cmd_args_t)args;
 }
 
@@ -72,6 +136,9 @@ void cmd_free_mount_args(cmd_args_t arg)
     if (args) {
         cmd_args_field_should_free(args, img_path, default_args);
         cmd_args_field_should_free(args, driver_number, default_args);
+        cmd_args_field_should_free(args, trace_path, default_args);
+        cmd_args_field_should_free(args, overlay_path, default_args);
+        cmd_args_field_should_free(args, index_path, default_args);
         free(args);
     }
 }
@@ -83,24 +150,60 @@ int cmd_do_mount(cmd_args_t arg)
         return -1;
     }
 
-    extern char* disk_path;
-    disk_path = args->img_path;
+    if (args->trace_path && trace_start() != 0) {
+        return -1;
+    }
 
-    FATFS   fs;
-    FRESULT fr = f_mount(&fs, args->driver_number, 0);
+    image_opts_t opts = {
+        .overlay_path       = args->overlay_path,
+        .writeback          = args->writeback >= 0,
+        .writeback_interval = args->writeback,
+        .partition          = args->partition,
+    };
+    image_t* img = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));  // shell中不带卷前缀的路径都指向该镜像
+    }
     if (fr != FR_OK) {
         fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
         return -1;
     }
 
-    // printf("Mounted virtual disk image %s to driver %s.\n", args->img_path, args->driver_number);
-    shell_run();
+    // 未指定索引文件时目录树只在本次会话中缓存
+    long n_index = fsindex_open(image_fs(img), args->index_path);
+    if (args->index_path && n_index > 0) {
+        printf("已从索引加载 %ld 项: %s\n", n_index, args->index_path);
+    }
 
-    fr = f_unmount(args->driver_number);
-    if (fr != FR_OK) {
-        fprintf(stderr, "卸载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+    shell_run(img);
+
+    n_index = fsindex_close(args->index_path);
+    if (n_index < 0) {
+        fprintf(stderr, "写入索引文件失败: %s\n", args->index_path);
+    } else if (n_index > 0) {
+        printf("已写入索引 %ld 项: %s\n", n_index, args->index_path);
+    }
+
+    // 卸载并写回延迟写回缓存，失败时镜像可能不一致
+    if (image_close(img) != 0) {
+        fprintf(stderr, "写回虚拟磁盘镜像失败: %s\n", args->img_path);
         return -1;
     }
 
+    if (args->trace_path) {
+        long n = trace_dump(args->trace_path);
+        if (n < 0) {
+            fprintf(stderr, "写入跟踪文件失败: %s\n", args->trace_path);
+            return -1;
+        }
+        printf("已写入 %ld 个跟踪事件: %s\n", n, args->trace_path);
+    }
+
     return 0;
 }
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "packed.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// pack 把镜像按固定大小的块分别压缩为只读的压缩镜像，mount、sum、diff、export-tar等命令可以直接打开；
+// 需要修改时用 mount -o 把写入保存到增量文件，或用 unpack 还原为普通镜像
+
+typedef struct pack_cmd_args_t {
+    char* img_path;
+    char* output;
+    DWORD block_size;
+} pack_cmd_args_t;
+
+const char* pack_help_str =
+    "用法: pack [选项]\n"
+    "把镜像按块压缩为只读的压缩镜像，可以直接挂载和浏览(按需解压，最近使用的块保存在缓存中)。\n"
+    "全零的块和稀疏镜像中的空洞不占空间。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定要压缩的镜像。(必填)\n"
+    "  -o, --output=路径       压缩镜像的路径。(必填)\n"
+    "  -b, --block-size=大小   块大小(KB，2的幂，4-1024)。块越大压缩率越高，随机读取越慢。(默认: 64)\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const pack_cmd_args_t default_args = {
+    .img_path   = NULL,
+    .output     = NULL,
+    .block_size = PACKED_BLOCK_DEFAULT,
+};
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _print_stats(const packed_stats_t* st, double secs)
+{
+    fprintf(stderr, "镜像 %.1f MB, 压缩镜像 %.1f MB (%.1f%%); %llu 块, 全零 %llu, 未压缩 %llu; 用时 %.3f 秒, %.1f MB/s\n",
+            (double)st->image_bytes / MB, (double)st->packed_bytes / MB,
+            st->image_bytes ? 100.0 * st->packed_bytes / st->image_bytes : 0.0, (unsigned long long)st->blocks,
+            (unsigned long long)st->zero_blocks, (unsigned long long)st->raw_blocks, secs,
+            secs > 0 ? st->image_bytes / secs / MB : 0.0);
+}
+
+cmd_args_t cmd_parse_pack_args(int argc, char** argv)
+{
+    pack_cmd_args_t* args = (pack_cmd_args_t*)calloc(1, sizeof(pack_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"output", required_argument, 0, 'o'},
+                                           {"block-size", required_argument, 0, 'b'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:o:b:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'o':  // output
+                cmd_args_field_should_free(args, output, default_args);
+                args->output = strdup(optarg);
+                break;
+            case 'b': {  // block-size
+                char*         end;
+                unsigned long kb = strtoul(optarg, &end, 10);
+                DWORD         bs = (DWORD)(kb * KB);
+                if (*end || kb == 0 || kb > PACKED_BLOCK_MAX / KB || bs < PACKED_BLOCK_MIN || (bs & (bs - 1))) {
+                    fprintf(stderr, "无效的块大小: %s\n", optarg);
+                    cmd_free_pack_args(args);
+                    return NULL;
+                }
+                args->block_size = bs;
+                break;
+            }
+            case 'h':  // help
+                printf("%s", pack_help_str);
+                cmd_free_pack_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_pack_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path || !args->output) {
+        fprintf(stderr, "必需参数: --img-path=路径 --output=路径\n");
+        cmd_free_pack_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_pack_args(cmd_args_t arg)
+{
+    pack_cmd_args_t* args = cmd_args_cast(arg, pack_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        cmd_args_field_should_free(args, output, default_args);
+        free(args);
+    }
+}
+
+int cmd_do_pack(cmd_args_t arg)
+{
+    pack_cmd_args_t* args = cmd_args_cast(arg, pack_cmd_args_t);
+    if (!args || !args->img_path || !args->output) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+    if (packed_probe(args->img_path)) {
+        fprintf(stderr, "已经是压缩镜像: %s\n", args->img_path);
+        return -1;
+    }
+
+    packed_stats_t st;
+    double         t0 = _now();
+    if (packed_pack(args->img_path, args->output, args->block_size, &st) != 0) {
+        fprintf(stderr, "压缩镜像失败: %s -> %s\n", args->img_path, args->output);
+        remove(args->output);
+        return -1;
+    }
+    _print_stats(&st, _now() - t0);
+    return 0;
+}
+
+typedef struct unpack_cmd_args_t {
+    char* img_path;
+    char* output;
+} unpack_cmd_args_t;
+
+const char* unpack_help_str =
+    "用法: unpack [选项]\n"
+    "把pack生成的压缩镜像还原为普通镜像，全零的块在输出中为稀疏的空洞。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定压缩镜像。(必填)\n"
+    "  -o, --output=路径       还原后的镜像路径。(必填)\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const unpack_cmd_args_t default_unpack_args = {
+    .img_path = NULL,
+    .output   = NULL,
+};
+
+cmd_args_t cmd_parse_unpack_args(int argc, char** argv)
+{
+    unpack_cmd_args_t* args = (unpack_cmd_args_t*)calloc(1, sizeof(unpack_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_unpack_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"output", required_argument, 0, 'o'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:o:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_unpack_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'o':  // output
+                cmd_args_field_should_free(args, output, default_unpack_args);
+                args->output = strdup(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", unpack_help_str);
+                cmd_free_unpack_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_unpack_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path || !args->output) {
+        fprintf(stderr, "必需参数: --img-path=路径 --output=路径\n");
+        cmd_free_unpack_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_unpack_args(cmd_args_t arg)
+{
+    unpack_cmd_args_t* args = cmd_args_cast(arg, unpack_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_unpack_args);
+        cmd_args_field_should_free(args, output, default_unpack_args);
+        free(args);
+    }
+}
+
+int cmd_do_unpack(cmd_args_t arg)
+{
+    unpack_cmd_args_t* args = cmd_args_cast(arg, unpack_cmd_args_t);
+    if (!args || !args->img_path || !args->output) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+    if (!packed_probe(args->img_path)) {
+        fprintf(stderr, "不是压缩镜像: %s\n", args->img_path);
+        return -1;
+    }
+
+    packed_stats_t st;
+    double         t0 = _now();
+    if (packed_unpack(args->img_path, args->output, &st) != 0) {
+        fprintf(stderr, "还原镜像失败: %s -> %s\n", args->img_path, args->output);
+        remove(args->output);
+        return -1;
+    }
+    _print_stats(&st, _now() - t0);
+    return 0;
+}
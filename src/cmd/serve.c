@@ -0,0 +1,624 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "fferrno.h"
+#include "fsindex.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 协议：客户端每个请求发送一行shell命令(以'\n'结尾)；服务端执行后先回复一行
+// "<返回值> <耗时(微秒)> <输出字节数>\n"，再跟上命令在stdout/stderr上的全部输出。
+// exit 结束当前连接，shutdown 卸载所有镜像并退出服务
+
+#define SERVE_MAX_IMAGES FF_VOLUMES  // 同时挂载的镜像数上限，每个镜像占用一个逻辑卷
+#define SERVE_LINE_MAX 4096          // 一条请求的最大长度(含换行符)
+#define SERVE_HEADER_MAX 64          // 回复头的最大长度
+#define SERVE_COPY_SIZE (64 * KB)    // 转发命令输出时的缓冲区大小
+#define SERVE_DEFAULT_SOCKET PROGRAM_NAME ".sock"
+
+typedef struct serve_cmd_args_t {
+    char* img_paths[SERVE_MAX_IMAGES];
+    int   n_images;
+    char* socket_path;
+    long  writeback;  // 延迟写回的冲刷间隔(秒)，<0不启用，0只在sync和退出时冲刷
+    int   verbose;    // 在服务端输出每个请求的耗时
+} serve_cmd_args_t;
+
+typedef struct client_cmd_args_t {
+    char*  socket_path;
+    char** cmds;    // -c 指定的命令，为空时从标准输入逐行读取
+    int    n_cmds;
+    int    timing;  // 在stderr上输出每个请求的服务端耗时和往返耗时
+} client_cmd_args_t;
+
+const char* serve_help_str =
+    "用法: serve [选项]\n"
+    "挂载一个或多个虚拟磁盘镜像并常驻，在Unix域套接字上执行shell命令(由 client 命令发送)。\n"
+    "第一个镜像为当前驱动器，其余镜像用 \"1:/路径\" 这样的卷前缀访问。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     要挂载的镜像，可重复指定，数量不超过FatFs的逻辑卷数(FF_VOLUMES)。(必填)\n"
+    "  -S, --socket=路径       监听的套接字路径。(默认: " SERVE_DEFAULT_SOCKET ")\n"
+    "  -w, --writeback[=秒]    延迟写回，含义同 mount -w；缓存在 sync、shutdown 或每隔指定秒数时写回。\n"
+    "  -v, --verbose           输出每个请求的命令、返回值和耗时。\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+const char* client_help_str =
+    "用法: client [选项]\n"
+    "向 serve 发送shell命令并输出结果，未指定 -c 时从标准输入逐行读取命令。\n\n"
+    "选项:\n"
+    "  -S, --socket=路径       服务端的套接字路径。(默认: " SERVE_DEFAULT_SOCKET ")\n"
+    "  -c, --cmd=命令          要执行的命令，可重复指定。\n"
+    "  -t, --time              在标准错误上输出每个请求的服务端耗时和往返耗时。\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const serve_cmd_args_t default_serve_args = {
+    .n_images    = 0,
+    .socket_path = SERVE_DEFAULT_SOCKET,
+    .writeback   = -1,
+    .verbose     = 0,
+};
+
+static const client_cmd_args_t default_client_args = {
+    .socket_path = SERVE_DEFAULT_SOCKET,
+    .cmds        = NULL,
+    .n_cmds      = 0,
+    .timing      = 0,
+};
+
+cmd_args_t cmd_parse_serve_args(int argc, char** argv)
+{
+    serve_cmd_args_t* args = (serve_cmd_args_t*)calloc(1, sizeof(serve_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_serve_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"socket", required_argument, 0, 'S'},
+                                           {"writeback", optional_argument, 0, 'w'},
+                                           {"verbose", no_argument, 0, 'v'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:S:w::vh", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                if (args->n_images >= SERVE_MAX_IMAGES) {
+                    fprintf(stderr, "最多挂载 %d 个镜像\n", SERVE_MAX_IMAGES);
+                    cmd_free_serve_args(args);
+                    return NULL;
+                }
+                args->img_paths[args->n_images++] = strdup(optarg);
+                break;
+            case 'S':  // socket
+                cmd_args_field_should_free(args, socket_path, default_serve_args);
+                args->socket_path = strdup(optarg);
+                break;
+            case 'w':  // writeback
+                args->writeback = 0;
+                if (optarg && cmd_parse_writeback(optarg, &args->writeback) != 0) {
+                    fprintf(stderr, "无效的写回间隔: %s\n", optarg);
+                    cmd_free_serve_args(args);
+                    return NULL;
+                }
+                break;
+            case 'v':  // verbose
+                args->verbose = 1;
+                break;
+            case 'h':  // help
+                printf("%s", serve_help_str);
+                cmd_free_serve_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_serve_args(args);
+                return NULL;
+        }
+    }
+
+    if (args->n_images == 0) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_serve_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_serve_args(cmd_args_t arg)
+{
+    serve_cmd_args_t* args = cmd_args_cast(arg, serve_cmd_args_t);
+    if (args) {
+        for (int i = 0; i < args->n_images; i++) {
+            free(args->img_paths[i]);
+        }
+        cmd_args_field_should_free(args, socket_path, default_serve_args);
+        free(args);
+    }
+}
+
+cmd_args_t cmd_parse_client_args(int argc, char** argv)
+{
+    client_cmd_args_t* args = (client_cmd_args_t*)calloc(1, sizeof(client_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_client_args;
+
+    static struct option long_options[] = {{"socket", required_argument, 0, 'S'},
+                                           {"cmd", required_argument, 0, 'c'},
+                                           {"time", no_argument, 0, 't'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "S:c:th", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'S':  // socket
+                cmd_args_field_should_free(args, socket_path, default_client_args);
+                args->socket_path = strdup(optarg);
+                break;
+            case 'c': {  // cmd
+                char** cmds = (char**)realloc(args->cmds, (args->n_cmds + 1) * sizeof(char*));
+                if (!cmds) {
+                    fprintf(stderr, "内存分配失败\n");
+                    cmd_free_client_args(args);
+                    return NULL;
+                }
+                args->cmds                 = cmds;
+                args->cmds[args->n_cmds++] = strdup(optarg);
+                break;
+            }
+            case 't':  // time
+                args->timing = 1;
+                break;
+            case 'h':  // help
+                printf("%s", client_help_str);
+                cmd_free_client_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_client_args(args);
+                return NULL;
+        }
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_client_args(cmd_args_t arg)
+{
+    client_cmd_args_t* args = cmd_args_cast(arg, client_cmd_args_t);
+    if (args) {
+        for (int i = 0; i < args->n_cmds; i++) {
+            free(args->cmds[i]);
+        }
+        free(args->cmds);
+        cmd_args_field_should_free(args, socket_path, default_client_args);
+        free(args);
+    }
+}
+
+#ifdef _WIN32
+
+int cmd_do_serve(cmd_args_t arg)
+{
+    (void)arg;
+    fprintf(stderr, "Windows下不支持serve命令\n");
+    return -1;
+}
+
+int cmd_do_client(cmd_args_t arg)
+{
+    (void)arg;
+    fprintf(stderr, "Windows下不支持client命令\n");
+    return -1;
+}
+
+#else
+
+#define SERVE_SHUTDOWN 2  // 请求处理结果：停止服务
+
+static volatile sig_atomic_t s_stop;
+static int                   s_stdout = -1;  // 服务端自己的stdout/stderr，执行命令时被重定向到输出文件
+static int                   s_stderr = -1;
+
+static void _on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _write_all(int fd, const void* buf, size_t len)
+{
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int _socket_addr(const char* path, struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "套接字路径过长: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// 创建监听套接字，路径上残留的旧套接字文件会被删除
+static int _listen(const char* path)
+{
+    struct sockaddr_un addr;
+    struct stat        st;
+    if (_socket_addr(path, &addr) != 0) {
+        return -1;
+    }
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "套接字路径已存在且不是套接字: %s\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "监听套接字失败: %s (%s)\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// 执行一条命令，命令的stdout/stderr写入out_fd，返回命令的结果
+static int _exec_captured(char* line, int out_fd, long long* usec)
+{
+    fflush(stdout);
+    fflush(stderr);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+
+    double t0  = _now();
+    int    ret = shell_exec(line);
+    *usec      = (long long)((_now() - t0) * 1e6);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(s_stdout, STDOUT_FILENO);
+    dup2(s_stderr, STDERR_FILENO);
+    return ret;
+}
+
+// 发送回复头和out_fd中的命令输出，然后清空out_fd
+static int _reply(int fd, int ret, long long usec, int out_fd)
+{
+    off_t len = lseek(out_fd, 0, SEEK_END);
+    if (len < 0) {
+        len = 0;
+    }
+    char header[SERVE_HEADER_MAX];
+    int  n = snprintf(header, sizeof(header), "%d %lld %lld\n", ret, usec, (long long)len);
+    if (_write_all(fd, header, (size_t)n) != 0) {
+        return -1;
+    }
+
+    static char buf[SERVE_COPY_SIZE];
+    int         result = 0;
+    for (off_t off = 0; off < len && result == 0;) {
+        ssize_t k = pread(out_fd, buf, sizeof(buf), off);
+        if (k <= 0) {
+            result = -1;
+            break;
+        }
+        result = _write_all(fd, buf, (size_t)k);
+        off += k;
+    }
+    if (ftruncate(out_fd, 0) != 0 || lseek(out_fd, 0, SEEK_SET) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// 处理一条请求：返回0继续，-1关闭连接，SERVE_SHUTDOWN停止服务
+static int _handle(int fd, char* line, int out_fd, const serve_cmd_args_t* args)
+{
+    char* cmd = args->verbose ? strdup(line) : NULL;
+    int   result;
+    if (strcmp(line, "shutdown") == 0) {
+        _reply(fd, 0, 0, out_fd);
+        result = SERVE_SHUTDOWN;
+    } else {
+        long long usec = 0;
+        int       ret  = _exec_captured(line, out_fd, &usec);
+        if (ret == SHELL_EXIT) {
+            _reply(fd, 0, usec, out_fd);
+            result = -1;
+        } else {
+            result = _reply(fd, ret, usec, out_fd);
+        }
+        if (cmd) {
+            printf("%8.3f ms  %3d  %s\n", usec / 1000.0, ret == SHELL_EXIT ? 0 : ret, cmd);
+        }
+    }
+    free(cmd);
+    return result;
+}
+
+// 逐行读取一个连接上的请求直到连接关闭
+static int _serve_conn(int fd, int out_fd, const serve_cmd_args_t* args)
+{
+    static char buf[SERVE_LINE_MAX];
+    size_t      len = 0;
+    while (!s_stop) {
+        ssize_t n = read(fd, buf + len, sizeof(buf) - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        len += (size_t)n;
+
+        char* start = buf;
+        char* nl;
+        while ((nl = memchr(start, '\n', len - (size_t)(start - buf))) != NULL) {
+            *nl = '\0';
+            if (nl > start && nl[-1] == '\r') {
+                nl[-1] = '\0';
+            }
+            int result = _handle(fd, start, out_fd, args);
+            if (result != 0) {
+                return result;
+            }
+            start = nl + 1;
+        }
+        len -= (size_t)(start - buf);
+        memmove(buf, start, len);
+        if (len == sizeof(buf)) {
+            fprintf(stderr, "请求过长，关闭连接\n");
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int cmd_do_serve(cmd_args_t arg)
+{
+    serve_cmd_args_t* args = cmd_args_cast(arg, serve_cmd_args_t);
+    if (!args || args->n_images == 0) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    image_opts_t opts = {
+        .writeback          = args->writeback >= 0,
+        .writeback_interval = args->writeback,
+    };
+    image_t* imgs[SERVE_MAX_IMAGES] = {0};
+    int      ret                    = 0;
+    for (int i = 0; i < args->n_images && ret == 0; i++) {
+        imgs[i] = image_open(args->img_paths[i], &opts);
+        if (!imgs[i]) {
+            fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_paths[i]);
+            ret = -1;
+            break;
+        }
+        FRESULT fr = image_mount(imgs[i]);
+        if (fr != FR_OK) {
+            fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_paths[i], f_strerror(fr), fr);
+            ret = -1;
+        }
+    }
+
+    int lfd    = -1;
+    int out_fd = -1;
+    if (ret == 0 && f_chdrive(image_drive(imgs[0])) != FR_OK) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        fsindex_open(image_fs(imgs[0]), NULL);  // 目录树索引在请求之间保持
+        shell_attach(imgs, args->n_images);
+        shell_set_remote(1);
+        lfd = _listen(args->socket_path);
+        FILE* out = tmpfile();
+        out_fd    = out ? dup(fileno(out)) : -1;
+        if (out) {
+            fclose(out);  // tmpfile已被删除，dup出的描述符保持其存在
+        }
+        s_stdout = dup(STDOUT_FILENO);
+        s_stderr = dup(STDERR_FILENO);
+        if (lfd < 0 || out_fd < 0 || s_stdout < 0 || s_stderr < 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = _on_signal;  // 不设置SA_RESTART，使accept被信号打断
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        signal(SIGPIPE, SIG_IGN);  // 客户端提前断开时write返回EPIPE
+
+        printf("已挂载 %d 个镜像，在 %s 上等待请求\n", args->n_images, args->socket_path);
+        fflush(stdout);
+        while (!s_stop) {
+            int cfd = accept(lfd, NULL, NULL);
+            if (cfd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "接受连接失败: %s\n", strerror(errno));
+                ret = -1;
+                break;
+            }
+            if (_serve_conn(cfd, out_fd, args) == SERVE_SHUTDOWN) {
+                s_stop = 1;
+            }
+            close(cfd);
+        }
+    }
+
+    if (lfd >= 0) {
+        close(lfd);
+        unlink(args->socket_path);
+    }
+    if (out_fd >= 0) {
+        close(out_fd);
+    }
+    if (s_stdout >= 0) {
+        close(s_stdout);
+        close(s_stderr);
+    }
+    shell_attach(NULL, 0);
+    shell_set_remote(0);
+    fsindex_close(NULL);
+
+    // 卸载并写回延迟写回缓存
+    for (int i = 0; i < args->n_images; i++) {
+        if (imgs[i] && image_close(imgs[i]) != 0) {
+            fprintf(stderr, "写回虚拟磁盘镜像失败: %s\n", args->img_paths[i]);
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        printf("服务已停止\n");
+    }
+    return ret;
+}
+
+// 发送一条命令并把输出写到stdout，返回命令的结果，连接断开返回-1并清除*in
+static int _call(int fd, FILE** in, const char* cmd, int timing)
+{
+    size_t len = strlen(cmd);
+    if (len + 1 >= SERVE_LINE_MAX || strchr(cmd, '\n')) {
+        fprintf(stderr, "命令过长或包含换行符\n");
+        return -1;
+    }
+
+    double    t0 = _now();
+    char      header[SERVE_HEADER_MAX];
+    int       ret;
+    long long usec, n;
+    if (_write_all(fd, cmd, len) != 0 || _write_all(fd, "\n", 1) != 0 ||
+        !fgets(header, sizeof(header), *in) || sscanf(header, "%d %lld %lld", &ret, &usec, &n) != 3) {
+        fprintf(stderr, "与服务端的连接已断开\n");
+        fclose(*in);
+        *in = NULL;
+        return -1;
+    }
+
+    static char buf[SERVE_COPY_SIZE];
+    while (n > 0) {
+        size_t k = fread(buf, 1, n < (long long)sizeof(buf) ? (size_t)n : sizeof(buf), *in);
+        if (k == 0) {
+            fprintf(stderr, "与服务端的连接已断开\n");
+            fclose(*in);
+            *in = NULL;
+            return -1;
+        }
+        fwrite(buf, 1, k, stdout);
+        n -= (long long)k;
+    }
+    fflush(stdout);
+    if (timing) {
+        fprintf(stderr, "[%s] 返回 %d, 服务端 %.3f ms, 往返 %.3f ms\n", cmd, ret, usec / 1000.0,
+                (_now() - t0) * 1000.0);
+    }
+    return ret;
+}
+
+int cmd_do_client(cmd_args_t arg)
+{
+    client_cmd_args_t* args = cmd_args_cast(arg, client_cmd_args_t);
+    if (!args) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    if (_socket_addr(args->socket_path, &addr) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "连接服务端失败: %s (%s)\n", args->socket_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    int   rfd = dup(fd);  // 读写分别使用各自的描述符，关闭FILE时不影响写入端
+    FILE* in  = rfd >= 0 ? fdopen(rfd, "rb") : NULL;
+    if (!in) {
+        close(fd);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int ret = 0;
+    if (args->n_cmds > 0) {
+        for (int i = 0; i < args->n_cmds && in; i++) {
+            if (_call(fd, &in, args->cmds[i], args->timing) != 0) {
+                ret = -1;
+            }
+        }
+    } else {
+        char line[SERVE_LINE_MAX];
+        while (in && fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] && _call(fd, &in, line, args->timing) != 0) {
+                ret = -1;
+            }
+        }
+    }
+
+    if (in) {
+        fclose(in);
+    }
+    close(fd);
+    return ret;
+}
+
+#endif
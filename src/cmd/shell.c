@@ -3,13 +3,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include "cmd.h"
+#include "diskio.h"
 #include "ff.h"
 #include "fferrno.h"
+#include "fsindex.h"
+#include "hostfs.h"
+#include "stats.h"
 #ifdef _WIN32
 #include <direct.h>
+#include <fcntl.h>
+#include <io.h>
 #endif
 
+static image_t **s_images;    // 当前挂载的镜像句柄
+static int       s_n_images;
+static int       s_remote;    // 在serve中执行：标准输入不属于发出命令的客户端
+
 int shell_do_help(int argc, char **argv)
 {
     (void)argc;
@@ -20,67 +31,60 @@ int shell_do_help(int argc, char **argv)
     printf("  pwd                                    - 显示当前目录\n");
     printf("  mkdir [-p] <dir1> <dir2> ...           - 创建目录\n");
     printf("  rm [-r] <file1> [<file2> ...]          - 删除文件\n");
-    printf("  read <file> [bytes]                    - 读取文件\n");
-    printf("  write <file> <data>                    - 写入文件\n");
+    printf("  read <file> [bytes]                    - 读取文件(--offset/--length范围, --raw原样输出)\n");
+    printf("  write <file> <data>|-|-f <host>        - 写入文件(-为标准输入, --append/--truncate)\n");
     printf("  head <file> [-n lines]                 - 读取文件前n行\n");
     printf("  truncate <file> [-p pos] [-s bytes]    - 从指定位置截断文件到指定大小\n");
     printf("  stat <path>                            - 检查文件/目录是否存在\n");
     printf("  mv <old> <new>                         - 重命名/移动文件或目录\n");
+    printf("  cp [-r] <src> <dst>                    - 在镜像内复制文件或目录\n");
+    printf("  find [dir] [-name pat] [-type f|d]     - 按名称查找文件或目录\n");
+    printf("  du [-s] [path]                         - 统计占用空间(KB)\n");
     printf("  touch <file>                           - 创建文件或更新文件时间戳\n");
     printf("  chmod +/-<attr> [...] <path>           - 更改文件/目录属性\n");
     printf("  getfree [<drive>]                      - 获取卷空闲空间\n");
     printf("  getlabel <drive>                       - 获取卷标\n");
     printf("  setlabel <drive> <label>               - 设置卷标\n");
     printf("  export <src> <dst>                     - 导出文件/目录到宿主机\n");
+    printf("  export-tar <src> [<tar>|-]             - 把文件/目录写成tar流(文件或标准输出)\n");
+    printf("  sum [-a alg] [-j n] [--tag] <path>     - 计算校验和(-a crc32|sha256|xxh64)，输出校验清单\n");
+    printf("  stats [-j] [-r]                        - 显示I/O和元数据计数器(-j输出JSON, -r显示后清零)\n");
+    printf("  sync                                   - 把延迟写回的数据写入镜像\n");
     printf("  clear                                  - 清空屏幕\n");
     printf("  help                                   - 显示此帮助信息\n");
     printf("  exit                                   - 退出shell\n");
     return 0;
 }
 
-static void _print_tree(const TCHAR *path, int level, int show_hidden, int is_last[])
+// 目录索引节点转为FILINFO，以便和直接读取目录的结果走同一套输出
+static void _node_to_fno(const fsindex_node_t *node, FILINFO *fno)
+{
+    snprintf(fno->fname, sizeof(fno->fname), "%s", node->name);
+    fno->fsize   = node->size;
+    fno->fdate   = node->fdate;
+    fno->ftime   = node->ftime;
+    fno->fattrib = node->attr;
+    fno->fclust  = node->clust;
+}
+
+// 目录树来自内存中的目录索引，子目录已全部读入
+static void _print_tree(const fsindex_node_t *dir, int level, int show_hidden, int is_last[])
 {
-    DIR     dp;
     FILINFO fno;
-    FRESULT fr;
     int     entry_count   = 0;
     int     current_entry = 0;
 
-    fr = f_opendir(&dp, path);
-    if (fr != FR_OK) {
-        fprintf(stderr, "无法打开目录: %s\n", path);
-        return;
-    }
-
     // First pass: count entries
-    while (1) {
-        fr = f_readdir(&dp, &fno);
-        if (fr != FR_OK || fno.fname[0] == 0)
-            break;
-
-        /* 跳过当前目录和父目录项 */
-        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0)
-            continue;
-
+    for (uint32_t i = 0; i < dir->n_child; i++) {
         // 跳过隐藏文件
-        if (!show_hidden && (fno.fattrib & AM_HID || fno.fname[0] == '.'))
+        if (!show_hidden && (dir->child[i].attr & AM_HID || dir->child[i].name[0] == '.'))
             continue;
 
         entry_count++;
     }
 
-    // Reset directory reading
-    f_rewinddir(&dp);
-    current_entry = 0;
-
-    while (1) {
-        fr = f_readdir(&dp, &fno);
-        if (fr != FR_OK || fno.fname[0] == 0)
-            break;
-
-        /* 跳过当前目录和父目录项 */
-        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0)
-            continue;
+    for (uint32_t i = 0; i < dir->n_child; i++) {
+        _node_to_fno(&dir->child[i], &fno);
 
         // 跳过隐藏文件
         if (!show_hidden && (fno.fattrib & AM_HID || fno.fname[0] == '.'))
@@ -110,20 +114,14 @@ static void _print_tree(const TCHAR *path, int level, int show_hidden, int is_la
         if (fno.fattrib & AM_DIR) {
             printf("%s/\n", fno.fname);
             // 递归打印子目录
-            TCHAR full_path[256] = {0};
-            if (strcmp(path, ".") == 0) {
-                snprintf(full_path, sizeof(full_path), "%s", fno.fname);
-            } else {
-                snprintf(full_path, sizeof(full_path), "%s/%s", path, fno.fname);
+            if (level + 1 < 256) {
+                is_last[level] = is_last_entry;
+                _print_tree(&dir->child[i], level + 1, show_hidden, is_last);
             }
-            is_last[level] = is_last_entry;
-            _print_tree(full_path, level + 1, show_hidden, is_last);
         } else {
             printf("%s\n", fno.fname);
         }
     }
-
-    f_closedir(&dp);
 }
 
 int shell_do_ls(int argc, char **argv)
@@ -161,16 +159,27 @@ int shell_do_ls(int argc, char **argv)
     }
 
     if (recursive) {
+        const fsindex_node_t *dir = fsindex_lookup(path, 1);
+        if (!dir || !(dir->attr & AM_DIR)) {
+            fprintf(stderr, "无法打开目录: %s\n", path);
+            return -1;
+        }
         printf("%s\n", path);
         int is_last[256] = {0};  // Track if each level is the last entry
-        _print_tree(path, 0, show_hidden, is_last);
+        _print_tree(dir, 0, show_hidden, is_last);
         return 0;
     }
 
-    fr = f_opendir(&dp, path);
-    if (fr != FR_OK) {
-        fprintf(stderr, "无法打开目录: %s\n", path);
-        return -1;
+    // 目录已在内存索引中时不再读取镜像
+    const fsindex_node_t *dir  = fsindex_lookup(path, 0);
+    int                   from_index = dir && (dir->attr & AM_DIR) && dir->loaded;
+    uint32_t              next_child = 0;
+    if (!from_index) {
+        fr = f_opendir(&dp, path);
+        if (fr != FR_OK) {
+            fprintf(stderr, "无法打开目录: %s\n", path);
+            return -1;
+        }
     }
 
     int           entry_num  = 0;
@@ -179,9 +188,15 @@ int shell_do_ls(int argc, char **argv)
     unsigned long total_size = 0;
 
     while (1) {
-        fr = f_readdir(&dp, &fno);
-        if (fr != FR_OK || fno.fname[0] == 0)
-            break;
+        if (from_index) {
+            if (next_child >= dir->n_child)
+                break;
+            _node_to_fno(&dir->child[next_child++], &fno);
+        } else {
+            fr = f_readdir(&dp, &fno);
+            if (fr != FR_OK || fno.fname[0] == 0)
+                break;
+        }
         /* 跳过当前目录和父目录项 */
         if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0)
             continue;
@@ -217,7 +232,9 @@ int shell_do_ls(int argc, char **argv)
         entry_num++;
     }
 
-    f_closedir(&dp);
+    if (!from_index) {
+        f_closedir(&dp);
+    }
 
     printf("%d 目录, %d 文件, 共 %lu 字节\n", dir_count, file_count, total_size);
 
@@ -316,11 +333,12 @@ static FRESULT _do_unlink(const TCHAR *path, int recursive)
             if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0)
                 continue;
 
-            TCHAR  relpath[256] = {0};
-            size_t len          = strlen(path);
-            strncpy(relpath, path, len);
-            relpath[len] = '/';
-            fr           = _do_unlink(strcat(relpath, fno.fname), recursive);
+            TCHAR relpath[512];
+            if (snprintf(relpath, sizeof(relpath), "%s/%s", path, fno.fname) >= (int)sizeof(relpath)) {
+                fr = FR_INVALID_NAME;
+                break;
+            }
+            fr = _do_unlink(relpath, recursive);
             if (fr != FR_OK) {
                 break;
             }
@@ -336,6 +354,28 @@ static FRESULT _do_unlink(const TCHAR *path, int recursive)
     return fr;
 }
 
+#define RMTREE_TABLE_SIZE (1 * MB)  // f_rmtree簇号表的初始大小，可容纳256K个对象，不够时按4倍扩大
+
+// 一次性删除目录树：先扫描整棵树，再删除顶层目录项、按簇号顺序释放所有簇链并只同步一次
+FRESULT remove_tree(const TCHAR *path)
+{
+    FRESULT fr  = FR_NOT_ENOUGH_CORE;
+    UINT    len = RMTREE_TABLE_SIZE;
+    while (fr == FR_NOT_ENOUGH_CORE) {
+        void *work = malloc(len);
+        if (!work) {
+            break;
+        }
+        fr = f_rmtree(path, work, len);
+        free(work);
+        len *= 4;
+    }
+    if (fr == FR_INVALID_PARAMETER || fr == FR_NOT_ENOUGH_CORE) {  // exFAT或内存不足时逐项删除
+        fr = _do_unlink(path, 1);
+    }
+    return fr;
+}
+
 int shell_do_rm(int argc, char **argv)
 {
     if (argc < 1) {
@@ -359,10 +399,10 @@ int shell_do_rm(int argc, char **argv)
     }
 
     for (int i = 0; i < argc; ++i) {
-        if (strcmp(argv[i], "-r") != 0) {
-            FRESULT fr = _do_unlink(argv[i], recursive);
+        if (argv[i][0] != '-') {
+            FRESULT fr = recursive ? remove_tree(argv[i]) : _do_unlink(argv[i], 0);
             if (fr != FR_OK) {
-                fprintf(stderr, "删除文件/目录失败: %s (%s: %d)\n", argv[0], f_strerror(fr), fr);
+                fprintf(stderr, "删除文件/目录失败: %s (%s: %d)\n", argv[i], f_strerror(fr), fr);
                 return -1;
             }
         }
@@ -396,6 +436,7 @@ int shell_do_cd(int argc, char **argv)
 
 int shell_do_pwd(int argc, char **argv)
 {
+    (void)argv;
     if (argc != 0) {
         fprintf(stderr, "用法: pwd\n");
         return -1;
@@ -463,123 +504,627 @@ int shell_do_mv(int argc, char **argv)
     return 0;
 }
 
-int shell_do_read(int argc, char **argv)
+#define CP_BUFFER_SIZE (4 * MB)  // cp每次搬运的最大字节数
+#define CP_LINKMAP_SIZE 64       // 源文件簇链映射表的初始大小
+#define CP_KEEP_ATTR (AM_RDO | AM_HID | AM_SYS | AM_ARC)
+
+// 通过快速定位的簇链映射表取得源文件的各段连续簇，按段以多扇区为单位直接复制到连续分配的目标文件
+static FRESULT _copy_clusters(FIL *src, FIL *dst, BYTE *buf)
 {
-    if (argc < 1 || argc > 2 || (argc == 2 && atoi(argv[1]) <= 0)) {
-        fprintf(stderr, "用法: read <文件名> [字节数]\n");
+    FATFS  *fs = src->obj.fs;
+    DWORD   tbl_small[CP_LINKMAP_SIZE];
+    DWORD  *tbl = tbl_small;
+    FRESULT fr;
+
+    tbl[0]      = CP_LINKMAP_SIZE;
+    src->cltbl = tbl;
+    fr          = f_lseek(src, CREATE_LINKMAP);
+    if (fr == FR_NOT_ENOUGH_CORE) {  // 碎片较多，按所需大小重新分配
+        DWORD need = tbl[0];
+        tbl        = (DWORD *)malloc(need * sizeof(DWORD));
+        if (!tbl) {
+            src->cltbl = NULL;
+            return FR_NOT_ENOUGH_CORE;
+        }
+        tbl[0]      = need;
+        src->cltbl = tbl;
+        fr          = f_lseek(src, CREATE_LINKMAP);
+    }
+
+    LBA_t left  = (LBA_t)((f_size(src) + SECTOR_SIZE - 1) / SECTOR_SIZE);
+    LBA_t dsect = fs->database + (LBA_t)fs->csize * (dst->obj.sclust - 2);
+    UINT  max_n = CP_BUFFER_SIZE / SECTOR_SIZE;
+    for (DWORD *frag = tbl + 1; fr == FR_OK && frag[0] && left; frag += 2) {
+        LBA_t ssect = fs->database + (LBA_t)fs->csize * (frag[1] - 2);
+        LBA_t n     = (LBA_t)frag[0] * fs->csize;
+        if (n > left) {
+            n = left;
+        }
+        left -= n;
+        while (n) {
+            UINT k = n > max_n ? max_n : (UINT)n;
+            if (disk_read(fs->pdrv, buf, ssect, k) != RES_OK ||
+                disk_write(fs->pdrv, buf, dsect, k) != RES_OK) {
+                fr = FR_DISK_ERR;
+                break;
+            }
+            ssect += k;
+            dsect += k;
+            n -= k;
+        }
+    }
+
+    src->cltbl = NULL;
+    if (tbl != tbl_small) {
+        free(tbl);
+    }
+    return fr;
+}
+
+// 无法连续分配时退回到经由文件对象的大块读写
+static FRESULT _copy_stream(FIL *src, FIL *dst, BYTE *buf)
+{
+    FRESULT fr;
+    UINT    br, bw;
+    do {
+        fr = f_read(src, buf, CP_BUFFER_SIZE, &br);
+        if (fr == FR_OK && br) {
+            fr = f_write(dst, buf, br, &bw);
+            if (fr == FR_OK && bw != br) {
+                fr = FR_DENIED;  // 磁盘已满
+            }
+        }
+    } while (fr == FR_OK && br == CP_BUFFER_SIZE);
+    return fr;
+}
+
+// 复制源对象的时间戳和属性
+static FRESULT _copy_meta(const TCHAR *dst_path, const FILINFO *fno)
+{
+    FRESULT fr = f_utime(dst_path, fno);
+    if (fr == FR_OK) {
+        fr = f_chmod(dst_path, fno->fattrib & CP_KEEP_ATTR, CP_KEEP_ATTR);
+    }
+    return fr;
+}
+
+static FRESULT _copy_file(const TCHAR *src_path, const TCHAR *dst_path, const FILINFO *fno, BYTE *buf)
+{
+    FIL     src, dst;
+    FRESULT fr = f_open(&src, src_path, FA_READ);
+    if (fr != FR_OK) {
+        return fr;
+    }
+    fr = f_open(&dst, dst_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) {
+        f_close(&src);
+        return fr;
+    }
+
+    if (f_size(&src) > 0) {
+        // 先为目标文件一次性分配连续的簇，成功则绕过文件对象直接在扇区之间复制
+        fr = f_expand(&dst, f_size(&src), 1);
+        if (fr == FR_OK) {
+            fr = _copy_clusters(&src, &dst, buf);
+        } else if (fr == FR_DENIED) {
+            fr = _copy_stream(&src, &dst, buf);
+        }
+    }
+
+    f_close(&src);
+    FRESULT fr_close = f_close(&dst);
+    if (fr == FR_OK) {
+        fr = fr_close;
+    }
+    if (fr == FR_OK) {
+        fr = _copy_meta(dst_path, fno);
+    }
+    return fr;
+}
+
+static int _copy_tree(const TCHAR *src_path, const TCHAR *dst_path, int recursive, BYTE *buf)
+{
+    FILINFO fno;
+    FRESULT fr = f_stat(src_path, &fno);
+    if (fr != FR_OK) {
+        fprintf(stderr, "源路径不存在: %s\n", src_path);
         return -1;
     }
 
-    const TCHAR *filename      = argv[0];
-    UINT         bytes_to_read = 0;
-    int          read_all      = (argc == 1);  // 如果没有提供字节数参数，则读取整个文件
+    if (!(fno.fattrib & AM_DIR)) {
+        fr = _copy_file(src_path, dst_path, &fno, buf);
+        if (fr != FR_OK) {
+            fprintf(stderr, "复制文件失败: %s -> %s (%s: %d)\n", src_path, dst_path, f_strerror(fr), fr);
+            return -1;
+        }
+        return 0;
+    }
 
-    FIL     fp;
-    FRESULT fr = f_open(&fp, filename, FA_READ);
+    if (!recursive) {
+        fprintf(stderr, "略过目录: %s (需要 -r)\n", src_path);
+        return -1;
+    }
+
+    fr = f_mkdir(dst_path);
+    if (fr != FR_OK && fr != FR_EXIST) {
+        fprintf(stderr, "创建目录失败: %s (%s: %d)\n", dst_path, f_strerror(fr), fr);
+        return -1;
+    }
+
+    DIR dp;
+    fr = f_opendir(&dp, src_path);
     if (fr != FR_OK) {
-        fprintf(stderr, "打开文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
+        fprintf(stderr, "无法打开目录: %s\n", src_path);
         return -1;
     }
 
-    // 如果没有提供字节数参数，则读取整个文件
-    if (read_all) {
-        bytes_to_read = (UINT)fp.obj.objsize;  // 获取文件大小
-        if (bytes_to_read == 0) {
-            printf("文件为空\n");
-            f_close(&fp);
-            return 0;
+    int     ret = 0;
+    FILINFO ent;
+    while ((fr = f_readdir(&dp, &ent)) == FR_OK && ent.fname[0]) {
+        TCHAR sub_src[512], sub_dst[512];
+        snprintf(sub_src, sizeof(sub_src), "%s/%s", strcmp(src_path, "/") == 0 ? "" : src_path, ent.fname);
+        snprintf(sub_dst, sizeof(sub_dst), "%s/%s", dst_path, ent.fname);
+        if (_copy_tree(sub_src, sub_dst, recursive, buf) != 0) {
+            ret = -1;
         }
+    }
+    f_closedir(&dp);
+
+    // 目录的时间戳在其内容复制完成后再设置
+    if (fno.fdate && _copy_meta(dst_path, &fno) != FR_OK) {
+        ret = -1;
+    }
+    return ret;
+}
+
+// 对象在卷中的标识：目录取起始簇(根目录为0)，文件取目录项所在的扇区和偏移
+typedef struct cp_obj_t {
+    FATFS *fs;
+    DWORD  sclust;
+    LBA_t  sect;
+    UINT   ofs;
+} cp_obj_t;
+
+static FRESULT _cp_identify(const TCHAR *path, cp_obj_t *obj)
+{
+    memset(obj, 0, sizeof(*obj));
+    DIR     dp;
+    FRESULT fr = f_opendir(&dp, path);
+    if (fr == FR_OK) {
+        obj->fs     = dp.obj.fs;
+        obj->sclust = dp.obj.sclust;
+        f_closedir(&dp);
+        return FR_OK;
+    }
+    FIL fp;
+    fr = f_open(&fp, path, FA_READ);
+    if (fr == FR_OK) {
+        obj->fs   = fp.obj.fs;
+        obj->sect = fp.dir_sect;
+        obj->ofs  = (UINT)(fp.dir_ptr - fp.obj.fs->win);
+        f_close(&fp);
+    }
+    return fr;
+}
+
+static int _cp_same(const TCHAR *path, const cp_obj_t *obj)
+{
+    cp_obj_t other;
+    return _cp_identify(path, &other) == FR_OK && other.fs == obj->fs && other.sclust == obj->sclust &&
+           other.sect == obj->sect && other.ofs == obj->ofs;
+}
+
+// 目标就是源对象，或者源是目录且目标位于其中时返回1。按对象而不是路径字符串比较，
+// 这样"./a.txt"、大小写不同的"A.TXT"以及带".."的路径都能识别
+static int _cp_into_self(const cp_obj_t *src, const TCHAR *dst_path)
+{
+    if (_cp_same(dst_path, src)) {
+        return 1;
+    }
+    if (src->sect) {
+        return 0;  // 源是文件，只需比较目标本身
+    }
+
+    // 转成绝对路径后逐级去掉最后一段，途经的目录包含了目标的每一级上级目录
+    TCHAR path[768];  // 当前目录(256)加上目标路径(512)
+    if (dst_path[0] == '/' || strchr(dst_path, ':')) {
+        snprintf(path, sizeof(path), "%s", dst_path);
     } else {
-        bytes_to_read = (UINT)atoi(argv[1]);
+        TCHAR cwd[256];
+        if (f_getcwd(cwd, sizeof(cwd)) != FR_OK) {
+            return 0;
+        }
+        size_t len = strlen(cwd);
+        snprintf(path, sizeof(path), "%s%s%s", cwd, len && cwd[len - 1] == '/' ? "" : "/", dst_path);
     }
+    for (;;) {
+        TCHAR *slash = strrchr(path, '/');
+        if (!slash) {
+            return 0;
+        }
+        int root = slash == path || slash[-1] == ':';
+        if (root && slash[1] == '\0') {
+            return 0;  // 已经检查到根目录
+        }
+        slash[root ? 1 : 0] = '\0';  // 保留根目录的'/'
+        if (_cp_same(path, src)) {
+            return 1;
+        }
+    }
+}
 
-    void *buff = malloc(bytes_to_read);
-    if (!buff) {
+int shell_do_cp(int argc, char **argv)
+{
+    int          recursive = 0;
+    const TCHAR *paths[2];
+    int          n_paths = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            recursive = 1;
+        } else if (n_paths < 2) {
+            paths[n_paths++] = argv[i];
+        } else {
+            n_paths++;
+        }
+    }
+    if (n_paths != 2) {
+        fprintf(stderr, "用法: cp [-r] <源路径> <目标路径>\n");
+        return -1;
+    }
+
+    // 目标是已存在的目录时复制到该目录下
+    TCHAR   dst_path[512];
+    FILINFO fno;
+    snprintf(dst_path, sizeof(dst_path), "%s", paths[1]);
+    if (f_stat(paths[1], &fno) == FR_OK && (fno.fattrib & AM_DIR)) {
+        const TCHAR *base = strrchr(paths[0], '/');
+        snprintf(dst_path, sizeof(dst_path), "%s/%s", paths[1], base ? base + 1 : paths[0]);
+    }
+
+    cp_obj_t src;
+    if (_cp_identify(paths[0], &src) != FR_OK) {
+        fprintf(stderr, "源路径不存在: %s\n", paths[0]);
+        return -1;
+    }
+    if (_cp_into_self(&src, dst_path)) {
+        fprintf(stderr, "不能把 %s 复制到自身: %s\n", paths[0], dst_path);
+        return -1;
+    }
+
+    BYTE *buf = (BYTE *)malloc(CP_BUFFER_SIZE);
+    if (!buf) {
         fprintf(stderr, "内存分配失败\n");
-        f_close(&fp);
         return -1;
     }
+    int ret = _copy_tree(paths[0], dst_path, recursive, buf);
+    free(buf);
+
+    if (ret == 0) {
+        printf("成功复制: %s -> %s\n", paths[0], dst_path);
+    }
+    return ret;
+}
+
+#define READ_BUFFER_SIZE (256 * KB)  // read每次从文件读取的字节数(16的倍数，十六进制的行不跨块)
+#define READ_LINE_MAX (1 + 16 + 2 + 16 * 3)  // 一行十六进制输出的最大长度: 换行、地址、": "、16个"XX "
+
+static char s_hex_pairs[256][2];  // 字节 -> 两个十六进制字符
+
+// 以每行16字节格式化data，行首为width位的地址(从addr开始)，返回写入out的字节数
+static size_t _hexdump(char *out, const BYTE *data, size_t n, unsigned long long addr, int width)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char             *p        = out;
+    for (size_t i = 0; i < n; i += 16, addr += 16) {
+        *p++ = '\n';
+        for (int d = 0; d < width; d++) {
+            p[d] = digits[(addr >> (4 * (width - 1 - d))) & 15];
+        }
+        p += width;
+        *p++     = ':';
+        *p++     = ' ';
+        size_t m = n - i < 16 ? n - i : 16;
+        for (size_t j = 0; j < m; j++) {
+            memcpy(p, s_hex_pairs[data[i + j]], 2);
+            p[2] = ' ';
+            p += 3;
+        }
+    }
+    return (size_t)(p - out);
+}
 
-    UINT bytes_read;
-    fr = f_read(&fp, buff, bytes_to_read, &bytes_read);
+// 解析非负整数(支持0x前缀)，成功返回0
+static int _parse_u64(const char *str, unsigned long long *val)
+{
+    char *end;
+    if (!*str || *str == '-') {
+        return -1;
+    }
+    *val = strtoull(str, &end, 0);
+    return *end ? -1 : 0;
+}
+
+int shell_do_read(int argc, char **argv)
+{
+    const TCHAR       *filename = NULL;
+    unsigned long long offset = 0, length = 0;
+    int                has_length = 0, raw = 0, bad = 0;
+    for (int i = 0; i < argc && !bad; i++) {
+        if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
+            bad = _parse_u64(argv[++i], &offset) != 0;
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            bad        = _parse_u64(argv[++i], &length) != 0 || length == 0;
+            has_length = 1;
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            raw = 1;
+        } else if (!filename) {
+            filename = argv[i];
+        } else if (!has_length) {  // 兼容 read <文件名> <字节数>
+            bad        = _parse_u64(argv[i], &length) != 0 || length == 0;
+            has_length = 1;
+        } else {
+            bad = 1;
+        }
+    }
+    if (bad || !filename) {
+        fprintf(stderr, "用法: read [--offset 偏移] [--length 字节数] [--raw] <文件名> [字节数]\n");
+        return -1;
+    }
+
+    FIL     fp;
+    FRESULT fr = f_open(&fp, filename, FA_READ);
     if (fr != FR_OK) {
-        fprintf(stderr, "读取文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
-        free(buff);
+        fprintf(stderr, "打开文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
+        return -1;
+    }
+
+    // 没有指定长度时读到文件末尾
+    unsigned long long size = f_size(&fp);
+    unsigned long long left = offset < size ? size - offset : 0;
+    if (has_length && length < left) {
+        left = length;
+    }
+    if (size == 0 && !raw) {
+        printf("文件为空\n");
+        f_close(&fp);
+        return 0;
+    }
+    if (left > 0) {
+        fr = f_lseek(&fp, (FSIZE_t)offset);
+    }
+
+    BYTE *buf = (BYTE *)malloc(READ_BUFFER_SIZE + (raw ? 0 : READ_BUFFER_SIZE / 16 * READ_LINE_MAX));
+    if (!buf) {
+        fprintf(stderr, "内存分配失败\n");
         f_close(&fp);
         return -1;
     }
+    char *out = (char *)buf + READ_BUFFER_SIZE;
 
-    printf("读取了 %u 字节的数据:", bytes_read);
-    // 以十六进制格式显示数据
-    for (UINT i = 0; i < bytes_read; i++) {
-        if (i % 16 == 0)
-            printf("\n%04X: ", i);
-        printf("%02X ", ((unsigned char *)buff)[i]);
+    int width = 4;  // 地址至少4位，所有行按最大地址对齐
+    if (!raw) {
+        if (!s_hex_pairs[0][0]) {
+            for (int i = 0; i < 256; i++) {
+                s_hex_pairs[i][0] = "0123456789ABCDEF"[i >> 4];
+                s_hex_pairs[i][1] = "0123456789ABCDEF"[i & 15];
+            }
+        }
+        while (width < 16 && (offset + (left ? left - 1 : 0)) >> (4 * width)) {
+            width++;
+        }
+        printf("读取了 %llu 字节的数据:", left);
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
     }
-    printf("\n");
+    fflush(stdout);
 
-    free(buff);
+    // 按块读出，十六进制时每块格式化后一次fwrite
+    unsigned long long addr = offset;
+    while (fr == FR_OK && left > 0) {
+        UINT n = left < READ_BUFFER_SIZE ? (UINT)left : READ_BUFFER_SIZE;
+        UINT br;
+        fr = f_read(&fp, buf, n, &br);
+        if (fr != FR_OK || br == 0) {
+            break;
+        }
+        if (raw) {
+            fwrite(buf, 1, br, stdout);
+        } else {
+            fwrite(out, 1, _hexdump(out, buf, br, addr, width), stdout);
+        }
+        addr += br;
+        left -= br;
+    }
+    if (!raw) {
+        printf("\n");
+    }
+    fflush(stdout);
 
+    free(buf);
     f_close(&fp);
+    if (fr != FR_OK) {
+        fprintf(stderr, "读取文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
+        return -1;
+    }
     return 0;
 }
 
+#define WRITE_BUFFER_SIZE (4 * MB)  // write从标准输入或宿主机文件每次读取、写入镜像的最大字节数
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 从当前位置起把src的全部内容写入fp：第一块补齐到扇区边界，之后每块都从扇区边界开始，f_write直接写多个扇区
+static FRESULT _write_stream(FIL *fp, FILE *src, BYTE *buf, unsigned long long *total)
+{
+    FRESULT fr   = FR_OK;
+    size_t  want = WRITE_BUFFER_SIZE - (size_t)(f_tell(fp) % SECTOR_SIZE);
+    size_t  n;
+    while (fr == FR_OK && (n = fread(buf, 1, want, src)) > 0) {
+        UINT bw;
+        fr = f_write(fp, buf, (UINT)n, &bw);
+        if (fr == FR_OK && bw != n) {
+            fr = FR_DENIED;  // 磁盘已满
+        }
+        *total += bw;
+        want = WRITE_BUFFER_SIZE;
+    }
+    return fr;
+}
+
+// 数据来源的大小，标准输入不是重定向的普通文件时返回-1
+static long long _write_src_size(const char *src)
+{
+    if (strcmp(src, "-") != 0) {
+        hostfs_stat_t st;
+        return hostfs_stat(src, &st) == 0 && !st.is_dir ? (long long)st.size : -1;
+    }
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode)) {
+        return (long long)(st.st_size - ftello(stdin));
+    }
+#endif
+    return -1;
+}
+
 int shell_do_write(int argc, char **argv)
 {
-    if (argc < 2) {
-        fprintf(stderr, "用法: write <文件名> <数据>\n");
+    const char  *usage    = "用法: write [--append|--truncate] <文件名> <数据>|-|-f <宿主机文件>\n";
+    int          mode     = 0;  // 0: 默认, 'a': --append, 't': --truncate
+    const TCHAR *filename = NULL;
+    const char  *src      = NULL;  // 数据来源，"-"为标准输入
+    int          i        = 0;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--append") == 0) {
+            mode = 'a';
+        } else if (strcmp(argv[i], "--truncate") == 0) {
+            mode = 't';
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "%s", usage);  // -f 后缺少宿主机文件
+                return -1;
+            }
+            src = argv[++i];
+        } else if (!filename) {
+            filename = argv[i];
+        } else {
+            break;  // 其余参数为数据
+        }
+    }
+    if (!src && i == argc - 1 && strcmp(argv[i], "-") == 0) {
+        src = argv[i++];
+    }
+    if (!filename || (src ? i < argc : i == argc)) {
+        fprintf(stderr, "%s", usage);
         return -1;
     }
+    if (src && s_remote && strcmp(src, "-") == 0) {
+        fprintf(stderr, "serve中不能从标准输入写入，请使用 -f <宿主机文件>\n");
+        return -1;
+    }
+    if (!mode) {
+        mode = src ? 't' : 'a';  // 命令行数据默认追加，标准输入和宿主机文件默认覆盖
+    }
 
-    const TCHAR *filename = argv[0];
-    // 将所有剩余的参数连接成一个字符串作为数据
-    TCHAR  data[256] = {0};
-    size_t data_len  = 0;
-
-    for (int i = 1; i < argc; i++) {
-        if (i > 1) {
-            // 在参数之间添加空格
-            data[data_len++] = ' ';
+    FILE *in = NULL;
+    if (src) {
+        in = strcmp(src, "-") == 0 ? stdin : fopen(src, "rb");
+        if (!in) {
+            fprintf(stderr, "无法打开宿主机文件: %s\n", src);
+            return -1;
         }
-        size_t arg_len = strlen(argv[i]);
-        if (data_len + arg_len < sizeof(data) - 1) {
-            strcpy(data + data_len, argv[i]);
-            data_len += arg_len;
-        } else {
-            // 数据太长，截断
-            strncpy(data + data_len, argv[i], sizeof(data) - data_len - 1);
-            data_len = sizeof(data) - 1;
-            printf("数据超过256字节, 超出部分被截断\n");
-            break;
+#ifdef _WIN32
+        if (in == stdin) {
+            _setmode(_fileno(stdin), _O_BINARY);
         }
+#endif
     }
 
     FIL     fp;
-    FRESULT fr = f_open(&fp, filename, FA_WRITE | FA_OPEN_ALWAYS);
+    FRESULT fr = f_open(&fp, filename, FA_WRITE | (mode == 'a' ? FA_OPEN_APPEND : FA_CREATE_ALWAYS));
     if (fr != FR_OK) {
         fprintf(stderr, "打开文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
+        if (in && in != stdin) {
+            fclose(in);
+        }
         return -1;
     }
 
-    // 移动到文件末尾
-    fr = f_lseek(&fp, f_size(&fp));
-    if (fr != FR_OK) {
-        fprintf(stderr, "定位文件指针失败 (%s: %d)\n", f_strerror(fr), fr);
+    if (!src) {
+        // 命令行参数以空格连接后写入
+        UINT bw, total = 0;
+        for (; fr == FR_OK && i < argc; i++) {
+            if (total > 0) {
+                fr = f_write(&fp, " ", 1, &bw);
+                total += bw;
+            }
+            if (fr == FR_OK) {
+                fr = f_write(&fp, argv[i], (UINT)strlen(argv[i]), &bw);
+                total += bw;
+            }
+        }
+        FRESULT fr_close = f_close(&fp);
+        if (fr == FR_OK) {
+            fr = fr_close;
+        }
+        if (fr != FR_OK) {
+            fprintf(stderr, "写入文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
+            return -1;
+        }
+        printf("%s了 %u 字节的数据到文件: %s\n", mode == 'a' ? "附加" : "写入", total, filename);
+        return 0;
+    }
+
+    BYTE *buf = (BYTE *)malloc(WRITE_BUFFER_SIZE);
+    if (!buf) {
+        fprintf(stderr, "内存分配失败\n");
         f_close(&fp);
+        if (in != stdin) {
+            fclose(in);
+        }
         return -1;
     }
 
-    UINT bytes_written;
-    fr = f_write(&fp, data, (UINT)data_len, &bytes_written);
+    // 空文件且已知数据大小时先用f_expand一次分配连续的簇，失败时照常边写边分配
+    long long size = _write_src_size(src);
+    if (f_size(&fp) == 0 && size > 0) {
+        f_expand(&fp, (FSIZE_t)size, 1);
+    }
+
+    unsigned long long total = 0;
+    double             t0    = _now();
+    fr                       = _write_stream(&fp, in, buf, &total);
+    int read_err             = ferror(in);
+    if (fr == FR_OK && f_tell(&fp) < f_size(&fp)) {
+        fr = f_truncate(&fp);  // 数据比预先分配的短
+    }
+    FRESULT fr_close = f_close(&fp);
+    if (fr == FR_OK) {
+        fr = fr_close;
+    }
+    double secs = _now() - t0;
+    free(buf);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (read_err) {
+        fprintf(stderr, "读取失败: %s\n", strcmp(src, "-") == 0 ? "标准输入" : src);
+        return -1;
+    }
     if (fr != FR_OK) {
         fprintf(stderr, "写入文件失败: %s (%s: %d)\n", filename, f_strerror(fr), fr);
-        f_close(&fp);
         return -1;
     }
-
-    printf("附加了 %u 字节的数据到文件: %s\n", bytes_written, filename);
-
-    f_close(&fp);
+    printf("%s了 %llu 字节的数据到文件: %s (用时 %.3f 秒, %.1f MB/s)\n", mode == 'a' ? "附加" : "写入", total,
+           filename, secs, secs > 0 ? total / secs / MB : 0.0);
     return 0;
 }
 
@@ -819,8 +1364,15 @@ int shell_do_stat(int argc, char **argv)
         return -1;
     }
 
-    FILINFO fno;
-    FRESULT fr = f_stat(argv[0], &fno);
+    FILINFO               fno;
+    FRESULT               fr   = FR_OK;
+    const fsindex_node_t *node = fsindex_lookup(argv[0], 0);
+    if (node && node->name[0]) {
+        _node_to_fno(node, &fno);
+    } else {
+        node = NULL;
+        fr   = f_stat(argv[0], &fno);
+    }
     if (fr != FR_OK) {
         fprintf(stderr, "获取文件/目录信息失败: %s (%s: %d)\n", argv[0], f_strerror(fr), fr);
         return -1;
@@ -852,10 +1404,146 @@ int shell_do_stat(int argc, char **argv)
     WORD second = (fno.ftime & 0x1F) * 2;
     printf("%8s: %04d-%02d-%02d %02d:%02d:%02d\n", fno.fattrib & AM_DIR ? "Created" : "Modified",
            year, month, day, hour, minute, second);
+    // 索引文件中记录了簇链的连续段
+    if (node && node->n_ext) {
+        printf("%8s: %lu, %lu Extents\n", "Cluster", (unsigned long)node->clust, (unsigned long)node->n_ext);
+    }
 
     return 0;
 }
 
+// 匹配 * 和 ? 通配符，ASCII字母不区分大小写
+static int _wildcard_match(const char *pat, const char *name)
+{
+    for (; *pat; pat++, name++) {
+        if (*pat == '*') {
+            while (*pat == '*') {
+                pat++;
+            }
+            if (!*pat) {
+                return 1;
+            }
+            for (; *name; name++) {
+                if (_wildcard_match(pat, name)) {
+                    return 1;
+                }
+            }
+            return 0;
+        }
+        if (!*name) {
+            return 0;
+        }
+        char a = *pat, b = *name;
+        if (a >= 'A' && a <= 'Z')
+            a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z')
+            b += 'a' - 'A';
+        if (a != '?' && a != b) {
+            return 0;
+        }
+    }
+    return *name == '\0';
+}
+
+static void _find_walk(const fsindex_node_t *node, char *path, size_t len, const char *pattern,
+                       char type)
+{
+    if ((!pattern || _wildcard_match(pattern, node->name)) &&
+        (!type || (type == 'd') == !!(node->attr & AM_DIR))) {
+        printf("%s\n", path);
+    }
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        int n = snprintf(path + len, 1024 - len, "%s%s", len && path[len - 1] == '/' ? "" : "/",
+                         node->child[i].name);
+        if (n > 0 && len + n < 1024) {
+            _find_walk(&node->child[i], path, len + n, pattern, type);
+        }
+        path[len] = '\0';
+    }
+}
+
+int shell_do_find(int argc, char **argv)
+{
+    const char *path    = ".";
+    const char *pattern = NULL;
+    char        type    = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-name") == 0 && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if (strcmp(argv[i], "-type") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "f") == 0 || strcmp(argv[i + 1], "d") == 0)) {
+            type = argv[++i][0];
+        } else if (argv[i][0] != '-' && i == 0) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "用法: find [目录] [-name 模式] [-type f|d]\n");
+            return -1;
+        }
+    }
+
+    const fsindex_node_t *node = fsindex_lookup(path, 1);
+    if (!node) {
+        fprintf(stderr, "无法打开目录: %s\n", path);
+        return -1;
+    }
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", path);
+    _find_walk(node, buf, strlen(buf), pattern, type);
+    return 0;
+}
+
+// 返回节点及其子树按簇链实际占用的字节数
+static unsigned long long _du_walk(const fsindex_node_t *node, char *path, size_t len, int print_dirs)
+{
+    unsigned long long csize = fsindex_cluster_size();
+    unsigned long long total = 0;
+    for (uint32_t i = 0; i < node->n_ext; i++) {
+        total += node->ext[i * 2 + 1] * csize;
+    }
+
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        int n = snprintf(path + len, 1024 - len, "%s%s", len && path[len - 1] == '/' ? "" : "/",
+                         node->child[i].name);
+        if (n > 0 && len + n < 1024) {
+            total += _du_walk(&node->child[i], path, len + n, print_dirs);
+        }
+        path[len] = '\0';
+    }
+    if (print_dirs && (node->attr & AM_DIR)) {
+        printf("%llu\t%s\n", total / 1024, path);
+    }
+    return total;
+}
+
+int shell_do_du(int argc, char **argv)
+{
+    const char *path      = ".";
+    int         summarize = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            summarize = 1;
+        } else if (argv[i][0] != '-' && strcmp(path, ".") == 0) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "用法: du [-s] [路径]\n");
+            return -1;
+        }
+    }
+
+    fsindex_node_t *node = fsindex_lookup(path, 1);
+    if (!node || fsindex_map_clusters(node) != 0) {
+        fprintf(stderr, "无法打开目录: %s\n", path);
+        return -1;
+    }
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", path);
+    unsigned long long total = _du_walk(node, buf, strlen(buf), !summarize);
+    if (summarize || !(node->attr & AM_DIR)) {
+        printf("%llu\t%s\n", total / 1024, path);
+    }
+    return 0;
+}
+
 static int _deal_with_attributes(BYTE *attr, const char *attributes, size_t attributes_len,
                                  char opt)
 {
@@ -865,7 +1553,7 @@ static int _deal_with_attributes(BYTE *attr, const char *attributes, size_t attr
 #define _ADD_ATTRIBUTE(origin, attr) origin |= (attr)
 #define _REMOVE_ATTRIBUTE(origin, attr) origin &= ~(attr)
     BYTE attribute = 0;
-    for (int i = 0; i < attributes_len; ++i) {
+    for (size_t i = 0; i < attributes_len; ++i) {
         switch (attributes[i]) {
             case 'R':
                 if (opt == '+')
@@ -990,7 +1678,8 @@ int shell_do_chmod(int argc, char **argv)
 
 int shell_do_getfree(int argc, char **argv)
 {
-    DWORD  fre_clust, fre_sect, tot_sect;
+    DWORD  fre_clust;
+    LBA_t  fre_sect, tot_sect;
     FATFS *fs;
 
     if (argc > 1) {
@@ -1016,12 +1705,12 @@ int shell_do_getfree(int argc, char **argv)
             FRESULT fr = f_getfree(driver_path, &fre_clust, &fs);
             if (fr == FR_OK) {
                 mounted_count++;
-                tot_sect = (fs->n_fatent - 2) * fs->csize;  // 总扇区数
-                fre_sect = fre_clust * fs->csize;           // 空闲扇区数
+                tot_sect = (LBA_t)(fs->n_fatent - 2) * fs->csize;  // 总扇区数
+                fre_sect = (LBA_t)fre_clust * fs->csize;           // 空闲扇区数
 
                 printf("  驱动器 %d:\n", i);
-                printf("    总扇区数: %lu\n", (unsigned long)tot_sect);
-                printf("    空闲扇区数: %lu\n", (unsigned long)fre_sect);
+                printf("    总扇区数: %llu\n", (unsigned long long)tot_sect);
+                printf("    空闲扇区数: %llu\n", (unsigned long long)fre_sect);
                 printf("    簇大小: %u 扇区\n", (unsigned int)fs->csize);
                 printf("    文件系统类型: ");
                 switch (fs->fs_type) {
@@ -1042,7 +1731,7 @@ int shell_do_getfree(int argc, char **argv)
                         break;
                 }
                 printf("\n");
-            } else {
+            } else if (fr != FR_NOT_ENABLED) {  // 没有挂载镜像的逻辑卷不列出
                 printf("  驱动器 %d: 获取信息失败 (%s: %d)\n", i, f_strerror(fr), fr);
             }
         }
@@ -1065,12 +1754,12 @@ int shell_do_getfree(int argc, char **argv)
         return -1;
     }
 
-    tot_sect = (fs->n_fatent - 2) * fs->csize;  // 总扇区数
-    fre_sect = fre_clust * fs->csize;           // 空闲扇区数
+    tot_sect = (LBA_t)(fs->n_fatent - 2) * fs->csize;  // 总扇区数
+    fre_sect = (LBA_t)fre_clust * fs->csize;           // 空闲扇区数
 
     printf("驱动器 %s 的空闲空间:\n", argv[0]);
-    printf("  总扇区数: %lu\n", (unsigned long)tot_sect);
-    printf("  空闲扇区数: %lu\n", (unsigned long)fre_sect);
+    printf("  总扇区数: %llu\n", (unsigned long long)tot_sect);
+    printf("  空闲扇区数: %llu\n", (unsigned long long)fre_sect);
     printf("  簇大小: %u 扇区\n", (unsigned int)fs->csize);
 
     return 0;
@@ -1114,6 +1803,47 @@ int shell_do_setlabel(int argc, char **argv)
     return 0;
 }
 
+int shell_do_stats(int argc, char **argv)
+{
+    stats_mode_t mode  = STATS_TEXT;
+    int          reset = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--json") == 0) {
+            mode = STATS_JSON;
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reset") == 0) {
+            reset = 1;
+        } else {
+            fprintf(stderr, "用法: stats [-j|--json] [-r|--reset]\n");
+            return -1;
+        }
+    }
+
+    int ret = stats_print(stdout, mode);
+    if (reset) {
+        stats_reset();
+    }
+    return ret;
+}
+
+int shell_do_sync(int argc, char **argv)
+{
+    (void)argv;
+    if (argc != 0) {
+        fprintf(stderr, "用法: sync\n");
+        return -1;
+    }
+
+    // 未启用延迟写回时等同于冲刷镜像文件的缓冲
+    int ret = 0;
+    for (int i = 0; i < s_n_images; i++) {
+        if (image_sync(s_images[i]) != FR_OK) {
+            fprintf(stderr, "写回镜像失败: %s\n", image_drive(s_images[i]));
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
 int shell_do_export(int argc, char **argv)
 {
     if (argc != 2) {
@@ -1162,14 +1892,19 @@ int shell_do_export(int argc, char **argv)
             // 构造源路径和目标路径
             TCHAR full_src_path[256];
             TCHAR full_dst_path[256];
+            int   n_src, n_dst;
 
             if (strcmp(src_path, "/") == 0) {
-                snprintf(full_src_path, sizeof(full_src_path), "/%s", fno.fname);
+                n_src = snprintf(full_src_path, sizeof(full_src_path), "/%s", fno.fname);
             } else {
-                snprintf(full_src_path, sizeof(full_src_path), "%s/%s", src_path, fno.fname);
+                n_src = snprintf(full_src_path, sizeof(full_src_path), "%s/%s", src_path, fno.fname);
             }
 
-            snprintf(full_dst_path, sizeof(full_dst_path), "%s/%s", dst_path, fno.fname);
+            n_dst = snprintf(full_dst_path, sizeof(full_dst_path), "%s/%s", dst_path, fno.fname);
+            if (n_src >= (int)sizeof(full_src_path) || n_dst >= (int)sizeof(full_dst_path)) {
+                fprintf(stderr, "路径过长，已跳过: %s/%s\n", src_path, fno.fname);
+                continue;
+            }
 
             // 递归导出
             char *sub_argv[] = {full_src_path, full_dst_path};
@@ -1312,13 +2047,124 @@ int parse_args(char *input, char *argv[], int max_args)
     return argc;
 }
 
-int shell_run(void)
+// 不修改目录树的命令
+static const char *readonly_cmds[] = {"exit",    "help",     "clear",  "ls",    "pwd",  "cd",
+                                      "read",    "head",     "stat",   "find",  "du",   "getfree",
+                                      "getlabel", "export",  "export-tar", "sum", "stats", "sync", NULL};
+
+void shell_attach(image_t **imgs, int n)
+{
+    s_images   = imgs;
+    s_n_images = n;
+}
+
+void shell_set_remote(int remote)
+{
+    s_remote = remote;
+}
+
+int shell_exec(char *line)
 {
-    char  input[256]               = {0};
     char *argv[SHELL_MAX_CMD_ARGS] = {0};
-    int   argc                     = 0;
     int   ret                      = 0;
 
+    // 解析命令行参数
+    int argc = parse_args(line, argv, SHELL_MAX_CMD_ARGS);
+    if (argc == 0) {
+        return 0;
+    }
+
+    // 可能修改目录树的命令执行前先丢弃内存中的目录索引
+    int readonly = 0;
+    for (const char **cmd = readonly_cmds; *cmd; cmd++) {
+        if (strcmp(argv[0], *cmd) == 0) {
+            readonly = 1;
+            break;
+        }
+    }
+    if (!readonly) {
+        fsindex_invalidate();
+    }
+
+#define _shell_cmd0_is(cmd_name) (strcmp(argv[0], #cmd_name) == 0)
+#define _shell_cmd1_is(cmd_name) (_shell_cmd0_is(cmd_name) && argc > 1)
+
+    // 内置命令处理
+    if (_shell_cmd0_is(exit)) {
+        ret = SHELL_EXIT;
+    } else if (_shell_cmd0_is(help)) {
+        ret = shell_do_help(argc, argv);
+    } else if (_shell_cmd0_is(clear)) {
+#ifdef _WIN32
+        system("cls");
+#else
+        system("clear");
+#endif
+    } else if (_shell_cmd0_is(ls)) {
+        ret = shell_do_ls(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(pwd)) {
+        ret = shell_do_pwd(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(mkdir)) {
+        ret = shell_do_mkdir(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(rm)) {
+        ret = shell_do_rm(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(cd)) {
+        ret = shell_do_cd(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(touch)) {
+        ret = shell_do_touch(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(read)) {
+        ret = shell_do_read(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(write)) {
+        ret = shell_do_write(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(head)) {
+        ret = shell_do_head(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(truncate)) {
+        ret = shell_do_truncate(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(stat)) {
+        ret = shell_do_stat(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(mv)) {
+        ret = shell_do_mv(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(cp)) {
+        ret = shell_do_cp(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(find)) {
+        ret = shell_do_find(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(du)) {
+        ret = shell_do_du(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(chmod)) {
+        ret = shell_do_chmod(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(getfree)) {
+        ret = shell_do_getfree(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(getlabel)) {
+        ret = shell_do_getlabel(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(setlabel)) {
+        ret = shell_do_setlabel(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(export)) {
+        ret = shell_do_export(argc - 1, argv + 1);
+    } else if (strcmp(argv[0], "export-tar") == 0) {
+        ret = shell_do_export_tar(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(sum)) {
+        ret = shell_do_sum(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(stats)) {
+        ret = shell_do_stats(argc - 1, argv + 1);
+    } else if (_shell_cmd0_is(sync)) {
+        ret = shell_do_sync(argc - 1, argv + 1);
+    } else {
+        fprintf(stderr, "未知命令: %s。输入 'help' 查看可用命令。\n", argv[0]);
+        ret = -1;
+    }
+
+#undef _shell_cmd0_is
+#undef _shell_cmd1_is
+
+    return ret;
+}
+
+int shell_run(image_t *img)
+{
+    char input[256] = {0};
+    int  ret        = 0;
+
+    shell_attach(&img, 1);
     printf("FatFS Shell - 输入 'help' 查看可用命令，'exit' 退出\n");
 
     while (1) {
@@ -1330,70 +2176,13 @@ int shell_run(void)
         // 移除换行符
         input[strcspn(input, "\n")] = 0;
 
-        // 空命令处理
-        if (strlen(input) == 0) {
-            continue;
-        }
-
-        // 解析命令行参数
-        argc = parse_args(input, argv, SHELL_MAX_CMD_ARGS);
-
-#define _shell_cmd0_is(cmd_name) (strcmp(argv[0], #cmd_name) == 0)
-#define _shell_cmd1_is(cmd_name) (_shell_cmd0_is(cmd_name) && argc > 1)
-
-        // 内置命令处理
-        if (_shell_cmd0_is(exit)) {
+        int r = shell_exec(input);
+        if (r == SHELL_EXIT) {
             break;
-        } else if (_shell_cmd0_is(help)) {
-            ret = shell_do_help(argc, argv);
-        } else if (_shell_cmd0_is(clear)) {
-#ifdef _WIN32
-            system("cls");
-#else
-            system("clear");
-#endif
-        } else if (_shell_cmd0_is(ls)) {
-            ret = shell_do_ls(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(pwd)) {
-            ret = shell_do_pwd(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(mkdir)) {
-            ret = shell_do_mkdir(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(rm)) {
-            ret = shell_do_rm(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(cd)) {
-            ret = shell_do_cd(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(touch)) {
-            ret = shell_do_touch(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(read)) {
-            ret = shell_do_read(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(write)) {
-            ret = shell_do_write(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(head)) {
-            ret = shell_do_head(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(truncate)) {
-            ret = shell_do_truncate(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(stat)) {
-            ret = shell_do_stat(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(mv)) {
-            ret = shell_do_mv(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(chmod)) {
-            ret = shell_do_chmod(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(getfree)) {
-            ret = shell_do_getfree(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(getlabel)) {
-            ret = shell_do_getlabel(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(setlabel)) {
-            ret = shell_do_setlabel(argc - 1, argv + 1);
-        } else if (_shell_cmd0_is(export)) {
-            ret = shell_do_export(argc - 1, argv + 1);
-        } else {
-            fprintf(stderr, "未知命令: %s。输入 'help' 查看可用命令。\n", argv[0]);
-            ret = -1;
         }
-
-#undef _shell_cmd0_is
-#undef _shell_cmd0_is
+        ret = r;
     }
 
+    shell_attach(NULL, 0);
     return ret;
 }
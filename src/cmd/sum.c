@@ -0,0 +1,596 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "checksum.h"
+#include "cmd.h"
+#include "fferrno.h"
+#include "thread.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 读取线程(调用FatFs的唯一线程)按遍历顺序用大块f_read读出文件内容，交给哈希线程计算；
+// 同一个文件的同一种算法总是由同一个哈希线程按顺序处理，不同文件和不同算法分散到各个线程上。
+// 缓冲块用完时读取线程等待，清单按遍历顺序输出，格式与 sha256sum/xxhsum 等工具相同。
+
+#define SUM_BLOCK_SIZE (1 * MB)  // 每次f_read读取的字节数
+#define SUM_BLOCKS_PER_JOB 2     // 每个哈希线程对应的缓冲块数，让读取可以领先于哈希
+#define SUM_PATH_MAX 4096
+#define SUM_MAX_SRCS 64
+
+typedef struct sum_opts_t {
+    checksum_alg_t algs[CHECKSUM_ALG_COUNT];
+    int            n_algs;
+    int            jobs;  // 哈希线程数
+    int            tag;   // BSD格式("SHA256 (路径) = ...")，多个算法时总是使用
+    FILE*          out;
+} sum_opts_t;
+
+typedef struct sum_file_t {
+    checksum_t         ck[CHECKSUM_ALG_COUNT];
+    int                pending;  // 尚未完成的(块, 算法)任务数
+    int                reading;  // 读取线程仍在读取该文件
+    int                error;
+    int                worker;  // 第一个算法所在的哈希线程
+    struct sum_file_t* next;
+    char               name[];  // 清单中的路径
+} sum_file_t;
+
+typedef struct sum_block_t {
+    sum_file_t*         file;
+    BYTE*               data;
+    UINT                len;
+    int                 refs;  // 尚未处理该块的算法数，为0时回到空闲链表
+    struct sum_block_t* next;
+} sum_block_t;
+
+typedef struct sum_task_t {
+    sum_block_t* block;
+    int          alg;  // 文件的第几个算法
+} sum_task_t;
+
+typedef struct sum_ctx_t sum_ctx_t;
+
+typedef struct sum_worker_t {
+    sum_ctx_t*  ctx;
+    sum_task_t* queue;  // 环形队列
+    int         head;
+    int         count;
+    thread_t*   thread;
+} sum_worker_t;
+
+struct sum_ctx_t {
+    const sum_opts_t* opts;
+    thread_mutex_t    lock;
+    thread_cond_t     work;  // 有新任务或需要退出
+    thread_cond_t     done;  // 有块被释放或任务完成
+    sum_worker_t*     workers;
+    int               n_workers;
+    int               qcap;  // 每个哈希线程队列的容量
+    sum_block_t*      blocks;
+    sum_block_t*      free_blocks;
+    sum_file_t*       head;  // 按遍历顺序排列、尚未输出的文件
+    sum_file_t*       tail;
+    int               quit;
+    unsigned long long bytes;
+    long              n_files;
+    long              n_errors;
+};
+
+static int _sum_worker(void* arg)
+{
+    sum_worker_t* w   = (sum_worker_t*)arg;
+    sum_ctx_t*    ctx = w->ctx;
+
+    thread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (!w->count && !ctx->quit) {
+            thread_cond_wait(&ctx->work, &ctx->lock);
+        }
+        if (!w->count) {
+            break;
+        }
+        sum_task_t t = w->queue[w->head];
+        w->head      = (w->head + 1) % ctx->qcap;
+        w->count--;
+        thread_mutex_unlock(&ctx->lock);
+
+        sum_block_t* b = t.block;
+        checksum_update(&b->file->ck[t.alg], b->data, b->len);
+
+        thread_mutex_lock(&ctx->lock);
+        b->file->pending--;
+        if (--b->refs == 0) {
+            b->next          = ctx->free_blocks;
+            ctx->free_blocks = b;
+        }
+        thread_cond_broadcast(&ctx->done);
+    }
+    thread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+static void _sum_print(sum_ctx_t* ctx, sum_file_t* f)
+{
+    const sum_opts_t* opts = ctx->opts;
+    char              hex[CHECKSUM_HEX_MAX];
+    if (f->error) {
+        return;
+    }
+    for (int i = 0; i < opts->n_algs; i++) {
+        checksum_final(&f->ck[i], hex);
+        if (opts->tag) {
+            fprintf(opts->out, "%s (%s) = %s\n", checksum_tag(opts->algs[i]), f->name, hex);
+        } else {
+            fprintf(opts->out, "%s  %s\n", hex, f->name);
+        }
+    }
+}
+
+// 按遍历顺序输出已经算完的文件，wait_all为非0时等待所有文件算完
+static void _sum_flush(sum_ctx_t* ctx, int wait_all)
+{
+    for (;;) {
+        thread_mutex_lock(&ctx->lock);
+        sum_file_t* f = ctx->head;
+        while (f && (f->reading || f->pending) && wait_all) {
+            thread_cond_wait(&ctx->done, &ctx->lock);
+        }
+        if (!f || f->reading || f->pending) {
+            thread_mutex_unlock(&ctx->lock);
+            return;
+        }
+        ctx->head = f->next;
+        if (!ctx->head) {
+            ctx->tail = NULL;
+        }
+        thread_mutex_unlock(&ctx->lock);
+
+        _sum_print(ctx, f);
+        free(f);
+    }
+}
+
+static void _sum_file(sum_ctx_t* ctx, const char* path, const char* name)
+{
+    const sum_opts_t* opts = ctx->opts;
+    FIL               fp;
+    FRESULT           fr = f_open(&fp, path, FA_READ);
+    if (fr != FR_OK) {
+        fprintf(stderr, "无法打开文件: %s (%s)\n", path, f_strerror(fr));
+        ctx->n_errors++;
+        return;
+    }
+    sum_file_t* f = (sum_file_t*)calloc(1, sizeof(sum_file_t) + strlen(name) + 1);
+    if (!f) {
+        fprintf(stderr, "内存不足: %s\n", path);
+        ctx->n_errors++;
+        f_close(&fp);
+        return;
+    }
+    strcpy(f->name, name);
+    for (int i = 0; i < opts->n_algs; i++) {
+        checksum_init(&f->ck[i], opts->algs[i]);
+    }
+    f->reading = 1;
+    f->worker  = (int)(ctx->n_files * opts->n_algs % ctx->n_workers);
+    ctx->n_files++;
+
+    thread_mutex_lock(&ctx->lock);
+    if (ctx->tail) {
+        ctx->tail->next = f;
+    } else {
+        ctx->head = f;
+    }
+    ctx->tail = f;
+    thread_mutex_unlock(&ctx->lock);
+
+    for (;;) {
+        thread_mutex_lock(&ctx->lock);
+        while (!ctx->free_blocks) {
+            thread_cond_wait(&ctx->done, &ctx->lock);
+        }
+        sum_block_t* b   = ctx->free_blocks;
+        ctx->free_blocks = b->next;
+        thread_mutex_unlock(&ctx->lock);
+
+        UINT br = 0;
+        fr      = f_read(&fp, b->data, SUM_BLOCK_SIZE, &br);
+
+        thread_mutex_lock(&ctx->lock);
+        if (fr != FR_OK || br == 0) {
+            b->next          = ctx->free_blocks;
+            ctx->free_blocks = b;
+            thread_mutex_unlock(&ctx->lock);
+            break;
+        }
+        b->file = f;
+        b->len  = br;
+        b->refs = opts->n_algs;
+        f->pending += opts->n_algs;
+        for (int i = 0; i < opts->n_algs; i++) {
+            sum_worker_t* w = &ctx->workers[(f->worker + i) % ctx->n_workers];
+            w->queue[(w->head + w->count) % ctx->qcap] = (sum_task_t){b, i};
+            w->count++;
+        }
+        thread_cond_broadcast(&ctx->work);
+        thread_mutex_unlock(&ctx->lock);
+
+        ctx->bytes += br;
+        if (br < SUM_BLOCK_SIZE) {
+            break;
+        }
+    }
+    f_close(&fp);
+    if (fr != FR_OK) {
+        fprintf(stderr, "读取文件失败: %s (%s)\n", path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+
+    thread_mutex_lock(&ctx->lock);
+    f->error   = fr != FR_OK;
+    f->reading = 0;
+    thread_mutex_unlock(&ctx->lock);
+    _sum_flush(ctx, 0);
+}
+
+// 递归处理目录，path[base]起为清单中显示的相对路径
+static void _sum_dir(sum_ctx_t* ctx, char* path, size_t len, size_t base)
+{
+    DIR     dir;
+    FILINFO fno;
+    FRESULT fr = f_opendir(&dir, path);
+    if (fr != FR_OK) {
+        fprintf(stderr, "无法打开目录: %s (%s)\n", path, f_strerror(fr));
+        ctx->n_errors++;
+        return;
+    }
+    while ((fr = f_readdir(&dir, &fno)) == FR_OK && fno.fname[0]) {
+        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0) {
+            continue;
+        }
+        int n = snprintf(path + len, SUM_PATH_MAX - len, "%s%s",
+                         len && path[len - 1] == '/' ? "" : "/", fno.fname);
+        if (n < 0 || len + n >= SUM_PATH_MAX) {
+            path[len] = '\0';
+            fprintf(stderr, "路径过长: %s/%s\n", path, fno.fname);
+            ctx->n_errors++;
+            continue;
+        }
+        if (fno.fattrib & AM_DIR) {
+            _sum_dir(ctx, path, len + n, base);
+        } else {
+            _sum_file(ctx, path, path + base);
+        }
+        path[len] = '\0';
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "读取目录失败: %s (%s)\n", path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+    f_closedir(&dir);
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 计算paths中各文件(目录则递归其中所有文件)的校验和并输出清单，有文件失败时返回-1
+static int _sum_run(char** paths, int n_paths, const sum_opts_t* opts)
+{
+    sum_ctx_t ctx = {.opts = opts};
+    int       n_blocks = opts->jobs * SUM_BLOCKS_PER_JOB + 1;
+    ctx.qcap           = n_blocks * opts->n_algs;
+    ctx.workers        = (sum_worker_t*)calloc(opts->jobs, sizeof(sum_worker_t));
+    ctx.blocks         = (sum_block_t*)calloc(n_blocks, sizeof(sum_block_t));
+    char* path         = (char*)malloc(SUM_PATH_MAX);
+    if (!ctx.workers || !ctx.blocks || !path) {
+        fprintf(stderr, "内存不足\n");
+        free(ctx.workers);
+        free(ctx.blocks);
+        free(path);
+        return -1;
+    }
+    for (int i = 0; i < n_blocks; i++) {
+        ctx.blocks[i].data = (BYTE*)malloc(SUM_BLOCK_SIZE);
+        if (ctx.blocks[i].data) {
+            ctx.blocks[i].next = ctx.free_blocks;
+            ctx.free_blocks    = &ctx.blocks[i];
+        }
+    }
+    thread_mutex_init(&ctx.lock);
+    thread_cond_init(&ctx.work);
+    thread_cond_init(&ctx.done);
+    for (int i = 0; i < opts->jobs; i++) {
+        sum_worker_t* w = &ctx.workers[ctx.n_workers];
+        w->ctx          = &ctx;
+        w->queue        = (sum_task_t*)malloc(ctx.qcap * sizeof(sum_task_t));
+        w->thread       = w->queue ? thread_start(_sum_worker, w) : NULL;
+        if (!w->thread) {
+            free(w->queue);
+            break;
+        }
+        ctx.n_workers++;
+    }
+
+    int    ret = 0;
+    double t0  = _now();
+    if (ctx.n_workers == 0 || !ctx.free_blocks) {
+        fprintf(stderr, "无法启动哈希线程\n");
+        ret = -1;
+    }
+    for (int i = 0; ret == 0 && i < n_paths; i++) {
+        DIR dir;
+        snprintf(path, SUM_PATH_MAX, "%s", paths[i]);
+        if (f_opendir(&dir, path) == FR_OK) {
+            f_closedir(&dir);
+            size_t len = strlen(path);
+            _sum_dir(&ctx, path, len, len && path[len - 1] != '/' ? len + 1 : len);
+        } else {
+            _sum_file(&ctx, path, paths[i]);
+        }
+    }
+    _sum_flush(&ctx, 1);
+    fflush(opts->out);
+
+    thread_mutex_lock(&ctx.lock);
+    ctx.quit = 1;
+    thread_cond_broadcast(&ctx.work);
+    thread_mutex_unlock(&ctx.lock);
+    for (int i = 0; i < ctx.n_workers; i++) {
+        thread_join(ctx.workers[i].thread);
+        free(ctx.workers[i].queue);
+    }
+
+    if (ret == 0) {
+        double secs = _now() - t0;
+        fprintf(stderr, "%ld 个文件, %llu 字节, 用时 %.3f 秒, %.1f MB/s\n", ctx.n_files, ctx.bytes,
+                secs, secs > 0 ? ctx.bytes / secs / MB : 0.0);
+    }
+
+    thread_cond_destroy(&ctx.done);
+    thread_cond_destroy(&ctx.work);
+    thread_mutex_destroy(&ctx.lock);
+    for (int i = 0; i < n_blocks; i++) {
+        free(ctx.blocks[i].data);
+    }
+    free(ctx.blocks);
+    free(ctx.workers);
+    free(path);
+    return ret == 0 && ctx.n_errors == 0 ? 0 : -1;
+}
+
+// 添加 -a 指定的算法，重复的算法只计算一次
+static int _sum_add_alg(sum_opts_t* opts, const char* name)
+{
+    int alg = checksum_parse(name);
+    if (alg < 0) {
+        fprintf(stderr, "未知的校验算法: %s (可用: crc32, sha256, xxh64)\n", name);
+        return -1;
+    }
+    for (int i = 0; i < opts->n_algs; i++) {
+        if (opts->algs[i] == (checksum_alg_t)alg) {
+            return 0;
+        }
+    }
+    opts->algs[opts->n_algs++] = (checksum_alg_t)alg;
+    return 0;
+}
+
+// 补全默认值：未指定算法时使用SHA-256，多个算法时使用BSD格式
+static void _sum_fix_opts(sum_opts_t* opts)
+{
+    if (opts->n_algs == 0) {
+        opts->algs[opts->n_algs++] = CHECKSUM_SHA256;
+    }
+    if (opts->n_algs > 1) {
+        opts->tag = 1;
+    }
+    if (opts->jobs <= 0) {
+        opts->jobs = thread_cpu_count();
+    }
+}
+
+int shell_do_sum(int argc, char** argv)
+{
+    sum_opts_t opts    = {.out = stdout};
+    char*      paths[SUM_MAX_SRCS];
+    int        n_paths = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            if (_sum_add_alg(&opts, argv[++i]) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            opts.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tag") == 0) {
+            opts.tag = 1;
+        } else if (argv[i][0] != '-' && n_paths < SUM_MAX_SRCS) {
+            paths[n_paths++] = argv[i];
+        } else {
+            fprintf(stderr, "用法: sum [-a crc32|sha256|xxh64]... [-j 线程数] [--tag] [路径...]\n");
+            return -1;
+        }
+    }
+    if (n_paths == 0) {
+        paths[n_paths++] = ".";
+    }
+    _sum_fix_opts(&opts);
+    return _sum_run(paths, n_paths, &opts);
+}
+
+typedef struct sum_cmd_args_t {
+    char*      img_path;
+    BYTE       partition;
+    char*      output;  // 清单文件，NULL时输出到标准输出
+    char*      srcs[SUM_MAX_SRCS];
+    int        n_srcs;
+    sum_opts_t opts;
+} sum_cmd_args_t;
+
+const char* sum_help_str =
+    "用法: sum [选项]\n"
+    "直接从镜像中读出文件并计算校验和，输出与 sha256sum、xxhsum 等工具兼容的清单。\n"
+    "目录中的文件以相对于该目录的路径输出，导出后可以在导出目录中用 sha256sum -c 校验。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -P, --partition=序号    使用分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -s, --src=路径          镜像内的文件或目录，可重复指定。(默认: /)\n"
+    "  -a, --algo=算法         crc32、sha256 或 xxh64，可重复指定以一次读取计算多种校验和。(默认: sha256)\n"
+    "  -j, --jobs=数量         哈希线程数。(默认: 处理器数)\n"
+    "      --tag               输出BSD格式(\"SHA256 (路径) = ...\")，指定多个算法时总是使用。\n"
+    "  -o, --output=文件       把清单写入宿主机文件。(默认: 标准输出)\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const sum_cmd_args_t default_args = {
+    .img_path  = NULL,
+    .partition = 0,
+    .output    = NULL,
+    .n_srcs    = 0,
+};
+
+cmd_args_t cmd_parse_sum_args(int argc, char** argv)
+{
+    sum_cmd_args_t* args = (sum_cmd_args_t*)calloc(1, sizeof(sum_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"src", required_argument, 0, 's'},
+                                           {"algo", required_argument, 0, 'a'},
+                                           {"jobs", required_argument, 0, 'j'},
+                                           {"tag", no_argument, 0, 'T'},
+                                           {"output", required_argument, 0, 'o'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:s:a:j:o:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_sum_args(args);
+                    return NULL;
+                }
+                break;
+            case 's':  // src
+                if (args->n_srcs >= SUM_MAX_SRCS) {
+                    fprintf(stderr, "最多指定 %d 个路径\n", SUM_MAX_SRCS);
+                    cmd_free_sum_args(args);
+                    return NULL;
+                }
+                args->srcs[args->n_srcs++] = strdup(optarg);
+                break;
+            case 'a':  // algo
+                if (_sum_add_alg(&args->opts, optarg) != 0) {
+                    cmd_free_sum_args(args);
+                    return NULL;
+                }
+                break;
+            case 'j':  // jobs
+                args->opts.jobs = atoi(optarg);
+                if (args->opts.jobs <= 0) {
+                    fprintf(stderr, "无效的线程数: %s\n", optarg);
+                    cmd_free_sum_args(args);
+                    return NULL;
+                }
+                break;
+            case 'T':  // tag
+                args->opts.tag = 1;
+                break;
+            case 'o':  // output
+                cmd_args_field_should_free(args, output, default_args);
+                args->output = strdup(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", sum_help_str);
+                cmd_free_sum_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_sum_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_sum_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_sum_args(cmd_args_t arg)
+{
+    sum_cmd_args_t* args = cmd_args_cast(arg, sum_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        cmd_args_field_should_free(args, output, default_args);
+        for (int i = 0; i < args->n_srcs; i++) {
+            free(args->srcs[i]);
+        }
+        free(args);
+    }
+}
+
+int cmd_do_sum(cmd_args_t arg)
+{
+    sum_cmd_args_t* args = cmd_args_cast(arg, sum_cmd_args_t);
+    if (!args || !args->img_path) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    image_opts_t opts = {.partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        return -1;
+    }
+
+    FILE* out = args->output ? fopen(args->output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "无法创建清单文件: %s\n", args->output);
+        image_close(img);
+        return -1;
+    }
+
+    char* root[] = {"/"};
+    args->opts.out = out;
+    _sum_fix_opts(&args->opts);
+    int ret = _sum_run(args->n_srcs ? args->srcs : root, args->n_srcs ? args->n_srcs : 1, &args->opts);
+
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "写入清单文件失败: %s\n", args->output);
+        ret = -1;
+    }
+    image_close(img);
+    return ret;
+}
@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "fferrno.h"
+#include "hostfs.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 把宿主机目录树增量同步到镜像中的目录：按名称合并比较两边的目录项，大小和修改时间(FAT的2秒精度)都相同的文件
+// 直接跳过；其余文件在原有的簇上逐块比较，只改写不同的块，再按需截断或延长并更新时间戳；镜像中多余的文件和
+// 目录被删除。元数据写入延迟写回缓存，结束时只同步一次。
+
+#define SYNC_BUFFER_SIZE (1 * MB)  // 每次从两边读出的字节数
+#define SYNC_CHUNK_SIZE (64 * KB)  // 比较和改写的粒度
+#define SYNC_PATH_MAX 4096
+
+typedef struct sync_opts_t {
+    int checksum;  // 大小和修改时间相同的文件也比较内容
+    int dry_run;   // 只列出要做的修改，不写入镜像
+    int verbose;   // 列出每个修改
+} sync_opts_t;
+
+typedef struct sync_entry_t {
+    char*              name;
+    int                is_dir;
+    unsigned long long size;
+    DWORD              fattime;  // 高16位日期，低16位时间
+} sync_entry_t;
+
+typedef struct sync_ctx_t {
+    const sync_opts_t* opts;
+    BYTE*              buf[2];
+    char*              host;  // 宿主机路径
+    char*              path;  // 镜像内路径
+    long               n_files;
+    long               n_added;
+    long               n_updated;
+    long               n_touched;  // 内容相同，只更新了时间戳
+    long               n_deleted;
+    long               n_errors;
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+} sync_ctx_t;
+
+// 从UTF-8名称中取出下一个字符，按FatFs比较长文件名的方式(ff_wtoupper)转成大写；无效的字节按原值返回
+static DWORD _sync_fold(const char** s)
+{
+    const unsigned char* p     = (const unsigned char*)*s;
+    DWORD                uc    = p[0];
+    int                  extra = uc >= 0xF0 ? 3 : uc >= 0xE0 ? 2 : uc >= 0xC0 ? 1 : 0;
+    for (int i = 1; i <= extra; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            extra = 0;
+            break;
+        }
+    }
+    if (extra) {
+        uc &= 0x3F >> extra;
+        for (int i = 1; i <= extra; i++) {
+            uc = uc << 6 | (p[i] & 0x3F);
+        }
+    }
+    *s += 1 + extra;
+    return ff_wtoupper(uc);
+}
+
+// FAT的文件名不区分大小写(包括非ASCII字符)，两边按FatFs认为相同的名称相等的顺序排列
+static int _sync_namecmp(const char* a, const char* b)
+{
+    while (*a || *b) {
+        DWORD ca = *a ? _sync_fold(&a) : 0;
+        DWORD cb = *b ? _sync_fold(&b) : 0;
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int _sync_entry_cmp(const void* a, const void* b)
+{
+    return _sync_namecmp(((const sync_entry_t*)a)->name, ((const sync_entry_t*)b)->name);
+}
+
+static void _sync_free_list(sync_entry_t* list, int n)
+{
+    for (int i = 0; i < n; i++) {
+        free(list[i].name);
+    }
+    free(list);
+}
+
+static int _sync_push(sync_entry_t** list, int* n, int* cap, const sync_entry_t* e)
+{
+    if (*n == *cap) {
+        int           new_cap = *cap ? *cap * 2 : 64;
+        sync_entry_t* grow    = (sync_entry_t*)realloc(*list, new_cap * sizeof(sync_entry_t));
+        if (!grow) {
+            return -1;
+        }
+        *list = grow;
+        *cap  = new_cap;
+    }
+    (*list)[*n] = *e;
+    (*list)[*n].name = strdup(e->name);
+    if (!(*list)[*n].name) {
+        return -1;
+    }
+    (*n)++;
+    return 0;
+}
+
+// 读出镜像目录中的所有目录项并按名称排序
+static FRESULT _sync_list_image(const char* path, sync_entry_t** out, int* count)
+{
+    DIR           dir;
+    FILINFO       fno;
+    sync_entry_t* list = NULL;
+    int           n = 0, cap = 0;
+    FRESULT       fr = f_opendir(&dir, path);
+    if (fr != FR_OK) {
+        return fr;
+    }
+    while ((fr = f_readdir(&dir, &fno)) == FR_OK && fno.fname[0]) {
+        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0) {
+            continue;
+        }
+        sync_entry_t e = {fno.fname, (fno.fattrib & AM_DIR) != 0, fno.fsize,
+                          (DWORD)fno.fdate << 16 | fno.ftime};
+        if (_sync_push(&list, &n, &cap, &e) != 0) {
+            fr = FR_NOT_ENOUGH_CORE;
+            break;
+        }
+    }
+    f_closedir(&dir);
+    if (fr != FR_OK) {
+        _sync_free_list(list, n);
+        return fr;
+    }
+    qsort(list, n, sizeof(sync_entry_t), _sync_entry_cmp);
+    *out   = list;
+    *count = n;
+    return FR_OK;
+}
+
+// 读出宿主机目录中的所有文件和目录并按名称排序，host[0..len)为目录路径
+static int _sync_list_host(char* host, size_t len, sync_entry_t** out, int* count)
+{
+    hostfs_dir_t* dir = hostfs_opendir(host);
+    if (!dir) {
+        return -1;
+    }
+    sync_entry_t* list = NULL;
+    int           n = 0, cap = 0, ret = 0;
+    const char*   name;
+    while ((name = hostfs_readdir(dir)) != NULL) {
+        hostfs_stat_t st;
+        int           k = snprintf(host + len, SYNC_PATH_MAX - len, "/%s", name);
+        if (k < 0 || len + k >= SYNC_PATH_MAX || hostfs_stat(host, &st) != 0) {
+            host[len] = '\0';
+            fprintf(stderr, "略过无法访问的宿主机路径: %s/%s\n", host, name);
+            continue;
+        }
+        sync_entry_t e = {(char*)name, st.is_dir, st.size, hostfs_to_fattime(st.mtime)};
+        if (_sync_push(&list, &n, &cap, &e) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+    host[len] = '\0';
+    hostfs_closedir(dir);
+    if (ret != 0) {
+        _sync_free_list(list, n);
+        return ret;
+    }
+    qsort(list, n, sizeof(sync_entry_t), _sync_entry_cmp);
+
+    // 只有大小写不同的名称在镜像中是同一个目录项，只保留一个
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (m && _sync_namecmp(list[m - 1].name, list[i].name) == 0) {
+            fprintf(stderr, "略过与 %s 只有大小写不同的宿主机路径: %s/%s\n", list[m - 1].name, host, list[i].name);
+            free(list[i].name);
+            continue;
+        }
+        list[m++] = list[i];
+    }
+    *out   = list;
+    *count = m;
+    return 0;
+}
+
+static void _sync_report(sync_ctx_t* ctx, char op, const char* path)
+{
+    if (ctx->opts->verbose || ctx->opts->dry_run) {
+        printf("%c\t%s\n", op, path);
+    }
+}
+
+// 设置镜像中文件或目录的修改时间
+static FRESULT _sync_utime(const char* path, DWORD fattime)
+{
+    FILINFO fno;
+    fno.fdate = (WORD)(fattime >> 16);
+    fno.ftime = (WORD)fattime;
+    return f_utime(path, &fno);
+}
+
+// 以宿主机文件的内容更新镜像中的文件：在已有的簇上逐块比较，只改写不同的块，超出部分追加，
+// 文件变小时截断；新建的文件先尝试一次性分配连续的簇。返回时*written为写入(或将要写入)的字节数
+static FRESULT _sync_write(sync_ctx_t* ctx, const char* host, const char* path, FSIZE_t old_size,
+                           unsigned long long size, int create, unsigned long long* written)
+{
+    FILE* hf = fopen(host, "rb");
+    if (!hf) {
+        return FR_NO_FILE;
+    }
+    FIL     fp;
+    FRESULT fr  = FR_OK;
+    int     dry = ctx->opts->dry_run;
+    *written    = 0;
+    if (!dry) {
+        fr = f_open(&fp, path, create ? FA_WRITE | FA_CREATE_ALWAYS : FA_READ | FA_WRITE);
+        if (fr == FR_OK && create && size > 0) {
+            f_expand(&fp, (FSIZE_t)size, 1);  // 尽量一次分配连续的簇，不成功时随写入逐簇分配
+        }
+    } else if (!create) {
+        fr = f_open(&fp, path, FA_READ);
+    }
+    if (fr != FR_OK) {
+        fclose(hf);
+        return fr;
+    }
+
+    unsigned long long off = 0;
+    while (fr == FR_OK && off < size) {
+        size_t n = size - off < SYNC_BUFFER_SIZE ? (size_t)(size - off) : SYNC_BUFFER_SIZE;
+        if (fread(ctx->buf[0], 1, n, hf) != n) {
+            fr = FR_DISK_ERR;  // 宿主机文件在同步过程中变小或读取失败
+            break;
+        }
+        ctx->bytes_read += n;
+
+        // 与镜像中原有的内容比较，原文件范围之外的部分总是写入
+        UINT br = 0;
+        if (!create && off < old_size) {
+            fr = f_read(&fp, ctx->buf[1], (UINT)n, &br);
+            ctx->bytes_read += br;
+        }
+        for (size_t c = 0; fr == FR_OK && c < n; c += SYNC_CHUNK_SIZE) {
+            size_t k = n - c < SYNC_CHUNK_SIZE ? n - c : SYNC_CHUNK_SIZE;
+            if (c + k <= br && memcmp(ctx->buf[0] + c, ctx->buf[1] + c, k) == 0) {
+                continue;
+            }
+            *written += k;
+            if (dry) {
+                continue;
+            }
+            UINT bw;
+            fr = f_lseek(&fp, (FSIZE_t)(off + c));
+            if (fr == FR_OK) {
+                fr = f_write(&fp, ctx->buf[0] + c, (UINT)k, &bw);
+            }
+            if (fr == FR_OK && bw != k) {
+                fr = FR_DENIED;  // 磁盘已满
+            }
+        }
+        off += n;
+        if (fr == FR_OK && !dry) {
+            fr = f_lseek(&fp, (FSIZE_t)off);
+        }
+    }
+    if (fr == FR_OK && !dry && old_size > size) {
+        fr = f_lseek(&fp, (FSIZE_t)size);
+        if (fr == FR_OK) {
+            fr = f_truncate(&fp);
+        }
+    }
+    fclose(hf);
+    if (!dry || !create) {
+        FRESULT fr_close = f_close(&fp);
+        if (fr == FR_OK) {
+            fr = fr_close;
+        }
+    }
+    ctx->bytes_written += *written;
+    return fr;
+}
+
+static void _sync_tree(sync_ctx_t* ctx, size_t hlen, size_t len, int fresh);
+
+// 删除镜像中的文件或目录树
+static void _sync_delete(sync_ctx_t* ctx, const sync_entry_t* e)
+{
+    _sync_report(ctx, '-', ctx->path);
+    ctx->n_deleted++;
+    if (ctx->opts->dry_run) {
+        return;
+    }
+    FRESULT fr = e->is_dir ? remove_tree(ctx->path) : f_unlink(ctx->path);
+    if (fr != FR_OK) {
+        fprintf(stderr, "删除失败: %s (%s)\n", ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+}
+
+// 在镜像中新建宿主机上的文件或目录树
+static void _sync_add(sync_ctx_t* ctx, const sync_entry_t* h, size_t hlen, size_t len)
+{
+    FRESULT fr = FR_OK;
+    _sync_report(ctx, '+', ctx->path);
+    if (h->is_dir) {
+        if (!ctx->opts->dry_run) {
+            fr = f_mkdir(ctx->path);
+        }
+        if (fr == FR_OK) {
+            _sync_tree(ctx, hlen, len, 1);
+            ctx->n_added++;
+            if (!ctx->opts->dry_run) {
+                fr = _sync_utime(ctx->path, h->fattime);
+            }
+        }
+    } else {
+        unsigned long long written;
+        ctx->n_files++;
+        fr = _sync_write(ctx, ctx->host, ctx->path, 0, h->size, 1, &written);
+        if (fr == FR_OK) {
+            ctx->n_added++;
+            if (!ctx->opts->dry_run) {
+                fr = _sync_utime(ctx->path, h->fattime);
+            }
+        }
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "写入失败: %s -> %s (%s)\n", ctx->host, ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+}
+
+// 更新两边都有的文件
+static void _sync_update(sync_ctx_t* ctx, const sync_entry_t* h, const sync_entry_t* e)
+{
+    ctx->n_files++;
+    if (h->size == e->size && h->fattime == e->fattime && !ctx->opts->checksum) {
+        return;
+    }
+    unsigned long long written;
+    FRESULT fr = _sync_write(ctx, ctx->host, ctx->path, (FSIZE_t)e->size, h->size, 0, &written);
+    if (fr == FR_OK && (written || h->size != e->size)) {
+        _sync_report(ctx, 'M', ctx->path);
+        ctx->n_updated++;
+    } else if (fr == FR_OK && h->fattime != e->fattime) {
+        _sync_report(ctx, 't', ctx->path);
+        ctx->n_touched++;
+    }
+    // 改写过的文件在关闭时被记为当前时间，也要恢复成宿主机上的修改时间
+    int modified = written || h->size != e->size || h->fattime != e->fattime;
+    if (fr == FR_OK && modified && !ctx->opts->dry_run) {
+        fr = _sync_utime(ctx->path, h->fattime);
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "更新失败: %s -> %s (%s)\n", ctx->host, ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+}
+
+// 同步host[0..hlen)到path[0..len)，fresh为非0时镜像目录是刚新建的(空目录)
+static void _sync_tree(sync_ctx_t* ctx, size_t hlen, size_t len, int fresh)
+{
+    sync_entry_t* list[2] = {NULL, NULL};  // 宿主机、镜像
+    int           n[2]    = {0, 0};
+    if (_sync_list_host(ctx->host, hlen, &list[0], &n[0]) != 0) {
+        fprintf(stderr, "无法读取宿主机目录: %s\n", ctx->host);
+        ctx->n_errors++;
+        return;
+    }
+    if (!fresh) {
+        FRESULT fr = _sync_list_image(ctx->path, &list[1], &n[1]);
+        if (fr != FR_OK) {
+            fprintf(stderr, "无法读取目录: %s (%s)\n", ctx->path, f_strerror(fr));
+            ctx->n_errors++;
+            _sync_free_list(list[0], n[0]);
+            return;
+        }
+    }
+
+    // 合并两遍：第一遍只删除镜像中多余的和类型不同的目录项，第二遍再新建和更新，
+    // 这样新建的文件不会在同一目录中随后被当作多余的目录项删除，删除释放的空间也能被新建的文件使用
+    for (int pass = 0; pass < 2; pass++) {
+        int i = 0, j = 0;
+        while (i < n[0] || j < n[1]) {
+            int c = i == n[0] ? 1 : j == n[1] ? -1 : _sync_namecmp(list[0][i].name, list[1][j].name);
+            // 镜像中的路径沿用镜像中已有的名称，新建时使用宿主机上的名称
+            const char* name   = c < 0 ? list[0][i].name : list[1][j].name;
+            int         hk     = c <= 0 ? snprintf(ctx->host + hlen, SYNC_PATH_MAX - hlen, "/%s", list[0][i].name) : 0;
+            int         k      = snprintf(ctx->path + len, SYNC_PATH_MAX - len, "%s%s",
+                                          len && ctx->path[len - 1] == '/' ? "" : "/", name);
+            int         retype = c == 0 && list[0][i].is_dir != list[1][j].is_dir;
+            if (hk < 0 || hlen + hk >= SYNC_PATH_MAX || k < 0 || len + k >= SYNC_PATH_MAX) {
+                ctx->host[hlen] = '\0';
+                ctx->path[len]  = '\0';
+                if (pass) {
+                    fprintf(stderr, "路径过长: %s/%s\n", ctx->path, name);
+                    ctx->n_errors++;
+                }
+            } else if (pass == 0) {
+                if (c > 0 || retype) {
+                    _sync_delete(ctx, &list[1][j]);
+                }
+            } else if (c < 0 || retype) {
+                _sync_add(ctx, &list[0][i], hlen + hk, len + k);
+            } else if (c == 0 && list[0][i].is_dir) {
+                _sync_tree(ctx, hlen + hk, len + k, 0);
+                if (list[0][i].fattime != list[1][j].fattime && !ctx->opts->dry_run &&
+                    _sync_utime(ctx->path, list[0][i].fattime) != FR_OK) {
+                    fprintf(stderr, "更新时间戳失败: %s\n", ctx->path);
+                    ctx->n_errors++;
+                }
+            } else if (c == 0) {
+                _sync_update(ctx, &list[0][i], &list[1][j]);
+            }
+            ctx->host[hlen] = '\0';
+            ctx->path[len]  = '\0';
+            i += c <= 0;
+            j += c >= 0;
+        }
+    }
+    _sync_free_list(list[0], n[0]);
+    _sync_free_list(list[1], n[1]);
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 把宿主机目录host_dir同步到镜像中的目录dst(不存在时新建)，成功返回0
+static int _sync_run(image_t* img, const char* host_dir, const char* dst, const sync_opts_t* opts)
+{
+    hostfs_stat_t st;
+    if (hostfs_stat(host_dir, &st) != 0 || !st.is_dir) {
+        fprintf(stderr, "宿主机目录不存在: %s\n", host_dir);
+        return -1;
+    }
+
+    sync_ctx_t ctx = {.opts = opts};
+    ctx.host       = (char*)malloc(SYNC_PATH_MAX);
+    ctx.path       = (char*)malloc(SYNC_PATH_MAX);
+    ctx.buf[0]     = (BYTE*)malloc(SYNC_BUFFER_SIZE);
+    ctx.buf[1]     = (BYTE*)malloc(SYNC_BUFFER_SIZE);
+    int ret        = 0;
+    if (!ctx.host || !ctx.path || !ctx.buf[0] || !ctx.buf[1]) {
+        fprintf(stderr, "内存不足\n");
+        ret = -1;
+    }
+
+    double t0 = _now();
+    if (ret == 0) {
+        snprintf(ctx.host, SYNC_PATH_MAX, "%s", host_dir);
+        snprintf(ctx.path, SYNC_PATH_MAX, "%s", dst);
+        size_t hlen = strlen(ctx.host);
+        while (hlen > 1 && ctx.host[hlen - 1] == '/') {  // 由_sync_tree统一加分隔符
+            ctx.host[--hlen] = '\0';
+        }
+        DIR     dir;
+        int     fresh = 0;
+        FRESULT fr    = f_opendir(&dir, ctx.path);
+        if (fr == FR_OK) {
+            f_closedir(&dir);
+        } else if (fr == FR_NO_FILE || fr == FR_NO_PATH) {
+            fr    = opts->dry_run ? FR_OK : f_mkdir(ctx.path);
+            fresh = 1;
+        }
+        if (fr != FR_OK) {
+            fprintf(stderr, "无法打开镜像中的目录: %s (%s)\n", ctx.path, f_strerror(fr));
+            ret = -1;
+        } else {
+            _sync_tree(&ctx, hlen, strlen(ctx.path), fresh);
+        }
+    }
+    if (ret == 0 && !opts->dry_run && image_sync(img) != FR_OK) {
+        fprintf(stderr, "写回镜像失败\n");
+        ret = -1;
+    }
+    fflush(stdout);
+    if (ret == 0) {
+        double secs = _now() - t0;
+        fprintf(stderr,
+                "%ld 个文件: 新增 %ld, 更新 %ld, 只更新时间 %ld, 删除 %ld; 读取 %llu 字节, 写入 %llu 字节, "
+                "用时 %.3f 秒\n",
+                ctx.n_files, ctx.n_added, ctx.n_updated, ctx.n_touched, ctx.n_deleted, ctx.bytes_read,
+                ctx.bytes_written, secs);
+    }
+
+    free(ctx.host);
+    free(ctx.path);
+    free(ctx.buf[0]);
+    free(ctx.buf[1]);
+    return ret == 0 && ctx.n_errors == 0 ? 0 : -1;
+}
+
+typedef struct sync_cmd_args_t {
+    char*       img_path;
+    BYTE        partition;
+    char*       dir;  // 宿主机目录
+    char*       dst;  // 镜像内目录
+    sync_opts_t opts;
+} sync_cmd_args_t;
+
+const char* sync_help_str =
+    "用法: sync [选项]\n"
+    "把宿主机目录树增量同步到已有镜像中的目录：只写入新增和内容变化的文件(在原有的簇上只改写不同的块)，\n"
+    "按需截断或延长文件、更新时间戳，并删除镜像中宿主机上已不存在的文件和目录。\n"
+    "大小和修改时间都相同的文件视为未变化。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -P, --partition=序号    使用分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -d, --dir=目录          宿主机上的源目录。(必填)\n"
+    "  -s, --dst=路径          镜像内的目标目录，不存在时新建。(默认: /)\n"
+    "  -c, --checksum          大小和修改时间都相同的文件也比较内容。\n"
+    "  -n, --dry-run           只列出要做的修改，不写入镜像。\n"
+    "  -v, --verbose           列出每个新增(+)、更新(M)、只更新时间(t)、删除(-)的路径。\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const sync_cmd_args_t default_args = {
+    .img_path  = NULL,
+    .partition = 0,
+    .dir       = NULL,
+    .dst       = "/",
+};
+
+cmd_args_t cmd_parse_sync_args(int argc, char** argv)
+{
+    sync_cmd_args_t* args = (sync_cmd_args_t*)calloc(1, sizeof(sync_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"dir", required_argument, 0, 'd'},
+                                           {"dst", required_argument, 0, 's'},
+                                           {"checksum", no_argument, 0, 'c'},
+                                           {"dry-run", no_argument, 0, 'n'},
+                                           {"verbose", no_argument, 0, 'v'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:d:s:cnvh", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_sync_args(args);
+                    return NULL;
+                }
+                break;
+            case 'd':  // dir
+                cmd_args_field_should_free(args, dir, default_args);
+                args->dir = strdup(optarg);
+                break;
+            case 's':  // dst
+                cmd_args_field_should_free(args, dst, default_args);
+                args->dst = strdup(optarg);
+                break;
+            case 'c':  // checksum
+                args->opts.checksum = 1;
+                break;
+            case 'n':  // dry-run
+                args->opts.dry_run = 1;
+                break;
+            case 'v':  // verbose
+                args->opts.verbose = 1;
+                break;
+            case 'h':  // help
+                printf("%s", sync_help_str);
+                cmd_free_sync_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_sync_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path || !args->dir) {
+        fprintf(stderr, "必需参数: --img-path=路径 --dir=目录\n");
+        cmd_free_sync_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_sync_args(cmd_args_t arg)
+{
+    sync_cmd_args_t* args = cmd_args_cast(arg, sync_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        cmd_args_field_should_free(args, dir, default_args);
+        cmd_args_field_should_free(args, dst, default_args);
+        free(args);
+    }
+}
+
+int cmd_do_sync(cmd_args_t arg)
+{
+    sync_cmd_args_t* args = cmd_args_cast(arg, sync_cmd_args_t);
+    if (!args || !args->img_path || !args->dir) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    // 目录项、FAT和FSInfo的写入留在延迟写回缓存中，结束时一次写入镜像；大块的文件数据直接写入
+    image_opts_t opts = {.writeback = 1, .writeback_interval = 0, .partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        return -1;
+    }
+
+    int ret = _sync_run(img, args->dir, args->dst, &args->opts);
+    if (image_close(img) != 0) {
+        fprintf(stderr, "关闭虚拟磁盘镜像失败: %s\n", args->img_path);
+        ret = -1;
+    }
+    return ret;
+}
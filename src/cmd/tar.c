@@ -0,0 +1,809 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cmd.h"
+#include "fferrno.h"
+#include "hostfs.h"
+#include "tar.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define strdup _strdup
+#endif
+
+// import-tar 从标准输入或文件顺序读取tar流，不在宿主机上解包，直接通过FatFs API在镜像中新建目录和文件：
+// 按头部中的大小用f_expand一次分配连续的簇，数据以大块写入，最后用f_utime设置修改时间。
+// export-tar 遍历一次镜像中的子树，按FILINFO生成头部，以大块f_read读出文件数据，把tar流写到标准输出或文件。
+
+#define TAR_BUFFER_SIZE (4 * MB)  // 每次从tar流读取、写入镜像(或从镜像读取、写入tar流)的最大字节数
+#define TAR_PAX_MAX (1 * MB)      // pax扩展头部数据的最大长度
+#define TAR_OUT_BUFFER (64 * KB)  // export-tar输出流的缓冲区，合并头部等小块写入
+
+typedef struct tar_import_t {
+    FILE*              in;
+    BYTE*              buf;
+    char*              path;  // 镜像内路径
+    size_t             base;  // path中目标目录部分的长度
+    long               n_files;
+    long               n_dirs;
+    long               n_skipped;
+    long               n_errors;
+    unsigned long long bytes;
+} tar_import_t;
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 从tar流读取len字节，data为NULL时丢弃
+static int _tar_read(tar_import_t* ctx, void* data, unsigned long long len)
+{
+    while (len) {
+        size_t n = len < TAR_BUFFER_SIZE ? (size_t)len : TAR_BUFFER_SIZE;
+        if (fread(data ? data : ctx->buf, 1, n, ctx->in) != n) {
+            return -1;
+        }
+        if (data) {
+            data = (BYTE*)data + n;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+// 把tar中的路径拼接到目标目录之后：去掉开头的 "/" 和 "./"、结尾的 "/"。
+// 返回0为目标目录之下的路径，1为目标目录本身，-1为含有 ".." 或过长的路径
+static int _tar_join(tar_import_t* ctx, const char* name)
+{
+    size_t len = ctx->base;
+    while (*name) {
+        const char* end = strchr(name, '/');
+        size_t      n   = end ? (size_t)(end - name) : strlen(name);
+        if (n == 2 && name[0] == '.' && name[1] == '.') {
+            return -1;
+        }
+        if (n && !(n == 1 && name[0] == '.')) {
+            if (len + 1 + n >= TAR_PATH_MAX) {
+                return -1;
+            }
+            if (len == 0 || ctx->path[len - 1] != '/') {
+                ctx->path[len++] = '/';
+            }
+            memcpy(ctx->path + len, name, n);
+            len += n;
+        }
+        name += end ? n + 1 : n;
+    }
+    ctx->path[len] = '\0';
+    return len > ctx->base ? 0 : 1;
+}
+
+// 逐级创建path中from之后的各级上级目录
+static FRESULT _tar_mkdirs(char* path, size_t from)
+{
+    for (char* p = path + from + 1; (p = strchr(p, '/')) != NULL; p++) {
+        *p         = '\0';
+        FRESULT fr = f_mkdir(path);
+        *p         = '/';
+        if (fr != FR_OK && fr != FR_EXIST) {
+            return fr;
+        }
+    }
+    return FR_OK;
+}
+
+static FRESULT _tar_utime(const char* path, time_t mtime)
+{
+    FILINFO fno;
+    DWORD   t = hostfs_to_fattime(mtime);
+    fno.fdate = (WORD)(t >> 16);
+    fno.ftime = (WORD)t;
+    return f_utime(path, &fno);
+}
+
+static FRESULT _tar_dir(tar_import_t* ctx, const tar_entry_t* e)
+{
+    FRESULT fr = f_mkdir(ctx->path);
+    if (fr == FR_NO_PATH) {
+        fr = _tar_mkdirs(ctx->path, ctx->base);
+        if (fr == FR_OK) {
+            fr = f_mkdir(ctx->path);
+        }
+    }
+    if (fr == FR_EXIST) {
+        fr = FR_OK;
+    }
+    if (fr == FR_OK) {
+        ctx->n_dirs++;
+        fr = _tar_utime(ctx->path, e->mtime);
+    }
+    return fr;
+}
+
+// 新建文件并写入数据；出错时仍读完该项的数据，使tar流保持在下一个头部上
+static FRESULT _tar_file(tar_import_t* ctx, const tar_entry_t* e, int* stream_ok)
+{
+    FIL     fp;
+    FRESULT fr = f_open(&fp, ctx->path, FA_WRITE | FA_CREATE_ALWAYS);  // 失败时fp被清空
+    if (fr == FR_NO_PATH) {  // tar中可以没有上级目录的项
+        fr = _tar_mkdirs(ctx->path, ctx->base);
+        if (fr == FR_OK) {
+            fr = f_open(&fp, ctx->path, FA_WRITE | FA_CREATE_ALWAYS);
+        }
+    }
+    if (fr == FR_OK && e->size > 0) {
+        f_expand(&fp, (FSIZE_t)e->size, 1);  // 尽量一次分配连续的簇，不成功时随写入逐簇分配
+    }
+
+    unsigned long long left = e->size;
+    while (left) {
+        UINT n = left < TAR_BUFFER_SIZE ? (UINT)left : TAR_BUFFER_SIZE;
+        if (fread(ctx->buf, 1, n, ctx->in) != n) {
+            *stream_ok = 0;
+            break;
+        }
+        left -= n;
+        if (fr == FR_OK) {
+            UINT bw;
+            fr = f_write(&fp, ctx->buf, n, &bw);
+            if (fr == FR_OK && bw != n) {
+                fr = FR_DENIED;  // 磁盘已满
+            }
+            ctx->bytes += bw;
+        }
+    }
+    if (fp.obj.fs) {
+        FRESULT fr_close = f_close(&fp);
+        if (fr == FR_OK) {
+            fr = fr_close;
+        }
+    }
+    if (!*stream_ok) {
+        f_unlink(ctx->path);  // 不留下按头部大小分配、内容不完整的文件
+    } else if (fr == FR_OK) {
+        ctx->n_files++;
+        fr = _tar_utime(ctx->path, e->mtime);
+    }
+    return fr;
+}
+
+// 导入整个tar流，成功返回0
+static int _tar_import(tar_import_t* ctx)
+{
+    unsigned char  blk[TAR_BLOCK_SIZE];
+    tar_entry_t*   e  = (tar_entry_t*)malloc(sizeof(tar_entry_t));
+    tar_override_t ov = {0};
+    int            ret = 0;
+    if (!e) {
+        fprintf(stderr, "内存不足\n");
+        return -1;
+    }
+
+    for (;;) {
+        size_t n = fread(blk, 1, TAR_BLOCK_SIZE, ctx->in);
+        if (n == 0 && feof(ctx->in)) {
+            break;  // 没有结束块的流
+        }
+        int r = n == TAR_BLOCK_SIZE ? tar_parse_header(blk, e) : -1;
+        if (r == 0) {
+            break;
+        }
+        if (r < 0) {
+            fprintf(stderr, "无效的tar头部(第 %ld 项之后)\n", ctx->n_files + ctx->n_dirs + ctx->n_skipped);
+            ret = -1;
+            break;
+        }
+
+        int stream_ok = 1;
+        if (e->type == TAR_TYPE_PAX || e->type == TAR_TYPE_GNU_LONGNAME) {
+            if (e->size >= TAR_PAX_MAX || _tar_read(ctx, ctx->buf, e->size) != 0) {
+                stream_ok = 0;
+            } else if (e->type == TAR_TYPE_PAX) {
+                if (tar_parse_pax((const char*)ctx->buf, (size_t)e->size, &ov) != 0) {
+                    fprintf(stderr, "无效的pax扩展头部\n");
+                    ret = -1;
+                    break;
+                }
+            } else {
+                size_t len = e->size < TAR_PATH_MAX ? (size_t)e->size : TAR_PATH_MAX - 1;
+                memcpy(ov.path, ctx->buf, len);
+                ov.path[len] = '\0';
+                ov.has_path  = 1;
+            }
+        } else {
+            tar_apply_override(e, &ov);
+            int is_file = e->type == TAR_TYPE_FILE || e->type == TAR_TYPE_FILE_OLD ||
+                          e->type == TAR_TYPE_CONTIGUOUS;
+            int is_dir  = e->type == TAR_TYPE_DIR;
+            int joined  = is_file || is_dir ? _tar_join(ctx, e->path) : -1;
+            FRESULT fr  = FR_OK;
+            if (joined == 0 && is_file) {
+                fr = _tar_file(ctx, e, &stream_ok);
+            } else {
+                if (joined == 0) {
+                    fr = _tar_dir(ctx, e);
+                } else if (e->type == TAR_TYPE_PAX_GLOBAL || (joined == 1 && is_dir)) {
+                    // 全局扩展头部不影响导入，目标目录本身("./")已经存在
+                } else if (is_file || is_dir) {
+                    fprintf(stderr, "略过无效的路径: %s\n", e->path);
+                    ctx->n_skipped++;
+                } else {
+                    fprintf(stderr, "略过不支持的类型 '%c': %s\n", e->type, e->path);
+                    ctx->n_skipped++;
+                }
+                stream_ok = _tar_read(ctx, NULL, e->size) == 0;
+            }
+            if (fr != FR_OK) {
+                fprintf(stderr, "写入失败: %s (%s)\n", ctx->path, f_strerror(fr));
+                ctx->n_errors++;
+            }
+        }
+        if (!stream_ok || _tar_read(ctx, NULL, tar_padding(e->size)) != 0) {
+            fprintf(stderr, "tar流意外结束: %s\n", e->path);
+            ret = -1;
+            break;
+        }
+    }
+    free(e);
+    return ret == 0 && ctx->n_errors == 0 ? 0 : -1;
+}
+
+typedef struct tar_export_t {
+    FILE*              out;
+    BYTE*              buf;
+    char*              path;  // 镜像内路径
+    size_t             base;  // path[base]起为tar中的路径
+    long               n_files;
+    long               n_dirs;
+    long               n_errors;
+    unsigned long long bytes;
+} tar_export_t;
+
+static int _tar_put(tar_export_t* ctx, const void* data, size_t len)
+{
+    if (fwrite(data, 1, len, ctx->out) != len) {
+        fprintf(stderr, "写入tar流失败\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int _tar_put_padding(tar_export_t* ctx, unsigned long long size)
+{
+    static const BYTE zero[TAR_BLOCK_SIZE];
+    return _tar_put(ctx, zero, tar_padding(size));
+}
+
+// 输出一项的头部，路径、大小或修改时间放不进ustar头部时先输出pax扩展头部
+static int _tar_put_header(tar_export_t* ctx, const char* name, const FILINFO* fno, char type)
+{
+    unsigned char blk[TAR_BLOCK_SIZE];
+    time_t        mtime = hostfs_from_fattime((DWORD)fno->fdate << 16 | fno->ftime);
+    unsigned      mode  = type == TAR_TYPE_DIR ? 0755 : 0644;
+    if (fno->fattrib & AM_RDO) {
+        mode &= ~0222u;
+    }
+    unsigned long long size = type == TAR_TYPE_DIR ? 0 : fno->fsize;
+    int need = tar_make_header(blk, name, size, mtime, type, mode);
+    if (need) {
+        unsigned char pax[TAR_BLOCK_SIZE];
+        size_t        len = tar_make_pax((char*)ctx->buf, TAR_PAX_MAX, need, name, size, mtime);
+        if (!len) {
+            fprintf(stderr, "路径过长: %s\n", name);
+            return -1;
+        }
+        tar_make_header(pax, "././@PaxHeader", len, mtime, TAR_TYPE_PAX, 0644);
+        if (_tar_put(ctx, pax, TAR_BLOCK_SIZE) != 0 || _tar_put(ctx, ctx->buf, len) != 0 ||
+            _tar_put_padding(ctx, len) != 0) {
+            return -1;
+        }
+    }
+    return _tar_put(ctx, blk, TAR_BLOCK_SIZE);
+}
+
+// 输出一个文件；读取失败时以0补足头部中的大小，使tar流保持完整，返回1
+static int _tar_put_file(tar_export_t* ctx, const char* name, const FILINFO* fno)
+{
+    FIL     fp;
+    FRESULT fr = f_open(&fp, ctx->path, FA_READ);
+    if (fr != FR_OK) {
+        fprintf(stderr, "无法打开文件: %s (%s)\n", ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+        return 0;  // 还没有输出头部，略过该文件
+    }
+    if (_tar_put_header(ctx, name, fno, TAR_TYPE_FILE) != 0) {
+        f_close(&fp);
+        return -1;
+    }
+
+    unsigned long long left = fno->fsize;
+    while (left) {
+        UINT n  = left < TAR_BUFFER_SIZE ? (UINT)left : TAR_BUFFER_SIZE;
+        UINT br = 0;
+        if (fr == FR_OK) {
+            fr = f_read(&fp, ctx->buf, n, &br);
+            if (fr == FR_OK && br != n) {
+                fr = FR_INT_ERR;  // 簇链比文件大小短
+            }
+            if (fr != FR_OK) {
+                fprintf(stderr, "读取文件失败: %s (%s)\n", ctx->path, f_strerror(fr));
+                ctx->n_errors++;
+            }
+        }
+        if (br != n) {
+            memset(ctx->buf + br, 0, n - br);
+        }
+        if (_tar_put(ctx, ctx->buf, n) != 0) {
+            f_close(&fp);
+            return -1;
+        }
+        left -= n;
+    }
+    f_close(&fp);
+    ctx->n_files++;
+    ctx->bytes += fno->fsize;
+    return _tar_put_padding(ctx, fno->fsize);
+}
+
+// 递归输出path[0..len)目录中的各项，写入tar流失败时返回-1
+static int _tar_put_dir(tar_export_t* ctx, size_t len)
+{
+    DIR      dir;
+    FILINFO* fno = (FILINFO*)malloc(sizeof(FILINFO));
+    FRESULT  fr  = fno ? f_opendir(&dir, ctx->path) : FR_NOT_ENOUGH_CORE;
+    if (fr != FR_OK) {
+        fprintf(stderr, "无法打开目录: %s (%s)\n", ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+        free(fno);
+        return 0;
+    }
+    int ret = 0;
+    while (ret == 0 && (fr = f_readdir(&dir, fno)) == FR_OK && fno->fname[0]) {
+        if (strcmp(fno->fname, ".") == 0 || strcmp(fno->fname, "..") == 0) {
+            continue;
+        }
+        int n = snprintf(ctx->path + len, TAR_PATH_MAX - len, "%s%s",
+                         len && ctx->path[len - 1] == '/' ? "" : "/", fno->fname);
+        if (n < 0 || len + n + 1 >= TAR_PATH_MAX) {  // 目录还要加上结尾的 "/"
+            ctx->path[len] = '\0';
+            fprintf(stderr, "路径过长: %s/%s\n", ctx->path, fno->fname);
+            ctx->n_errors++;
+            continue;
+        }
+        if (fno->fattrib & AM_DIR) {
+            // tar中目录的路径以 "/" 结尾，镜像内的路径不带
+            ctx->path[len + n]     = '/';
+            ctx->path[len + n + 1] = '\0';
+            ret                    = _tar_put_header(ctx, ctx->path + ctx->base, fno, TAR_TYPE_DIR);
+            ctx->path[len + n]     = '\0';
+            ctx->n_dirs++;
+            if (ret == 0) {
+                ret = _tar_put_dir(ctx, len + n);
+            }
+        } else {
+            ret = _tar_put_file(ctx, ctx->path + ctx->base, fno);
+        }
+        ctx->path[len] = '\0';
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "读取目录失败: %s (%s)\n", ctx->path, f_strerror(fr));
+        ctx->n_errors++;
+    }
+    f_closedir(&dir);
+    free(fno);
+    return ret;
+}
+
+// 把镜像中的文件或目录src写成tar流，目录中各项的路径相对于该目录，单个文件使用文件名
+static int _tar_export(const char* src, FILE* out)
+{
+    tar_export_t ctx = {.out = out};
+    ctx.buf          = (BYTE*)malloc(TAR_BUFFER_SIZE);
+    ctx.path         = (char*)malloc(TAR_PATH_MAX);
+    if (!ctx.buf || !ctx.path) {
+        fprintf(stderr, "内存不足\n");
+        free(ctx.buf);
+        free(ctx.path);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, TAR_OUT_BUFFER);
+
+    double t0 = _now();
+    int    ret = 0;
+    DIR    dir;
+    snprintf(ctx.path, TAR_PATH_MAX, "%s", src);
+    size_t len = strlen(ctx.path);
+    if (f_opendir(&dir, ctx.path) == FR_OK) {  // 根目录无法f_stat，先按目录打开
+        f_closedir(&dir);
+        ctx.base = len && ctx.path[len - 1] != '/' ? len + 1 : len;
+        ret      = _tar_put_dir(&ctx, len);
+    } else {
+        FILINFO fno;
+        FRESULT fr = f_stat(ctx.path, &fno);
+        if (fr != FR_OK) {
+            fprintf(stderr, "源路径不存在: %s (%s)\n", src, f_strerror(fr));
+            ret = -1;
+        } else {
+            const char* name = strrchr(ctx.path, '/');
+            ret              = _tar_put_file(&ctx, name ? name + 1 : ctx.path, &fno);
+        }
+    }
+    if (ret == 0) {
+        static const BYTE end[2 * TAR_BLOCK_SIZE];  // 结束块
+        ret = _tar_put(&ctx, end, sizeof(end));
+    }
+    if (ret == 0 && fflush(out) != 0) {
+        fprintf(stderr, "写入tar流失败\n");
+        ret = -1;
+    }
+    double secs = _now() - t0;
+    fprintf(stderr, "%ld 个文件, %ld 个目录, %llu 字节, 用时 %.3f 秒, %.1f MB/s\n", ctx.n_files, ctx.n_dirs,
+            ctx.bytes, secs, secs > 0 ? ctx.bytes / secs / MB : 0.0);
+
+    free(ctx.buf);
+    free(ctx.path);
+    return ret == 0 && ctx.n_errors == 0 ? 0 : -1;
+}
+
+// 打开tar输出：NULL或"-"为标准输出
+static FILE* _tar_open_out(const char* path)
+{
+    if (!path || strcmp(path, "-") == 0) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return stdout;
+    }
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "无法创建tar文件: %s\n", path);
+    }
+    return out;
+}
+
+static int _tar_close_out(FILE* out)
+{
+    return out == stdout ? 0 : fclose(out);
+}
+
+int shell_do_export_tar(int argc, char** argv)
+{
+    if (argc < 1 || argc > 2) {
+        fprintf(stderr, "用法: export-tar <源路径> [<tar文件>|-]\n");
+        return -1;
+    }
+    FILE* out = _tar_open_out(argc > 1 ? argv[1] : NULL);
+    if (!out) {
+        return -1;
+    }
+    int ret = _tar_export(argv[0], out);
+    if (_tar_close_out(out) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+typedef struct import_tar_cmd_args_t {
+    char* img_path;
+    BYTE  partition;
+    char* file;  // tar文件，"-"为标准输入
+    char* dst;   // 镜像内目录
+} import_tar_cmd_args_t;
+
+const char* import_tar_help_str =
+    "用法: import-tar [选项]\n"
+    "从标准输入或文件读取tar流(ustar/pax/GNU长文件名)，直接在镜像中新建目录和文件，不在宿主机上解包。\n"
+    "已存在的文件被覆盖；符号链接、硬链接和设备文件被略过。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -P, --partition=序号    使用分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -f, --file=文件         tar文件，- 为标准输入。(默认: -)\n"
+    "  -s, --dst=路径          镜像内的目标目录，不存在时新建。(默认: /)\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const import_tar_cmd_args_t default_import_args = {
+    .img_path  = NULL,
+    .partition = 0,
+    .file      = "-",
+    .dst       = "/",
+};
+
+cmd_args_t cmd_parse_import_tar_args(int argc, char** argv)
+{
+    import_tar_cmd_args_t* args = (import_tar_cmd_args_t*)calloc(1, sizeof(import_tar_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_import_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"file", required_argument, 0, 'f'},
+                                           {"dst", required_argument, 0, 's'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:f:s:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_import_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_import_tar_args(args);
+                    return NULL;
+                }
+                break;
+            case 'f':  // file
+                cmd_args_field_should_free(args, file, default_import_args);
+                args->file = strdup(optarg);
+                break;
+            case 's':  // dst
+                cmd_args_field_should_free(args, dst, default_import_args);
+                args->dst = strdup(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", import_tar_help_str);
+                cmd_free_import_tar_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_import_tar_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_import_tar_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_import_tar_args(cmd_args_t arg)
+{
+    import_tar_cmd_args_t* args = cmd_args_cast(arg, import_tar_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_import_args);
+        cmd_args_field_should_free(args, file, default_import_args);
+        cmd_args_field_should_free(args, dst, default_import_args);
+        free(args);
+    }
+}
+
+int cmd_do_import_tar(cmd_args_t arg)
+{
+    import_tar_cmd_args_t* args = cmd_args_cast(arg, import_tar_cmd_args_t);
+    if (!args || !args->img_path) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    int   from_stdin = strcmp(args->file, "-") == 0;
+    FILE* in         = from_stdin ? stdin : fopen(args->file, "rb");
+    if (!in) {
+        fprintf(stderr, "无法打开tar文件: %s\n", args->file);
+        return -1;
+    }
+#ifdef _WIN32
+    if (from_stdin) {
+        _setmode(_fileno(stdin), _O_BINARY);
+    }
+#endif
+
+    // 目录项、FAT和FSInfo的写入留在延迟写回缓存中，结束时一次写入镜像；大块的文件数据直接写入
+    image_opts_t opts = {.writeback = 1, .writeback_interval = 0, .partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        if (!from_stdin) {
+            fclose(in);
+        }
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        if (!from_stdin) {
+            fclose(in);
+        }
+        return -1;
+    }
+
+    tar_import_t ctx = {.in = in};
+    ctx.buf          = (BYTE*)malloc(TAR_BUFFER_SIZE);
+    ctx.path         = (char*)malloc(TAR_PATH_MAX);
+    int ret          = 0;
+    if (!ctx.buf || !ctx.path) {
+        fprintf(stderr, "内存不足\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        snprintf(ctx.path, TAR_PATH_MAX, "%s", args->dst);
+        ctx.base = strlen(ctx.path);
+        while (ctx.base > 0 && ctx.path[ctx.base - 1] == '/') {  // 由_tar_join统一加分隔符
+            ctx.path[--ctx.base] = '\0';
+        }
+        if (ctx.base) {  // 逐级创建目标目录
+            fr = _tar_mkdirs(ctx.path, 0);
+            if (fr == FR_OK) {
+                fr = f_mkdir(ctx.path);
+                fr = fr == FR_EXIST ? FR_OK : fr;
+            }
+            if (fr != FR_OK) {
+                fprintf(stderr, "无法创建目标目录: %s (%s)\n", ctx.path, f_strerror(fr));
+                ret = -1;
+            }
+        }
+    }
+
+    double t0 = _now();
+    if (ret == 0) {
+        ret = _tar_import(&ctx);
+    }
+    if (image_sync(img) != FR_OK) {
+        fprintf(stderr, "写回镜像失败\n");
+        ret = -1;
+    }
+    double secs = _now() - t0;
+    fprintf(stderr, "%ld 个文件, %ld 个目录, 略过 %ld 项, %llu 字节, 用时 %.3f 秒, %.1f MB/s\n", ctx.n_files,
+            ctx.n_dirs, ctx.n_skipped, ctx.bytes, secs, secs > 0 ? ctx.bytes / secs / MB : 0.0);
+
+    free(ctx.buf);
+    free(ctx.path);
+    if (!from_stdin) {
+        fclose(in);
+    }
+    if (image_close(img) != 0) {
+        fprintf(stderr, "关闭虚拟磁盘镜像失败: %s\n", args->img_path);
+        ret = -1;
+    }
+    return ret;
+}
+
+typedef struct export_tar_cmd_args_t {
+    char* img_path;
+    BYTE  partition;
+    char* src;     // 镜像内路径
+    char* output;  // tar文件，"-"为标准输出
+} export_tar_cmd_args_t;
+
+const char* export_tar_help_str =
+    "用法: export-tar [选项]\n"
+    "把镜像中的文件或目录子树写成tar流(ustar，长路径和超过8GB的文件使用pax扩展头部)，\n"
+    "可以直接用管道交给压缩或网络工具，不在宿主机上生成文件。目录中各项的路径相对于该目录。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -P, --partition=序号    使用分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -s, --src=路径          镜像内的文件或目录。(默认: /)\n"
+    "  -o, --output=文件       tar文件，- 为标准输出。(默认: -)\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const export_tar_cmd_args_t default_export_args = {
+    .img_path  = NULL,
+    .partition = 0,
+    .src       = "/",
+    .output    = "-",
+};
+
+cmd_args_t cmd_parse_export_tar_args(int argc, char** argv)
+{
+    export_tar_cmd_args_t* args = (export_tar_cmd_args_t*)calloc(1, sizeof(export_tar_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_export_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"src", required_argument, 0, 's'},
+                                           {"output", required_argument, 0, 'o'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:s:o:h", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_export_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_export_tar_args(args);
+                    return NULL;
+                }
+                break;
+            case 's':  // src
+                cmd_args_field_should_free(args, src, default_export_args);
+                args->src = strdup(optarg);
+                break;
+            case 'o':  // output
+                cmd_args_field_should_free(args, output, default_export_args);
+                args->output = strdup(optarg);
+                break;
+            case 'h':  // help
+                printf("%s", export_tar_help_str);
+                cmd_free_export_tar_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_export_tar_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_export_tar_args(args);
+        return NULL;
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_export_tar_args(cmd_args_t arg)
+{
+    export_tar_cmd_args_t* args = cmd_args_cast(arg, export_tar_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_export_args);
+        cmd_args_field_should_free(args, src, default_export_args);
+        cmd_args_field_should_free(args, output, default_export_args);
+        free(args);
+    }
+}
+
+int cmd_do_export_tar(cmd_args_t arg)
+{
+    export_tar_cmd_args_t* args = cmd_args_cast(arg, export_tar_cmd_args_t);
+    if (!args || !args->img_path) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    image_opts_t opts = {.partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        return -1;
+    }
+
+    FILE* out = _tar_open_out(args->output);
+    int   ret = out ? _tar_export(args->src, out) : -1;
+    if (out && _tar_close_out(out) != 0) {
+        fprintf(stderr, "写入tar文件失败: %s\n", args->output);
+        ret = -1;
+    }
+    image_close(img);
+    return ret;
+}
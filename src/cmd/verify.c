@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "checksum.h"
+#include "cmd.h"
+#include "diskio.h"
+#include "fferrno.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#endif
+
+// 先遍历一次目录树，通过快速定位的簇链映射表取得每个文件的簇段，然后按簇号顺序以大块disk_read顺序读出整个数据区，
+// 计算每个簇的CRC32；文件的CRC32不再沿簇链重新读取，而是按簇链顺序拼接各簇的CRC32(最后不满一簇的部分单独计算)。
+// 第一次运行时把结果保存为清单，之后的运行与清单比较，列出内容变化的簇和文件。
+
+#define VERIFY_BUFFER_SIZE (4 * MB)  // 每次读出的最大字节数(簇更大时为一个簇)
+#define VERIFY_LINKMAP_SIZE 64       // 簇链映射表的初始大小
+#define VERIFY_PATH_MAX 4096
+#define VERIFY_MAGIC "FFVFYv1"
+#define VERIFY_HEADER_SIZE 64
+
+// 清单格式(小端)：
+//   [0, 64)  文件头: 魔数 "FFVFYv1\0"，簇大小(4字节)，簇数(4字节)，文件数(4字节)
+//   之后     各簇的CRC32(簇号2开始，每个4字节)
+//   之后     各文件: 路径长度(2字节)、路径(UTF-8)、大小(8字节)、CRC32(4字节)，按路径排序
+
+typedef struct verify_file_t {
+    char*   path;
+    FSIZE_t size;
+    DWORD   crc;
+    DWORD*  frags;  // (簇数, 起始簇号)...，以0结尾；从清单读入时为NULL
+} verify_file_t;
+
+// 文件最后不满一簇的部分
+typedef struct verify_tail_t {
+    DWORD clust;
+    DWORD len;
+    DWORD crc;
+    long  file;
+} verify_tail_t;
+
+// 一次计算的结果，也是清单的内容
+typedef struct verify_state_t {
+    DWORD          clust_size;  // 字节
+    DWORD          n_clusts;
+    DWORD*         clust_crc;  // clust_crc[i]为簇i+2
+    verify_file_t* files;
+    long           n_files;
+    long           cap_files;
+} verify_state_t;
+
+typedef struct verify_ctx_t {
+    FATFS*             fs;
+    verify_state_t     cur;
+    verify_tail_t*     tails;
+    long               n_tails;
+    long               cap_tails;
+    char*              path;
+    long               n_errors;
+    unsigned long long bytes;
+} verify_ctx_t;
+
+static void _verify_free_state(verify_state_t* st)
+{
+    for (long i = 0; i < st->n_files; i++) {
+        free(st->files[i].path);
+        free(st->files[i].frags);
+    }
+    free(st->files);
+    free(st->clust_crc);
+    memset(st, 0, sizeof(*st));
+}
+
+static int _verify_file_cmp(const void* a, const void* b)
+{
+    return strcmp(((const verify_file_t*)a)->path, ((const verify_file_t*)b)->path);
+}
+
+static int _verify_tail_cmp(const void* a, const void* b)
+{
+    DWORD x = ((const verify_tail_t*)a)->clust, y = ((const verify_tail_t*)b)->clust;
+    return x < y ? -1 : x > y;
+}
+
+// 取得文件的簇段列表，小表放不下时按所需大小重新分配
+static FRESULT _verify_frags(FIL* fp, DWORD** frags)
+{
+    DWORD  small[VERIFY_LINKMAP_SIZE];
+    DWORD* tbl = small;
+    small[0]   = VERIFY_LINKMAP_SIZE;
+    fp->cltbl  = small;
+    FRESULT fr = f_lseek(fp, CREATE_LINKMAP);
+    if (fr == FR_NOT_ENOUGH_CORE) {  // 碎片较多
+        DWORD need = small[0];
+        tbl        = (DWORD*)malloc(need * sizeof(DWORD));
+        if (!tbl) {
+            fp->cltbl = NULL;
+            return FR_NOT_ENOUGH_CORE;
+        }
+        tbl[0]    = need;
+        fp->cltbl = tbl;
+        fr        = f_lseek(fp, CREATE_LINKMAP);
+    }
+    fp->cltbl = NULL;
+    if (fr == FR_OK) {
+        size_t n = 1;
+        while (tbl[n]) {
+            n += 2;
+        }
+        *frags = (DWORD*)malloc(n * sizeof(DWORD));  // tbl[1..n]，含结尾的0
+        if (*frags) {
+            memcpy(*frags, tbl + 1, n * sizeof(DWORD));
+        } else {
+            fr = FR_NOT_ENOUGH_CORE;
+        }
+    }
+    if (tbl != small) {
+        free(tbl);
+    }
+    return fr;
+}
+
+// 记录一个文件及其最后不满一簇的部分
+static int _verify_add_file(verify_ctx_t* ctx, const FILINFO* fno)
+{
+    verify_state_t* st = &ctx->cur;
+    verify_file_t   f  = {NULL, fno->fsize, 0, NULL};
+    if (fno->fsize > 0) {
+        FIL     fp;
+        FRESULT fr = f_open(&fp, ctx->path, FA_READ);
+        if (fr == FR_OK) {
+            fr = _verify_frags(&fp, &f.frags);
+            f_close(&fp);
+        }
+        if (fr != FR_OK) {
+            fprintf(stderr, "无法取得文件的簇链: %s (%s)\n", ctx->path, f_strerror(fr));
+            ctx->n_errors++;
+            return 0;
+        }
+    }
+    f.path = strdup(ctx->path);
+    if (!f.path) {
+        free(f.frags);
+        return -1;
+    }
+    if (st->n_files == st->cap_files) {
+        long           cap   = st->cap_files ? st->cap_files * 2 : 1024;
+        verify_file_t* files = (verify_file_t*)realloc(st->files, cap * sizeof(verify_file_t));
+        if (!files) {
+            free(f.path);
+            free(f.frags);
+            return -1;
+        }
+        st->files     = files;
+        st->cap_files = cap;
+    }
+    st->files[st->n_files] = f;
+
+    DWORD tail = (DWORD)(fno->fsize % st->clust_size);
+    if (tail) {
+        // 最后一簇：沿簇段数到第 (fsize-1)/簇大小 个簇
+        FSIZE_t idx = (fno->fsize - 1) / st->clust_size;
+        DWORD   cl  = 0;
+        for (const DWORD* fr = f.frags; fr[0]; fr += 2) {
+            if (idx < fr[0]) {
+                cl = fr[1] + (DWORD)idx;
+                break;
+            }
+            idx -= fr[0];
+        }
+        if (ctx->n_tails == ctx->cap_tails) {
+            long           cap   = ctx->cap_tails ? ctx->cap_tails * 2 : 1024;
+            verify_tail_t* tails = (verify_tail_t*)realloc(ctx->tails, cap * sizeof(verify_tail_t));
+            if (!tails) {
+                return -1;
+            }
+            ctx->tails     = tails;
+            ctx->cap_tails = cap;
+        }
+        ctx->tails[ctx->n_tails++] = (verify_tail_t){cl, tail, 0, st->n_files};
+    }
+    st->n_files++;
+    return 0;
+}
+
+// 递归记录path[0..len)目录中的文件
+static int _verify_walk(verify_ctx_t* ctx, size_t len)
+{
+    DIR      dir;
+    FILINFO* fno = (FILINFO*)malloc(sizeof(FILINFO));
+    FRESULT  fr  = fno ? f_opendir(&dir, len ? ctx->path : "/") : FR_NOT_ENOUGH_CORE;
+    if (fr != FR_OK) {
+        fprintf(stderr, "无法打开目录: %s (%s)\n", len ? ctx->path : "/", f_strerror(fr));
+        ctx->n_errors++;
+        free(fno);
+        return 0;
+    }
+    int ret = 0;
+    while (ret == 0 && (fr = f_readdir(&dir, fno)) == FR_OK && fno->fname[0]) {
+        if (strcmp(fno->fname, ".") == 0 || strcmp(fno->fname, "..") == 0) {
+            continue;
+        }
+        int n = snprintf(ctx->path + len, VERIFY_PATH_MAX - len, "/%s", fno->fname);
+        if (n < 0 || len + n >= VERIFY_PATH_MAX) {
+            ctx->path[len] = '\0';
+            fprintf(stderr, "路径过长: %s/%s\n", ctx->path, fno->fname);
+            ctx->n_errors++;
+            continue;
+        }
+        ret            = fno->fattrib & AM_DIR ? _verify_walk(ctx, len + n) : _verify_add_file(ctx, fno);
+        ctx->path[len] = '\0';
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "读取目录失败: %s (%s)\n", len ? ctx->path : "/", f_strerror(fr));
+        ctx->n_errors++;
+    }
+    f_closedir(&dir);
+    free(fno);
+    return ret;
+}
+
+// 按簇号顺序读出整个数据区，计算各簇以及各文件最后不满一簇部分的CRC32
+static int _verify_scan(verify_ctx_t* ctx)
+{
+    FATFS*          fs  = ctx->fs;
+    verify_state_t* st  = &ctx->cur;
+    DWORD           per = st->clust_size < VERIFY_BUFFER_SIZE ? VERIFY_BUFFER_SIZE / st->clust_size : 1;
+    BYTE*           buf = (BYTE*)malloc((size_t)per * st->clust_size);
+    if (!buf) {
+        fprintf(stderr, "内存不足\n");
+        return -1;
+    }
+    qsort(ctx->tails, ctx->n_tails, sizeof(verify_tail_t), _verify_tail_cmp);
+
+    long t = 0;
+    for (DWORD c = 0; c < st->n_clusts; c += per) {
+        DWORD k = st->n_clusts - c < per ? st->n_clusts - c : per;
+        if (disk_read(fs->pdrv, buf, fs->database + (LBA_t)c * fs->csize, k * fs->csize) != RES_OK) {
+            fprintf(stderr, "读取簇 %lu-%lu 失败\n", (unsigned long)c + 2, (unsigned long)(c + k + 1));
+            free(buf);
+            return -1;
+        }
+        for (DWORD i = 0; i < k; i++) {
+            const BYTE* p  = buf + (size_t)i * st->clust_size;
+            DWORD       cl = c + i + 2;
+            st->clust_crc[c + i] = ff_crc32(0, p, st->clust_size);
+            for (; t < ctx->n_tails && ctx->tails[t].clust <= cl; t++) {
+                if (ctx->tails[t].clust == cl) {
+                    ctx->tails[t].crc = ff_crc32(0, p, ctx->tails[t].len);
+                }
+            }
+        }
+        ctx->bytes += (unsigned long long)k * st->clust_size;
+    }
+    free(buf);
+
+    // 文件的CRC32：按簇链顺序拼接整簇的CRC32，最后拼接不满一簇的部分
+    DWORD op = checksum_crc32_shift(st->clust_size);
+    for (long i = 0; i < ctx->n_tails; i++) {
+        st->files[ctx->tails[i].file].crc = ctx->tails[i].crc;  // 暂存，下面拼接到最后
+    }
+    for (long i = 0; i < st->n_files; i++) {
+        verify_file_t* f     = &st->files[i];
+        FSIZE_t        full  = f->size / st->clust_size;
+        DWORD          tail  = (DWORD)(f->size % st->clust_size);
+        DWORD          tcrc  = f->crc;
+        DWORD          crc   = 0;
+        for (const DWORD* fr = f->frags; fr && fr[0] && full; fr += 2) {
+            for (DWORD j = 0; j < fr[0] && full; j++, full--) {
+                DWORD cl = fr[1] + j;
+                if (cl < 2 || cl - 2 >= st->n_clusts) {
+                    fprintf(stderr, "簇链超出数据区: %s\n", f->path);
+                    ctx->n_errors++;
+                    full = 0;
+                    break;
+                }
+                crc = checksum_crc32_combine(crc, st->clust_crc[cl - 2], op);
+            }
+        }
+        if (tail) {
+            crc = checksum_crc32_combine(crc, tcrc, checksum_crc32_shift(tail));
+        }
+        f->crc = crc;
+    }
+    qsort(st->files, st->n_files, sizeof(verify_file_t), _verify_file_cmp);
+    return 0;
+}
+
+static void _verify_st32(BYTE* p, DWORD v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (BYTE)(v >> (i * 8));
+    }
+}
+
+static DWORD _verify_ld32(const BYTE* p)
+{
+    return (DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24;
+}
+
+static int _verify_save(const verify_state_t* st, const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "无法创建清单: %s\n", path);
+        return -1;
+    }
+    BYTE hdr[VERIFY_HEADER_SIZE] = {0};
+    memcpy(hdr, VERIFY_MAGIC, 8);
+    _verify_st32(hdr + 8, st->clust_size);
+    _verify_st32(hdr + 12, st->n_clusts);
+    _verify_st32(hdr + 16, (DWORD)st->n_files);
+    int ok = fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr);
+
+    BYTE chunk[4096];
+    for (DWORD i = 0; ok && i < st->n_clusts;) {
+        DWORD n = 0;
+        for (; n < sizeof(chunk) / 4 && i < st->n_clusts; n++, i++) {
+            _verify_st32(chunk + n * 4, st->clust_crc[i]);
+        }
+        ok = fwrite(chunk, 4, n, fp) == n;
+    }
+    for (long i = 0; ok && i < st->n_files; i++) {
+        const verify_file_t* f   = &st->files[i];
+        size_t               len = strlen(f->path);
+        BYTE                 rec[14];
+        rec[0] = (BYTE)len;
+        rec[1] = (BYTE)(len >> 8);
+        _verify_st32(rec + 2, (DWORD)f->size);
+        _verify_st32(rec + 6, (DWORD)((unsigned long long)f->size >> 32));
+        _verify_st32(rec + 10, f->crc);
+        ok = fwrite(rec, 1, 2, fp) == 2 && fwrite(f->path, 1, len, fp) == len && fwrite(rec + 2, 1, 12, fp) == 12;
+    }
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "写入清单失败: %s\n", path);
+    }
+    return ok ? 0 : -1;
+}
+
+// 读入清单，格式错误时返回-1
+static int _verify_load(verify_state_t* st, FILE* fp)
+{
+    BYTE hdr[VERIFY_HEADER_SIZE];
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || memcmp(hdr, VERIFY_MAGIC, 8) != 0) {
+        return -1;
+    }
+    st->clust_size = _verify_ld32(hdr + 8);
+    st->n_clusts   = _verify_ld32(hdr + 12);
+    st->n_files    = 0;
+    long n_files   = (long)_verify_ld32(hdr + 16);
+    st->clust_crc  = (DWORD*)malloc(((size_t)st->n_clusts + 1) * sizeof(DWORD));
+    st->files      = (verify_file_t*)calloc((size_t)n_files + 1, sizeof(verify_file_t));
+    if (!st->clust_crc || !st->files) {
+        return -1;
+    }
+    BYTE chunk[4096];
+    for (DWORD i = 0; i < st->n_clusts;) {
+        DWORD n = st->n_clusts - i < sizeof(chunk) / 4 ? st->n_clusts - i : (DWORD)(sizeof(chunk) / 4);
+        if (fread(chunk, 4, n, fp) != n) {
+            return -1;
+        }
+        for (DWORD j = 0; j < n; j++, i++) {
+            st->clust_crc[i] = _verify_ld32(chunk + j * 4);
+        }
+    }
+    for (long i = 0; i < n_files; i++) {
+        BYTE   rec[12];
+        size_t len;
+        if (fread(rec, 1, 2, fp) != 2) {
+            return -1;
+        }
+        len        = rec[0] | (size_t)rec[1] << 8;
+        char* path = (char*)malloc(len + 1);
+        if (!path || fread(path, 1, len, fp) != len || fread(rec, 1, 12, fp) != 12) {
+            free(path);
+            return -1;
+        }
+        path[len]          = '\0';
+        st->files[i].path  = path;
+        st->files[i].size  = (FSIZE_t)(_verify_ld32(rec) | (unsigned long long)_verify_ld32(rec + 4) << 32);
+        st->files[i].crc   = _verify_ld32(rec + 8);
+        st->n_files        = i + 1;
+    }
+    return 0;
+}
+
+// 列出CRC32不一致的连续簇，按所属的文件分组
+static long _verify_check_clusters(const verify_state_t* cur, const verify_state_t* old)
+{
+    DWORD* owner  = NULL;  // 簇 -> 文件序号+1，有不一致的簇时才建立
+    long   n_diff = 0;
+    for (DWORD c = 0; c < cur->n_clusts;) {
+        if (cur->clust_crc[c] == old->clust_crc[c]) {
+            c++;
+            continue;
+        }
+        if (!owner) {
+            owner = (DWORD*)calloc(cur->n_clusts, sizeof(DWORD));
+            for (long i = 0; owner && i < cur->n_files; i++) {
+                for (const DWORD* fr = cur->files[i].frags; fr && fr[0]; fr += 2) {
+                    for (DWORD j = 0; j < fr[0]; j++) {
+                        if (fr[1] + j >= 2 && fr[1] + j - 2 < cur->n_clusts) {
+                            owner[fr[1] + j - 2] = (DWORD)i + 1;
+                        }
+                    }
+                }
+            }
+        }
+        DWORD who = owner ? owner[c] : 0;
+        DWORD end = c + 1;
+        while (end < cur->n_clusts && cur->clust_crc[end] != old->clust_crc[end] && (owner ? owner[end] : 0) == who) {
+            end++;
+        }
+        printf("C %lu-%lu %s\n", (unsigned long)c + 2, (unsigned long)end + 1,
+               who ? cur->files[who - 1].path : "(目录、空闲簇或文件末尾之后)");
+        n_diff += end - c;
+        c = end;
+    }
+    free(owner);
+    return n_diff;
+}
+
+// 按路径合并比较文件，返回有变化的文件数
+static long _verify_check_files(const verify_state_t* cur, const verify_state_t* old)
+{
+    long i = 0, j = 0, n_diff = 0;
+    while (i < cur->n_files || j < old->n_files) {
+        int c = i >= cur->n_files ? 1 : j >= old->n_files ? -1 : strcmp(cur->files[i].path, old->files[j].path);
+        if (c < 0) {
+            printf("A %s\n", cur->files[i++].path);
+            n_diff++;
+        } else if (c > 0) {
+            printf("D %s\n", old->files[j++].path);
+            n_diff++;
+        } else {
+            const verify_file_t* a = &cur->files[i++];
+            const verify_file_t* b = &old->files[j++];
+            if (a->size != b->size) {
+                printf("M %s (大小 %llu -> %llu)\n", a->path, (unsigned long long)b->size, (unsigned long long)a->size);
+                n_diff++;
+            } else if (a->crc != b->crc) {
+                printf("M %s (CRC32 %08lx -> %08lx)\n", a->path, (unsigned long)b->crc, (unsigned long)a->crc);
+                n_diff++;
+            }
+        }
+    }
+    return n_diff;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 计算当前镜像的各簇和各文件的CRC32
+static int _verify_compute(verify_ctx_t* ctx)
+{
+    verify_state_t* st = &ctx->cur;
+    st->clust_size     = (DWORD)ctx->fs->csize * SECTOR_SIZE;
+    st->n_clusts       = ctx->fs->n_fatent - 2;
+    st->clust_crc      = (DWORD*)malloc(((size_t)st->n_clusts + 1) * sizeof(DWORD));
+    ctx->path          = (char*)malloc(VERIFY_PATH_MAX);
+    if (!st->clust_crc || !ctx->path) {
+        fprintf(stderr, "内存不足\n");
+        return -1;
+    }
+    ctx->path[0] = '\0';
+    if (_verify_walk(ctx, 0) != 0) {
+        fprintf(stderr, "内存不足\n");
+        return -1;
+    }
+    return _verify_scan(ctx);
+}
+
+typedef struct verify_cmd_args_t {
+    char* img_path;
+    BYTE  partition;
+    char* manifest;
+    int   update;
+} verify_cmd_args_t;
+
+const char* verify_help_str =
+    "用法: verify [选项]\n"
+    "计算镜像中每个簇和每个文件的CRC32。清单不存在时保存为清单；存在时与清单比较，列出内容变化的簇(C)\n"
+    "和新增(A)、删除(D)、修改(M)的文件，用于发现归档镜像的静默损坏。一致时返回0，不一致时返回1。\n"
+    "数据区按簇号顺序大块读出，文件的CRC32由各簇的CRC32拼接得到，不重复读取文件数据。\n\n"
+    "选项:\n"
+    "  -p, --img-path=路径     指定虚拟磁盘镜像的路径。(必填)\n"
+    "  -P, --partition=序号    使用分区镜像中的第几个分区(从1开始，默认: 自动查找第一个)。\n"
+    "  -m, --manifest=路径     清单文件。(默认: <镜像路径>.crc)\n"
+    "  -u, --update            比较后用当前的结果更新清单。\n"
+    "  -h, --help              显示此帮助信息。\n";
+
+static const verify_cmd_args_t default_args = {
+    .img_path  = NULL,
+    .partition = 0,
+    .manifest  = NULL,
+    .update    = 0,
+};
+
+cmd_args_t cmd_parse_verify_args(int argc, char** argv)
+{
+    verify_cmd_args_t* args = (verify_cmd_args_t*)calloc(1, sizeof(verify_cmd_args_t));
+    if (!args) {
+        return NULL;
+    }
+
+    *args = default_args;
+
+    static struct option long_options[] = {{"img-path", required_argument, 0, 'p'},
+                                           {"partition", required_argument, 0, 'P'},
+                                           {"manifest", required_argument, 0, 'm'},
+                                           {"update", no_argument, 0, 'u'},
+                                           {"help", no_argument, 0, 'h'},
+                                           {0, 0, 0, 0}};
+
+    int opt;
+    int option_index = 0;
+
+    while ((opt = getopt_long(argc, argv, "p:P:m:uh", long_options, &option_index)) != -1) {
+        switch (opt) {
+            case 'p':  // img-path
+                cmd_args_field_should_free(args, img_path, default_args);
+                args->img_path = strdup(optarg);
+                break;
+            case 'P':  // partition
+                if (cmd_parse_partition(optarg, &args->partition) != 0) {
+                    fprintf(stderr, "无效的分区号: %s\n", optarg);
+                    cmd_free_verify_args(args);
+                    return NULL;
+                }
+                break;
+            case 'm':  // manifest
+                cmd_args_field_should_free(args, manifest, default_args);
+                args->manifest = strdup(optarg);
+                break;
+            case 'u':  // update
+                args->update = 1;
+                break;
+            case 'h':  // help
+                printf("%s", verify_help_str);
+                cmd_free_verify_args(args);
+                return MONO_ARGS_VALUE;
+            default:
+                fprintf(stderr, "未知选项: %c\n", opt);
+                cmd_free_verify_args(args);
+                return NULL;
+        }
+    }
+
+    if (!args->img_path) {
+        fprintf(stderr, "必需参数: --img-path=路径\n");
+        cmd_free_verify_args(args);
+        return NULL;
+    }
+
+    if (!args->manifest) {
+        size_t len     = strlen(args->img_path) + 5;
+        args->manifest = (char*)malloc(len);
+        if (!args->manifest) {
+            cmd_free_verify_args(args);
+            return NULL;
+        }
+        snprintf(args->manifest, len, "%s.crc", args->img_path);
+    }
+
+    return (cmd_args_t)args;
+}
+
+void cmd_free_verify_args(cmd_args_t arg)
+{
+    verify_cmd_args_t* args = cmd_args_cast(arg, verify_cmd_args_t);
+    if (args) {
+        cmd_args_field_should_free(args, img_path, default_args);
+        cmd_args_field_should_free(args, manifest, default_args);
+        free(args);
+    }
+}
+
+int cmd_do_verify(cmd_args_t arg)
+{
+    verify_cmd_args_t* args = cmd_args_cast(arg, verify_cmd_args_t);
+    if (!args || !args->img_path || !args->manifest) {
+        fprintf(stderr, "无效的参数\n");
+        return -1;
+    }
+
+    // 先读入清单，格式错误时不必再读镜像
+    verify_state_t old = {0};
+    FILE*          mf  = fopen(args->manifest, "rb");
+    if (mf) {
+        int bad = _verify_load(&old, mf) != 0;
+        fclose(mf);
+        if (bad) {
+            fprintf(stderr, "无效的清单: %s\n", args->manifest);
+            _verify_free_state(&old);
+            return -1;
+        }
+    }
+
+    image_opts_t opts = {.partition = args->partition};
+    image_t*     img  = image_open(args->img_path, &opts);
+    if (!img) {
+        fprintf(stderr, "打开虚拟磁盘镜像失败: %s\n", args->img_path);
+        _verify_free_state(&old);
+        return -1;
+    }
+    FRESULT fr = image_mount(img);
+    if (fr == FR_OK) {
+        fr = f_chdrive(image_drive(img));
+    }
+    if (fr != FR_OK) {
+        fprintf(stderr, "挂载虚拟磁盘镜像失败: %s (%s: %d)\n", args->img_path, f_strerror(fr), fr);
+        image_close(img);
+        _verify_free_state(&old);
+        return -1;
+    }
+
+    verify_ctx_t ctx = {.fs = image_fs(img)};
+    double       t0  = _now();
+    int          ret = _verify_compute(&ctx);
+    double       secs = _now() - t0;
+    image_close(img);
+
+    long n_clusts = 0, n_files = 0;
+    if (ret == 0 && mf) {
+        if (old.clust_size != ctx.cur.clust_size || old.n_clusts != ctx.cur.n_clusts) {
+            fprintf(stderr, "卷的簇大小或簇数与清单不同，无法比较: %s\n", args->manifest);
+            ret = -1;
+        } else {
+            n_clusts = _verify_check_clusters(&ctx.cur, &old);
+            n_files  = _verify_check_files(&ctx.cur, &old);
+        }
+    }
+    if (ret == 0 && (!mf || args->update) && _verify_save(&ctx.cur, args->manifest) != 0) {
+        ret = -1;
+    }
+    fflush(stdout);
+    if (ret == 0) {
+        fprintf(stderr, "%lu 个簇 (每簇 %lu 字节), %ld 个文件, 读取 %llu 字节, 用时 %.3f 秒, %.1f MB/s",
+                (unsigned long)ctx.cur.n_clusts, (unsigned long)ctx.cur.clust_size, ctx.cur.n_files, ctx.bytes, secs,
+                secs > 0 ? ctx.bytes / secs / MB : 0.0);
+        if (mf) {
+            fprintf(stderr, "; 不一致的簇 %ld, 有变化的文件 %ld%s\n", n_clusts, n_files, args->update ? ", 已更新清单" : "");
+        } else {
+            fprintf(stderr, "; 已保存清单 %s\n", args->manifest);
+        }
+    }
+
+    _verify_free_state(&ctx.cur);
+    _verify_free_state(&old);
+    free(ctx.tails);
+    free(ctx.path);
+    if (ret != 0 || ctx.n_errors) {
+        return -1;
+    }
+    return n_clusts || n_files ? 1 : 0;
+}
@@ -0,0 +1,690 @@
+#include "fsindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "diskio.h"
+
+#ifdef _WIN32
+#define strdup _strdup
+#define strncasecmp _strnicmp
+#endif
+
+#define INDEX_MAGIC "FFIDXv1"  // 索引文件魔数(含结尾的\0共8字节)
+#define INDEX_PATH_MAX 1024
+#define INDEX_READ_SIZE (256 * KB)  // 校验子目录时每次读取的最大字节数
+#define INDEX_HASH_SEED 0xCBF29CE484222325ULL
+
+// 用于判断索引是否仍然属于当前卷的键值，读取都经过磁盘层，写时复制挂载时反映的是覆盖后的内容
+typedef struct index_key_t {
+    uint64_t fat_sum;   // 第一个FAT的校验和
+    uint64_t root_sum;  // 根目录的校验和
+    uint64_t dir_sum;   // 所有子目录簇的校验和，按索引中记录的簇链读取，FAT不变时簇链即有效
+} index_key_t;
+
+static FATFS         *s_fs;
+static char           s_drive[4];   // 卷前缀(如 "0:")，其他卷上的路径不经过索引
+static fsindex_node_t s_root;
+static int            s_valid;      // s_root 可用
+static int            s_from_file;  // s_root 从索引文件加载且之后未被修改
+
+/*-----------------------------------------------------------------------*/
+/* 节点管理                                                              */
+/*-----------------------------------------------------------------------*/
+
+static void _free_children(fsindex_node_t *node)
+{
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        _free_children(&node->child[i]);
+        free(node->child[i].name);
+        free(node->child[i].ext);
+    }
+    free(node->child);
+    node->child   = NULL;
+    node->n_child = 0;
+    node->loaded  = 0;
+}
+
+static void _reset_root(void)
+{
+    _free_children(&s_root);
+    free(s_root.ext);
+    memset(&s_root, 0, sizeof(s_root));
+    s_root.name = "";
+    s_root.attr = AM_DIR;
+}
+
+void fsindex_invalidate(void)
+{
+    if (s_valid) {
+        _reset_root();
+    }
+    s_from_file = 0;
+}
+
+// 从镜像读入目录的所有子项
+static int _load_dir(fsindex_node_t *node, const char *path)
+{
+    DIR     dp;
+    FILINFO fno;
+    FRESULT fr = f_opendir(&dp, path);
+    if (fr != FR_OK) {
+        return -1;
+    }
+
+    uint32_t cap = 0;
+    while ((fr = f_readdir(&dp, &fno)) == FR_OK && fno.fname[0]) {
+        if (strcmp(fno.fname, ".") == 0 || strcmp(fno.fname, "..") == 0) {
+            continue;
+        }
+        if (node->n_child == cap) {
+            cap                  = cap ? cap * 2 : 16;
+            fsindex_node_t *grow = (fsindex_node_t *)realloc(node->child, cap * sizeof(fsindex_node_t));
+            if (!grow) {
+                fr = FR_NOT_ENOUGH_CORE;
+                break;
+            }
+            node->child = grow;
+        }
+        fsindex_node_t *c = &node->child[node->n_child];
+        memset(c, 0, sizeof(*c));
+        c->name = strdup(fno.fname);
+        if (!c->name) {
+            fr = FR_NOT_ENOUGH_CORE;
+            break;
+        }
+        c->size  = fno.fsize;
+        c->clust = fno.fclust;
+        c->fdate = fno.fdate;
+        c->ftime = fno.ftime;
+        c->attr  = fno.fattrib;
+#if FF_FS_EXFAT
+        c->cont = fno.fcont;
+#endif
+        node->n_child++;
+    }
+    f_closedir(&dp);
+
+    if (fr != FR_OK) {
+        _free_children(node);
+        return -1;
+    }
+    node->loaded = 1;
+    return 0;
+}
+
+// 读入节点下的整棵子树
+static int _load_tree(fsindex_node_t *node, char *path, size_t len)
+{
+    if (!(node->attr & AM_DIR)) {
+        return 0;
+    }
+    if (!node->loaded && _load_dir(node, len ? path : "/") != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        fsindex_node_t *c = &node->child[i];
+        if (!(c->attr & AM_DIR)) {
+            continue;
+        }
+        int n = snprintf(path + len, INDEX_PATH_MAX - len, "/%s", c->name);
+        if (n < 0 || len + n >= INDEX_PATH_MAX) {
+            return -1;
+        }
+        if (_load_tree(c, path, len + n) != 0) {
+            return -1;
+        }
+        path[len] = '\0';
+    }
+    return 0;
+}
+
+static fsindex_node_t *_find_child(fsindex_node_t *node, const char *name, size_t len)
+{
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        if (strncmp(node->child[i].name, name, len) == 0 && node->child[i].name[len] == '\0') {
+            return &node->child[i];
+        }
+    }
+    // FAT文件名不区分大小写，这里只处理ASCII字母，其余情况交给FatFs
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        if (strncasecmp(node->child[i].name, name, len) == 0 && node->child[i].name[len] == '\0') {
+            return &node->child[i];
+        }
+    }
+    return NULL;
+}
+
+fsindex_node_t *fsindex_lookup(const char *path, int tree)
+{
+    if (!s_fs) {
+        return NULL;
+    }
+
+    // 拼出绝对路径
+    char abs[INDEX_PATH_MAX];
+    const char *colon = strchr(path, ':');
+    if (colon) {
+        size_t n = (size_t)(colon - path) + 1;
+        if (n != strlen(s_drive) || strncmp(path, s_drive, n) != 0) {
+            return NULL;
+        }
+        path = colon + 1;
+    }
+    if (path[0] == '/') {
+        if (snprintf(abs, sizeof(abs), "%s", path) >= (int)sizeof(abs)) {
+            return NULL;
+        }
+    } else {
+        TCHAR cwd[INDEX_PATH_MAX];
+        if (f_getcwd(cwd, sizeof(cwd)) != FR_OK) {
+            return NULL;
+        }
+        const char *p = strchr(cwd, ':') ? strchr(cwd, ':') + 1 : cwd;
+        if (snprintf(abs, sizeof(abs), "%s/%s", p, path) >= (int)sizeof(abs)) {
+            return NULL;
+        }
+    }
+
+    if (!s_valid) {
+        _reset_root();
+        s_valid = 1;
+    }
+
+    // 逐级查找，必要时读入目录；walked 记录已经过的规范化路径
+    char            walked[INDEX_PATH_MAX] = "";
+    size_t          wlen                   = 0;
+    fsindex_node_t *stack[128];
+    size_t          stack_len[128];
+    int             depth = 0;
+    fsindex_node_t *node  = &s_root;
+    const char     *p     = abs;
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        size_t len = strcspn(p, "/");
+        if (len == 0) {
+            break;
+        }
+        if (len == 1 && p[0] == '.') {
+            p += len;
+            continue;
+        }
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            if (depth > 0) {
+                depth--;
+                node           = stack[depth];
+                wlen           = stack_len[depth];
+                walked[wlen]   = '\0';
+            }
+            p += len;
+            continue;
+        }
+        if (!(node->attr & AM_DIR) || depth >= 128) {
+            return NULL;
+        }
+        if (!node->loaded && (!tree || _load_dir(node, wlen ? walked : "/") != 0)) {
+            return NULL;
+        }
+        fsindex_node_t *c = _find_child(node, p, len);
+        if (!c) {
+            return NULL;
+        }
+        stack[depth]     = node;
+        stack_len[depth] = wlen;
+        depth++;
+        int n = snprintf(walked + wlen, sizeof(walked) - wlen, "/%s", c->name);
+        if (n < 0 || wlen + n >= sizeof(walked)) {
+            return NULL;
+        }
+        wlen += n;
+        node = c;
+        p += len;
+    }
+
+    if (tree && _load_tree(node, walked, wlen) != 0) {
+        return NULL;
+    }
+    return node;
+}
+
+uint32_t fsindex_cluster_size(void)
+{
+    return s_fs ? (uint32_t)s_fs->csize * SECTOR_SIZE : 0;
+}
+
+/*-----------------------------------------------------------------------*/
+/* 卷的键值与簇链                                                        */
+/*-----------------------------------------------------------------------*/
+
+static uint64_t _checksum(uint64_t h, const BYTE *p, size_t n)
+{
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    for (; n; p++, n--) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+// 在内存中的FAT里取下一簇，链结束或簇号无效时返回0
+static DWORD _fat_next(const BYTE *fat, DWORD clst)
+{
+    DWORD next;
+    switch (s_fs->fs_type) {
+        case FS_FAT12: {
+            UINT bc = clst + clst / 2;
+            WORD w  = (WORD)(fat[bc] | fat[bc + 1] << 8);
+            next    = (clst & 1) ? w >> 4 : w & 0xFFF;
+            break;
+        }
+        case FS_FAT16:
+            next = (DWORD)(fat[clst * 2] | fat[clst * 2 + 1] << 8);
+            break;
+        default:
+            next = (DWORD)fat[clst * 4] | (DWORD)fat[clst * 4 + 1] << 8 |
+                   (DWORD)fat[clst * 4 + 2] << 16 | (DWORD)fat[clst * 4 + 3] << 24;
+            if (s_fs->fs_type == FS_FAT32) {
+                next &= 0x0FFFFFFF;
+            }
+            break;
+    }
+    return (next >= 2 && next < s_fs->n_fatent) ? next : 0;
+}
+
+// 读出第一个FAT并计算FAT和根目录的校验和，fat_out不为NULL时把FAT交给调用方释放
+static int _volume_key(index_key_t *key, BYTE **fat_out)
+{
+    memset(key, 0, sizeof(*key));
+    BYTE *fat = (BYTE *)malloc((size_t)s_fs->fsize * SECTOR_SIZE);
+    BYTE *buf = (BYTE *)malloc((size_t)s_fs->csize * SECTOR_SIZE);
+    if (!fat || !buf || disk_read(s_fs->pdrv, fat, s_fs->fatbase, s_fs->fsize) != RES_OK) {
+        free(fat);
+        free(buf);
+        return -1;
+    }
+    key->fat_sum  = _checksum(INDEX_HASH_SEED, fat, (size_t)s_fs->fsize * SECTOR_SIZE);
+    key->root_sum = INDEX_HASH_SEED;
+
+    int ret = 0;
+#if FF_FS_EXFAT
+    if (s_fs->fs_type == FS_EXFAT) {  // 连续分配的对象不写FAT，只修改分配位图
+        LBA_t n_sect = ((s_fs->n_fatent - 2 + 7) / 8 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        LBA_t sect   = s_fs->bitbase;
+        while (n_sect && ret == 0) {
+            UINT k = n_sect < s_fs->csize ? (UINT)n_sect : s_fs->csize;
+            if (disk_read(s_fs->pdrv, buf, sect, k) != RES_OK) {
+                ret = -1;
+            }
+            key->fat_sum = _checksum(key->fat_sum, buf, (size_t)k * SECTOR_SIZE);
+            sect += k;
+            n_sect -= k;
+        }
+    }
+#endif
+    if (ret == 0 && (s_fs->fs_type == FS_FAT32 || s_fs->fs_type == FS_EXFAT)) {  // 根目录在簇链上
+        DWORD n = 0;
+        for (DWORD c = (DWORD)s_fs->dirbase; c && n < s_fs->n_fatent; c = _fat_next(fat, c), n++) {
+            if (disk_read(s_fs->pdrv, buf, s_fs->database + (LBA_t)s_fs->csize * (c - 2), s_fs->csize) !=
+                RES_OK) {
+                ret = -1;
+                break;
+            }
+            key->root_sum = _checksum(key->root_sum, buf, (size_t)s_fs->csize * SECTOR_SIZE);
+        }
+    } else if (ret == 0) {  // 固定的根目录区
+        UINT  n_sect = s_fs->n_rootdir * 32 / SECTOR_SIZE;
+        LBA_t sect   = s_fs->dirbase;
+        while (n_sect && ret == 0) {
+            UINT k = n_sect < s_fs->csize ? n_sect : s_fs->csize;
+            if (disk_read(s_fs->pdrv, buf, sect, k) != RES_OK) {
+                ret = -1;
+            }
+            key->root_sum = _checksum(key->root_sum, buf, (size_t)k * SECTOR_SIZE);
+            sect += k;
+            n_sect -= k;
+        }
+    }
+    free(buf);
+
+    if (ret != 0 || !fat_out) {
+        free(fat);
+    } else {
+        *fat_out = fat;
+    }
+    return ret;
+}
+
+// 沿FAT计算节点及其子树的簇链连续段
+static int _build_extents(fsindex_node_t *node, const BYTE *fat)
+{
+    free(node->ext);
+    node->ext   = NULL;
+    node->n_ext = 0;
+    uint32_t cap = 0;
+    DWORD    n   = 0;
+    DWORD    c   = node->clust;
+    if (node->cont && c >= 2) {  // exFAT中不使用FAT链的连续对象只有一段
+        node->ext = (uint32_t *)malloc(2 * sizeof(uint32_t));
+        if (!node->ext) {
+            return -1;
+        }
+        node->ext[0] = c;
+        node->ext[1] = node->cont;
+        node->n_ext  = 1;
+        c            = 0;
+    }
+    for (; c >= 2 && c < s_fs->n_fatent && n < s_fs->n_fatent; n++) {
+        DWORD next = _fat_next(fat, c);
+        if (node->n_ext && node->ext[node->n_ext * 2 - 2] + node->ext[node->n_ext * 2 - 1] == c) {
+            node->ext[node->n_ext * 2 - 1]++;
+        } else {
+            if (node->n_ext == cap) {
+                cap             = cap ? cap * 2 : 4;
+                uint32_t *grow = (uint32_t *)realloc(node->ext, cap * 2 * sizeof(uint32_t));
+                if (!grow) {
+                    return -1;
+                }
+                node->ext = grow;
+            }
+            node->ext[node->n_ext * 2]     = c;
+            node->ext[node->n_ext * 2 + 1] = 1;
+            node->n_ext++;
+        }
+        c = next;
+    }
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        if (_build_extents(&node->child[i], fat) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 按先序读取所有子目录的簇链连续段并累加校验和
+static int _dir_sum(const fsindex_node_t *node, BYTE *buf, uint64_t *h)
+{
+    if (!(node->attr & AM_DIR)) {
+        return 0;
+    }
+    UINT max_n = INDEX_READ_SIZE / SECTOR_SIZE;
+    for (uint32_t i = 0; i < node->n_ext && node->name[0]; i++) {
+        LBA_t sect = s_fs->database + (LBA_t)s_fs->csize * (node->ext[i * 2] - 2);
+        LBA_t left = (LBA_t)s_fs->csize * node->ext[i * 2 + 1];
+        while (left) {
+            UINT k = left > max_n ? max_n : (UINT)left;
+            if (disk_read(s_fs->pdrv, buf, sect, k) != RES_OK) {
+                return -1;
+            }
+            *h = _checksum(*h, buf, (size_t)k * SECTOR_SIZE);
+            sect += k;
+            left -= k;
+        }
+    }
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        if (_dir_sum(&node->child[i], buf, h) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int _tree_dir_sum(uint64_t *h)
+{
+    BYTE *buf = (BYTE *)malloc(INDEX_READ_SIZE);
+    *h        = INDEX_HASH_SEED;
+    int ret   = buf ? _dir_sum(&s_root, buf, h) : -1;
+    free(buf);
+    return ret;
+}
+
+int fsindex_map_clusters(fsindex_node_t *node)
+{
+    if (!s_fs) {
+        return -1;
+    }
+    if (s_from_file) {  // 索引文件中已有簇链
+        return 0;
+    }
+    BYTE *fat = (BYTE *)malloc((size_t)s_fs->fsize * SECTOR_SIZE);
+    int   ret = -1;
+    if (fat && disk_read(s_fs->pdrv, fat, s_fs->fatbase, s_fs->fsize) == RES_OK) {
+        ret = _build_extents(node, fat);
+    }
+    free(fat);
+    return ret;
+}
+
+/*-----------------------------------------------------------------------*/
+/* 索引文件读写                                                          */
+/*-----------------------------------------------------------------------*/
+// 文件格式(小端)：
+//   文件头: 魔数(8) fat_sum(8) root_sum(8) dir_sum(8) 节点数(4)
+//   节点按先序排列: attr(1) fdate(2) ftime(2) size(8) clust(4) n_child(4) n_ext(4) 名称长度(2) 名称 连续段(8*n_ext)
+
+static void _put(FILE *fp, uint64_t v, int n)
+{
+    for (int i = 0; i < n; i++) {
+        fputc((int)(v >> (8 * i)) & 0xFF, fp);
+    }
+}
+
+static int _write_node(FILE *fp, const fsindex_node_t *node, long *count)
+{
+    size_t name_len = strlen(node->name);
+    _put(fp, node->attr, 1);
+    _put(fp, node->fdate, 2);
+    _put(fp, node->ftime, 2);
+    _put(fp, node->size, 8);
+    _put(fp, node->clust, 4);
+    _put(fp, node->n_child, 4);
+    _put(fp, node->n_ext, 4);
+    _put(fp, name_len, 2);
+    fwrite(node->name, 1, name_len, fp);
+    for (uint32_t i = 0; i < node->n_ext * 2; i++) {
+        _put(fp, node->ext[i], 4);
+    }
+    (*count)++;
+    for (uint32_t i = 0; i < node->n_child; i++) {
+        _write_node(fp, &node->child[i], count);
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+typedef struct index_reader_t {
+    const BYTE *p;
+    const BYTE *end;
+    long        left;  // 文件头声明的剩余节点数
+} index_reader_t;
+
+static int _get(index_reader_t *rd, uint64_t *v, int n)
+{
+    if (rd->end - rd->p < n) {
+        return -1;
+    }
+    *v = 0;
+    for (int i = 0; i < n; i++) {
+        *v |= (uint64_t)rd->p[i] << (8 * i);
+    }
+    rd->p += n;
+    return 0;
+}
+
+static int _read_node(index_reader_t *rd, fsindex_node_t *node, int is_root)
+{
+    uint64_t attr, fdate, ftime, size, clust, n_child, n_ext, name_len;
+    if (rd->left-- <= 0 || _get(rd, &attr, 1) || _get(rd, &fdate, 2) || _get(rd, &ftime, 2) ||
+        _get(rd, &size, 8) || _get(rd, &clust, 4) || _get(rd, &n_child, 4) || _get(rd, &n_ext, 4) ||
+        _get(rd, &name_len, 2) || (uint64_t)(rd->end - rd->p) < name_len + n_ext * 8 ||
+        n_child > (uint64_t)rd->left) {
+        return -1;
+    }
+    node->attr  = (uint8_t)attr;
+    node->fdate = (uint16_t)fdate;
+    node->ftime = (uint16_t)ftime;
+    node->size  = size;
+    node->clust = (uint32_t)clust;
+    if (!is_root) {
+        node->name = (char *)malloc(name_len + 1);
+        if (!node->name) {
+            return -1;
+        }
+        memcpy(node->name, rd->p, name_len);
+        node->name[name_len] = '\0';
+    }
+    rd->p += name_len;
+    if (n_ext) {
+        node->ext = (uint32_t *)malloc(n_ext * 2 * sizeof(uint32_t));
+        if (!node->ext) {
+            return -1;
+        }
+        node->n_ext = (uint32_t)n_ext;
+        for (uint32_t i = 0; i < n_ext * 2; i++) {
+            uint64_t v;
+            if (_get(rd, &v, 4) != 0) {
+                return -1;
+            }
+            node->ext[i] = (uint32_t)v;
+        }
+    }
+    if (node->attr & AM_DIR) {
+        node->loaded = 1;
+    }
+    if (n_child) {
+        node->child = (fsindex_node_t *)calloc(n_child, sizeof(fsindex_node_t));
+        if (!node->child) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < n_child; i++) {
+            node->n_child++;  // 先计数，出错时已分配的子项也能被释放
+            if (_read_node(rd, &node->child[i], 0) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+long fsindex_open(FATFS *fs, const char *index_path)
+{
+    // 立即挂载卷以取得卷的几何参数
+    DIR dp;
+    if (f_opendir(&dp, "/") != FR_OK) {
+        return -1;
+    }
+    f_closedir(&dp);
+    s_fs = fs;
+
+    // 记录当前驱动器的卷前缀，同时挂载多个镜像时只索引当前驱动器
+    TCHAR cwd[INDEX_PATH_MAX];
+    const char *colon = f_getcwd(cwd, sizeof(cwd)) == FR_OK ? strchr(cwd, ':') : NULL;
+    size_t      n     = colon ? (size_t)(colon - cwd) + 1 : 0;
+    if (n >= sizeof(s_drive)) {
+        n = 0;
+    }
+    memcpy(s_drive, cwd, n);
+    s_drive[n] = '\0';
+    _reset_root();
+    s_valid     = 1;
+    s_from_file = 0;
+    if (!index_path) {
+        return 0;
+    }
+
+    FILE *fp = fopen(index_path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    BYTE *data = NULL;
+    long  size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        data = (BYTE *)malloc(size);
+        if (data && fread(data, 1, size, fp) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+    if (!data) {
+        return 0;
+    }
+
+    // 先比较FAT和根目录，一致时再按索引中的簇链校验子目录
+    index_reader_t rd = {data, data + size, 0};
+    index_key_t    cur;
+    uint64_t       v[4];
+    int            ok = size > 8 && memcmp(data, INDEX_MAGIC, 8) == 0;
+    rd.p += 8;
+    for (int i = 0; ok && i < 4; i++) {
+        ok = _get(&rd, &v[i], i == 3 ? 4 : 8) == 0;
+    }
+    if (ok) {
+        rd.left = (long)v[3];
+        ok      = _volume_key(&cur, NULL) == 0 && cur.fat_sum == v[0] && cur.root_sum == v[1];
+    }
+
+    long count = rd.left;
+    if (ok && _read_node(&rd, &s_root, 1) == 0 && rd.left == 0 && rd.p == rd.end &&
+        _tree_dir_sum(&cur.dir_sum) == 0 && cur.dir_sum == v[2]) {
+        s_from_file = 1;
+    } else {
+        _reset_root();
+        count = 0;
+    }
+    free(data);
+    return count;
+}
+
+long fsindex_close(const char *index_path)
+{
+    long count = 0;
+    if (index_path && s_fs && !s_from_file) {
+        // 补全目录树，计算簇链后写入
+        BYTE       *fat = NULL;
+        index_key_t key;
+        char        path[INDEX_PATH_MAX] = "";
+        count                            = -1;
+        if (!s_valid) {
+            _reset_root();
+            s_valid = 1;
+        }
+        if (_load_tree(&s_root, path, 0) == 0 && _volume_key(&key, &fat) == 0 &&
+            _build_extents(&s_root, fat) == 0 && _tree_dir_sum(&key.dir_sum) == 0) {
+            FILE *fp = fopen(index_path, "wb");
+            if (fp) {
+                long n = 0;
+                fwrite(INDEX_MAGIC, 1, 8, fp);
+                _put(fp, key.fat_sum, 8);
+                _put(fp, key.root_sum, 8);
+                _put(fp, key.dir_sum, 8);
+                long pos = ftell(fp);
+                _put(fp, 0, 4);  // 节点数，写完后回填
+                int ret = _write_node(fp, &s_root, &n);
+                if (ret == 0 && fseek(fp, pos, SEEK_SET) == 0) {
+                    _put(fp, (uint64_t)n, 4);
+                    count = n;
+                }
+                if (fclose(fp) != 0 || ret != 0) {
+                    count = -1;
+                }
+                if (count < 0) {
+                    remove(index_path);
+                }
+            }
+        }
+        free(fat);
+    }
+
+    if (s_valid) {
+        _reset_root();
+    }
+    s_valid     = 0;
+    s_from_file = 0;
+    s_fs        = NULL;
+    return count;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "ff.h"
+
+#if !FF_FS_FCLUST
+#error "目录树索引需要在ffconf.h中设置 FF_FS_FCLUST = 1"
+#endif
+
+// 目录树索引：按需从镜像读入目录并缓存在内存中，卸载时可以连同簇链信息写入旁路索引文件，
+// 下次挂载时若卷未被修改则直接加载，ls -r/find/du 等遍历无需再逐个读取目录簇
+
+typedef struct fsindex_node_t {
+    char                  *name;
+    uint64_t               size;
+    uint32_t               clust;    // 起始簇号，0表示未分配簇
+    uint16_t               fdate;
+    uint16_t               ftime;
+    uint8_t                attr;
+    uint8_t                loaded;   // 目录的子项已读入内存
+    uint32_t               cont;     // exFAT中不使用FAT链的连续簇数，0表示按FAT链
+    uint32_t               n_ext;    // 簇链的连续段数，写索引文件或fsindex_map_clusters()时计算
+    uint32_t              *ext;      // 每段两项: 起始簇号, 簇数
+    uint32_t               n_child;
+    struct fsindex_node_t *child;
+} fsindex_node_t;
+
+// 挂载后调用：index_path不为NULL时尝试加载旁路索引文件，键值(FAT(exFAT还包括分配位图)、根目录和所有子目录簇的校验和)
+// 与当前卷一致才使用。返回加载的项数，未加载返回0，卷无法挂载返回-1
+long fsindex_open(FATFS *fs, const char *index_path);
+
+// 卸载前调用：目录树被修改过或来自镜像时补全所有目录，计算簇链连续段并写入索引文件，然后释放内存
+// index_path为NULL时只释放内存。返回写入的项数，无需写入返回0，失败返回-1
+long fsindex_close(const char *index_path);
+
+// 目录树将被修改时调用，丢弃内存中的目录树
+void fsindex_invalidate(void);
+
+// 查找路径(相对路径基于当前目录)对应的节点
+// tree为1时按需从镜像读入沿途目录及节点下的整棵子树；为0时只在内存中查找，节点的子项也可能未读入
+// 找不到返回NULL，调用方应退回到直接使用FatFs
+fsindex_node_t *fsindex_lookup(const char *path, int tree);
+
+// 读取FAT，计算节点及其子树(已读入的部分)的簇链连续段，成功返回0
+int fsindex_map_clusters(fsindex_node_t *node);
+
+// 卷的簇大小(字节)
+uint32_t fsindex_cluster_size(void);
@@ -0,0 +1,142 @@
+#include "hostfs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#ifdef _WIN32
+struct hostfs_dir_t {
+    intptr_t           handle;
+    struct _finddata_t data;
+    int                first;  // data中已有尚未返回的第一项
+};
+#else
+struct hostfs_dir_t {
+    DIR *dp;
+};
+#endif
+
+int hostfs_stat(const char *path, hostfs_stat_t *st)
+{
+#ifdef _WIN32
+    struct _stat64 sb;
+    if (_stat64(path, &sb) != 0) {
+        return -1;
+    }
+    st->is_dir = (sb.st_mode & _S_IFDIR) != 0;
+#else
+    struct stat sb;
+    if (stat(path, &sb) != 0) {
+        return -1;
+    }
+    st->is_dir = S_ISDIR(sb.st_mode);
+#endif
+    st->size  = (unsigned long long)sb.st_size;
+    st->mtime = sb.st_mtime;
+    return 0;
+}
+
+hostfs_dir_t *hostfs_opendir(const char *path)
+{
+    hostfs_dir_t *dir = (hostfs_dir_t *)calloc(1, sizeof(hostfs_dir_t));
+    if (!dir) {
+        return NULL;
+    }
+#ifdef _WIN32
+    size_t len     = strlen(path);
+    char  *pattern = (char *)malloc(len + 3);
+    if (!pattern) {
+        free(dir);
+        return NULL;
+    }
+    memcpy(pattern, path, len);
+    memcpy(pattern + len, "/*", 3);
+    dir->handle = _findfirst(pattern, &dir->data);
+    free(pattern);
+    if (dir->handle == -1) {
+        free(dir);
+        return NULL;
+    }
+    dir->first = 1;
+#else
+    dir->dp = opendir(path);
+    if (!dir->dp) {
+        free(dir);
+        return NULL;
+    }
+#endif
+    return dir;
+}
+
+const char *hostfs_readdir(hostfs_dir_t *dir)
+{
+    const char *name;
+    do {
+#ifdef _WIN32
+        if (dir->first) {
+            dir->first = 0;
+        } else if (_findnext(dir->handle, &dir->data) != 0) {
+            return NULL;
+        }
+        name = dir->data.name;
+#else
+        struct dirent *ent = readdir(dir->dp);
+        if (!ent) {
+            return NULL;
+        }
+        name = ent->d_name;
+#endif
+    } while (strcmp(name, ".") == 0 || strcmp(name, "..") == 0);
+    return name;
+}
+
+void hostfs_closedir(hostfs_dir_t *dir)
+{
+    if (!dir) {
+        return;
+    }
+#ifdef _WIN32
+    _findclose(dir->handle);
+#else
+    closedir(dir->dp);
+#endif
+    free(dir);
+}
+
+uint32_t hostfs_to_fattime(time_t t)
+{
+    // 并行填充多个分区时会在多个线程中调用，使用可重入版本
+    struct tm  buf;
+#ifdef _WIN32
+    struct tm *tm = localtime_s(&buf, &t) == 0 ? &buf : NULL;
+#else
+    struct tm *tm = localtime_r(&t, &buf);
+#endif
+    if (!tm || tm->tm_year < 80) {  // FAT时间戳从1980年开始
+        return (uint32_t)(0 << 25 | 1 << 21 | 1 << 16);
+    }
+    if (tm->tm_year > 207) {
+        return (uint32_t)(127U << 25 | 12 << 21 | 31 << 16 | 23 << 11 | 59 << 5 | 29);
+    }
+    return ((uint32_t)(tm->tm_year - 80) << 25) | ((uint32_t)(tm->tm_mon + 1) << 21) |
+           ((uint32_t)tm->tm_mday << 16) | ((uint32_t)tm->tm_hour << 11) | ((uint32_t)tm->tm_min << 5) |
+           ((uint32_t)tm->tm_sec >> 1);
+}
+
+time_t hostfs_from_fattime(uint32_t fattime)
+{
+    struct tm tm = {0};
+    tm.tm_year   = (int)(fattime >> 25) + 80;
+    tm.tm_mon    = (int)(fattime >> 21 & 0x0F) - 1;
+    tm.tm_mday   = (int)(fattime >> 16 & 0x1F);
+    tm.tm_hour   = (int)(fattime >> 11 & 0x1F);
+    tm.tm_min    = (int)(fattime >> 5 & 0x3F);
+    tm.tm_sec    = (int)(fattime & 0x1F) * 2;
+    tm.tm_isdst  = -1;
+    time_t t     = mktime(&tm);
+    return t == (time_t)-1 ? 0 : t;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <time.h>
+#include <stdint.h>
+
+// 宿主机文件系统的最小抽象，供需要遍历宿主机目录树的命令使用
+
+typedef struct hostfs_stat_t {
+    int                is_dir;
+    unsigned long long size;
+    time_t             mtime;
+} hostfs_stat_t;
+
+typedef struct hostfs_dir_t hostfs_dir_t;
+
+int hostfs_stat(const char *path, hostfs_stat_t *st);
+
+// 打开宿主机目录，逐项读取名称(自动跳过 "." 和 "..")，读完返回NULL
+hostfs_dir_t *hostfs_opendir(const char *path);
+const char   *hostfs_readdir(hostfs_dir_t *dir);
+void          hostfs_closedir(hostfs_dir_t *dir);
+
+// 将宿主机时间转换为FAT时间戳(高16位日期，低16位时间)，与FatFs的DWORD格式一致
+uint32_t hostfs_to_fattime(time_t t);
+// 将FAT时间戳(按本地时间)转换为宿主机时间
+time_t hostfs_from_fattime(uint32_t fattime);
@@ -0,0 +1,259 @@
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "diskio.h"
+#include "vdisk.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define WORK_BUFFER_SIZE (4 * MB)  // f_mkfs工作缓冲区大小，越大则无法跳过的清零写入次数越少
+#define PATH_BUFFER_SIZE 4096      // 拼接卷前缀后的路径缓冲区大小
+
+// 多个句柄共享的驱动器(同一镜像的不同分区)
+typedef struct image_disk_t {
+    BYTE pdrv;
+    int  refs;
+} image_disk_t;
+
+struct image_t {
+    image_disk_t* disk;
+    BYTE          vol;       // 句柄独占的逻辑卷号
+    char          drive[3];  // 逻辑卷前缀 "n:"
+    FATFS         fs;
+    int           mounted;
+    void*         work;  // f_mkfs/f_fdisk的工作缓冲区，第一次使用时分配
+};
+
+// FatFs的卷表和f_mount不可重入，分配逻辑卷、挂载和卸载时持有该锁
+#ifdef _WIN32
+static SRWLOCK s_lock = SRWLOCK_INIT;
+#define LOCK() AcquireSRWLockExclusive(&s_lock)
+#define UNLOCK() ReleaseSRWLockExclusive(&s_lock)
+#else
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&s_lock)
+#define UNLOCK() pthread_mutex_unlock(&s_lock)
+#endif
+
+static image_t* s_volumes[FF_VOLUMES];  // 逻辑卷号 -> 句柄
+
+// 为句柄分配空闲的逻辑卷，并通过VolToPart映射到驱动器的分区上
+static int _attach_volume(image_t* img, image_disk_t* disk, BYTE partition)
+{
+    int ret = -1;
+    LOCK();
+    for (BYTE i = 0; i < FF_VOLUMES; i++) {
+        if (!s_volumes[i]) {
+            s_volumes[i]    = img;
+            VolToPart[i].pd = disk->pdrv;
+            VolToPart[i].pt = partition;
+            img->vol        = i;
+            img->disk       = disk;
+            disk->refs++;
+            ret = 0;
+            break;
+        }
+    }
+    UNLOCK();
+    if (ret == 0) {
+        img->drive[0] = (char)('0' + img->vol);
+        img->drive[1] = ':';
+        img->drive[2] = '\0';
+    }
+    return ret;
+}
+
+image_t* image_open(const char* path, const image_opts_t* opts)
+{
+    vdisk_opts_t vopts = {NULL, -1};
+    if (opts) {
+        vopts.overlay_path = opts->overlay_path;
+        vopts.writeback    = opts->writeback ? opts->writeback_interval : -1;
+    }
+
+    image_t*      img  = (image_t*)calloc(1, sizeof(image_t));
+    image_disk_t* disk = (image_disk_t*)calloc(1, sizeof(image_disk_t));
+    int           pdrv = (img && disk) ? vdisk_attach(path, &vopts) : -1;
+    if (pdrv < 0) {
+        free(img);
+        free(disk);
+        return NULL;
+    }
+    disk->pdrv = (BYTE)pdrv;
+    if (_attach_volume(img, disk, opts ? opts->partition : 0) != 0) {
+        vdisk_detach(disk->pdrv);
+        free(img);
+        free(disk);
+        return NULL;
+    }
+    return img;
+}
+
+image_t* image_open_partition(image_t* img, BYTE partition)
+{
+    image_t* part = (image_t*)calloc(1, sizeof(image_t));
+    if (!part) {
+        return NULL;
+    }
+    if (_attach_volume(part, img->disk, partition) != 0) {
+        free(part);
+        return NULL;
+    }
+    return part;
+}
+
+int image_close(image_t* img)
+{
+    if (!img) {
+        return 0;
+    }
+    image_unmount(img);
+
+    LOCK();
+    s_volumes[img->vol]    = NULL;
+    VolToPart[img->vol].pd = 0;
+    VolToPart[img->vol].pt = 0;
+    image_disk_t* disk     = --img->disk->refs == 0 ? img->disk : NULL;
+    UNLOCK();
+
+    int ret = 0;
+    if (disk) {
+        ret = vdisk_detach(disk->pdrv) == RES_OK ? 0 : -1;
+        free(disk);
+    }
+    free(img->work);
+    free(img);
+    return ret;
+}
+
+const char* image_drive(const image_t* img)
+{
+    return img->drive;
+}
+
+BYTE image_pdrv(const image_t* img)
+{
+    return img->disk->pdrv;
+}
+
+// 分配工作缓冲区
+static void* _work(image_t* img)
+{
+    if (!img->work) {
+        img->work = malloc(WORK_BUFFER_SIZE);
+    }
+    return img->work;
+}
+
+FRESULT image_mkfs(image_t* img, const MKFS_PARM* parm)
+{
+    void* work = _work(img);
+    if (!work) {
+        return FR_NOT_ENOUGH_CORE;
+    }
+    return f_mkfs(img->drive, parm, work, WORK_BUFFER_SIZE);
+}
+
+FRESULT image_fdisk(image_t* img, const LBA_t plist[])
+{
+    void* work = _work(img);
+    if (!work) {
+        return FR_NOT_ENOUGH_CORE;
+    }
+    return f_fdisk(img->disk->pdrv, plist, work);
+}
+
+FRESULT image_mount(image_t* img)
+{
+    LOCK();
+    FRESULT fr = f_mount(&img->fs, img->drive, 1);
+    if (fr == FR_OK) {
+        img->mounted = 1;
+    } else {
+        f_mount(NULL, img->drive, 0);  // 注销未能挂载的文件系统对象
+    }
+    UNLOCK();
+    return fr;
+}
+
+FRESULT image_unmount(image_t* img)
+{
+    if (!img->mounted) {
+        return FR_OK;
+    }
+    LOCK();
+    FRESULT fr   = f_unmount(img->drive);
+    img->mounted = 0;
+    UNLOCK();
+    return fr;
+}
+
+FATFS* image_fs(image_t* img)
+{
+    return img->mounted ? &img->fs : NULL;
+}
+
+FRESULT image_sync(image_t* img)
+{
+    return disk_ioctl(img->disk->pdrv, CTRL_FLUSH, NULL) == RES_OK ? FR_OK : FR_DISK_ERR;
+}
+
+// 在卷内路径前拼接卷前缀，路径过长时返回NULL
+static const char* _path(const image_t* img, const char* path, char* buf)
+{
+    int n = snprintf(buf, PATH_BUFFER_SIZE, "%s%s", img->drive, path);
+    return (n < 0 || n >= PATH_BUFFER_SIZE) ? NULL : buf;
+}
+
+FRESULT image_fopen(image_t* img, FIL* fp, const char* path, BYTE mode)
+{
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path, buf);
+    return p ? f_open(fp, p, mode) : FR_INVALID_NAME;
+}
+
+FRESULT image_opendir(image_t* img, DIR* dp, const char* path)
+{
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path, buf);
+    return p ? f_opendir(dp, p) : FR_INVALID_NAME;
+}
+
+FRESULT image_stat(image_t* img, const char* path, FILINFO* fno)
+{
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path, buf);
+    return p ? f_stat(p, fno) : FR_INVALID_NAME;
+}
+
+FRESULT image_mkdir(image_t* img, const char* path)
+{
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path, buf);
+    return p ? f_mkdir(p) : FR_INVALID_NAME;
+}
+
+FRESULT image_unlink(image_t* img, const char* path)
+{
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path, buf);
+    return p ? f_unlink(p) : FR_INVALID_NAME;
+}
+
+FRESULT image_rename(image_t* img, const char* path_old, const char* path_new)
+{
+    // f_rename的新路径不带卷前缀，总是与旧路径位于同一个卷
+    char        buf[PATH_BUFFER_SIZE];
+    const char* p = _path(img, path_old, buf);
+    return p ? f_rename(p, path_new) : FR_INVALID_NAME;
+}
+
+FRESULT image_getfree(image_t* img, DWORD* nclst)
+{
+    FATFS* fs;
+    return f_getfree(img->drive, nclst, &fs);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ff.h"
+
+// 镜像句柄：可嵌入的库接口(libfatfs-tool)，一个句柄对应镜像文件上的一个逻辑卷。
+// 每个句柄拥有自己的驱动器状态(文件、增量文件、延迟写回缓存)、逻辑卷和工作缓冲区，
+// 不同句柄可以在不同线程中同时使用；同一个句柄同一时刻只能由一个线程使用。
+// 同时打开的句柄数不超过FatFs的逻辑卷数(FF_VOLUMES)。
+
+typedef struct image_t image_t;
+
+typedef struct image_opts_t {
+    const char* overlay_path;        // 非NULL时以写时复制方式打开：镜像只读，写入保存到该增量文件
+    int         writeback;           // 非0时启用延迟写回缓存
+    long        writeback_interval;  // 延迟写回的定时冲刷间隔(秒)，0只在image_sync和关闭时写回
+    BYTE        partition;           // 分区号，0为整个镜像(挂载时自动查找第一个分区)
+} image_opts_t;
+
+// 打开镜像文件(不挂载)，opts为NULL时直接读写镜像，失败返回NULL
+image_t* image_open(const char* path, const image_opts_t* opts);
+// 在同一个镜像上打开另一个分区的句柄，与img共享驱动器，镜像在最后一个句柄关闭时才关闭
+image_t* image_open_partition(image_t* img, BYTE partition);
+// 卸载并关闭句柄，最后一个句柄关闭时写回缓存并关闭镜像，写回失败返回-1
+int image_close(image_t* img);
+
+// 句柄的逻辑卷前缀(如 "1:")，直接调用FatFs API时拼接在卷内路径之前
+const char* image_drive(const image_t* img);
+// 句柄的物理驱动器号，用于disk_read/disk_write/disk_ioctl
+BYTE image_pdrv(const image_t* img);
+
+// 格式化句柄对应的卷(整个镜像或分区)，使用句柄自己的大块工作缓冲区
+FRESULT image_mkfs(image_t* img, const MKFS_PARM* parm);
+// 在镜像上创建分区表，plist为各分区的扇区数(<=100时为百分比)，以0结尾
+FRESULT image_fdisk(image_t* img, const LBA_t plist[]);
+
+FRESULT image_mount(image_t* img);
+FRESULT image_unmount(image_t* img);
+// 已挂载时返回文件系统对象，否则返回NULL
+FATFS* image_fs(image_t* img);
+// 写回延迟写回缓存和增量文件
+FRESULT image_sync(image_t* img);
+
+// 文件操作，path为卷内路径(如 "/dir/file")；打开后的FIL/DIR直接使用f_read/f_write/f_readdir/f_close等
+FRESULT image_fopen(image_t* img, FIL* fp, const char* path, BYTE mode);
+FRESULT image_opendir(image_t* img, DIR* dp, const char* path);
+FRESULT image_stat(image_t* img, const char* path, FILINFO* fno);
+FRESULT image_mkdir(image_t* img, const char* path);
+FRESULT image_unlink(image_t* img, const char* path);
+FRESULT image_rename(image_t* img, const char* path_old, const char* path_new);
+FRESULT image_getfree(image_t* img, DWORD* nclst);
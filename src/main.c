@@ -2,14 +2,25 @@
 #include <string.h>
 #include "cmd/cmd.h"
 
-char *disk_path = NULL;
-
 // 命令映射表
 static cmd_t cmd_map[] = {{"help", cmd_do_help, NULL, NULL},
                           {"version", cmd_do_version, NULL, NULL},
                           {"create", cmd_do_create, cmd_parse_reate_args, cmd_free_create_args},
                           {"format", cmd_do_format, cmd_parse_format_args, cmd_free_format_args},
                           {"mount", cmd_do_mount, cmd_parse_mount_args, cmd_free_mount_args},
+                          {"compact", cmd_do_compact, cmd_parse_compact_args, cmd_free_compact_args},
+                          {"build", cmd_do_build, cmd_parse_build_args, cmd_free_build_args},
+                          {"commit", cmd_do_commit, cmd_parse_commit_args, cmd_free_commit_args},
+                          {"serve", cmd_do_serve, cmd_parse_serve_args, cmd_free_serve_args},
+                          {"client", cmd_do_client, cmd_parse_client_args, cmd_free_client_args},
+                          {"sum", cmd_do_sum, cmd_parse_sum_args, cmd_free_sum_args},
+                          {"diff", cmd_do_diff, cmd_parse_diff_args, cmd_free_diff_args},
+                          {"sync", cmd_do_sync, cmd_parse_sync_args, cmd_free_sync_args},
+                          {"import-tar", cmd_do_import_tar, cmd_parse_import_tar_args, cmd_free_import_tar_args},
+                          {"export-tar", cmd_do_export_tar, cmd_parse_export_tar_args, cmd_free_export_tar_args},
+                          {"pack", cmd_do_pack, cmd_parse_pack_args, cmd_free_pack_args},
+                          {"unpack", cmd_do_unpack, cmd_parse_unpack_args, cmd_free_unpack_args},
+                          {"verify", cmd_do_verify, cmd_parse_verify_args, cmd_free_verify_args},
                           {NULL, NULL, NULL, NULL}};
 
 int main(int argc, char **argv)
@@ -0,0 +1,117 @@
+#include "stats.h"
+#include <string.h>
+#include "ff.h"
+
+int stats_parse_mode(const char *arg)
+{
+    if (!arg || strcmp(arg, "text") == 0) {
+        return STATS_TEXT;
+    }
+    if (strcmp(arg, "json") == 0) {
+        return STATS_JSON;
+    }
+    return -1;
+}
+
+#if FF_USE_STATS
+
+void stats_reset(void)
+{
+    memset(&FfStats, 0, sizeof(FfStats));
+}
+
+// 延迟直方图第i个区间的标签: "<1", "1-2", "2-4", ..., ">=16384" (微秒)
+static const char *_lat_label(int i, char *buf, size_t len)
+{
+    if (i == 0) {
+        snprintf(buf, len, "<1");
+    } else if (i == FF_STAT_NLAT - 1) {
+        snprintf(buf, len, ">=%lu", 1UL << (i - 1));
+    } else {
+        snprintf(buf, len, "%lu-%lu", 1UL << (i - 1), 1UL << i);
+    }
+    return buf;
+}
+
+static void _print_lat_text(FILE *fp, const char *title, const QWORD *hist)
+{
+    char label[24];
+    int  empty = 1;
+    fprintf(fp, "  %s延迟(us):", title);
+    for (int i = 0; i < FF_STAT_NLAT; i++) {
+        if (hist[i]) {
+            fprintf(fp, " %s:%llu", _lat_label(i, label, sizeof(label)), (unsigned long long)hist[i]);
+            empty = 0;
+        }
+    }
+    fprintf(fp, "%s\n", empty ? " 无" : "");
+}
+
+static void _print_io_json(FILE *fp, const char *name, QWORD calls, QWORD sects, QWORD bytes,
+                           const QWORD *hist)
+{
+    char label[24];
+    fprintf(fp, "\"%s\":{\"calls\":%llu,\"sectors\":%llu,\"bytes\":%llu,\"latency_us\":{", name,
+            (unsigned long long)calls, (unsigned long long)sects, (unsigned long long)bytes);
+    for (int i = 0; i < FF_STAT_NLAT; i++) {
+        fprintf(fp, "%s\"%s\":%llu", i ? "," : "", _lat_label(i, label, sizeof(label)),
+                (unsigned long long)hist[i]);
+    }
+    fprintf(fp, "}}");
+}
+
+int stats_print(FILE *fp, stats_mode_t mode)
+{
+    const FFSTATS *s = &FfStats;
+
+    if (mode == STATS_JSON) {
+        fprintf(fp, "{");
+        _print_io_json(fp, "disk_read", s->rd_calls, s->rd_sects, s->rd_bytes, s->rd_lat);
+        fprintf(fp, ",");
+        _print_io_json(fp, "disk_write", s->wr_calls, s->wr_sects, s->wr_bytes, s->wr_lat);
+        fprintf(fp,
+                ",\"window\":{\"hits\":%llu,\"misses\":%llu,\"writebacks\":%llu,\"fat_mirror_writes\":%llu}"
+                ",\"fat\":{\"get_fat\":%llu,\"put_fat\":%llu}"
+                ",\"dir_next\":%llu"
+                ",\"create_chain\":{\"calls\":%llu,\"scanned\":%llu,\"max_scan\":%llu}}\n",
+                (unsigned long long)s->win_hits, (unsigned long long)s->win_misses,
+                (unsigned long long)s->win_syncs, (unsigned long long)s->win_mirror,
+                (unsigned long long)s->getfat_calls, (unsigned long long)s->putfat_calls,
+                (unsigned long long)s->dirnext_steps, (unsigned long long)s->chain_calls,
+                (unsigned long long)s->chain_scans, (unsigned long long)s->chain_scan_max);
+        return 0;
+    }
+
+    QWORD win_total = s->win_hits + s->win_misses;
+    fprintf(fp, "磁盘读取: %llu 次, %llu 扇区, %llu 字节\n", (unsigned long long)s->rd_calls,
+            (unsigned long long)s->rd_sects, (unsigned long long)s->rd_bytes);
+    _print_lat_text(fp, "读", s->rd_lat);
+    fprintf(fp, "磁盘写入: %llu 次, %llu 扇区, %llu 字节\n", (unsigned long long)s->wr_calls,
+            (unsigned long long)s->wr_sects, (unsigned long long)s->wr_bytes);
+    _print_lat_text(fp, "写", s->wr_lat);
+    fprintf(fp, "扇区窗口: 命中 %llu, 未命中 %llu (命中率 %.1f%%)\n", (unsigned long long)s->win_hits,
+            (unsigned long long)s->win_misses, win_total ? 100.0 * s->win_hits / win_total : 0.0);
+    fprintf(fp, "窗口回写: %llu 次 (其中同步到第二个FAT %llu 次)\n", (unsigned long long)s->win_syncs,
+            (unsigned long long)s->win_mirror);
+    fprintf(fp, "FAT访问: get_fat %llu 次, put_fat %llu 次\n", (unsigned long long)s->getfat_calls,
+            (unsigned long long)s->putfat_calls);
+    fprintf(fp, "目录遍历: dir_next %llu 次\n", (unsigned long long)s->dirnext_steps);
+    fprintf(fp, "簇分配: create_chain %llu 次, 扫描FAT项 %llu 个 (单次最多 %llu 个)\n",
+            (unsigned long long)s->chain_calls, (unsigned long long)s->chain_scans,
+            (unsigned long long)s->chain_scan_max);
+    return 0;
+}
+
+#else
+
+void stats_reset(void) {}
+
+int stats_print(FILE *fp, stats_mode_t mode)
+{
+    (void)fp;
+    (void)mode;
+    fprintf(stderr, "性能计数器未启用 (FF_USE_STATS = 0)\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdio.h>
+
+// FatFs性能计数器(FfStats)的输出格式
+typedef enum stats_mode_t {
+    STATS_OFF  = 0,
+    STATS_TEXT = 1,
+    STATS_JSON = 2,
+} stats_mode_t;
+
+// 解析 --stats[=text|json] 的参数，arg为NULL时表示文本格式，无效时返回-1
+int stats_parse_mode(const char *arg);
+
+// 清零所有计数器
+void stats_reset(void);
+
+// 按指定格式输出当前计数器；未启用FF_USE_STATS时输出提示并返回-1
+int stats_print(FILE *fp, stats_mode_t mode);
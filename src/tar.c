@@ -0,0 +1,255 @@
+#include "tar.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ustar头部中各字段的偏移和长度
+#define TAR_NAME 0
+#define TAR_NAME_LEN 100
+#define TAR_MODE 100
+#define TAR_UID 108
+#define TAR_GID 116
+#define TAR_SIZE 124
+#define TAR_SIZE_LEN 12
+#define TAR_MTIME 136
+#define TAR_MTIME_LEN 12
+#define TAR_CHKSUM 148
+#define TAR_CHKSUM_LEN 8
+#define TAR_TYPEFLAG 156
+#define TAR_MAGIC 257
+#define TAR_VERSION 263
+#define TAR_PREFIX 345
+#define TAR_PREFIX_LEN 155
+
+// 解析八进制数字段；最高位为1时是GNU的base-256编码(用于超过8GB的大小)
+static unsigned long long _tar_number(const unsigned char *p, int len)
+{
+    unsigned long long v = 0;
+    if (p[0] & 0x80) {
+        v = p[0] & 0x3F;
+        for (int i = 1; i < len; i++) {
+            v = v << 8 | p[i];
+        }
+        return v;
+    }
+    int i = 0;
+    while (i < len && (p[i] == ' ' || p[i] == '\0')) {
+        i++;
+    }
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; i++) {
+        v = v << 3 | (unsigned)(p[i] - '0');
+    }
+    return v;
+}
+
+// 复制最长len字节、不一定以'\0'结尾的字段
+static size_t _tar_field(char *dst, const unsigned char *src, size_t len)
+{
+    size_t n = 0;
+    while (n < len && src[n]) {
+        dst[n] = (char)src[n];
+        n++;
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+int tar_parse_header(const unsigned char *blk, tar_entry_t *e)
+{
+    // 校验和按校验和字段为8个空格计算，兼容把字节当作有符号数求和的旧实现
+    unsigned long sum_u = 0;
+    long          sum_s = 0;
+    int           zero  = 1;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        unsigned char c = i >= TAR_CHKSUM && i < TAR_CHKSUM + TAR_CHKSUM_LEN ? ' ' : blk[i];
+        sum_u += c;
+        sum_s += (signed char)c;
+        zero &= blk[i] == 0;
+    }
+    if (zero) {
+        return 0;
+    }
+    unsigned long long chksum = _tar_number(blk + TAR_CHKSUM, TAR_CHKSUM_LEN);
+    if (chksum != sum_u && (long long)chksum != sum_s) {
+        return -1;
+    }
+
+    // ustar的路径为 prefix/name
+    size_t n = 0;
+    if (memcmp(blk + TAR_MAGIC, "ustar", 5) == 0 && blk[TAR_PREFIX]) {
+        n            = _tar_field(e->path, blk + TAR_PREFIX, TAR_PREFIX_LEN);
+        e->path[n++] = '/';
+    }
+    _tar_field(e->path + n, blk + TAR_NAME, TAR_NAME_LEN);
+    e->size  = _tar_number(blk + TAR_SIZE, TAR_SIZE_LEN);
+    e->mtime = (time_t)_tar_number(blk + TAR_MTIME, TAR_MTIME_LEN);
+    e->type  = (char)blk[TAR_TYPEFLAG];
+    return 1;
+}
+
+int tar_parse_pax(const char *data, size_t len, tar_override_t *ov)
+{
+    size_t pos = 0;
+    while (pos < len && data[pos]) {
+        // 每条记录为 "<记录总长度> <键>=<值>\n"
+        size_t rec = 0, i = pos;
+        while (i < len && data[i] >= '0' && data[i] <= '9') {
+            rec = rec * 10 + (size_t)(data[i++] - '0');
+        }
+        if (i >= len || data[i] != ' ' || rec == 0 || pos + rec > len || data[pos + rec - 1] != '\n') {
+            return -1;
+        }
+        const char *key = data + i + 1;
+        const char *end = data + pos + rec - 1;  // 结尾的'\n'
+        const char *eq  = memchr(key, '=', (size_t)(end - key));
+        if (!eq) {
+            return -1;
+        }
+        size_t klen = (size_t)(eq - key);
+        size_t vlen = (size_t)(end - eq - 1);
+        if (klen == 4 && memcmp(key, "path", 4) == 0 && vlen < TAR_PATH_MAX) {
+            memcpy(ov->path, eq + 1, vlen);
+            ov->path[vlen] = '\0';
+            ov->has_path   = 1;
+        } else if (klen == 4 && memcmp(key, "size", 4) == 0) {
+            ov->size     = strtoull(eq + 1, NULL, 10);
+            ov->has_size = 1;
+        } else if (klen == 5 && memcmp(key, "mtime", 5) == 0) {
+            ov->mtime     = (time_t)strtoll(eq + 1, NULL, 10);  // 忽略小数部分
+            ov->has_mtime = 1;
+        }
+        pos += rec;
+    }
+    return 0;
+}
+
+void tar_apply_override(tar_entry_t *e, tar_override_t *ov)
+{
+    if (ov->has_path) {
+        strcpy(e->path, ov->path);
+    }
+    if (ov->has_size) {
+        e->size = ov->size;
+    }
+    if (ov->has_mtime) {
+        e->mtime = ov->mtime;
+    }
+    ov->has_path = ov->has_size = ov->has_mtime = 0;
+}
+
+// 在路径中找一个'/'，使其前后分别放得进prefix和name字段，找不到返回-1
+static int _tar_split(const char *path, size_t len)
+{
+    if (len <= TAR_NAME_LEN) {
+        return 0;
+    }
+    for (size_t i = len - 1; i > 0; i--) {
+        if (len - i - 1 > TAR_NAME_LEN) {
+            break;
+        }
+        if (path[i] == '/' && i <= TAR_PREFIX_LEN && i + 1 < len) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// 填写数字字段：放得进len-1位八进制数时用八进制(以'\0'结尾)，否则用GNU的base-256编码，返回1表示用了base-256
+static int _tar_put_number(unsigned char *p, int len, unsigned long long v)
+{
+    if (v < 1ULL << (3 * (len - 1))) {
+        p[len - 1] = '\0';
+        for (int i = len - 2; i >= 0; i--, v >>= 3) {
+            p[i] = (unsigned char)('0' + (v & 7));
+        }
+        return 0;
+    }
+    p[0] = 0x80;
+    for (int i = len - 1; i > 0; i--, v >>= 8) {
+        p[i] = (unsigned char)v;
+    }
+    return 1;
+}
+
+int tar_make_header(unsigned char *blk, const char *path, unsigned long long size, time_t mtime,
+                    char type, unsigned mode)
+{
+    int    need = 0;
+    size_t len  = strlen(path);
+    int    cut  = _tar_split(path, len);
+    memset(blk, 0, TAR_BLOCK_SIZE);
+    if (cut > 0) {
+        memcpy(blk + TAR_PREFIX, path, (size_t)cut);
+        memcpy(blk + TAR_NAME, path + cut + 1, len - cut - 1);
+    } else {
+        memcpy(blk + TAR_NAME, path, len < TAR_NAME_LEN ? len : TAR_NAME_LEN);
+        need |= cut < 0 ? TAR_NEED_PATH : 0;
+    }
+
+    _tar_put_number(blk + TAR_MODE, 8, mode & 07777);
+    _tar_put_number(blk + TAR_UID, 8, 0);
+    _tar_put_number(blk + TAR_GID, 8, 0);
+    if (_tar_put_number(blk + TAR_SIZE, TAR_SIZE_LEN, size)) {
+        need |= TAR_NEED_SIZE;
+    }
+    if (_tar_put_number(blk + TAR_MTIME, TAR_MTIME_LEN, (unsigned long long)(mtime > 0 ? mtime : 0))) {
+        need |= TAR_NEED_MTIME;
+    }
+    blk[TAR_TYPEFLAG] = (unsigned char)type;
+    memcpy(blk + TAR_MAGIC, "ustar", 6);
+    memcpy(blk + TAR_VERSION, "00", 2);
+
+    unsigned sum = 0;
+    memset(blk + TAR_CHKSUM, ' ', TAR_CHKSUM_LEN);
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += blk[i];
+    }
+    snprintf((char *)blk + TAR_CHKSUM, 7, "%06o", sum);  // 6位八进制数、'\0'，最后保留空格
+    return need;
+}
+
+// 追加一条 "<记录总长度> <键>=<值>\n" 记录
+static size_t _tar_pax_record(char *data, size_t cap, const char *key, const char *value)
+{
+    size_t body = strlen(key) + strlen(value) + 3;  // ' '、'='、'\n'
+    size_t len  = body + 1;
+    while (len != body + (size_t)snprintf(NULL, 0, "%zu", len)) {
+        len = body + (size_t)snprintf(NULL, 0, "%zu", len);
+    }
+    if (len >= cap) {
+        return 0;
+    }
+    snprintf(data, cap, "%zu %s=%s\n", len, key, value);
+    return len;
+}
+
+size_t tar_make_pax(char *data, size_t cap, int need, const char *path, unsigned long long size, time_t mtime)
+{
+    size_t len = 0;
+    if (need & TAR_NEED_PATH) {
+        size_t n = _tar_pax_record(data, cap, "path", path);
+        if (!n) {
+            return 0;
+        }
+        len += n;
+    }
+    if (need & TAR_NEED_SIZE) {
+        char   num[24];
+        snprintf(num, sizeof(num), "%llu", size);
+        size_t n = _tar_pax_record(data + len, cap - len, "size", num);
+        if (!n) {
+            return 0;
+        }
+        len += n;
+    }
+    if (need & TAR_NEED_MTIME) {
+        char   num[24];
+        snprintf(num, sizeof(num), "%llu", (unsigned long long)mtime);
+        size_t n = _tar_pax_record(data + len, cap - len, "mtime", num);
+        if (!n) {
+            return 0;
+        }
+        len += n;
+    }
+    return len;
+}
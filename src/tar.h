@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <time.h>
+
+// tar流格式(POSIX ustar，以及pax扩展头部和GNU长文件名)
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_PATH_MAX 4096
+
+// 头部中的类型标记
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_FILE_OLD '\0'    // 早期tar的普通文件
+#define TAR_TYPE_CONTIGUOUS '7'   // 连续文件，按普通文件处理
+#define TAR_TYPE_DIR '5'
+#define TAR_TYPE_PAX 'x'          // pax扩展头部，作用于下一项
+#define TAR_TYPE_PAX_GLOBAL 'g'   // pax全局扩展头部
+#define TAR_TYPE_GNU_LONGNAME 'L' // GNU长文件名，数据为下一项的路径
+#define TAR_TYPE_GNU_LONGLINK 'K' // GNU长链接目标
+
+typedef struct tar_entry_t {
+    char               path[TAR_PATH_MAX];
+    unsigned long long size;  // 数据的字节数(不含补齐到块大小的部分)
+    time_t             mtime;
+    char               type;
+} tar_entry_t;
+
+// pax扩展头部或GNU长文件名给出的、覆盖下一项头部中对应字段的值
+typedef struct tar_override_t {
+    int                has_path;
+    int                has_size;
+    int                has_mtime;
+    char               path[TAR_PATH_MAX];
+    unsigned long long size;
+    time_t             mtime;
+} tar_override_t;
+
+// 解析一个头部块，返回1为有效的头部，0为结束块(全零)，-1为格式或校验和错误
+int tar_parse_header(const unsigned char *blk, tar_entry_t *e);
+// 解析pax扩展头部的数据("长度 键=值\n"记录)，识别path、size、mtime，格式错误返回-1
+int tar_parse_pax(const char *data, size_t len, tar_override_t *ov);
+// 把覆盖值应用到刚解析出的头部上并清空
+void tar_apply_override(tar_entry_t *e, tar_override_t *ov);
+
+// 生成ustar头部时需要先输出pax扩展头部的字段
+#define TAR_NEED_PATH 0x01  // 路径无法拆分成prefix/name
+#define TAR_NEED_SIZE 0x02  // 大小超过八进制字段(8GB)，大小字段改用base-256编码
+#define TAR_NEED_MTIME 0x04 // 修改时间超过八进制字段(8^11秒，2242年以后)，时间字段改用base-256编码
+
+// 填写ustar头部(mode为权限位)，返回TAR_NEED_*的组合；路径放不下时头部中为截断的路径
+int tar_make_header(unsigned char *blk, const char *path, unsigned long long size, time_t mtime,
+                    char type, unsigned mode);
+// 生成pax扩展头部的数据(need中指定的path、size、mtime记录)，返回数据长度，cap不够时返回0
+size_t tar_make_pax(char *data, size_t cap, int need, const char *path, unsigned long long size, time_t mtime);
+
+// 数据之后补齐到块大小的字节数
+#define tar_padding(size) ((TAR_BLOCK_SIZE - (size) % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE)
@@ -0,0 +1,149 @@
+#include "thread.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+struct thread_t {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    thread_fn_t fn;
+    void       *arg;
+    int         ret;
+};
+
+#ifdef _WIN32
+static unsigned __stdcall _thread_main(void *p)
+#else
+static void *_thread_main(void *p)
+#endif
+{
+    thread_t *th = (thread_t *)p;
+    th->ret      = th->fn(th->arg);
+    return 0;
+}
+
+thread_t *thread_start(thread_fn_t fn, void *arg)
+{
+    thread_t *th = (thread_t *)calloc(1, sizeof(thread_t));
+    if (!th) {
+        return NULL;
+    }
+    th->fn  = fn;
+    th->arg = arg;
+#ifdef _WIN32
+    th->handle = (HANDLE)_beginthreadex(NULL, 0, _thread_main, th, 0, NULL);
+    if (!th->handle) {
+#else
+    if (pthread_create(&th->handle, NULL, _thread_main, th) != 0) {
+#endif
+        free(th);
+        return NULL;
+    }
+    return th;
+}
+
+int thread_join(thread_t *th)
+{
+    if (!th) {
+        return -1;
+    }
+#ifdef _WIN32
+    int ok = WaitForSingleObject(th->handle, INFINITE) == WAIT_OBJECT_0;
+    CloseHandle(th->handle);
+#else
+    int ok = pthread_join(th->handle, NULL) == 0;
+#endif
+    int ret = ok ? th->ret : -1;
+    free(th);
+    return ret;
+}
+
+int thread_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+void thread_mutex_init(thread_mutex_t *m)
+{
+#ifdef _WIN32
+    InitializeSRWLock(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+void thread_mutex_destroy(thread_mutex_t *m)
+{
+#ifdef _WIN32
+    (void)m;
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+void thread_mutex_lock(thread_mutex_t *m)
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+void thread_mutex_unlock(thread_mutex_t *m)
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+void thread_cond_init(thread_cond_t *c)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
+
+void thread_cond_destroy(thread_cond_t *c)
+{
+#ifdef _WIN32
+    (void)c;
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+void thread_cond_wait(thread_cond_t *c, thread_mutex_t *m)
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(c, m, INFINITE, 0);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+void thread_cond_broadcast(thread_cond_t *c)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// 最小的跨平台线程封装，供需要并行处理多个分区的命令使用
+
+typedef struct thread_t thread_t;
+
+// 线程函数，返回值由thread_join取回
+typedef int (*thread_fn_t)(void *arg);
+
+// 启动线程，失败返回NULL
+thread_t *thread_start(thread_fn_t fn, void *arg);
+// 等待线程结束并释放，返回线程函数的返回值，失败返回-1
+int thread_join(thread_t *th);
+
+// 可用的处理器数量(至少为1)
+int thread_cpu_count(void);
+
+// 互斥锁和条件变量，供生产者/消费者队列使用
+#ifdef _WIN32
+typedef SRWLOCK            thread_mutex_t;
+typedef CONDITION_VARIABLE thread_cond_t;
+#else
+typedef pthread_mutex_t thread_mutex_t;
+typedef pthread_cond_t  thread_cond_t;
+#endif
+
+void thread_mutex_init(thread_mutex_t *m);
+void thread_mutex_destroy(thread_mutex_t *m);
+void thread_mutex_lock(thread_mutex_t *m);
+void thread_mutex_unlock(thread_mutex_t *m);
+
+void thread_cond_init(thread_cond_t *c);
+void thread_cond_destroy(thread_cond_t *c);
+// 释放m并等待c被唤醒，返回前重新持有m
+void thread_cond_wait(thread_cond_t *c, thread_mutex_t *m);
+void thread_cond_broadcast(thread_cond_t *c);
@@ -0,0 +1,102 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include "ff.h"
+
+#if FF_USE_TRACE
+
+// 各事件开始时两个参数的含义，未列出的事件不输出参数
+static const struct {
+    const char *name;
+    const char *arg0;
+    const char *arg1;
+} trace_args[] = {
+    {"disk_read", "sector", "count"},
+    {"disk_write", "sector", "count"},
+    {"disk_ioctl", "cmd", NULL},
+    {"f_mount", "opt", "mount"},
+    {"f_open", "mode", NULL},
+    {"f_read", "bytes", "fptr"},
+    {"f_write", "bytes", "fptr"},
+    {"f_lseek", "ofs", NULL},
+    {"f_truncate", "size", NULL},
+    {"f_chmod", "attr", "mask"},
+    {"f_expand", "size", "opt"},
+    {"f_mkfs", "fmt", "work"},
+};
+
+int trace_start(void)
+{
+    FfTraceOn = 0;
+    ff_trace_clear();
+    FfTraceOn = 1;
+    return 0;
+}
+
+static void _write_args(FILE *fp, const FFTRACE *ev)
+{
+    if (ev->ph == 'E') {
+        fprintf(fp, ",\"args\":{\"res\":%llu}", (unsigned long long)ev->arg0);
+        return;
+    }
+    for (size_t i = 0; i < sizeof(trace_args) / sizeof(trace_args[0]); i++) {
+        if (strcmp(trace_args[i].name, ev->name) == 0) {
+            fprintf(fp, ",\"args\":{\"%s\":%llu", trace_args[i].arg0, (unsigned long long)ev->arg0);
+            if (trace_args[i].arg1) {
+                fprintf(fp, ",\"%s\":%llu", trace_args[i].arg1, (unsigned long long)ev->arg1);
+            }
+            fprintf(fp, "}");
+            return;
+        }
+    }
+}
+
+long trace_dump(const char *path)
+{
+    FfTraceOn = 0;
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        return -1;
+    }
+
+    // 缓冲区写满后最早的事件已被覆盖，只输出仍保留的部分
+    QWORD total = ff_trace_count();
+    QWORD first = total > FF_TRACE_DEPTH ? total - FF_TRACE_DEPTH : 0;
+    QWORD t0    = total ? FfTrace[first % FF_TRACE_DEPTH].ts : 0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (QWORD n = first; n < total; n++) {
+        const FFTRACE *ev = &FfTrace[n % FF_TRACE_DEPTH];
+        fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+                n == first ? "" : ",\n", ev->name, strncmp(ev->name, "f_", 2) == 0 ? "fatfs" : "diskio",
+                ev->ph, (ev->ts - t0) / 1000.0);
+        _write_args(fp, ev);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0) {
+        return -1;
+    }
+    if (first) {
+        fprintf(stderr, "跟踪缓冲区已满，最早的 %llu 个事件被覆盖\n", (unsigned long long)first);
+    }
+    return (long)(total - first);
+}
+
+#else
+
+int trace_start(void)
+{
+    fprintf(stderr, "事件跟踪未启用 (FF_USE_TRACE = 0)\n");
+    return -1;
+}
+
+long trace_dump(const char *path)
+{
+    (void)path;
+    return -1;
+}
+
+#endif
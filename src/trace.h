@@ -0,0 +1,8 @@
+#pragma once
+
+// 清空环形缓冲区并开始记录FatFs API调用和磁盘I/O事件；未启用FF_USE_TRACE时返回-1
+int trace_start(void);
+
+// 停止记录，把缓冲区中的事件以Chrome trace JSON格式(可用Perfetto或chrome://tracing打开)写入文件
+// 返回写入的事件数，失败返回-1
+long trace_dump(const char *path);